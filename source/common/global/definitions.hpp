@@ -21,7 +21,13 @@
 #define PERSISTENT_STAGING_BUFFER 0
 #define COPY_ON_MAIN_COMMANDBUFFER 0
 #define COMBINE_MESHES 0
-#define TEXTURE_ARRAY_LENGTH 1
+// Store mesh UVs as half floats and normals as 8-bit snorm on the GPU. Positions stay 32-bit float unless
+// QUANTIZE_VERTEX_POSITIONS is also set, in which case they are 16-bit unorm within each mesh's bounding cube and are
+// dequantized by folding a per-mesh transform into the model matrix.
+#define COMPRESS_VERTICES 1
+#define QUANTIZE_VERTEX_POSITIONS 0
+// The most levels of detail generated for each mesh at import, including the full-detail one
+#define MAX_MESH_LODS 4
 
 #if USE_VULKAN_COORDS
 # if COMBINE_MESHES
@@ -53,6 +59,9 @@
 #define NOMINMAX
 
 // Physics and controls defines
+#define PHYSICS_STEP (1.f / 60.f) // Seconds, the same on the server and every client so that they simulate alike
+#define PHYSICS_MAX_STEPS_PER_TICK 5 // Beyond this, the simulation slows down to catch up instead of falling behind
+#define PRINT_PHYSICS_STEP_TIMES 0 // Print how long steps take on average, to compare the physics_threads_u setting
 #define HUMAN_HEIGHT 1.83f
 #define HUMAN_WIDTH 0.5f
 #define HUMAN_DEPTH 0.3f
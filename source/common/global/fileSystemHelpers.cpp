@@ -1,4 +1,6 @@
+#include <cstdio>
 #include "fileSystemHelpers.hpp"
+#include "hash.hpp"
 
 std::string getFileNameOnly(PATH_TYPE &path) {
   return path.path().stem().string();
@@ -13,3 +15,11 @@ std::string getFileNameRelative(PATH_TYPE &path) {
 bool fileExists(const std::string &filePath) {
   return fs::exists(filePath);
 }
+
+std::string getCacheFileStem(const std::string &sourcePath) {
+  fs::path path(sourcePath);
+  std::string dir = path.parent_path().generic_string();
+  char dirHash[17];
+  snprintf(dirHash, sizeof(dirHash), "%016llx", (unsigned long long) at3::fnv1a64(dir.data(), dir.size()));
+  return path.stem().string() + "-" + dirHash;
+}
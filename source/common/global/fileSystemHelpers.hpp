@@ -16,3 +16,9 @@ std::string getFileExtOnly(PATH_TYPE &path);
 std::string getFileNameRelative(PATH_TYPE &path);
 
 bool fileExists(const std::string &filePath);
+
+/*
+ * The name to store something derived from a file under: its stem and a hash of its directory, so that files with the
+ * same name in different directories don't share it.
+ */
+std::string getCacheFileStem(const std::string &sourcePath);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace at3 {
+
+  /*
+   * FNV-1a, for cache keys and hash tables, where speed and simplicity matter more than the quality of the hash. To
+   * hash several things together, pass each one the hash of the ones before it.
+   */
+  static const uint64_t fnvOffsetBasis64 = 14695981039346656037ull;
+  static const uint32_t fnvOffsetBasis32 = 2166136261u;
+
+  inline uint64_t fnv1a64(const void *data, size_t size, uint64_t hash = fnvOffsetBasis64) {
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= ((const uint8_t *) data)[i];
+      hash *= 1099511628211ull;
+    }
+    return hash;
+  }
+
+  inline uint32_t fnv1a32(const void *data, size_t size, uint32_t hash = fnvOffsetBasis32) {
+    for (size_t i = 0; i < size; ++i) {
+      hash ^= ((const uint8_t *) data)[i];
+      hash *= 16777619u;
+    }
+    return hash;
+  }
+}
@@ -19,9 +19,23 @@ namespace at3 {
 
       namespace vulkan {
         bool forceFifo = true;
+        uint32_t assetBudgetMiB = 1024; // unreferenced meshes and textures are evicted above this. 0 means no limit.
+        uint32_t textureBudgetMiB = 512; // streamed texture mip levels are dropped above this. 0 means no limit.
+        float lodPixelError = 1.f; // the coarsest mesh LOD whose error projects to at most this many pixels is drawn
+        bool gpuDriven = false; // resolve transforms, cull, and write draw commands in compute, if the device can
+        bool occlusionCulling = true; // cull GPU-driven draws hidden behind what was drawn first, using a depth pyramid
+        float debugLineRadius = 100.f; // how far from the camera to draw physics debug lines, or 0 for no limit
+        bool wireframe = false; // draw the edges of every triangle over the meshes, if the device can (toggled by F6)
+        bool verboseMeshLoading = false; // print what loading did to each mesh, and each texture streamed in or out
       }
     }
 
+    namespace physics {
+      uint32_t threads = 1; // more than 1 steps the world on that many of the engine's threads, 0 on all of them
+      uint32_t projectilePoolSize = 512; // balls that can be flying at once, after which the oldest are reused
+      float projectileLifetime = 30.f; // seconds before a ball is put back into the pool
+    }
+
     namespace controls {
       float mouseSpeed = 0.005f;
       bool mouseInvertX = false;
@@ -85,6 +99,17 @@ namespace at3 {
       registry.insert(std::make_pair( "graphics_win_posx_i", &graphics::windowPosX));
       registry.insert(std::make_pair( "graphics_win_posy_i", &graphics::windowPosY));
       registry.insert(std::make_pair( "graphics_vk_forceFifo_b", &graphics::vulkan::forceFifo));
+      registry.insert(std::make_pair( "graphics_vk_asset_budget_mib_u", &graphics::vulkan::assetBudgetMiB));
+      registry.insert(std::make_pair( "graphics_vk_texture_budget_mib_u", &graphics::vulkan::textureBudgetMiB));
+      registry.insert(std::make_pair( "graphics_vk_lod_pixel_error_f", &graphics::vulkan::lodPixelError));
+      registry.insert(std::make_pair( "graphics_vk_gpu_driven_b", &graphics::vulkan::gpuDriven));
+      registry.insert(std::make_pair( "graphics_vk_occlusion_culling_b", &graphics::vulkan::occlusionCulling));
+      registry.insert(std::make_pair( "graphics_vk_debug_line_radius_f", &graphics::vulkan::debugLineRadius));
+      registry.insert(std::make_pair( "graphics_vk_wireframe_b", &graphics::vulkan::wireframe));
+      registry.insert(std::make_pair( "graphics_vk_verbose_mesh_loading_b", &graphics::vulkan::verboseMeshLoading));
+      registry.insert(std::make_pair( "physics_threads_u", &physics::threads));
+      registry.insert(std::make_pair( "physics_projectile_pool_u", &physics::projectilePoolSize));
+      registry.insert(std::make_pair( "physics_projectile_lifetime_f", &physics::projectileLifetime));
       registry.insert(std::make_pair( "controls_mouse_speed_f", &controls::mouseSpeed));
       registry.insert(std::make_pair( "controls_mouse_invert_x_b", &controls::mouseInvertX));
       registry.insert(std::make_pair( "controls_mouse_invert_y_b", &controls::mouseInvertY));
@@ -23,9 +23,23 @@ namespace at3 {
 
       namespace vulkan {
         extern bool forceFifo;
+        extern uint32_t assetBudgetMiB;
+        extern uint32_t textureBudgetMiB;
+        extern float lodPixelError;
+        extern bool gpuDriven;
+        extern bool occlusionCulling;
+        extern float debugLineRadius;
+        extern bool wireframe;
+        extern bool verboseMeshLoading;
       }
     }
 
+    namespace physics {
+      extern uint32_t threads;
+      extern uint32_t projectilePoolSize;
+      extern float projectileLifetime;
+    }
+
     namespace controls {
       extern float mouseSpeed;
       extern bool mouseInvertX;
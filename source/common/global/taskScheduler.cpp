@@ -0,0 +1,90 @@
+
+#include <algorithm>
+#include "taskScheduler.hpp"
+
+namespace at3 {
+
+  TaskScheduler &TaskScheduler::shared() {
+    static TaskScheduler scheduler(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return scheduler;
+  }
+
+  TaskScheduler::TaskScheduler(uint32_t workerCount) : busy(false), nextBegin(0) {
+    for (uint32_t i = 0; i < workerCount; ++i) {
+      workers.emplace_back(&TaskScheduler::workerLoop, this);
+    }
+  }
+
+  TaskScheduler::~TaskScheduler() {
+    { // Wake the workers for the last time
+      std::lock_guard<std::mutex> lock(mutex);
+      quitting = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  void TaskScheduler::parallelFor(int begin, int end, int grainSize, const RangeFunc &func, uint32_t maxThreads) {
+    if (end <= begin) { return; }
+    uint32_t threads = maxThreads ? std::min(maxThreads, getMaxThreadCount()) : getMaxThreadCount();
+    int grain = std::max(grainSize, 1);
+    bool idle = false;
+    if (threads < 2 || end - begin <= grain || ! busy.compare_exchange_strong(idle, true)) {
+      func(begin, end);
+      return;
+    }
+
+    { // Several chunks for each thread, so that uneven ones even out, but none smaller than the grain
+      std::lock_guard<std::mutex> lock(mutex);
+      loopFunc = &func;
+      loopEnd = end;
+      chunkSize = std::max(grain, (end - begin) / (int) (threads * 4));
+      nextBegin.store(begin);
+      helpersWanted = threads - 1;
+      ++generation;
+    }
+    wake.notify_all();
+    runChunks(func, end, chunkSize);
+
+    { // Workers that haven't joined in yet would find nothing left to do, so they don't
+      std::unique_lock<std::mutex> lock(mutex);
+      helpersWanted = 0;
+      done.wait(lock, [this]{ return helpersActive == 0; });
+      loopFunc = nullptr;
+    }
+    busy.store(false);
+  }
+
+  uint32_t TaskScheduler::getMaxThreadCount() const {
+    return (uint32_t) workers.size() + 1;
+  }
+
+  void TaskScheduler::workerLoop() {
+    uint64_t joined = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [&]{ return quitting || (generation != joined && helpersWanted); });
+      if (quitting) { return; }
+      joined = generation;
+      --helpersWanted;
+      ++helpersActive;
+      const RangeFunc &func = *loopFunc;
+      int end = loopEnd, chunk = chunkSize;
+      lock.unlock();
+      runChunks(func, end, chunk);
+      lock.lock();
+      if ( ! --helpersActive) {
+        done.notify_one();
+      }
+    }
+  }
+
+  void TaskScheduler::runChunks(const RangeFunc &func, int end, int chunk) {
+    for (int begin = nextBegin.fetch_add(chunk); begin < end; begin = nextBegin.fetch_add(chunk)) {
+      func(begin, std::min(begin + chunk, end));
+    }
+  }
+
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace at3 {
+
+  /*
+   * The engine's worker threads, shared by every system that has work to spread across them, so that no system needs
+   * a thread pool of its own. parallelFor splits a range of indices into chunks and runs them on the workers and the
+   * calling thread, returning once every chunk is done. Only one loop runs at a time: a loop started from inside a
+   * chunk of another, or while another thread's loop is running, just runs on the thread that started it. Between
+   * loops, the workers sleep.
+   */
+  class TaskScheduler {
+
+    public:
+
+      typedef std::function<void(int begin, int end)> RangeFunc;
+
+      /*
+       * The scheduler shared by the whole engine, with a worker for every hardware thread but the calling one. It is
+       * made the first time it's asked for, so nothing should ask for it unless it has work to spread across threads.
+       */
+      static TaskScheduler &shared();
+
+      explicit TaskScheduler(uint32_t workerCount);
+      ~TaskScheduler();
+      /*
+       * Run func over [begin, end), in chunks of at least grainSize indices, on at most maxThreads threads including
+       * the calling one, or on all of them if maxThreads is 0.
+       */
+      void parallelFor(int begin, int end, int grainSize, const RangeFunc &func, uint32_t maxThreads = 0);
+      uint32_t getMaxThreadCount() const; // The workers and the calling thread
+
+    private:
+
+      std::vector<std::thread> workers;
+      std::atomic<bool> busy;
+      std::mutex mutex;
+      std::condition_variable wake, done;
+
+      // The loop being run, guarded by the mutex except for nextBegin
+      const RangeFunc *loopFunc = nullptr;
+      int loopEnd = 0, chunkSize = 1;
+      std::atomic<int> nextBegin;
+      uint32_t helpersWanted = 0; // How many more workers may join in
+      uint32_t helpersActive = 0;
+      uint64_t generation = 0;
+      bool quitting = false;
+
+      void workerLoop();
+      void runChunks(const RangeFunc &func, int end, int chunk);
+  };
+
+}
@@ -0,0 +1,20 @@
+#version 450 core
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Lines in world space, with a color at each end (see DebugLines)
+
+layout(location=0) in vec3 vertex;
+layout(location=1) in vec4 color;
+
+layout(location=0) out vec4 fragColor;
+
+layout(push_constant) uniform Camera {
+	mat4 vp;
+} camera;
+
+void main() {
+	gl_Position = camera.vp * vec4(vertex, 1.0);
+	fragColor = color;
+}
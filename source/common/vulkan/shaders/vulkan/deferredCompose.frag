@@ -0,0 +1,68 @@
+#version 450 core
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Lights the G-buffer that the mesh pipelines wrote in the subpass before, once per pixel. Besides the sun and sky,
+// each pixel only sees the point lights that were culled into its screen tile on the CPU (see LightGrid).
+
+const uint TILE_SIZE = 16; // LightGrid::tileSize
+
+layout(input_attachment_index = 0, set = 0, binding = 0) uniform subpassInput gAlbedo;
+layout(input_attachment_index = 1, set = 0, binding = 1) uniform subpassInput gNormal;
+layout(input_attachment_index = 2, set = 0, binding = 2) uniform subpassInput gDepth;
+
+struct PointLight {
+	vec4 positionRadius; // xyz: world position, w: the distance at which it has faded out entirely
+	vec4 color;
+};
+layout(std430, set = 0, binding = 3) readonly buffer Lights {
+	PointLight lights[];
+};
+// An offset into tileData and a light count for each tile, row by row, followed by the light indices of every tile
+layout(std430, set = 0, binding = 4) readonly buffer LightTiles {
+	uint tileData[];
+};
+
+layout(push_constant) uniform ComposeParams {
+	mat4 invViewProj;
+	vec2 screenSize;
+	uvec2 tileCount;
+} params;
+
+layout(location = 0) out vec4 outColor;
+
+const vec3 incident = normalize(vec3(1.0, 0.0, 0.0));
+const vec4 sunColor = vec4(vec3(1.0, 0.95, 0.9) * 1.2, 1.0);
+const vec4 skyColor = vec4(vec3(0.9, 0.95, 1.0) * 1.1, 1.0);
+
+void main() {
+	float depth = subpassLoad(gDepth).r;
+	if (depth >= 1.0) { // Nothing was drawn here
+		outColor = vec4(0.0, 0.0, 0.0, 1.0);
+		return;
+	}
+	vec4 albedo = subpassLoad(gAlbedo);
+	vec3 norm = normalize(subpassLoad(gNormal).xyz * 2.0 - 1.0);
+
+	float sunAmount = max(0, dot(norm, incident));
+	float skyAmount = 0.33 * (1.0 - sunAmount);
+	vec4 lighting = ((sunAmount * sunColor) + (skyAmount * skyColor));
+
+	vec4 position = params.invViewProj * vec4(gl_FragCoord.xy / params.screenSize * 2.0 - 1.0, depth, 1.0);
+	position.xyz /= position.w;
+
+	uvec2 tile = min(uvec2(gl_FragCoord.xy) / TILE_SIZE, params.tileCount - 1);
+	uint tileIndex = tile.y * params.tileCount.x + tile.x;
+	uint first = tileData[2 * tileIndex];
+	uint count = tileData[2 * tileIndex + 1];
+	for (uint i = first; i < first + count; ++i) {
+		PointLight light = lights[tileData[i]];
+		vec3 toLight = light.positionRadius.xyz - position.xyz;
+		float dist = length(toLight);
+		float falloff = max(0.0, 1.0 - dist / light.positionRadius.w);
+		lighting += light.color * max(0.0, dot(norm, toLight / max(dist, 0.0001))) * falloff * falloff;
+	}
+
+	outColor = albedo * lighting;
+}
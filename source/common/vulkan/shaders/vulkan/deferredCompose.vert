@@ -0,0 +1,11 @@
+#version 450 core
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// One triangle that covers the whole screen, with no vertex buffer
+
+void main() {
+	vec2 corner = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+	gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -9,6 +9,7 @@ layout(location=2) in vec3 normal;
 
 layout(location=0) out vec3 fragNorm;
 layout(location=1) out vec2 fragUV;
+layout(location=2) flat out uint fragTexIndex;
 
 struct transform {
 	mat4 vp;
@@ -28,4 +29,5 @@ void main() {
 //	fragNorm =  normalize((uboPage.slot[index].custom * vec4(normal, 0.0)).xyz);
 	fragNorm =  (uboPage.slot[index].m * vec4(normal, 0.0)).xyz;
 	fragUV = uv;
+	fragTexIndex = indices.raw >> 20u & 0xFFFu;
 }
@@ -0,0 +1,33 @@
+#version 450 core
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// The vertex shader for meshes drawn by indirect commands, which get their instance data from the culling pass
+
+layout(location=0) in vec3 vertex;
+layout(location=1) in vec2 uv;
+layout(location=2) in vec3 normal;
+
+layout(location=0) out vec3 fragNorm;
+layout(location=1) out vec2 fragUV;
+layout(location=2) flat out uint fragTexIndex;
+
+struct Instance {
+	mat4 m;
+	uvec4 misc; // x: texture
+};
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+	Instance instances[];
+};
+layout(push_constant) uniform Camera {
+	mat4 vp;
+} camera;
+
+void main() {
+	Instance instance = instances[gl_InstanceIndex];
+	gl_Position = camera.vp * instance.m * vec4(vertex, 1.0);
+	fragNorm = (instance.m * vec4(normal, 0.0)).xyz;
+	fragUV = uv;
+	fragTexIndex = instance.misc.x;
+}
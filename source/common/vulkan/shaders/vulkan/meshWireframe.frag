@@ -0,0 +1,34 @@
+#version 450 core
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// The same as meshDefault, with the edges of every triangle drawn into the albedo
+
+layout (constant_id = 0) const uint TEXTURE_ARRAY_LENGTH = 1;
+
+// The texture table, which may have unwritten entries past the ones in use
+layout(set = 1, binding = 0) uniform sampler2D textures[TEXTURE_ARRAY_LENGTH];
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in vec2 fragUV;
+layout(location = 2) flat in uint fragTexIndex;
+layout(location = 3) in vec3 fragBarycentric;
+
+layout(location = 0) out vec4 outAlbedo;
+layout(location = 1) out vec4 outNormal; // World space, scaled and biased into zero to one
+
+const vec3 edgeColor = vec3(1.0, 1.0, 0.0);
+const float edgeWidth = 1.0; // In pixels
+
+void main()
+{
+    outAlbedo = texture(textures[fragTexIndex], fragUV, 0.0);
+    outNormal = vec4(normalize(fragNormal) * 0.5 + 0.5, 0.0);
+
+    // How many pixels away the nearest edge is, going by how fast each coordinate changes across the screen
+    vec3 pixels = fragBarycentric / fwidth(fragBarycentric);
+    float nearest = min(pixels.x, min(pixels.y, pixels.z));
+    float edge = 1.0 - smoothstep(edgeWidth - 0.5, edgeWidth + 0.5, nearest);
+    outAlbedo.rgb = mix(outAlbedo.rgb, edgeColor, edge);
+}
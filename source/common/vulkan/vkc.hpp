@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <unordered_map>
 #include <string>
 #include <sstream>
@@ -15,12 +16,19 @@
 
 #include "topics.hpp"
 #include "settings.hpp"
+#include "hash.hpp"
 
 #include "vkcTypes.hpp"
 #include "vkcAlloc.hpp"
 #include "vkcUboPageMgr.hpp"
 #include "vkcPipelines.hpp"
+#include "vkcGpuScene.hpp"
+#include "vkcLightGrid.hpp"
+#include "vkcDebugLines.hpp"
 #include "vkcTextures.hpp"
+#include "vkcMeshCache.hpp"
+#include "vkcMeshOptimizer.hpp"
+#include "vkcVertexFormat.hpp"
 
 #define SUBSCRIBE_TOPIC(e, x) std::make_unique<rtu::topics::Subscription>(e, RTU_MTHD_DLGT(&VulkanContext::x, this));
 
@@ -53,9 +61,19 @@ namespace at3::vkc {
           const std::string &meshFileName,
           const std::string &textureFileName = "");
       void deRegisterMeshInstance(typename EcsInterface::EcsId id);
-      std::vector<float> * getMeshStoredVertices(const std::string &meshName, uint32_t internalIndex = 0);
-      uint32_t getMeshStoredVertexStride();
-      std::vector<uint32_t> * getMeshStoredIndices(const std::string &meshName, uint32_t internalIndex = 0);
+      void registerPointLight(typename EcsInterface::EcsId id, const glm::vec3 &color, float radius);
+      void deRegisterPointLight(typename EcsInterface::EcsId id);
+      void markTransformChanged(typename EcsInterface::EcsId id);
+      void markSceneTreeChanged();
+      /*
+       * The triangles of a mesh whose name starts with "terrain", which keeps them for physics, or nullptr otherwise.
+       */
+      std::shared_ptr<const StoredTriangles> getMeshStoredTriangles(const std::string &meshName,
+                                                                    uint32_t internalIndex = 0);
+      std::vector<TextureResidencyStats> getTextureResidencyStats();
+      DeviceMemoryStats getDeviceMemoryStats();
+      void printDeviceMemoryStats();
+      DebugLines &getDebugLines();
 
     private:
 
@@ -64,16 +82,67 @@ namespace at3::vkc {
       EcsInterface *ecs;
 
       MeshRepository<EcsInterface> meshRepo;
+      std::unordered_map<std::string, MeshSource> meshSources;
+      std::unordered_map<typename EcsInterface::EcsId, std::string> instanceMeshNames;
+      VkDeviceSize meshResidentSize = 0;
+      uint64_t meshUseCounter = 0;
+      size_t compressedMeshBytes = 0;
+      size_t uncompressedMeshBytes = 0;
+      bool residencyChanged = false;
+      struct RetiredBuffer {
+        VkBuffer buffer;
+        Allocation memory;
+        uint64_t frame; // the last submission that may have used it
+      };
+      std::vector<RetiredBuffer> retiredBuffers;
+      struct RetiredDescriptorSet {
+        VkDescriptorSet set;
+        uint64_t frame; // the last submission that may have used it
+      };
+      std::vector<RetiredDescriptorSet> retiredDescriptorSets;
+      static const VkDeviceSize maxDefragmentationBytesPerFrame = 8 * 1024 * 1024;
       std::unique_ptr<TextureRepository> textureRepo;
       std::unique_ptr<PipelineRepository> pipelineRepo;
 
+      // GPU-driven rendering, if enabled (see settings::graphics::vulkan::gpuDriven and GpuScene)
+      struct GpuMeshDraws {
+        const MeshResource<EcsInterface> *mesh;
+        uint32_t firstDraw;
+        uint32_t drawCount;
+      };
+      std::unique_ptr<GpuScene> gpuScene;
+      std::vector<typename EcsInterface::EcsId> gpuSceneNodeIds; // by node index
+      std::unordered_map<typename EcsInterface::EcsId, uint32_t> gpuSceneNodeIndices;
+      std::vector<GpuMeshDraws> gpuMeshDraws;
+      bool gpuSceneDirty = true; // mesh instances have come or gone since the tables were built
+      std::vector<typename EcsInterface::EcsId> changedTransforms; // since the last frame, while the tables are valid
+      CullStats gpuCullStats = {}; // as of the last finished frame
+
+      // Point lights, which follow the transforms of their entities and are shaded by the deferred compose pass
+      struct PointLightSource {
+        glm::vec3 color;
+        float radius;
+      };
+      std::unordered_map<typename EcsInterface::EcsId, PointLightSource> pointLights;
+      std::vector<PointLight> framePointLights; // Only kept to avoid reallocating every frame
+      std::unique_ptr<LightGrid> lightGrid;
+
+      // Lines that anyone can add to the next frame, drawn over everything else
+      std::unique_ptr<DebugLines> debugLines;
+
       std::unique_ptr<rtu::topics::Subscription> sub_windowResize;
+      std::unique_ptr<rtu::topics::Subscription> sub_memoryStats;
+      std::unique_ptr<rtu::topics::Subscription> sub_cullStats;
+      std::unique_ptr<rtu::topics::Subscription> sub_wireframe;
       VkDebugReportCallbackEXT callback;
 //      GlobalShaderDataStore globalData;
       static const uint32_t INVALID_QUEUE_FAMILY_IDX = (uint32_t) -1;
 
       // used as subscription callback
       void reInitRendering(void *nothing);
+      void dumpDeviceMemoryStats(void *nothing);
+      void dumpCullStats(void *nothing);
+      void toggleWireframe(void *nothing);
 
       void createInstance(const char *appName);
       void createPhysicalDevice();
@@ -97,7 +166,7 @@ namespace at3::vkc {
       uint32_t getMemoryType(const VkPhysicalDevice &device, uint32_t memoryTypeBitsRequirement,
                              VkMemoryPropertyFlags requiredProperties);
       void createFrameBuffers(std::vector<VkFramebuffer> &outBuffers, const SwapChain &swapChain,
-                                    const VkImageView *depthBufferView, const VkRenderPass &renderPass);
+                              const std::vector<VkImageView> &sharedViews, const VkRenderPass &renderPass);
       void allocateDeviceMemory(Allocation &outMem, AllocationCreateInfo info);
       CommandBuffer beginScratchCommandBuffer(CmdPoolType type);
       void submitScratchCommandBuffer(CommandBuffer &commandBuffer);
@@ -111,7 +180,7 @@ namespace at3::vkc {
                       uint32_t dstOffset, VkCommandBuffer *buffer);
 
       void createBuffer(VkBuffer &outBuffer, Allocation &bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage,
-                        VkMemoryPropertyFlags properties);
+                        VkMemoryPropertyFlags properties, AllocationCategory category = AllocationCategory::OTHER);
       void copyDataToBuffer(VkBuffer *buffer, uint32_t dataSize, uint32_t dstOffset, char *data);
       void createImage(VkImage &outImage, uint32_t width, uint32_t height, VkFormat format, VkImageTiling tiling,
                        VkImageUsageFlags usage);
@@ -122,14 +191,41 @@ namespace at3::vkc {
 
       void createWindowSizeDependents();
       void updateDescriptorSets(UboPageMgr *dataStore);
+      void rewriteTextureDescriptors();
+      void createRenderTarget(RenderBuffer &outBuffer, VkFormat format, VkImageUsageFlags usage,
+                              VkImageAspectFlags aspectMask);
       void createDepthBuffer();
+      void createGBuffer();
+      void destroyRenderTarget(RenderBuffer &buffer);
+      float getPixelsPerObjectUnit(const MeshResource<EcsInterface> &mesh, const glm::mat4 &model,
+                                   const glm::vec3 &cameraPos, float lodScale);
+      uint32_t selectLod(const MeshResource<EcsInterface> &mesh, float pixelsPerObjectUnit);
+      void readGpuSceneNode(typename EcsInterface::EcsId id, GpuScene::Node &outNode);
+      void rebuildGpuScene();
+      void updateGpuScene();
+      VkPipeline getMeshPipeline(StandardPipeline index);
+      void recordIndirectDraws(VkCommandBuffer commandBuffer, const glm::mat4 &vp, bool secondPhase);
       void render(UboPageMgr *dataStore, const glm::mat4 &wvMat, const MeshRepository<EcsInterface> &meshAssets,
                   EcsInterface *ecs);
 
       MeshResource<EcsInterface> loadMeshFromData(const std::vector<float> &vertices,
                                                   const std::vector<uint32_t> &indices);
+      MeshResource<EcsInterface> loadMeshFromData(const float *vertices, size_t numVertices,
+                                                  const uint32_t *indices, size_t numIndices);
+      MeshResources<EcsInterface> loadMeshFromCooked(const float *vertices, const uint32_t *indices,
+                                                     const CookedSubMesh *subMeshes, uint32_t subMeshCount,
+                                                     uint64_t cookedKey, bool storeTriangles);
       MeshResources<EcsInterface> loadMeshFromFile(const char *filepath, bool combineSubMeshes,
                                                     bool storeTriangles = false);
+      bool ensureMeshResident(const std::string &meshName);
+      void evictMesh(const std::string &meshName);
+      void retireBuffer(VkBuffer buffer, const Allocation &memory);
+      void destroyRetiredBuffers();
+      void waitForFramesInFlight();
+      VkDeviceSize evictUnusedMeshes(VkDeviceSize bytesToFree);
+      void updateResidency();
+      void compactUboPages();
+      void defragmentDeviceMemory();
 //      void quad(MeshResource<EcsInterface> &outAsset, float width, float height, float xOffset, float yOffset);
 
 
@@ -1,12 +1,51 @@
 
+#include <algorithm>
+#if defined(_MSC_VER)
+# include <intrin.h>
+#endif
 #include "vkcAlloc.hpp"
 #include "definitions.hpp"
 
+namespace at3::vkc {
+
+  const char *getAllocationCategoryName(AllocationCategory category) {
+    switch (category) {
+      case AllocationCategory::OTHER: return "other";
+      case AllocationCategory::MESH: return "meshes";
+      case AllocationCategory::TEXTURE: return "textures";
+      case AllocationCategory::INSTANCE_DATA: return "instance data";
+      case AllocationCategory::RENDER_TARGET: return "render targets";
+      case AllocationCategory::STAGING: return "staging";
+      default: return "invalid";
+    }
+  }
+
+  float MemoryTypeStats::getFragmentation() const {
+    VkDeviceSize freeBytes = reservedBytes - liveBytes;
+    if ( ! freeBytes) { return 0.f; }
+    return 1.f - (float) largestFreeBytes / (float) freeBytes;
+  }
+
+  static void recordAlloc(MemoryTypeStats &stats, const Allocation &allocation) {
+    stats.liveBytes += allocation.size;
+    stats.highWaterBytes = std::max(stats.highWaterBytes, stats.liveBytes);
+    stats.categoryBytes[(size_t) allocation.category] += allocation.size;
+    stats.allocationCount++;
+  }
+
+  static void recordFree(MemoryTypeStats &stats, const Allocation &allocation) {
+    stats.liveBytes -= allocation.size;
+    stats.categoryBytes[(size_t) allocation.category] -= allocation.size;
+    stats.allocationCount--;
+  }
+
+}
+
 //Simple Passthrough allocator -> sub allocators responsible for actually parcelling out memory
 namespace at3::vkc::passthrough {
 
   AllocatorState state;
-  AllocatorInterface allocImpl = {activate, alloc, free, allocatedSize, numAllocs};
+  AllocatorInterface allocImpl = {activate, alloc, free, allocatedSize, numAllocs, getStats};
 
   void activate(Common *context) {
     context->allocator = allocImpl;
@@ -16,6 +55,7 @@ namespace at3::vkc::passthrough {
     vkGetPhysicalDeviceMemoryProperties(context->gpu.device, &memProperties);
 
     state.memTypeAllocSizes = (size_t *) calloc(1, sizeof(size_t) * memProperties.memoryTypeCount);
+    state.memTypeStats.assign(memProperties.memoryTypeCount, MemoryTypeStats());
   }
 
   void deactivate(Common *context) {
@@ -38,18 +78,31 @@ namespace at3::vkc::passthrough {
 
     outAlloc.size = createInfo.size;
     outAlloc.type = createInfo.memoryTypeIndex;
+    outAlloc.pool = 0;
     outAlloc.offset = 0;
+    outAlloc.category = createInfo.category;
     outAlloc.context = state.context;
 
     AT3_ASSERT(res != VK_ERROR_OUT_OF_DEVICE_MEMORY, "Out of device memory");
     AT3_ASSERT(res != VK_ERROR_TOO_MANY_OBJECTS, "Attempting to create too many allocations")
     AT3_ASSERT(res == VK_SUCCESS, "Error allocating memory in passthrough allocator");
+
+    // Every allocation is its own block, so nothing is ever reserved but not live
+    MemoryTypeStats &stats = state.memTypeStats[createInfo.memoryTypeIndex];
+    recordAlloc(stats, outAlloc);
+    stats.reservedBytes += createInfo.size;
+    stats.blockCount++;
   }
 
   void free(Allocation &allocation) {
     state.totalAllocs--;
     state.memTypeAllocSizes[allocation.type] -= allocation.size;
     vkFreeMemory(state.context->device, (allocation.handle), nullptr);
+
+    MemoryTypeStats &stats = state.memTypeStats[allocation.type];
+    recordFree(stats, allocation);
+    stats.reservedBytes -= allocation.size;
+    stats.blockCount--;
   }
 
   size_t allocatedSize(uint32_t memoryType) {
@@ -59,12 +112,278 @@ namespace at3::vkc::passthrough {
   uint32_t numAllocs() {
     return state.totalAllocs;
   }
+
+  void getStats(std::vector<MemoryTypeStats> &outStats) {
+    outStats = state.memTypeStats;
+  }
 }
 
 namespace at3::vkc::pool {
 
+  static uint32_t lowestSetBit(uint64_t bits) {
+#   if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (uint32_t) index;
+#   else
+    return (uint32_t) __builtin_ctzll(bits);
+#   endif
+  }
+
+  static uint32_t highestSetBit(uint64_t bits) {
+#   if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64(&index, bits);
+    return (uint32_t) index;
+#   else
+    return 63 - (uint32_t) __builtin_clzll(bits);
+#   endif
+  }
+
+  //TLSF HEAP
+
+  TlsfHeap::TlsfHeap(VkDeviceSize size) : size(size) {
+    for (auto &heads : freeHeads) {
+      for (uint32_t &head : heads) {
+        head = none;
+      }
+    }
+    uint32_t whole = newSpan();
+    spans[whole].size = size;
+    insertFree(whole);
+  }
+
+  void TlsfHeap::mapping(VkDeviceSize size, uint32_t &fl, uint32_t &sl) {
+    if (size < slCount) { // Small sizes each get their own class
+      fl = 0;
+      sl = (uint32_t) size;
+      return;
+    }
+    uint32_t msb = highestSetBit(size);
+    sl = (uint32_t) (size >> (msb - slBits)) - slCount;
+    fl = msb - slBits + 1;
+  }
+
+  uint32_t TlsfHeap::newSpan() {
+    if ( ! unusedSpans.empty()) {
+      uint32_t span = unusedSpans.back();
+      unusedSpans.pop_back();
+      spans[span] = Span();
+      return span;
+    }
+    spans.emplace_back();
+    return (uint32_t) spans.size() - 1;
+  }
+
+  uint32_t TlsfHeap::split(uint32_t span, VkDeviceSize firstSize) {
+    uint32_t second = newSpan(); // May reallocate spans, so no references are held across this
+    spans[second].offset = spans[span].offset + firstSize;
+    spans[second].size = spans[span].size - firstSize;
+    spans[second].prevPhys = span;
+    spans[second].nextPhys = spans[span].nextPhys;
+    if (spans[span].nextPhys != none) {
+      spans[spans[span].nextPhys].prevPhys = second;
+    }
+    spans[span].nextPhys = second;
+    spans[span].size = firstSize;
+    return second;
+  }
+
+  void TlsfHeap::absorb(uint32_t span, uint32_t next) {
+    spans[span].size += spans[next].size;
+    spans[span].nextPhys = spans[next].nextPhys;
+    if (spans[next].nextPhys != none) {
+      spans[spans[next].nextPhys].prevPhys = span;
+    }
+    spans[next] = Span();
+    unusedSpans.push_back(next);
+  }
+
+  void TlsfHeap::insertFree(uint32_t span) {
+    uint32_t fl, sl;
+    mapping(spans[span].size, fl, sl);
+    spans[span].free = true;
+    spans[span].prevFree = none;
+    spans[span].nextFree = freeHeads[fl][sl];
+    if (freeHeads[fl][sl] != none) {
+      spans[freeHeads[fl][sl]].prevFree = span;
+    }
+    freeHeads[fl][sl] = span;
+    flBitmap |= uint64_t(1) << fl;
+    slBitmaps[fl] |= 1u << sl;
+  }
+
+  void TlsfHeap::removeFree(uint32_t span) {
+    uint32_t fl, sl;
+    mapping(spans[span].size, fl, sl);
+    Span &s = spans[span];
+    if (s.prevFree != none) {
+      spans[s.prevFree].nextFree = s.nextFree;
+    } else {
+      freeHeads[fl][sl] = s.nextFree;
+    }
+    if (s.nextFree != none) {
+      spans[s.nextFree].prevFree = s.prevFree;
+    }
+    s.free = false;
+    s.prevFree = s.nextFree = none;
+    if (freeHeads[fl][sl] == none) {
+      slBitmaps[fl] &= ~(1u << sl);
+      if ( ! slBitmaps[fl]) {
+        flBitmap &= ~(uint64_t(1) << fl);
+      }
+    }
+  }
+
+  uint32_t TlsfHeap::findFree(VkDeviceSize size) const {
+    // Round up to the next class boundary, so that every span in the class found is big enough
+    if (size >= slCount) {
+      size += (VkDeviceSize(1) << (highestSetBit(size) - slBits)) - 1;
+    }
+    uint32_t fl, sl;
+    mapping(size, fl, sl);
+    uint32_t slMap = slBitmaps[fl] & (~0u << sl);
+    if ( ! slMap) {
+      uint64_t flMap = fl + 1 < 64 ? flBitmap & (~uint64_t(0) << (fl + 1)) : 0;
+      if ( ! flMap) { return none; }
+      fl = lowestSetBit(flMap);
+      slMap = slBitmaps[fl];
+    }
+    sl = lowestSetBit(slMap);
+    return freeHeads[fl][sl];
+  }
+
+  bool TlsfHeap::alloc(VkDeviceSize allocSize, VkDeviceSize alignment, VkDeviceSize &outOffset) {
+    AT3_ASSERT(allocSize, "Zero-sized device memory allocation");
+    AT3_ASSERT(alignment && ! (alignment & (alignment - 1)), "Alignment must be a power of two");
+
+    uint32_t span = findFree(allocSize + alignment - 1); // Big enough wherever it starts
+    if (span == none) { return false; }
+    removeFree(span);
+
+    // Anything before the aligned offset stays free. The span before this one can't have been free, or the two would
+    // have been merged, so there is nothing to merge the padding with.
+    VkDeviceSize padding = ((spans[span].offset + alignment - 1) & ~(alignment - 1)) - spans[span].offset;
+    if (padding) {
+      uint32_t rest = split(span, padding);
+      insertFree(span);
+      span = rest;
+    }
+    // Likewise for anything after the end
+    if (spans[span].size > allocSize) {
+      insertFree(split(span, allocSize));
+    }
+
+    usedSpans[spans[span].offset] = span;
+    usedSize += allocSize;
+    outOffset = spans[span].offset;
+    return true;
+  }
+
+  void TlsfHeap::free(VkDeviceSize offset) {
+    auto found = usedSpans.find(offset);
+    AT3_ASSERT(found != usedSpans.end(), "Freeing device memory that was not allocated");
+    uint32_t span = found->second;
+    usedSpans.erase(found);
+    usedSize -= spans[span].size;
+
+    uint32_t next = spans[span].nextPhys;
+    if (next != none && spans[next].free) {
+      removeFree(next);
+      absorb(span, next);
+    }
+    uint32_t prev = spans[span].prevPhys;
+    if (prev != none && spans[prev].free) {
+      removeFree(prev);
+      absorb(prev, span);
+      span = prev;
+    }
+    insertFree(span);
+  }
+
+  VkDeviceSize TlsfHeap::getSize() const {
+    return size;
+  }
+
+  VkDeviceSize TlsfHeap::getUsedSize() const {
+    return usedSize;
+  }
+
+  VkDeviceSize TlsfHeap::getLargestFreeSize() const {
+    if ( ! flBitmap) { return 0; }
+    // The largest free span is somewhere in the highest non-empty size class
+    uint32_t fl = highestSetBit(flBitmap);
+    uint32_t sl = highestSetBit(slBitmaps[fl]);
+    VkDeviceSize largest = 0;
+    for (uint32_t span = freeHeads[fl][sl]; span != none; span = spans[span].nextFree) {
+      largest = std::max(largest, spans[span].size);
+    }
+    return largest;
+  }
+
+  bool TlsfHeap::isEmpty() const {
+    return usedSpans.empty();
+  }
+
+  void TlsfHeap::validate() const {
+    VkDeviceSize end = 0, used = 0;
+    size_t freeSpans = 0;
+    bool prevFree = false;
+    for (uint32_t span = 0; span != none; span = spans[span].nextPhys) {
+      const Span &s = spans[span];
+      AT3_ASSERT(s.offset == end, "Gap or overlap at offset %llu", (unsigned long long) s.offset);
+      AT3_ASSERT( ! (prevFree && s.free), "Adjacent free spans at offset %llu", (unsigned long long) s.offset);
+      end += s.size;
+      prevFree = s.free;
+      if (s.free) {
+        ++freeSpans;
+      } else {
+        used += s.size;
+        AT3_ASSERT(usedSpans.count(s.offset), "Used span at offset %llu is untracked", (unsigned long long) s.offset);
+      }
+    }
+    AT3_ASSERT(end == size, "Spans cover %llu of %llu bytes", (unsigned long long) end, (unsigned long long) size);
+    AT3_ASSERT(used == usedSize, "Used size is out of sync");
+
+    size_t listed = 0;
+    for (uint32_t fl = 0; fl < flCount; ++fl) {
+      for (uint32_t sl = 0; sl < slCount; ++sl) {
+        AT3_ASSERT(((slBitmaps[fl] >> sl) & 1u) == (freeHeads[fl][sl] != none), "Free bitmap is out of sync");
+        for (uint32_t span = freeHeads[fl][sl]; span != none; span = spans[span].nextFree) {
+          uint32_t spanFl, spanSl;
+          mapping(spans[span].size, spanFl, spanSl);
+          AT3_ASSERT(spans[span].free && spanFl == fl && spanSl == sl, "Span is in the wrong free list");
+          ++listed;
+        }
+      }
+    }
+    AT3_ASSERT(listed == freeSpans, "%zu free spans but %zu listed", freeSpans, listed);
+  }
+
+  //POOLED ALLOCATOR
+
   AllocatorState state;
-  AllocatorInterface allocImpl = {activate, alloc, free, allocatedSize, numAllocs};
+  AllocatorInterface allocImpl = {activate, alloc, free, allocatedSize, numAllocs, getStats};
+
+  void setup(VkDevice device, uint32_t memoryTypeCount, PFN_vkAllocateMemory allocateMemory,
+             PFN_vkFreeMemory freeMemory) {
+    state.device = device;
+    state.allocateMemory = allocateMemory;
+    state.freeMemory = freeMemory;
+    state.totalAllocs = 0;
+
+    state.memTypeAllocSizes.assign(memoryTypeCount, 0);
+    state.memTypeStats.assign(memoryTypeCount, MemoryTypeStats());
+    state.memPools.clear();
+    state.memPools.resize(memoryTypeCount * 2);
+    for (auto &pool : state.memPools) {
+      pool.evacuating = noBlock;
+      pool.abandoned = noBlock;
+      pool.abandonedUsedSize = 0;
+    }
+
+    state.memoryBlockMinSize = 32 * 1024 * 1024;
+  }
 
   void activate(Common *context) {
     context->allocator = allocImpl;
@@ -73,119 +392,159 @@ namespace at3::vkc::pool {
     VkPhysicalDeviceMemoryProperties memProperties;
     vkGetPhysicalDeviceMemoryProperties(context->gpu.device, &memProperties);
 
-    state.memTypeAllocSizes.resize(memProperties.memoryTypeCount);
-    state.memPools.resize(memProperties.memoryTypeCount);
-
-    state.pageSize = 1024; //can't use context->gpu.deviceProps.limits.bufferImageGranularity because some AMD cards set this to 1
-    state.memoryBlockMinSize = state.pageSize * 10;
+    setup(context->device, memProperties.memoryTypeCount, vkAllocateMemory, vkFreeMemory);
   }
 
-  uint32_t addBlockToPool(VkDeviceSize size, uint32_t memoryType, bool fitToAlloc) {
-    VkDeviceSize newPoolSize = size * 2;
-    newPoolSize = newPoolSize < state.memoryBlockMinSize ? state.memoryBlockMinSize : newPoolSize;
-
+  static VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryType) {
     VkMemoryAllocateInfo allocInfo {};
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = newPoolSize;
+    allocInfo.allocationSize = size;
     allocInfo.memoryTypeIndex = memoryType;
 
-    DeviceMemoryBlock newBlock = {};
-    VkResult res = vkAllocateMemory(state.context->device, &allocInfo, nullptr, &newBlock.mem.handle);
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkResult res = state.allocateMemory(state.device, &allocInfo, nullptr, &memory);
 
     AT3_ASSERT(res != VK_ERROR_OUT_OF_DEVICE_MEMORY, "Out of device memory");
     AT3_ASSERT(res != VK_ERROR_TOO_MANY_OBJECTS, "Attempting to create too many allocations")
-    AT3_ASSERT(res == VK_SUCCESS, "Error allocating memory in passthrough allocator");
-
-    newBlock.mem.type = memoryType;
-    newBlock.mem.size = newPoolSize;
-
-    MemoryPool &pool = state.memPools[memoryType];
-    pool.blocks.push_back(newBlock);
-
-    pool.blocks[pool.blocks.size() - 1].layout.push_back({0, newPoolSize});
+    AT3_ASSERT(res == VK_SUCCESS, "Error allocating memory in pool allocator");
 
     state.totalAllocs++;
-
-    return pool.blocks.size() - 1;
+    state.memTypeStats[memoryType].reservedBytes += size;
+    state.memTypeStats[memoryType].blockCount++;
+    return memory;
   }
 
-  void markChunkOfMemoryBlockUsed(uint32_t memoryType, BlockSpanIndexPair indices, VkDeviceSize size) {
-    MemoryPool &pool = state.memPools[memoryType];
+  static uint32_t addBlockToPool(uint32_t poolIndex, VkDeviceSize size, uint32_t memoryType) {
+    MemoryPool &pool = state.memPools[poolIndex];
+    uint32_t blockIdx = 0;
+    while (blockIdx < pool.blocks.size() && pool.blocks[blockIdx].mem.handle != VK_NULL_HANDLE) {
+      ++blockIdx;
+    }
+    if (blockIdx == pool.blocks.size()) {
+      pool.blocks.emplace_back();
+    }
 
-    pool.blocks[indices.blockIdx].layout[indices.spanIdx].offset += size;
-    pool.blocks[indices.blockIdx].layout[indices.spanIdx].size -= size;
+    DeviceMemoryBlock &block = pool.blocks[blockIdx];
+    block.mem.handle = allocateDeviceMemory(size, memoryType);
+    block.mem.type = memoryType;
+    block.mem.size = size;
+    block.heap = std::make_unique<TlsfHeap>(size);
+    return blockIdx;
   }
 
-  bool findFreeChunkForAllocation(BlockSpanIndexPair &outIndexPair, uint32_t memoryType, VkDeviceSize size,
-                                  bool needsWholePage) {
-    MemoryPool &pool = state.memPools[memoryType];
+  static void releaseBlock(uint32_t poolIndex, uint32_t blockIdx) {
+    MemoryPool &pool = state.memPools[poolIndex];
+    DeviceMemoryBlock &block = pool.blocks[blockIdx];
+    state.freeMemory(state.device, block.mem.handle, nullptr);
+    state.totalAllocs--;
+    state.memTypeStats[block.mem.type].reservedBytes -= block.mem.size;
+    state.memTypeStats[block.mem.type].blockCount--;
+    block.mem.handle = VK_NULL_HANDLE;
+    block.heap.reset();
+    if (pool.evacuating == blockIdx) {
+      pool.evacuating = noBlock;
+    }
+    if (pool.abandoned == blockIdx) {
+      pool.abandoned = noBlock;
+    }
+  }
 
+  /*
+   * Mark the emptiest block of a pool for evacuation if everything in it would fit in the other blocks' free space
+   * with plenty to spare (free space can be fragmented, and this shouldn't have to give up half way).
+   */
+  static void considerEvacuation(uint32_t poolIndex) {
+    MemoryPool &pool = state.memPools[poolIndex];
+    if (pool.evacuating != noBlock) { return; }
+    uint32_t emptiest = noBlock;
+    VkDeviceSize totalFree = 0;
     for (uint32_t i = 0; i < pool.blocks.size(); ++i) {
-      for (uint32_t j = 0; j < pool.blocks[i].layout.size(); ++j) {
-        bool validOffset = needsWholePage ? pool.blocks[i].layout[j].offset == 0 : true;
-        if (pool.blocks[i].layout[j].size >= size && validOffset) {
-          outIndexPair.blockIdx = i;
-          outIndexPair.spanIdx = j;
-          return true;
-        }
+      if ( ! pool.blocks[i].heap) { continue; }
+      const TlsfHeap &heap = *pool.blocks[i].heap;
+      totalFree += heap.getSize() - heap.getUsedSize();
+      if (emptiest == noBlock || heap.getUsedSize() < pool.blocks[emptiest].heap->getUsedSize()) {
+        emptiest = i;
       }
     }
-    return false;
+    if (emptiest == noBlock) { return; }
+    const TlsfHeap &heap = *pool.blocks[emptiest].heap;
+    if (emptiest == pool.abandoned && heap.getUsedSize() > pool.abandonedUsedSize / 2) { return; }
+    VkDeviceSize freeElsewhere = totalFree - (heap.getSize() - heap.getUsedSize());
+    if (heap.getUsedSize() < heap.getSize() / 2 && freeElsewhere >= heap.getUsedSize() * 2) {
+      pool.evacuating = emptiest;
+    }
   }
 
   void alloc(Allocation &outAlloc, AllocationCreateInfo createInfo) {
     uint32_t memoryType = createInfo.memoryTypeIndex;
     VkDeviceSize size = createInfo.size;
+    VkDeviceSize alignment = std::max(createInfo.alignment, VkDeviceSize(1));
 
-    MemoryPool &pool = state.memPools[memoryType];
-    //make sure we always alloc a multiple of pageSize
-    VkDeviceSize requestedAllocSize = ((size / state.pageSize) + 1) * state.pageSize;
-    state.memTypeAllocSizes[memoryType] += requestedAllocSize;
-
-    BlockSpanIndexPair location;
+    state.memTypeAllocSizes[memoryType] += size;
 
-    bool needsOwnPage = createInfo.usage != VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
-    bool found = findFreeChunkForAllocation(location, memoryType, requestedAllocSize, needsOwnPage);
-
-    if (!found) {
-      location = {addBlockToPool(requestedAllocSize, memoryType, needsOwnPage), 0};
-    }
-
-    pool.blocks[location.blockIdx].pageReserved = needsOwnPage;
-
-    outAlloc.handle = pool.blocks[location.blockIdx].mem.handle;
     outAlloc.size = size;
-    outAlloc.offset = pool.blocks[location.blockIdx].layout[location.spanIdx].offset;
     outAlloc.type = memoryType;
-    outAlloc.id = location.blockIdx;
+    outAlloc.category = createInfo.category;
     outAlloc.context = state.context;
+    recordAlloc(state.memTypeStats[memoryType], outAlloc);
+
+    // Memory that will be mapped gets its own device memory, since a VkDeviceMemory can only be mapped once at a time
+    if (createInfo.usage != VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+      outAlloc.handle = allocateDeviceMemory(size, memoryType);
+      outAlloc.pool = dedicatedPool;
+      outAlloc.id = 0;
+      outAlloc.offset = 0;
+      return;
+    }
 
-    markChunkOfMemoryBlockUsed(memoryType, location, requestedAllocSize);
-  }
+    uint32_t poolIndex = memoryType * 2 + (createInfo.optimalTiling ? 1 : 0);
+    MemoryPool &pool = state.memPools[poolIndex];
 
-  void free(Allocation &allocation) {
-    VkDeviceSize requestedAllocSize = ((allocation.size / state.pageSize) + 1) * state.pageSize;
+    VkDeviceSize offset = 0;
+    uint32_t blockIdx = noBlock;
+    for (uint32_t i = 0; i < pool.blocks.size(); ++i) {
+      if (pool.blocks[i].heap && i != pool.evacuating && pool.blocks[i].heap->alloc(size, alignment, offset)) {
+        blockIdx = i;
+        break;
+      }
+    }
+    if (blockIdx == noBlock) {
+      blockIdx = addBlockToPool(poolIndex, std::max(state.memoryBlockMinSize, size), memoryType);
+      bool fits = pool.blocks[blockIdx].heap->alloc(size, alignment, offset);
+      AT3_ASSERT(fits, "A new device memory block could not fit the allocation it was made for");
+    }
 
-    OffsetSize span = {allocation.offset, requestedAllocSize};
+    outAlloc.handle = pool.blocks[blockIdx].mem.handle;
+    outAlloc.pool = poolIndex;
+    outAlloc.id = blockIdx;
+    outAlloc.offset = offset;
+  }
 
-    MemoryPool &pool = state.memPools[allocation.type];
-    pool.blocks[allocation.id].pageReserved = false;
+  void free(Allocation &allocation) {
+    state.memTypeAllocSizes[allocation.type] -= allocation.size;
+    recordFree(state.memTypeStats[allocation.type], allocation);
+
+    if (allocation.pool == dedicatedPool) {
+      state.freeMemory(state.device, allocation.handle, nullptr);
+      state.totalAllocs--;
+      state.memTypeStats[allocation.type].reservedBytes -= allocation.size;
+      state.memTypeStats[allocation.type].blockCount--;
+      return;
+    }
 
-    bool found = false;
+    MemoryPool &pool = state.memPools[allocation.pool];
+    TlsfHeap &heap = *pool.blocks[allocation.id].heap;
+    heap.free(allocation.offset);
 
-    uint32_t numLayoutMems = pool.blocks[allocation.id].layout.size();
-    for (uint32_t j = 0; j < numLayoutMems; ++j) {
-      if (pool.blocks[allocation.id].layout[j].offset == requestedAllocSize + allocation.offset) {
-        pool.blocks[allocation.id].layout[j].offset = allocation.offset;
-        pool.blocks[allocation.id].layout[j].size += requestedAllocSize;
-        found = true;
-        break;
-      }
+    // Empty blocks are given back, except for the last one in the pool
+    uint32_t liveBlocks = 0;
+    for (auto &block : pool.blocks) {
+      liveBlocks += block.heap ? 1 : 0;
     }
-
-    if (!found) {
-      state.memPools[allocation.type].blocks[allocation.id].layout.push_back(span);
-      state.memTypeAllocSizes[allocation.type] -= requestedAllocSize;
+    if (heap.isEmpty() && (liveBlocks > 1 || pool.evacuating == allocation.id)) {
+      releaseBlock(allocation.pool, allocation.id);
+    } else {
+      considerEvacuation(allocation.pool);
     }
   }
 
@@ -197,6 +556,36 @@ namespace at3::vkc::pool {
     return state.totalAllocs;
   }
 
+  void getStats(std::vector<MemoryTypeStats> &outStats) {
+    outStats = state.memTypeStats;
+    for (uint32_t poolIndex = 0; poolIndex < state.memPools.size(); ++poolIndex) {
+      MemoryTypeStats &stats = outStats[poolIndex / 2];
+      for (auto &block : state.memPools[poolIndex].blocks) {
+        if ( ! block.heap) { continue; }
+        stats.largestFreeBytes = std::max(stats.largestFreeBytes, block.heap->getLargestFreeSize());
+      }
+    }
+  }
+
+  bool defragmentationPending() {
+    for (auto &pool : state.memPools) {
+      if (pool.evacuating != noBlock) { return true; }
+    }
+    return false;
+  }
+
+  bool isEvacuating(const Allocation &allocation) {
+    return allocation.pool != dedicatedPool && state.memPools[allocation.pool].evacuating == allocation.id;
+  }
+
+  void stopDefragmentation(uint32_t poolIndex) {
+    MemoryPool &pool = state.memPools[poolIndex];
+    if (pool.evacuating == noBlock) { return; }
+    pool.abandoned = pool.evacuating;
+    pool.abandonedUsedSize = pool.blocks[pool.evacuating].heap->getUsedSize();
+    pool.evacuating = noBlock;
+  }
+
   void deactivate(Common *context) {
   }
 
@@ -2,6 +2,9 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 #include "vkcTypes.hpp"
 
@@ -9,6 +12,7 @@ namespace at3::vkc::passthrough {
   struct AllocatorState {
     size_t *memTypeAllocSizes;
     uint32_t totalAllocs;
+    std::vector<MemoryTypeStats> memTypeStats;
 
     Common *context;
   };
@@ -21,38 +25,105 @@ namespace at3::vkc::passthrough {
   void free(Allocation &handle);
   size_t allocatedSize(uint32_t memoryType);
   uint32_t numAllocs();
+  void getStats(std::vector<MemoryTypeStats> &outStats);
 
 }
 
 namespace at3::vkc::pool {
-  struct OffsetSize {
-    uint64_t offset;
-    uint64_t size;
-  };
-  struct BlockSpanIndexPair {
-    uint32_t blockIdx;
-    uint32_t spanIdx;
+
+  /*
+   * A two-level segregated fit (TLSF) heap that parcels out the byte range [0, size) of one block of device memory.
+   * Free spans are kept in lists by size class (a power of two, subdivided linearly into slCount classes), and a bitmap
+   * of which lists are non-empty lets alloc find a big enough span in constant time. Freed spans are merged with free
+   * neighbors on both sides. This knows nothing about Vulkan beyond VkDeviceSize, so it can be exercised on its own.
+   */
+  class TlsfHeap {
+    public:
+      explicit TlsfHeap(VkDeviceSize size);
+      /*
+       * Find room for size bytes at an offset that is a multiple of alignment (which must be a power of two).
+       * Returns false if there is no free span big enough.
+       */
+      bool alloc(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &outOffset);
+      /*
+       * Free the span at the given offset, which must have been returned by alloc.
+       */
+      void free(VkDeviceSize offset);
+      VkDeviceSize getSize() const;
+      VkDeviceSize getUsedSize() const;
+      VkDeviceSize getLargestFreeSize() const;
+      bool isEmpty() const;
+      /*
+       * Assert that the spans exactly cover the heap, that no two free spans are adjacent, and that every free span is
+       * in the list for its size class.
+       */
+      void validate() const;
+
+    private:
+      static constexpr uint32_t slBits = 5;
+      static constexpr uint32_t slCount = 1u << slBits;
+      static constexpr uint32_t flCount = 64 - slBits + 1;
+      static constexpr uint32_t none = UINT32_MAX;
+
+      struct Span {
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        uint32_t prevPhys = none, nextPhys = none;  // neighbors in memory
+        uint32_t prevFree = none, nextFree = none;  // neighbors in the free list, if free
+        bool free = false;
+      };
+
+      VkDeviceSize size;
+      VkDeviceSize usedSize = 0;
+      std::vector<Span> spans;           // span 0 always starts at offset 0
+      std::vector<uint32_t> unusedSpans; // indices into spans that can be reused
+      std::unordered_map<VkDeviceSize, uint32_t> usedSpans; // by offset
+      uint64_t flBitmap = 0;
+      uint32_t slBitmaps[flCount] = {};
+      uint32_t freeHeads[flCount][slCount];
+
+      static void mapping(VkDeviceSize size, uint32_t &fl, uint32_t &sl);
+      uint32_t newSpan();
+      uint32_t split(uint32_t span, VkDeviceSize firstSize);
+      void absorb(uint32_t span, uint32_t next);
+      void insertFree(uint32_t span);
+      void removeFree(uint32_t span);
+      uint32_t findFree(VkDeviceSize size) const;
   };
 
   struct DeviceMemoryBlock {
-    Allocation mem;
-    std::vector<OffsetSize> layout;
-    bool pageReserved;
+    Allocation mem; // mem.handle is VK_NULL_HANDLE if the block has been released and this slot can be reused
+    std::unique_ptr<TlsfHeap> heap;
   };
 
   struct MemoryPool {
     std::vector<DeviceMemoryBlock> blocks;
+    uint32_t evacuating; // the block being emptied by defragmentation, if any
+    // The block that defragmentation last gave up on, and how much was left in it then. It isn't picked again until
+    // that has halved, so that a block holding things that can't be moved isn't picked over and over.
+    uint32_t abandoned;
+    VkDeviceSize abandonedUsedSize;
   };
 
+  static constexpr uint32_t noBlock = UINT32_MAX;
+  static constexpr uint32_t dedicatedPool = UINT32_MAX;
+
   struct AllocatorState {
     Common *context;
+    VkDevice device;
+
+    // Device memory blocks are allocated and freed through these, which can be replaced for testing
+    PFN_vkAllocateMemory allocateMemory;
+    PFN_vkFreeMemory freeMemory;
 
     std::vector<size_t> memTypeAllocSizes;
     uint32_t totalAllocs;
+    std::vector<MemoryTypeStats> memTypeStats; // everything but largestFreeBytes, which is found when asked for
 
-    uint32_t pageSize;
     VkDeviceSize memoryBlockMinSize;
 
+    // Two pools per memory type: one for buffers (and linear images) and one for optimal-tiling images, so that the two
+    // never share a bufferImageGranularity page.
     std::vector<MemoryPool> memPools;
   };
 
@@ -64,5 +135,24 @@ namespace at3::vkc::pool {
   void free(Allocation &handle);
   size_t allocatedSize(uint32_t memoryType);
   uint32_t numAllocs();
+  void getStats(std::vector<MemoryTypeStats> &outStats);
+
+  /*
+   * Everything activate does except install the allocator in a context, with the device memory functions given.
+   */
+  void setup(VkDevice device, uint32_t memoryTypeCount, PFN_vkAllocateMemory allocateMemory,
+             PFN_vkFreeMemory freeMemory);
+
+  /*
+   * Defragmentation is incremental, and is driven by whoever owns the allocations. When enough has been freed from a
+   * pool that the contents of its emptiest block would fit in the free space of its other blocks, that block is marked
+   * for evacuation, and new allocations stop coming from it. Owners should then (a few at a time) make new allocations
+   * for whatever they have in it, copy their contents over, and free the old ones. The block is released as soon as it
+   * is empty. If an owner finds nothing of its own left to move in a pool, it should call stopDefragmentation for that
+   * pool, since the rest belongs to something that can't be moved.
+   */
+  bool defragmentationPending();
+  bool isEvacuating(const Allocation &allocation);
+  void stopDefragmentation(uint32_t poolIndex);
 
 }
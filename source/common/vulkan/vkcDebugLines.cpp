@@ -0,0 +1,115 @@
+
+#include "vkcDebugLines.hpp"
+#include "vkcUboPageMgr.hpp"
+
+namespace at3::vkc {
+
+  DebugLines::DebugLines(Common &ctxt, PipelineRepository &pipelineRepo) : ctxt(&ctxt), pipelineRepo(&pipelineRepo) { }
+
+  /*
+   * Find room for count vertices at once, or return nullptr if there is none. The ring is never allowed to fill up
+   * completely, so that a full ring can't be mistaken for an empty one.
+   */
+  DebugLines::Vertex *DebugLines::reserve(uint32_t count) {
+    if ( ! vertices) { // The first line ever added
+      createBuffer(buffer, memory, capacity * sizeof(Vertex), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, *ctxt,
+                   AllocationCategory::STAGING);
+      vkMapMemory(ctxt->device, memory.handle, memory.offset, capacity * sizeof(Vertex), 0, (void **) &vertices);
+    }
+
+    uint32_t at;
+    if (head >= tail) { // The free space runs from head to the end, then from the start up to tail
+      if (head + count < capacity || (head + count == capacity && tail > 0)) {
+        at = head;
+      } else if (count < tail) { // Carry on from the start, leaving the rest of the end unused until it comes around
+        wrapEnd = head;
+        wrapped = true;
+        at = 0;
+      } else {
+        ++droppedLines;
+        return nullptr;
+      }
+    } else if (head + count < tail) {
+      at = head;
+    } else {
+      ++droppedLines;
+      return nullptr;
+    }
+
+    head = at + count;
+    if (head == capacity) {
+      wrapEnd = capacity;
+      wrapped = true;
+      head = 0;
+    }
+    return vertices + at;
+  }
+
+  void DebugLines::clear() {
+    head = batchStart;
+    wrapped = false;
+  }
+
+  void DebugLines::record(VkCommandBuffer commandBuffer, uint32_t frame, const glm::mat4 &vp) {
+    if (head == batchStart && ! wrapped) { return; }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRepo->at(DEBUG_LINES).handle);
+    vkCmdPushConstants(commandBuffer, pipelineRepo->at(DEBUG_LINES).layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(vp),
+                       &vp);
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &buffer, &offset);
+    if (wrapped) {
+      if (wrapEnd > batchStart) {
+        vkCmdDraw(commandBuffer, wrapEnd - batchStart, 1, batchStart, 0);
+      }
+      if (head) {
+        vkCmdDraw(commandBuffer, head, 1, 0, 0);
+      }
+    } else {
+      vkCmdDraw(commandBuffer, head - batchStart, 1, batchStart, 0);
+    }
+
+    inFlight.push_back({frame, head});
+    batchStart = head;
+    wrapped = false;
+  }
+
+  void DebugLines::release(uint32_t frame) {
+    // Frames finish in the order they were submitted, so every frame before this one is done too
+    for (size_t i = 0; i < inFlight.size(); ++i) {
+      if (inFlight[i].frame == frame) {
+        tail = inFlight[i].end;
+        inFlight.erase(inFlight.begin(), inFlight.begin() + i + 1);
+        return;
+      }
+    }
+  }
+
+  void DebugLines::setCameraPosition(const glm::vec3 &position) {
+    cameraPosition = position;
+  }
+
+  glm::vec3 DebugLines::getCameraPosition() const {
+    return cameraPosition;
+  }
+
+  uint64_t DebugLines::getDroppedLineCount() const {
+    return droppedLines;
+  }
+
+  /*
+   * Only called when the GPU is idle.
+   */
+  void DebugLines::destroy() {
+    if ( ! vertices) { return; }
+    vkUnmapMemory(ctxt->device, memory.handle);
+    vkDestroyBuffer(ctxt->device, buffer, nullptr);
+    ctxt->allocator.free(memory);
+    vertices = nullptr;
+    head = tail = batchStart = 0;
+    wrapped = false;
+    inFlight.clear();
+  }
+
+}
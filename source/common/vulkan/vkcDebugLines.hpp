@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+#include "vkcPipelines.hpp"
+#include "math.hpp"
+
+namespace at3::vkc {
+
+  /*
+   * Lines to draw over a frame for debugging, such as the shapes that physics sees. Lines are written straight into a
+   * ring buffer that stays mapped, and each frame draws whatever was added since the frame before it with one draw
+   * call (two, when the lines run over the end of the ring and carry on from the start). The space a frame used is
+   * only reused once that frame has finished, and lines that don't fit in the rest of the ring are dropped.
+   *
+   * Nothing is allocated until the first line is added, so this costs nothing unless it is used.
+   */
+  class DebugLines {
+
+    public:
+
+      struct Vertex {
+        glm::vec3 position;
+        uint32_t color; // RGBA, one byte each
+      };
+
+      static constexpr uint32_t capacity = 1 << 20; // Vertices in the ring, two for each line
+
+      DebugLines(Common &ctxt, PipelineRepository &pipelineRepo);
+      /*
+       * Add a line to the next frame drawn.
+       */
+      void add(const glm::vec3 &from, const glm::vec3 &to, uint32_t color) {
+        if (Vertex *vertices = reserve(2)) {
+          vertices[0] = {from, color};
+          vertices[1] = {to, color};
+        }
+      }
+      /*
+       * Forget the lines added since the last frame drawn.
+       */
+      void clear();
+      /*
+       * Record the lines added since the last frame drawn, from within SUBPASS_OVERLAY. Their space is kept until
+       * release is called with the same frame index.
+       */
+      void record(VkCommandBuffer commandBuffer, uint32_t frame, const glm::mat4 &vp);
+      /*
+       * Reuse the space of the lines recorded with this frame index, and of every frame recorded before them, now that
+       * the GPU is done with it.
+       */
+      void release(uint32_t frame);
+      void setCameraPosition(const glm::vec3 &position);
+      // Where the camera was in the last frame drawn, for anything that only wants to add lines near it
+      glm::vec3 getCameraPosition() const;
+      uint64_t getDroppedLineCount() const;
+      void destroy();
+
+    private:
+
+      struct InFlight {
+        uint32_t frame;
+        uint32_t end; // Where the frame's lines ended, which is where the space in use starts once it's done
+      };
+
+      Common *ctxt;
+      PipelineRepository *pipelineRepo;
+      VkBuffer buffer = VK_NULL_HANDLE;
+      Allocation memory = {};
+      Vertex *vertices = nullptr;
+      uint32_t head = 0;       // Where the next line goes
+      uint32_t tail = 0;       // Where the space in use by frames in flight starts, or head if there is none
+      uint32_t batchStart = 0; // Where the lines added since the last frame drawn start
+      uint32_t wrapEnd = 0;    // If those lines carry on from the start of the ring, where they left off at the end
+      bool wrapped = false;
+      std::deque<InFlight> inFlight;
+      glm::vec3 cameraPosition = glm::vec3(0.f);
+      uint64_t droppedLines = 0;
+
+      Vertex *reserve(uint32_t count);
+  };
+
+}
@@ -0,0 +1,579 @@
+
+#include <algorithm>
+#include <cstring>
+#include "vkcGpuScene.hpp"
+#include "vkcUboPageMgr.hpp"
+
+namespace at3::vkc {
+
+  static const uint32_t groupSize = 64; // local_size_x of the resolveTransforms and cullInstances shaders
+  static const uint32_t pyramidGroupSize = 8; // local_size_x and local_size_y of the depthPyramid shader
+
+  GpuScene::GpuScene(Common &ctxt, PipelineRepository &pipelineRepo) : ctxt(&ctxt), pipelineRepo(&pipelineRepo) {
+    // One set per frame for the compute passes, one for the indirect mesh pipeline, and one per depth pyramid level
+    VkDescriptorPoolSize poolSizes[3] = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = maxFrames * (GPU_SCENE_BINDING_COUNT - 1) + 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = maxFrames + maxPyramidLevels;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[2].descriptorCount = maxPyramidLevels;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 3;
+    poolInfo.pPoolSizes = poolSizes;
+    poolInfo.maxSets = maxFrames + 1 + maxPyramidLevels;
+    VkResult res = vkCreateDescriptorPool(ctxt.device, &poolInfo, nullptr, &descPool);
+    AT3_ASSERT(res == VK_SUCCESS, "Error creating GPU scene descriptor pool");
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &pipelineRepo.at(MESH_INDIRECT).descSetLayouts[0];
+    res = vkAllocateDescriptorSets(ctxt.device, &allocInfo, &instanceDescSet);
+    AT3_ASSERT(res == VK_SUCCESS, "Error allocating GPU scene instance descriptor set");
+
+    std::vector<VkDescriptorSetLayout> pyramidLayouts(maxPyramidLevels,
+                                                      pipelineRepo.at(BUILD_DEPTH_PYRAMID).descSetLayouts[0]);
+    allocInfo.descriptorSetCount = maxPyramidLevels;
+    allocInfo.pSetLayouts = pyramidLayouts.data();
+    res = vkAllocateDescriptorSets(ctxt.device, &allocInfo, pyramidDescSets);
+    AT3_ASSERT(res == VK_SUCCESS, "Error allocating depth pyramid descriptor sets");
+
+    // Only ever read with texelFetch, so filtering doesn't matter
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = (float) maxPyramidLevels;
+    res = vkCreateSampler(ctxt.device, &samplerInfo, nullptr, &pyramidSampler);
+    AT3_ASSERT(res == VK_SUCCESS, "Error creating depth pyramid sampler");
+  }
+
+  void GpuScene::markAllDirty() {
+    allDirty = true;
+    dirtyNodes.clear();
+  }
+
+  void GpuScene::markNodeDirty(uint32_t node) {
+    if ( ! allDirty) {
+      dirtyNodes.push_back(node);
+    }
+  }
+
+  VkDeviceSize GpuScene::getRequiredSize(GpuSceneBinding binding) {
+    switch (binding) {
+      case GPU_SCENE_NODES: return nodes.size() * sizeof(Node);
+      case GPU_SCENE_ABS_TRANSFORMS: return nodes.size() * sizeof(glm::mat4);
+      case GPU_SCENE_MESHES: return meshes.size() * sizeof(Mesh);
+      case GPU_SCENE_LODS: return lods.size() * sizeof(Lod);
+      case GPU_SCENE_DRAWS: return draws.size() * sizeof(Draw);
+      case GPU_SCENE_DRAW_COMMANDS: return 2 * draws.size() * sizeof(VkDrawIndexedIndirectCommand); // One per phase
+      case GPU_SCENE_INSTANCES: return draws.size() * sizeof(Instance);
+      case GPU_SCENE_VISIBILITY: return draws.size() * sizeof(uint32_t);
+      default: AT3_ASSERT(0, "Invalid GPU scene buffer"); return 0;
+    }
+  }
+
+  /*
+   * Make sure that every device-local buffer can hold the tables, growing them to the next power of two if not. Growing
+   * waits for the GPU to be idle and throws away the contents of all of them, so everything must be uploaded again.
+   * Returns whether anything grew.
+   */
+  bool GpuScene::reserveBuffers() {
+    bool grew = false;
+    for (uint32_t i = 0; i < GPU_SCENE_TEXTURE_DETAIL; ++i) {
+      VkDeviceSize required = std::max(getRequiredSize((GpuSceneBinding) i), VkDeviceSize(256));
+      if (buffers[i].size >= required) { continue; }
+      if ( ! grew) {
+        vkDeviceWaitIdle(ctxt->device);
+        grew = true;
+      }
+      destroyBuffer(buffers[i]);
+      VkDeviceSize size = 256;
+      while (size < required) { size *= 2; }
+      VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+      if (i == GPU_SCENE_DRAW_COMMANDS) {
+        usage |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+      }
+      createBuffer(buffers[i].buffer, buffers[i].memory, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, *ctxt,
+                   AllocationCategory::INSTANCE_DATA);
+      buffers[i].size = size;
+    }
+    if (grew) {
+      markAllDirty();
+      for (auto &frame : frames) {
+        writeFrameDescriptorSet(frame);
+      }
+      writeInstanceDescriptorSet();
+    }
+    return grew;
+  }
+
+  /*
+   * A persistently mapped buffer that both the host and the GPU can see.
+   */
+  void GpuScene::createHostBuffer(Buffer &outBuffer, void **outMap, VkDeviceSize size, VkBufferUsageFlags usage) {
+    createBuffer(outBuffer.buffer, outBuffer.memory, size, usage,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, *ctxt,
+                 AllocationCategory::STAGING);
+    outBuffer.size = size;
+    vkMapMemory(ctxt->device, outBuffer.memory.handle, outBuffer.memory.offset, size, 0, outMap);
+    memset(*outMap, 0, size);
+  }
+
+  void GpuScene::destroyHostBuffer(Buffer &buffer) {
+    if ( ! buffer.size) { return; }
+    vkUnmapMemory(ctxt->device, buffer.memory.handle);
+    destroyBuffer(buffer);
+  }
+
+  void GpuScene::createFrame() {
+    AT3_ASSERT(frames.size() < maxFrames, "Too many frames in flight for the GPU scene");
+    Frame &frame = frames.emplace_back();
+
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    createHostBuffer(frame.textureDetail, (void **) &frame.textureDetailMap,
+                     MeshInstanceIndices::maxTextures * sizeof(uint32_t), usage);
+    createHostBuffer(frame.view, (void **) &frame.viewMap, sizeof(CullParams), usage);
+    createHostBuffer(frame.cullStats, (void **) &frame.cullStatsMap, sizeof(CullStats), usage);
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &pipelineRepo->at(RESOLVE_TRANSFORMS).descSetLayouts[0];
+    VkResult res = vkAllocateDescriptorSets(ctxt->device, &allocInfo, &frame.descSet);
+    AT3_ASSERT(res == VK_SUCCESS, "Error allocating GPU scene descriptor set");
+  }
+
+  /*
+   * Point a frame's set at the current buffers and depth pyramid. The frame must not be in use by the GPU.
+   */
+  void GpuScene::writeFrameDescriptorSet(Frame &frame) {
+    VkDescriptorBufferInfo bufferInfos[GPU_SCENE_BINDING_COUNT];
+    VkWriteDescriptorSet writes[GPU_SCENE_BINDING_COUNT];
+    for (uint32_t i = 0; i < GPU_SCENE_DEPTH_PYRAMID; ++i) {
+      switch (i) {
+        case GPU_SCENE_TEXTURE_DETAIL: bufferInfos[i].buffer = frame.textureDetail.buffer; break;
+        case GPU_SCENE_VIEW: bufferInfos[i].buffer = frame.view.buffer; break;
+        case GPU_SCENE_CULL_STATS: bufferInfos[i].buffer = frame.cullStats.buffer; break;
+        default: bufferInfos[i].buffer = buffers[i].buffer; break;
+      }
+      bufferInfos[i].offset = 0;
+      bufferInfos[i].range = VK_WHOLE_SIZE;
+
+      writes[i] = {};
+      writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[i].dstSet = frame.descSet;
+      writes[i].dstBinding = i;
+      writes[i].descriptorCount = 1;
+      writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    VkDescriptorImageInfo pyramidInfo = {};
+    pyramidInfo.sampler = pyramidSampler;
+    pyramidInfo.imageView = pyramid.view;
+    pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet &pyramidWrite = writes[GPU_SCENE_DEPTH_PYRAMID];
+    pyramidWrite = {};
+    pyramidWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    pyramidWrite.dstSet = frame.descSet;
+    pyramidWrite.dstBinding = GPU_SCENE_DEPTH_PYRAMID;
+    pyramidWrite.descriptorCount = 1;
+    pyramidWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    pyramidWrite.pImageInfo = &pyramidInfo;
+
+    vkUpdateDescriptorSets(ctxt->device, GPU_SCENE_BINDING_COUNT, writes, 0, nullptr);
+  }
+
+  /*
+   * Point the instance set at the current instance buffer. The GPU must be idle.
+   */
+  void GpuScene::writeInstanceDescriptorSet() {
+    VkDescriptorBufferInfo bufferInfo = {};
+    bufferInfo.buffer = buffers[GPU_SCENE_INSTANCES].buffer;
+    bufferInfo.offset = 0;
+    bufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = instanceDescSet;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(ctxt->device, 1, &write, 0, nullptr);
+  }
+
+  void GpuScene::setDepthBuffer(VkImage image, VkImageView view, VkExtent2D extent) {
+    destroyPyramid();
+    pyramid.depthImage = image;
+    pyramid.depthExtent = extent;
+
+    // Halve the size until both sides are down to one texel
+    VkExtent2D size = {std::max(extent.width / 2, 1u), std::max(extent.height / 2, 1u)};
+    pyramid.levelCount = 1;
+    while ((size.width >> pyramid.levelCount) || (size.height >> pyramid.levelCount)) {
+      ++pyramid.levelCount;
+    }
+    AT3_ASSERT(pyramid.levelCount <= maxPyramidLevels, "Depth buffer is too large for the depth pyramid");
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.extent = {size.width, size.height, 1};
+    imageInfo.mipLevels = pyramid.levelCount;
+    imageInfo.arrayLayers = 1;
+    imageInfo.format = VK_FORMAT_R32_SFLOAT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageInfo.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkResult res = vkCreateImage(ctxt->device, &imageInfo, nullptr, &pyramid.image);
+    AT3_ASSERT(res == VK_SUCCESS, "Error creating depth pyramid image");
+
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(ctxt->device, pyramid.image, &memRequirements);
+    AllocationCreateInfo allocInfo = {};
+    allocInfo.size = memRequirements.size;
+    allocInfo.alignment = memRequirements.alignment;
+    allocInfo.optimalTiling = true;
+    allocInfo.memoryTypeIndex = getMemoryType(ctxt->gpu.device, memRequirements.memoryTypeBits,
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    allocInfo.usage = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    allocInfo.category = AllocationCategory::RENDER_TARGET;
+    ctxt->allocator.alloc(pyramid.memory, allocInfo);
+    vkBindImageMemory(ctxt->device, pyramid.image, pyramid.memory.handle, pyramid.memory.offset);
+
+    VkImageViewCreateInfo viewInfo = {};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.image = pyramid.image;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = VK_FORMAT_R32_SFLOAT;
+    viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid.levelCount, 0, 1};
+    res = vkCreateImageView(ctxt->device, &viewInfo, nullptr, &pyramid.view);
+    AT3_ASSERT(res == VK_SUCCESS, "Error creating depth pyramid image view");
+    for (uint32_t level = 0; level < pyramid.levelCount; ++level) {
+      viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+      res = vkCreateImageView(ctxt->device, &viewInfo, nullptr, &pyramid.levelViews[level]);
+      AT3_ASSERT(res == VK_SUCCESS, "Error creating depth pyramid level image view");
+    }
+
+    // Each level reads the one before it, and the first one reads the depth buffer
+    std::vector<VkDescriptorImageInfo> imageInfos(2 * pyramid.levelCount);
+    std::vector<VkWriteDescriptorSet> writes(2 * pyramid.levelCount);
+    for (uint32_t level = 0; level < pyramid.levelCount; ++level) {
+      VkDescriptorImageInfo &srcInfo = imageInfos[2 * level];
+      srcInfo.sampler = pyramidSampler;
+      srcInfo.imageView = level ? pyramid.levelViews[level - 1] : view;
+      srcInfo.imageLayout = level ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+      VkDescriptorImageInfo &dstInfo = imageInfos[2 * level + 1];
+      dstInfo.sampler = VK_NULL_HANDLE;
+      dstInfo.imageView = pyramid.levelViews[level];
+      dstInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+      for (uint32_t binding = 0; binding < 2; ++binding) {
+        VkWriteDescriptorSet &write = writes[2 * level + binding];
+        write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = pyramidDescSets[level];
+        write.dstBinding = binding;
+        write.descriptorCount = 1;
+        write.descriptorType = binding ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo = &imageInfos[2 * level + binding];
+      }
+    }
+    vkUpdateDescriptorSets(ctxt->device, (uint32_t) writes.size(), writes.data(), 0, nullptr);
+
+    if (buffers[0].size) { // Otherwise they're written once the buffers are created
+      for (auto &frame : frames) {
+        writeFrameDescriptorSet(frame);
+      }
+    }
+  }
+
+  void GpuScene::destroyPyramid() {
+    if ( ! pyramid.image) { return; }
+    for (uint32_t level = 0; level < pyramid.levelCount; ++level) {
+      vkDestroyImageView(ctxt->device, pyramid.levelViews[level], nullptr);
+    }
+    vkDestroyImageView(ctxt->device, pyramid.view, nullptr);
+    vkDestroyImage(ctxt->device, pyramid.image, nullptr);
+    ctxt->allocator.free(pyramid.memory);
+    pyramid = DepthPyramid();
+  }
+
+  void GpuScene::record(VkCommandBuffer commandBuffer, uint32_t frameIndex, CullParams params,
+                        bool occlusionCulling) {
+    AT3_ASSERT(pyramid.image, "The GPU scene has no depth buffer to cull against");
+    while (frames.size() <= frameIndex) {
+      createFrame();
+      if (buffers[0].size) { // Otherwise it's written once the buffers are created
+        writeFrameDescriptorSet(frames.back());
+      }
+    }
+    Frame &frame = frames[frameIndex];
+
+    if (draws.empty()) {
+      memset(frame.textureDetailMap, 0, frame.textureDetail.size);
+      memset(frame.cullStatsMap, 0, frame.cullStats.size);
+      return;
+    }
+
+    reserveBuffers();
+    bool resetVisibility = allDirty; // The draws may have been reordered, so nothing is known to be visible
+
+    // Gather the uploads: every table if anything but the nodes changed, otherwise runs of consecutive dirty nodes
+    struct Upload {
+      GpuSceneBinding binding;
+      const void *data;
+      VkBufferCopy region;
+    };
+    std::vector<Upload> uploads;
+    VkDeviceSize stagingSize = 0;
+    auto addUpload = [&](GpuSceneBinding binding, const void *data, VkDeviceSize dstOffset, VkDeviceSize size) {
+      if ( ! size) { return; }
+      uploads.push_back({binding, data, {stagingSize, dstOffset, size}});
+      stagingSize += size;
+    };
+    if (allDirty) {
+      addUpload(GPU_SCENE_NODES, nodes.data(), 0, nodes.size() * sizeof(Node));
+      addUpload(GPU_SCENE_MESHES, meshes.data(), 0, meshes.size() * sizeof(Mesh));
+      addUpload(GPU_SCENE_LODS, lods.data(), 0, lods.size() * sizeof(Lod));
+      addUpload(GPU_SCENE_DRAWS, draws.data(), 0, draws.size() * sizeof(Draw));
+    } else {
+      std::sort(dirtyNodes.begin(), dirtyNodes.end());
+      dirtyNodes.erase(std::unique(dirtyNodes.begin(), dirtyNodes.end()), dirtyNodes.end());
+      for (size_t i = 0; i < dirtyNodes.size();) {
+        size_t end = i + 1;
+        while (end < dirtyNodes.size() && dirtyNodes[end] == dirtyNodes[end - 1] + 1) { ++end; }
+        addUpload(GPU_SCENE_NODES, &nodes[dirtyNodes[i]], dirtyNodes[i] * sizeof(Node), (end - i) * sizeof(Node));
+        i = end;
+      }
+    }
+    allDirty = false;
+    dirtyNodes.clear();
+
+    // This frame's staging buffer is not in use, since the GPU is done with the last frame that had this index
+    if (frame.staging.size < stagingSize) {
+      VkDeviceSize size = std::max(stagingSize, frame.staging.size * 2);
+      destroyHostBuffer(frame.staging);
+      createHostBuffer(frame.staging, (void **) &frame.stagingMap, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    }
+    for (auto &upload : uploads) {
+      memcpy(frame.stagingMap + upload.region.srcOffset, upload.data, upload.region.size);
+    }
+
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+    // Earlier frames may still be reading the buffers that are about to be written
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = 0;
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+                         | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    std::vector<VkBufferCopy> regions;
+    for (uint32_t i = 0; i < GPU_SCENE_TEXTURE_DETAIL; ++i) {
+      regions.clear();
+      for (auto &upload : uploads) {
+        if (upload.binding == i) {
+          regions.push_back(upload.region);
+        }
+      }
+      if ( ! regions.empty()) {
+        vkCmdCopyBuffer(commandBuffer, frame.staging.buffer, buffers[i].buffer, (uint32_t) regions.size(),
+                        regions.data());
+      }
+    }
+    vkCmdFillBuffer(commandBuffer, frame.textureDetail.buffer, 0, VK_WHOLE_SIZE, 0);
+    vkCmdFillBuffer(commandBuffer, frame.cullStats.buffer, 0, VK_WHOLE_SIZE, 0);
+    if (resetVisibility) {
+      vkCmdFillBuffer(commandBuffer, buffers[GPU_SCENE_VISIBILITY].buffer, 0, VK_WHOLE_SIZE, 0);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    // Resolve the absolute transforms one level at a time, since each level reads the one above it
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineRepo->at(RESOLVE_TRANSFORMS).handle);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineRepo->at(RESOLVE_TRANSFORMS).layout,
+                            0, 1, &frame.descSet, 0, nullptr);
+    for (size_t level = 0; level + 1 < levelStarts.size(); ++level) {
+      ResolveParams resolveParams = {levelStarts[level], levelStarts[level + 1] - levelStarts[level]};
+      vkCmdPushConstants(commandBuffer, pipelineRepo->at(RESOLVE_TRANSFORMS).layout, VK_SHADER_STAGE_COMPUTE_BIT,
+                         0, sizeof(resolveParams), &resolveParams);
+      vkCmdDispatch(commandBuffer, (resolveParams.count + groupSize - 1) / groupSize, 1, 1);
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // Cull, pick LODs, and write the draw commands and instance data. The set layouts match, so the set stays bound.
+    // The view goes straight into this frame's buffer, which the GPU is not using.
+    params.drawCount = (uint32_t) draws.size();
+    params.depthSize = glm::vec2(pyramid.depthExtent.width, pyramid.depthExtent.height);
+    *frame.viewMap = params;
+    CullPhase phase = occlusionCulling ? CULL_FIRST_PHASE : CULL_SINGLE_PHASE;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineRepo->at(CULL_INSTANCES).handle);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineRepo->at(CULL_INSTANCES).layout,
+                            0, 1, &frame.descSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineRepo->at(CULL_INSTANCES).layout, VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, sizeof(phase), &phase);
+    vkCmdDispatch(commandBuffer, (params.drawCount + groupSize - 1) / groupSize, 1, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+                         | VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+  }
+
+  void GpuScene::recordOcclusionCulling(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    AT3_ASSERT(frameIndex < frames.size() && ! draws.empty(), "No first phase to follow");
+    Frame &frame = frames[frameIndex];
+
+    // The first phase's depth becomes readable, the pyramid's old contents are thrown away, and the first phase's color
+    // is finished before the second render pass carries on with it
+    VkMemoryBarrier colorBarrier = {};
+    colorBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    colorBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    colorBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    VkImageMemoryBarrier imageBarriers[2] = {};
+    imageBarriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    imageBarriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    imageBarriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarriers[0].image = pyramid.depthImage;
+    imageBarriers[0].subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1};
+
+    imageBarriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarriers[1].srcAccessMask = 0;
+    imageBarriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    imageBarriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    imageBarriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    imageBarriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarriers[1].image = pyramid.image;
+    imageBarriers[1].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramid.levelCount, 0, 1};
+
+    vkCmdPipelineBarrier(commandBuffer,
+                         VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT
+                         | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                         0, 1, &colorBarrier, 0, nullptr, 2, imageBarriers);
+
+    // Build the pyramid one level at a time, since each level reads the one before it
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineRepo->at(BUILD_DEPTH_PYRAMID).handle);
+    DepthPyramidParams pyramidParams = {};
+    pyramidParams.dstSize = glm::uvec2(pyramid.depthExtent.width, pyramid.depthExtent.height);
+    for (uint32_t level = 0; level < pyramid.levelCount; ++level) {
+      pyramidParams.srcSize = pyramidParams.dstSize;
+      pyramidParams.dstSize = glm::max(pyramidParams.srcSize / 2u, glm::uvec2(1));
+      vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                              pipelineRepo->at(BUILD_DEPTH_PYRAMID).layout, 0, 1, &pyramidDescSets[level], 0, nullptr);
+      vkCmdPushConstants(commandBuffer, pipelineRepo->at(BUILD_DEPTH_PYRAMID).layout, VK_SHADER_STAGE_COMPUTE_BIT,
+                         0, sizeof(pyramidParams), &pyramidParams);
+      vkCmdDispatch(commandBuffer, (pyramidParams.dstSize.x + pyramidGroupSize - 1) / pyramidGroupSize,
+                    (pyramidParams.dstSize.y + pyramidGroupSize - 1) / pyramidGroupSize, 1);
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           0, 1, &barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // Test everything in the frustum against the pyramid, and write the second phase's draw commands
+    CullPhase phase = CULL_SECOND_PHASE;
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineRepo->at(CULL_INSTANCES).handle);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineRepo->at(CULL_INSTANCES).layout,
+                            0, 1, &frame.descSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineRepo->at(CULL_INSTANCES).layout, VK_SHADER_STAGE_COMPUTE_BIT,
+                       0, sizeof(phase), &phase);
+    vkCmdDispatch(commandBuffer, ((uint32_t) draws.size() + groupSize - 1) / groupSize, 1, 1);
+
+    // The depth buffer goes back to being an attachment for the second render pass
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+    imageBarriers[0].srcAccessMask = 0;
+    imageBarriers[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+                                     | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    imageBarriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    imageBarriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT
+                         | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 1, &barrier, 0, nullptr, 1, imageBarriers);
+  }
+
+  const uint32_t *GpuScene::getTextureDetail(uint32_t frame) {
+    return frame < frames.size() ? frames[frame].textureDetailMap : nullptr;
+  }
+
+  const CullStats *GpuScene::getCullStats(uint32_t frame) {
+    return frame < frames.size() ? frames[frame].cullStatsMap : nullptr;
+  }
+
+  VkBuffer GpuScene::getDrawCommandBuffer() {
+    return buffers[GPU_SCENE_DRAW_COMMANDS].buffer;
+  }
+
+  VkDeviceSize GpuScene::getSecondPhaseCommandOffset() {
+    return draws.size() * sizeof(VkDrawIndexedIndirectCommand);
+  }
+
+  VkDescriptorSet GpuScene::getInstanceDescriptorSet() {
+    return instanceDescSet;
+  }
+
+  void GpuScene::destroyBuffer(Buffer &buffer) {
+    if ( ! buffer.size) { return; }
+    vkDestroyBuffer(ctxt->device, buffer.buffer, nullptr);
+    ctxt->allocator.free(buffer.memory);
+    buffer = Buffer();
+  }
+
+  /*
+   * Only called when the GPU is idle.
+   */
+  void GpuScene::destroy() {
+    for (auto &frame : frames) {
+      destroyHostBuffer(frame.staging);
+      destroyHostBuffer(frame.textureDetail);
+      destroyHostBuffer(frame.view);
+      destroyHostBuffer(frame.cullStats);
+    }
+    frames.clear();
+    for (auto &buffer : buffers) {
+      destroyBuffer(buffer);
+    }
+    destroyPyramid();
+    vkDestroySampler(ctxt->device, pyramidSampler, nullptr);
+    vkDestroyDescriptorPool(ctxt->device, descPool, nullptr); // Frees the sets too
+    descPool = VK_NULL_HANDLE;
+  }
+
+}
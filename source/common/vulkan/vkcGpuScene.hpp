@@ -0,0 +1,170 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vkcPipelines.hpp"
+#include "math.hpp"
+
+namespace at3::vkc {
+
+  /*
+   * The scene as GPU-driven rendering sees it. The owner fills in the tables below: the scene graph nodes that mesh
+   * instances hang from, with their local transforms, and one draw per mesh instance. Each frame, record uploads
+   * whatever has changed, resolves the absolute transforms of the nodes one level of the hierarchy at a time, and then
+   * culls every draw against the view frustum, picks its LOD, and writes its indirect draw command and instance data.
+   * The draws of each mesh are contiguous, so each mesh takes one indirect draw call, and the command of a culled draw
+   * is left in place with an instance count of zero.
+   *
+   * The nodes must be sorted by their depth in the hierarchy, so that each level is contiguous and comes after the one
+   * above it. levelStarts holds the first node of each level, followed by the node count.
+   *
+   * Changing the tables requires markAllDirty, which uploads all of them. Changing the local transform, parent or flags
+   * of a node in place only requires markNodeDirty, which uploads just that node.
+   *
+   * The culling pass also records how large each texture appears on screen, for texture streaming, and how many draws
+   * it culled. Each frame slot has its own copy of both, readable through getTextureDetail and getCullStats once that
+   * frame has finished.
+   *
+   * With occlusion culling, a frame is drawn in two phases, each with its own range of draw commands. The commands
+   * that record writes draw only what was visible last frame. Once those have been drawn, recordOcclusionCulling
+   * builds a depth pyramid from the depth buffer, tests everything else in the frustum against it, and writes the
+   * commands of the second phase, which draw whatever has become visible since. The depth pyramid follows the depth
+   * buffer given to setDepthBuffer, which must be called before the first frame and whenever the depth buffer changes.
+   */
+  class GpuScene {
+
+    public:
+
+      static constexpr uint32_t noParent = UINT32_MAX;
+      static constexpr uint32_t mat3OverrideFlag = 1; // The node only inherits its parent's position
+      static constexpr uint32_t maxFrames = 8;
+      static constexpr uint32_t maxPyramidLevels = 16;
+
+      struct Node {
+        glm::mat4 local;
+        uint32_t parent;
+        uint32_t flags;
+        uint32_t pad[2];
+      };
+      struct Mesh {
+        glm::mat4 dequantization;
+        glm::vec4 sphere; // bounding sphere in object space
+        uint32_t firstLod;
+        uint32_t lodCount;
+        uint32_t pad[2];
+      };
+      struct Lod {
+        uint32_t indexCount;
+        uint32_t firstIndex;
+        float error;
+        uint32_t pad;
+      };
+      struct Draw {
+        uint32_t node;
+        uint32_t mesh;
+        uint32_t texture;
+        uint32_t pad;
+      };
+
+      std::vector<Node> nodes;
+      std::vector<uint32_t> levelStarts;
+      std::vector<Mesh> meshes;
+      std::vector<Lod> lods;
+      std::vector<Draw> draws;
+
+      GpuScene(Common &ctxt, PipelineRepository &pipelineRepo);
+      void markAllDirty();
+      void markNodeDirty(uint32_t node);
+      /*
+       * Build the depth pyramid from this depth buffer from now on. The GPU must be idle.
+       */
+      void setDepthBuffer(VkImage image, VkImageView view, VkExtent2D extent);
+      /*
+       * Record the uploads and compute dispatches for a frame, outside of any render pass. The frame index picks which
+       * staging and readback buffers to use, and must not be used again until the GPU is done with this frame.
+       * The draw count and depth size in params are filled in here. With occlusionCulling, this is the first phase.
+       */
+      void record(VkCommandBuffer commandBuffer, uint32_t frame, CullParams params, bool occlusionCulling);
+      /*
+       * Record the second phase of occlusion culling, between the render pass that draws the first phase's commands and
+       * the one that draws the second's. Leaves the depth buffer ready for the second render pass. Only for frames
+       * recorded with occlusionCulling and at least one draw.
+       */
+      void recordOcclusionCulling(VkCommandBuffer commandBuffer, uint32_t frame);
+      /*
+       * The most pixels that each texture covered in the last frame recorded with this index, or nullptr if there was
+       * none. Only valid once the GPU is done with that frame.
+       */
+      const uint32_t *getTextureDetail(uint32_t frame);
+      /*
+       * What the culling passes threw away and kept in the last frame recorded with this index, or nullptr if there
+       * was none. Only valid once the GPU is done with that frame.
+       */
+      const CullStats *getCullStats(uint32_t frame);
+      VkBuffer getDrawCommandBuffer();
+      VkDeviceSize getSecondPhaseCommandOffset();
+      VkDescriptorSet getInstanceDescriptorSet();
+      void destroy();
+
+    private:
+
+      struct Instance { // Written by the culling pass, read by the meshIndirect vertex shader
+        glm::mat4 m;
+        uint32_t texture;
+        uint32_t pad[3];
+      };
+
+      struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation memory = {};
+        VkDeviceSize size = 0;
+      };
+
+      struct Frame {
+        Buffer staging;
+        uint8_t *stagingMap = nullptr;
+        Buffer textureDetail;
+        uint32_t *textureDetailMap = nullptr;
+        Buffer view;
+        CullParams *viewMap = nullptr;
+        Buffer cullStats;
+        CullStats *cullStatsMap = nullptr;
+        VkDescriptorSet descSet = VK_NULL_HANDLE;
+      };
+
+      // Each level is half the size of the one before it, starting from half the size of the depth buffer
+      struct DepthPyramid {
+        VkImage image = VK_NULL_HANDLE;
+        Allocation memory = {};
+        VkImageView view = VK_NULL_HANDLE; // Every level, for the culling pass
+        VkImageView levelViews[maxPyramidLevels] = {};
+        uint32_t levelCount = 0;
+        VkImage depthImage = VK_NULL_HANDLE;
+        VkExtent2D depthExtent = {};
+      };
+
+      Common *ctxt;
+      PipelineRepository *pipelineRepo;
+      VkDescriptorPool descPool = VK_NULL_HANDLE;
+      VkDescriptorSet instanceDescSet = VK_NULL_HANDLE;
+      Buffer buffers[GPU_SCENE_TEXTURE_DETAIL]; // Device-local, indexed by binding
+      std::vector<Frame> frames;
+      DepthPyramid pyramid;
+      VkSampler pyramidSampler = VK_NULL_HANDLE;
+      VkDescriptorSet pyramidDescSets[maxPyramidLevels] = {}; // Each builds one level from the one before it
+      std::vector<uint32_t> dirtyNodes;
+      bool allDirty = true;
+
+      VkDeviceSize getRequiredSize(GpuSceneBinding binding);
+      bool reserveBuffers();
+      void createFrame();
+      void createHostBuffer(Buffer &outBuffer, void **outMap, VkDeviceSize size, VkBufferUsageFlags usage);
+      void destroyHostBuffer(Buffer &buffer);
+      void destroyPyramid();
+      void writeFrameDescriptorSet(Frame &frame);
+      void writeInstanceDescriptorSet();
+      void destroyBuffer(Buffer &buffer);
+  };
+
+}
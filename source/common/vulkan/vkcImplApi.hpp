@@ -16,6 +16,9 @@ VulkanContext<EcsInterface>::VulkanContext(VulkanContextCreateInfo <EcsInterface
 
   // Subscribe to window resize events
   sub_windowResize = SUBSCRIBE_TOPIC("window_resized", reInitRendering);
+  sub_memoryStats = SUBSCRIBE_TOPIC("key_down_f4", dumpDeviceMemoryStats);
+  sub_cullStats = SUBSCRIBE_TOPIC("key_down_f5", dumpCullStats);
+  sub_wireframe = SUBSCRIBE_TOPIC("key_down_f6", toggleWireframe);
 
   // Store the window and entity-component-system pointers.
   common.window = info.window;
@@ -47,6 +50,7 @@ VulkanContext<EcsInterface>::VulkanContext(VulkanContextCreateInfo <EcsInterface
   createVkSemaphore(common.imageAvailableSemaphore);
   createVkSemaphore(common.renderFinishedSemaphore);
   common.frameFences.resize(common.swapChain.imageViews.size());
+  common.frameSerials.resize(common.frameFences.size(), 0);
   for (uint32_t i = 0; i < common.frameFences.size(); ++i) {
     createFence(common.frameFences[i]);
   }
@@ -61,11 +65,14 @@ VulkanContext<EcsInterface>::VulkanContext(VulkanContextCreateInfo <EcsInterface
   texOpInfo.physicalMemProps = common.gpu.memProps;
   texOpInfo.samplerAnisotropy = common.gpu.features.samplerAnisotropy;
   texOpInfo.maxSamplerAnisotropy = common.gpu.deviceProps.limits.maxSamplerAnisotropy;
+  texOpInfo.context = &common;
   textureRepo = std::make_unique<TextureRepository>("./assets/textures", texOpInfo);
 
   // Create the pipelines.
   // The number of textures that got loaded is needed for specialization constants.
   pipelineRepo = std::make_unique<PipelineRepository>(common, textureRepo->getDescriptorImageInfoArrayCount());
+  lightGrid = std::make_unique<LightGrid>(common, *pipelineRepo);
+  debugLines = std::make_unique<DebugLines>(common, *pipelineRepo);
 
   // Load the meshes into a repository
   // TODO: put this crap in a proper repository like VkcTextureRepository does, do it when upgrading to gltf
@@ -81,14 +88,12 @@ VulkanContext<EcsInterface>::VulkanContext(VulkanContextCreateInfo <EcsInterface
     resources.emplace_back(loadMeshFromData(verts, indices));
     meshRepo.emplace("debug", resources);
   }
+  // Meshes are only found here. Each one is loaded the first time something asks for it (see ensureMeshResident).
   for (auto &path : fs::recursive_directory_iterator("./assets/models")) {
     if (getFileExtOnly(path) == ".dae") {
-      printf("\n%s:\nLoading Mesh: %s\n", getFileNameOnly(path).c_str(), getFileNameRelative(path).c_str());
-      bool useAsTerrain = getFileNameOnly(path).substr(0, 7) == "terrain";
-      if (useAsTerrain) {
-        printf("Storing triangles of %s for use as a static terrain.\n", getFileNameOnly(path).c_str());
-      }
-      meshRepo.emplace(getFileNameOnly(path), loadMeshFromFile(getFileNameRelative(path).c_str(), true, useAsTerrain));
+      MeshSource &source = meshSources[getFileNameOnly(path)];
+      source.path = getFileNameRelative(path);
+      source.storeTriangles = getFileNameOnly(path).substr(0, 7) == "terrain";
     }
   }
   printf("\n");
@@ -103,7 +108,10 @@ VulkanContext<EcsInterface>::VulkanContext(VulkanContextCreateInfo <EcsInterface
 
 template<typename EcsInterface>
 VulkanContext<EcsInterface>::~VulkanContext() {
-
+  // The device itself is left for the driver to clean up, but everything the textures took from the allocator,
+  // including the staging buffer they keep mapped, is given back
+  vkDeviceWaitIdle(common.device);
+  textureRepo->destroy();
 }
 
 template<typename EcsInterface>
@@ -114,18 +122,59 @@ void VulkanContext<EcsInterface>::reInitRendering(void *nothing) {
   storeWindowSize();
   createSwapchainForSurface();
   createWindowSizeDependents();
-  pipelineRepo->reinit(common, textureRepo->getDescriptorImageInfoArrayCount());
+  pipelineRepo->reinit(common);
+}
+
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::dumpDeviceMemoryStats(void *nothing) {
+  printDeviceMemoryStats();
+}
+
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::dumpCullStats(void *nothing) {
+  if ( ! gpuScene) {
+    printf("GPU culling is off (see graphics_vk_gpu_driven_b)\n");
+    return;
+  }
+  uint32_t total = gpuCullStats.frustumCulled + gpuCullStats.occlusionCulled + gpuCullStats.drawnFirstPhase
+                   + gpuCullStats.drawnSecondPhase;
+  printf("GPU culling: %u draws, %u outside the frustum, %u occluded, %u drawn in the first phase, %u in the second\n",
+         total, gpuCullStats.frustumCulled, gpuCullStats.occlusionCulled, gpuCullStats.drawnFirstPhase,
+         gpuCullStats.drawnSecondPhase);
+}
+
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::toggleWireframe(void *nothing) {
+  if ( ! pipelineRepo->at(MESH).wireframeHandle) {
+    printf("The wireframe view needs geometry shaders, which this device doesn't support\n");
+    return;
+  }
+  settings::graphics::vulkan::wireframe = ! settings::graphics::vulkan::wireframe;
 }
 
 template<typename EcsInterface>
 void VulkanContext<EcsInterface>::tick(const glm::mat4 &viewMatrix) {
+  updateResidency();
+  compactUboPages();
+  defragmentDeviceMemory();
   render(dataStore.get(), viewMatrix, meshRepo, ecs);
 }
 
 template<typename EcsInterface>
 void VulkanContext<EcsInterface>::registerMeshInstance(
     const typename EcsInterface::EcsId id, const std::string &meshFileName, const std::string &textureFileName) {
-  AT3_ASSERT(meshRepo.count(meshFileName), "No mesh file \"%s\" found\n!", meshFileName.c_str());
+  bool meshFound = ensureMeshResident(meshFileName);
+  AT3_ASSERT(meshFound, "No mesh file \"%s\" found\n!", meshFileName.c_str());
+  if (meshSources.count(meshFileName)) {
+    MeshSource &source = meshSources.at(meshFileName);
+    ++source.refCount;
+    source.lastUsed = ++meshUseCounter;
+  }
+  uint32_t texture = 0; // The first texture will be used (probably "0.ktx", alphabetically, or debug).
+  if (textureFileName.length() && textureRepo->textureExists(textureFileName)) {
+    texture = textureRepo->acquire(textureFileName);
+    residencyChanged = true;
+  }
   for (auto &mesh : meshRepo.at(meshFileName)) {
     MeshInstance<EcsInterface> instance;
     UboPageMgr::AcquireStatus didAcquire = dataStore->acquire(instance.indices);
@@ -134,43 +183,165 @@ void VulkanContext<EcsInterface>::registerMeshInstance(
       updateDescriptorSets(dataStore.get());
     }
     instance.id = id;
-    if (textureFileName.length() && textureRepo->textureExists(textureFileName)) {
-      instance.indices.setTexture(textureRepo->getTextureArrayIndex(textureFileName));
-    } else {
-      instance.indices.setTexture(0u);  // The first texture will be used (probably "0.ktx", alphabetically, or debug).
-    }
+    instance.indices.setTexture(texture);
     mesh.instances.push_back(instance);
   }
+  instanceMeshNames[id] = meshFileName;
+  gpuSceneDirty = true;
+}
+
+/*
+ * A point light at the position of an entity, which it follows from then on. Its light fades out entirely by radius.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::registerPointLight(const typename EcsInterface::EcsId id, const glm::vec3 &color,
+                                                     float radius) {
+  pointLights[id] = {color, radius};
+}
+
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::deRegisterPointLight(const typename EcsInterface::EcsId id) {
+  if ( ! pointLights.erase(id)) {
+    fprintf(stderr, "Vulkan: Attempted to de-register a point light that was never registered!\n");
+  }
+}
+
+/*
+ * The local transform, custom model transform or mat3 override of an entity was written. Only the scene nodes of the
+ * entities named here are uploaded to the GPU scene, so whatever moves an entity has to call this whenever it does.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::markTransformChanged(const typename EcsInterface::EcsId id) {
+  if (gpuScene && ! gpuSceneDirty) {
+    changedTransforms.push_back(id);
+  }
+}
+
+/*
+ * An entity joined or left the scene tree, which may re-parent scene nodes, so the GPU scene is rebuilt
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::markSceneTreeChanged() {
+  gpuSceneDirty = true;
+}
+
+template<typename EcsInterface>
+DebugLines &VulkanContext<EcsInterface>::getDebugLines() {
+  return *debugLines;
 }
 
 template<typename EcsInterface>
 void VulkanContext<EcsInterface>::deRegisterMeshInstance(const typename EcsInterface::EcsId id) {
-  fprintf(stderr, "Vulkan: De-registration of a mesh is not yet implemented!\n");
+  if ( ! instanceMeshNames.count(id)) {
+    fprintf(stderr, "Vulkan: Attempted to de-register a mesh instance that was never registered!\n");
+    return;
+  }
+  const std::string meshName = instanceMeshNames.at(id);
+  instanceMeshNames.erase(id);
+
+  uint32_t texture = 0;
+  for (auto &mesh : meshRepo.at(meshName)) {
+    for (size_t i = 0; i < mesh.instances.size(); ++i) {
+      if (mesh.instances[i].id == id) {
+        texture = mesh.instances[i].indices.getTexture();
+        dataStore->release(mesh.instances[i].indices);
+        mesh.instances[i] = mesh.instances.back();
+        mesh.instances.pop_back();
+        break;
+      }
+    }
+  }
+  if (texture) {
+    textureRepo->release(texture);
+  }
+  if (meshSources.count(meshName)) {
+    --meshSources.at(meshName).refCount;
+  }
+  residencyChanged = true;
+  gpuSceneDirty = true;
 }
 
 template<typename EcsInterface>
-std::vector<float> * VulkanContext<EcsInterface>::getMeshStoredVertices(
+std::shared_ptr<const StoredTriangles> VulkanContext<EcsInterface>::getMeshStoredTriangles(
     const std::string &meshName,
     uint32_t internalIndex /*= 0*/) {
-  if(meshRepo.count(meshName)) {
-    return meshRepo.at(meshName).at(internalIndex).storedVertices.get();
+  if(ensureMeshResident(meshName)) {
+    return meshRepo.at(meshName).at(internalIndex).storedTriangles;
   } else {
     return nullptr;
   }
 }
 
 template<typename EcsInterface>
-std::vector<uint32_t> * VulkanContext<EcsInterface>::getMeshStoredIndices(
-    const std::string &meshName,
-    uint32_t internalIndex /*= 0*/) {
-  if(meshRepo.count(meshName)) {
-    return meshRepo.at(meshName).at(internalIndex).storedIndices.get();
-  } else {
-    return nullptr;
+std::vector<TextureResidencyStats> VulkanContext<EcsInterface>::getTextureResidencyStats() {
+  return textureRepo->getResidencyStats();
+}
+
+template<typename EcsInterface>
+DeviceMemoryStats VulkanContext<EcsInterface>::getDeviceMemoryStats() {
+  DeviceMemoryStats stats;
+  common.allocator.getStats(stats.types);
+
+  const VkPhysicalDeviceMemoryProperties &memProps = common.gpu.memProps;
+  stats.heaps.resize(memProps.memoryHeapCount);
+  for (uint32_t h = 0; h < memProps.memoryHeapCount; ++h) {
+    stats.heaps[h].size = memProps.memoryHeaps[h].size;
+  }
+  for (uint32_t t = 0; t < stats.types.size(); ++t) {
+    MemoryHeapStats &heap = stats.heaps[memProps.memoryTypes[t].heapIndex];
+    heap.liveBytes += stats.types[t].liveBytes;
+    heap.reservedBytes += stats.types[t].reservedBytes;
+  }
+
+  if (common.gpu.hasMemoryBudget) { // The budget changes as other processes come and go, so it's asked for every time
+    auto getMemoryProperties2 = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR) vkGetInstanceProcAddr(
+        common.instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+    budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2KHR memProps2 = {};
+    memProps2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+    memProps2.pNext = &budget;
+    getMemoryProperties2(common.gpu.device, &memProps2);
+    for (uint32_t h = 0; h < memProps.memoryHeapCount; ++h) {
+      stats.heaps[h].hasBudget = true;
+      stats.heaps[h].budgetBytes = budget.heapBudget[h];
+      stats.heaps[h].usageBytes = budget.heapUsage[h];
+    }
   }
+  return stats;
 }
 
 template<typename EcsInterface>
-uint32_t VulkanContext<EcsInterface>::getMeshStoredVertexStride() {
-  return pipelineRepo->getVertexAttributes().vertexSize;
+void VulkanContext<EcsInterface>::printDeviceMemoryStats() {
+  DeviceMemoryStats stats = getDeviceMemoryStats();
+  const VkPhysicalDeviceMemoryProperties &memProps = common.gpu.memProps;
+  auto mib = [](VkDeviceSize bytes) { return (double) bytes / (1024.0 * 1024.0); };
+
+  printf("Device memory by type (MiB):\n");
+  printf("  type heap flags      live  reserved  high-water  blocks  allocs  fragmentation\n");
+  for (uint32_t t = 0; t < stats.types.size(); ++t) {
+    const MemoryTypeStats &type = stats.types[t];
+    if ( ! type.reservedBytes && ! type.highWaterBytes) { continue; }
+    printf("  %4u %4u 0x%03x %9.1f %9.1f %11.1f %7u %7u %14.2f\n", t, memProps.memoryTypes[t].heapIndex,
+           memProps.memoryTypes[t].propertyFlags, mib(type.liveBytes), mib(type.reservedBytes),
+           mib(type.highWaterBytes), type.blockCount, type.allocationCount, type.getFragmentation());
+    for (uint32_t c = 0; c < (uint32_t) AllocationCategory::COUNT; ++c) {
+      if ( ! type.categoryBytes[c]) { continue; }
+      printf("         %-16s %9.1f\n", getAllocationCategoryName((AllocationCategory) c), mib(type.categoryBytes[c]));
+    }
+  }
+
+  printf("Device memory by heap (MiB):\n");
+  printf("  heap      size      live  reserved    budget     usage\n");
+  for (uint32_t h = 0; h < stats.heaps.size(); ++h) {
+    const MemoryHeapStats &heap = stats.heaps[h];
+    if (heap.hasBudget) {
+      printf("  %4u %9.1f %9.1f %9.1f %9.1f %9.1f\n", h, mib(heap.size), mib(heap.liveBytes),
+             mib(heap.reservedBytes), mib(heap.budgetBytes), mib(heap.usageBytes));
+    } else {
+      printf("  %4u %9.1f %9.1f %9.1f       n/a       n/a\n", h, mib(heap.size), mib(heap.liveBytes),
+             mib(heap.reservedBytes));
+    }
+  }
+  printf("Device memory allocations: %u\n", common.allocator.numAllocs());
 }
@@ -129,6 +129,15 @@ void VulkanContext<EcsInterface>::createInstance(const char *appName) {
 
   AT3_ASSERT(allExtensionsFound, "Failed to find all required vulkan extensions");
 
+  // Not required, but needed to find out whether the device can hold textures in a bindless texture table
+  common.hasPhysicalDeviceProperties2 = false;
+  for (auto &prop : extensions) {
+    if (strcmp(prop.extensionName, VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) == 0) {
+      requiredExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+      common.hasPhysicalDeviceProperties2 = true;
+    }
+  }
+
   //create instance with all extensions
 
   VkInstanceCreateInfo inst_info;
@@ -296,6 +305,60 @@ void VulkanContext<EcsInterface>::createPhysicalDevice() {
   vkGetPhysicalDeviceProperties(outDevice, &common.gpu.deviceProps);
   printf("Max mem allocations: %i\n", common.gpu.deviceProps.limits.maxMemoryAllocationCount);
 
+  { // Find out whether textures can be kept in a bindless texture table, and whether memory budgets can be queried
+    common.gpu.maxBindlessTextures = 0;
+    common.gpu.hasMemoryBudget = false;
+
+    uint32_t extensionCount;
+    vkEnumerateDeviceExtensionProperties(outDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(outDevice, nullptr, &extensionCount, availableExtensions.data());
+    bool hasDescriptorIndexing = false, hasMaintenance3 = false, hasMemoryBudget = false;
+    for (auto &ext : availableExtensions) {
+      hasDescriptorIndexing |= strcmp(ext.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0;
+      hasMaintenance3 |= strcmp(ext.extensionName, VK_KHR_MAINTENANCE3_EXTENSION_NAME) == 0;
+      hasMemoryBudget |= strcmp(ext.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+    }
+
+    auto getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR) vkGetInstanceProcAddr(
+        common.instance, "vkGetPhysicalDeviceFeatures2KHR");
+    auto getProperties2 = (PFN_vkGetPhysicalDeviceProperties2KHR) vkGetInstanceProcAddr(
+        common.instance, "vkGetPhysicalDeviceProperties2KHR");
+
+    if (common.hasPhysicalDeviceProperties2 && hasDescriptorIndexing && hasMaintenance3
+        && getFeatures2 && getProperties2) {
+      VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+      indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+      VkPhysicalDeviceFeatures2KHR features2 = {};
+      features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+      features2.pNext = &indexingFeatures;
+      getFeatures2(outDevice, &features2);
+
+      VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProps = {};
+      indexingProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+      VkPhysicalDeviceProperties2KHR props2 = {};
+      props2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+      props2.pNext = &indexingProps;
+      getProperties2(outDevice, &props2);
+
+      if (indexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+          && indexingFeatures.descriptorBindingPartiallyBound
+          && indexingFeatures.descriptorBindingUpdateUnusedWhilePending) {
+        common.gpu.maxBindlessTextures = std::min({
+            indexingProps.maxPerStageDescriptorUpdateAfterBindSampledImages,
+            indexingProps.maxPerStageDescriptorUpdateAfterBindSamplers,
+            indexingProps.maxDescriptorSetUpdateAfterBindSampledImages,
+            indexingProps.maxDescriptorSetUpdateAfterBindSamplers });
+      }
+    }
+    printf("Bindless textures: %s\n", common.gpu.maxBindlessTextures ? "supported" : "not supported");
+
+    common.gpu.hasMemoryBudget = common.hasPhysicalDeviceProperties2 && hasMemoryBudget
+        && vkGetInstanceProcAddr(common.instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+    printf("Memory budget queries: %s\n", common.gpu.hasMemoryBudget ? "supported" : "not supported");
+  }
+  printf("GPU-driven rendering: %s\n", common.gpu.features.drawIndirectFirstInstance ? "supported" : "not supported");
+
   //get queue families while we're here
   vkGetPhysicalDeviceQueueFamilyProperties(outDevice, &common.gpu.queueFamilyCount, nullptr);
 
@@ -391,8 +454,12 @@ void VulkanContext<EcsInterface>::createLogicalDevice() {
 
   VkPhysicalDeviceFeatures deviceFeatures = {};
   deviceFeatures.samplerAnisotropy = VK_TRUE;
-  deviceFeatures.geometryShader = VK_TRUE;
+  // Only for the wireframe view, which is left out without it (see PipelineRepository::createWireframeVariant)
+  deviceFeatures.geometryShader = physDevice.features.geometryShader;
   deviceFeatures.tessellationShader = VK_TRUE;
+  // For GPU-driven rendering, which uses firstInstance to find each draw's instance data (see GpuScene)
+  deviceFeatures.multiDrawIndirect = physDevice.features.multiDrawIndirect;
+  deviceFeatures.drawIndirectFirstInstance = physDevice.features.drawIndirectFirstInstance;
 
   VkDeviceCreateInfo createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -400,6 +467,21 @@ void VulkanContext<EcsInterface>::createLogicalDevice() {
   createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 
   createInfo.pEnabledFeatures = &deviceFeatures;
+
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+  if (physDevice.maxBindlessTextures) {
+    deviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+    deviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+    indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+    indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    createInfo.pNext = &indexingFeatures;
+  }
+  if (physDevice.hasMemoryBudget) {
+    deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+
   createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
   createInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
@@ -454,6 +536,7 @@ void VulkanContext<EcsInterface>::createDescriptorPool(
 
   VkDescriptorPoolCreateInfo poolInfo = {};
   poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT; // UBO pages can be freed by compaction
   poolInfo.poolSizeCount = static_cast<uint32_t>(info.descriptorTypeCounts.size());
   poolInfo.pPoolSizes = info.descriptorTypeCounts.data();
   poolInfo.maxSets = summedDescCount;
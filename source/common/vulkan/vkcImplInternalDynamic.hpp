@@ -262,17 +262,15 @@ uint32_t VulkanContext<EcsInterface>::getMemoryType(
 template<typename EcsInterface>
 void
 VulkanContext<EcsInterface>::createFrameBuffers(
-    std::vector<VkFramebuffer> &outBuffers, const SwapChain &swapChain, const VkImageView *depthBufferView,
+    std::vector<VkFramebuffer> &outBuffers, const SwapChain &swapChain, const std::vector<VkImageView> &sharedViews,
     const VkRenderPass &renderPass) {
   outBuffers.resize(swapChain.imageViews.size());
 
   for (uint32_t i = 0; i < outBuffers.size(); i++) {
+    // Each framebuffer has its own swapchain image, followed by the attachments that they all share
     std::vector<VkImageView> attachments;
     attachments.push_back(swapChain.imageViews[i]);
-
-    if (depthBufferView) {
-      attachments.push_back(*depthBufferView);
-    }
+    attachments.insert(attachments.end(), sharedViews.begin(), sharedViews.end());
 
     VkFramebufferCreateInfo framebufferInfo = {};
     framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -404,7 +402,7 @@ VulkanContext<EcsInterface>::copyBuffer(
 template<typename EcsInterface>
 void VulkanContext<EcsInterface>::createBuffer(
     VkBuffer &outBuffer, Allocation &bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage,
-    VkMemoryPropertyFlags properties) {
+    VkMemoryPropertyFlags properties, AllocationCategory category) {
   VkBufferCreateInfo bufferInfo = {};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
@@ -433,8 +431,10 @@ void VulkanContext<EcsInterface>::createBuffer(
 
   AllocationCreateInfo allocInfo = {};
   allocInfo.size = memRequirements.size;
+  allocInfo.alignment = memRequirements.alignment;
   allocInfo.memoryTypeIndex = getMemoryType(common.gpu.device, memRequirements.memoryTypeBits, properties);
   allocInfo.usage = properties;
+  allocInfo.category = category;
 
   common.allocator.alloc(bufferMemory, allocInfo);
   vkBindBufferMemory(common.device, outBuffer, bufferMemory.handle, bufferMemory.offset);
@@ -449,7 +449,7 @@ VulkanContext<EcsInterface>::copyDataToBuffer(
 
   createBuffer(stagingBuffer, stagingMemory, dataSize,
                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+               VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, AllocationCategory::STAGING);
 
   void *mappedStagingBuffer;
   vkMapMemory(common.device, stagingMemory.handle, stagingMemory.offset, dataSize, 0, &mappedStagingBuffer);
@@ -595,6 +595,8 @@ void VulkanContext<EcsInterface>::allocMemoryForImage(
 
   AllocationCreateInfo createInfo;
   createInfo.size = memRequirements.size;
+  createInfo.alignment = memRequirements.alignment;
+  createInfo.optimalTiling = true; // Only used for images with optimal tiling
   createInfo.memoryTypeIndex = getMemoryType(common.gpu.device, memRequirements.memoryTypeBits, properties);
   createInfo.usage = properties;
   allocateDeviceMemory(outMem, createInfo);
@@ -603,8 +605,18 @@ void VulkanContext<EcsInterface>::allocMemoryForImage(
 template<typename EcsInterface>
 void VulkanContext<EcsInterface>::createWindowSizeDependents() {
   createDepthBuffer();
+  createGBuffer();
+  if (gpuScene) {
+    gpuScene->setDepthBuffer(common.windowDependents.depthBuffer.handle, common.windowDependents.depthBuffer.view,
+                             common.swapChain.extent);
+  }
+  lightGrid->setGBuffer(common.windowDependents.gBufferAlbedo.view, common.windowDependents.gBufferNormal.view,
+                        common.windowDependents.depthBuffer.view, common.swapChain.extent);
 
-  createFrameBuffers(common.windowDependents.frameBuffers, common.swapChain, &common.windowDependents.depthBuffer.view,
+  // In the order of the render pass's attachments (see PipelineRepository::createRenderPass)
+  createFrameBuffers(common.windowDependents.frameBuffers, common.swapChain,
+                     {common.windowDependents.depthBuffer.view, common.windowDependents.gBufferAlbedo.view,
+                      common.windowDependents.gBufferNormal.view},
                      pipelineRepo->mainRenderPass);
 
   uint32_t swapChainImageCount = static_cast<uint32_t>(common.swapChain.imageViews.size());
@@ -622,8 +634,12 @@ void VulkanContext<EcsInterface>::updateDescriptorSets(UboPageMgr *dataStore) {
   size_t oldNumPages = pipelineRepo->at(MESH).descSets.size();
   size_t newNumPages = dataStore->getNumPages();
 
+  // Free the sets of any pages that have been trimmed away, once the frames in flight are done with them
+  for (size_t i = newNumPages; i < oldNumPages; ++i) {
+    retiredDescriptorSets.push_back({pipelineRepo->at(MESH).descSets[i], common.framesSubmitted});
+  }
+
   pipelineRepo->at(MESH).descSets.resize(newNumPages);
-  pipelineRepo->at(TRI_DEBUG).descSets.resize(newNumPages);
 
   for (size_t i = oldNumPages; i < newNumPages; ++i) {
 
@@ -638,17 +654,6 @@ void VulkanContext<EcsInterface>::updateDescriptorSets(UboPageMgr *dataStore) {
       AT3_ASSERT(res == VK_SUCCESS, "Error allocating global descriptor set");
     }
 
-    { // Allocate the new descriptor sets for the NORMAL pipeline
-      VkDescriptorSetAllocateInfo allocInfo = {};
-      allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-      allocInfo.descriptorPool = common.descriptorPool;
-      allocInfo.descriptorSetCount = static_cast<uint32_t>(pipelineRepo->at(TRI_DEBUG).descSetLayouts.size());
-      allocInfo.pSetLayouts = pipelineRepo->at(TRI_DEBUG).descSetLayouts.data();
-
-      VkResult res = vkAllocateDescriptorSets(common.device, &allocInfo, &pipelineRepo->at(TRI_DEBUG).descSets[i]);
-      AT3_ASSERT(res == VK_SUCCESS, "Error allocating global descriptor set");
-    }
-
     common.setWriters.clear();  // This *could* be faster than recreating a vector every update.
 
     VkDescriptorBufferInfo bufferInfo = {};
@@ -666,27 +671,6 @@ void VulkanContext<EcsInterface>::updateDescriptorSets(UboPageMgr *dataStore) {
       uboSetWriter.dstSet = pipelineRepo->at(MESH).descSets[i];
       uboSetWriter.pBufferInfo = &bufferInfo;
       uboSetWriter.pImageInfo = nullptr;
-
-      VkWriteDescriptorSet &texSetWriter = common.setWriters.emplace_back();
-      texSetWriter.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      texSetWriter.dstBinding = 1;
-      texSetWriter.dstArrayElement = 0;
-      texSetWriter.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-      texSetWriter.descriptorCount = textureRepo->getDescriptorImageInfoArrayCount();
-      texSetWriter.dstSet = pipelineRepo->at(MESH).descSets[i];
-      texSetWriter.pImageInfo = textureRepo->getDescriptorImageInfoArrayPtr();
-    }
-
-    { // Make the set writers for the NORMAL pipeline
-      VkWriteDescriptorSet &uboSetWriter = common.setWriters.emplace_back();
-      uboSetWriter.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-      uboSetWriter.dstBinding = 0;
-      uboSetWriter.dstArrayElement = 0;
-      uboSetWriter.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      uboSetWriter.descriptorCount = 1;
-      uboSetWriter.dstSet = pipelineRepo->at(TRI_DEBUG).descSets[i];
-      uboSetWriter.pBufferInfo = &bufferInfo;
-      uboSetWriter.pImageInfo = nullptr;
     }
 
     // Use all the set writers at once
@@ -696,39 +680,89 @@ void VulkanContext<EcsInterface>::updateDescriptorSets(UboPageMgr *dataStore) {
 }
 
 template<typename EcsInterface>
-void VulkanContext<EcsInterface>::createDepthBuffer() {
-  createImage(common.windowDependents.depthBuffer.handle, common.swapChain.extent.width, common.swapChain.extent.height,
-              VK_FORMAT_D32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
-              VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+void VulkanContext<EcsInterface>::rewriteTextureDescriptors() {
+  common.setWriters.clear();
+  for (uint32_t index : textureRepo->getDirtyDescriptorIndices()) {
+    VkWriteDescriptorSet &texSetWriter = common.setWriters.emplace_back();
+    texSetWriter.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    texSetWriter.dstBinding = 0;
+    texSetWriter.dstArrayElement = index;
+    texSetWriter.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    texSetWriter.descriptorCount = 1;
+    texSetWriter.dstSet = pipelineRepo->textureTable.set;
+    texSetWriter.pImageInfo = textureRepo->getDescriptorImageInfoArrayPtr() + index;
+  }
+  if ( ! common.setWriters.empty()) {
+    vkUpdateDescriptorSets(common.device, static_cast<uint32_t>(common.setWriters.size()), common.setWriters.data(), 0,
+                           nullptr);
+  }
+}
+
+/*
+ * Create an image the size of the swapchain to render to, with its memory and a view of it.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::createRenderTarget(RenderBuffer &outBuffer, VkFormat format, VkImageUsageFlags usage,
+                                                     VkImageAspectFlags aspectMask) {
+  createImage(outBuffer.handle, common.swapChain.extent.width, common.swapChain.extent.height, format,
+              VK_IMAGE_TILING_OPTIMAL, usage);
 
   VkMemoryRequirements memRequirements;
-  vkGetImageMemoryRequirements(common.device, common.windowDependents.depthBuffer.handle, &memRequirements);
+  vkGetImageMemoryRequirements(common.device, outBuffer.handle, &memRequirements);
 
   AllocationCreateInfo createInfo;
   createInfo.size = memRequirements.size;
+  createInfo.alignment = memRequirements.alignment;
+  createInfo.optimalTiling = true;
   createInfo.memoryTypeIndex = getMemoryType(common.gpu.device, memRequirements.memoryTypeBits,
                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
   createInfo.usage = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  createInfo.category = AllocationCategory::RENDER_TARGET;
+
+  allocateDeviceMemory(outBuffer.imageMemory, createInfo);
 
-  allocateDeviceMemory(common.windowDependents.depthBuffer.imageMemory, createInfo);
+  vkBindImageMemory(common.device, outBuffer.handle, outBuffer.imageMemory.handle, outBuffer.imageMemory.offset);
+
+  createImageView(outBuffer.view, format, aspectMask, 1, outBuffer.handle);
+}
 
-  vkBindImageMemory(common.device, common.windowDependents.depthBuffer.handle,
-                    common.windowDependents.depthBuffer.imageMemory.handle,
-                    common.windowDependents.depthBuffer.imageMemory.offset);
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::destroyRenderTarget(RenderBuffer &buffer) {
+  vkDestroyImageView(common.device, buffer.view, nullptr);
+  vkDestroyImage(common.device, buffer.handle, nullptr);
+  pool::free(buffer.imageMemory);
+}
 
-  createImageView(common.windowDependents.depthBuffer.view, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT, 1,
-                  common.windowDependents.depthBuffer.handle);
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::createDepthBuffer() {
+  // Sampled to build the depth pyramid for occlusion culling, and read by the deferred compose pass
+  createRenderTarget(common.windowDependents.depthBuffer, VK_FORMAT_D32_SFLOAT,
+                     VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+                     | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
+                     VK_IMAGE_ASPECT_DEPTH_BIT);
 
   transitionImageLayout(common.windowDependents.depthBuffer.handle, VK_FORMAT_D32_SFLOAT,
                         VK_IMAGE_LAYOUT_UNDEFINED,
                         VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
 }
 
+/*
+ * The render passes leave the G-buffer in whatever layout they last used it in, so it needs no transition here.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::createGBuffer() {
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+  createRenderTarget(common.windowDependents.gBufferAlbedo, PipelineRepository::gBufferAlbedoFormat, usage,
+                     VK_IMAGE_ASPECT_COLOR_BIT);
+  createRenderTarget(common.windowDependents.gBufferNormal, PipelineRepository::gBufferNormalFormat, usage,
+                     VK_IMAGE_ASPECT_COLOR_BIT);
+}
+
 template<typename EcsInterface>
 void VulkanContext<EcsInterface>::destroyWindowSizeDependents() {
-  vkDestroyImageView(common.device, common.windowDependents.depthBuffer.view, nullptr);
-  vkDestroyImage(common.device, common.windowDependents.depthBuffer.handle, nullptr);
-  pool::free(common.windowDependents.depthBuffer.imageMemory);
+  destroyRenderTarget(common.windowDependents.depthBuffer);
+  destroyRenderTarget(common.windowDependents.gBufferAlbedo);
+  destroyRenderTarget(common.windowDependents.gBufferNormal);
 
   for (size_t i = 0; i < common.windowDependents.frameBuffers.size(); i++) {
     vkDestroyFramebuffer(common.device, common.windowDependents.frameBuffers[i], nullptr);
@@ -745,6 +779,197 @@ void VulkanContext<EcsInterface>::destroyWindowSizeDependents() {
   vkDestroySwapchainKHR(common.device, common.swapChain.swapChain, nullptr);
 }
 
+/**
+ * How many pixels one unit of a mesh instance's object space covers on screen, measured at the nearest point of the
+ * instance's bounding sphere.
+ */
+template<typename EcsInterface>
+float VulkanContext<EcsInterface>::getPixelsPerObjectUnit(const MeshResource<EcsInterface> &mesh,
+                                                          const glm::mat4 &model, const glm::vec3 &cameraPos,
+                                                          float lodScale) {
+  float scale = glm::max(glm::length(glm::vec3(model[0])),
+                         glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+  glm::vec3 center = glm::vec3(model * glm::vec4((mesh.min + mesh.max) * 0.5f, 1.f));
+  float radius = glm::length(mesh.max - mesh.min) * 0.5f * scale;
+  float distance = glm::max(glm::length(center - cameraPos) - radius, std::numeric_limits<float>::epsilon());
+  return scale * lodScale / distance;
+}
+
+/**
+ * Pick the coarsest LOD of a mesh whose error projects to no more than settings::graphics::vulkan::lodPixelError pixels.
+ */
+template<typename EcsInterface>
+uint32_t VulkanContext<EcsInterface>::selectLod(const MeshResource<EcsInterface> &mesh, float pixelsPerObjectUnit) {
+  uint32_t lod = 0;
+  while (lod + 1 < mesh.lodCount
+         && mesh.lods[lod + 1].error * pixelsPerObjectUnit <= settings::graphics::vulkan::lodPixelError) {
+    ++lod;
+  }
+  return lod;
+}
+
+/**
+ * The local transform of a scene node as the scene tree sees it (see SceneObject::traverseAndCache), and whether it
+ * only inherits its parent's position. Nodes without a transform of their own pass their parent's straight through.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::readGpuSceneNode(typename EcsInterface::EcsId id, GpuScene::Node &outNode) {
+  outNode.local = glm::mat4(1.f);
+  outNode.flags = 0;
+  if (ecs->hasTransform(id)) {
+    outNode.local = ecs->hasCustomModelTransform(id) ? ecs->getCustomModelTransform(id) : ecs->getTransform(id);
+    if (ecs->hasLocalMat3Override(id)) {
+      outNode.flags |= GpuScene::mat3OverrideFlag;
+    }
+  }
+}
+
+/**
+ * Rebuild the GPU scene's tables from scratch: the nodes of every mesh instance and of all of their ancestors, sorted
+ * by depth, and one draw per instance, grouped by mesh.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::rebuildGpuScene() {
+  gpuSceneDirty = false;
+  changedTransforms.clear();
+  GpuScene &scene = *gpuScene;
+  scene.nodes.clear();
+  scene.levelStarts.clear();
+  scene.meshes.clear();
+  scene.lods.clear();
+  scene.draws.clear();
+  gpuSceneNodeIds.clear();
+  gpuSceneNodeIndices.clear();
+  gpuMeshDraws.clear();
+
+  { // Find the depth of every node, walking up from each instance until reaching the root or a node already seen
+    std::unordered_map<typename EcsInterface::EcsId, uint32_t> depths;
+    std::vector<typename EcsInterface::EcsId> chain;
+    for (auto &pair : meshRepo) {
+      for (auto &mesh : pair.second) {
+        for (auto &instance : mesh.instances) {
+          chain.clear();
+          typename EcsInterface::EcsId id = instance.id;
+          while (id && ! depths.count(id)) {
+            chain.push_back(id);
+            id = ecs->getSceneParent(id);
+          }
+          uint32_t depth = id ? depths.at(id) + 1 : 0;
+          for (auto node = chain.rbegin(); node != chain.rend(); ++node) {
+            depths[*node] = depth++;
+          }
+        }
+      }
+    }
+    std::vector<std::pair<uint32_t, typename EcsInterface::EcsId>> sorted;
+    for (auto &pair : depths) {
+      sorted.emplace_back(pair.second, pair.first);
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    // Parents come before their children, so their indices are always known
+    for (auto &node : sorted) {
+      uint32_t index = (uint32_t) scene.nodes.size();
+      if (scene.levelStarts.size() <= node.first) {
+        scene.levelStarts.push_back(index);
+      }
+      GpuScene::Node &gpuNode = scene.nodes.emplace_back();
+      typename EcsInterface::EcsId parentId = ecs->getSceneParent(node.second);
+      gpuNode.parent = parentId ? gpuSceneNodeIndices.at(parentId) : GpuScene::noParent;
+      readGpuSceneNode(node.second, gpuNode);
+      gpuSceneNodeIds.push_back(node.second);
+      gpuSceneNodeIndices[node.second] = index;
+    }
+    scene.levelStarts.push_back((uint32_t) scene.nodes.size());
+  }
+
+  for (auto &pair : meshRepo) {
+    for (auto &mesh : pair.second) {
+      if (mesh.instances.empty()) { continue; }
+      GpuScene::Mesh &gpuMesh = scene.meshes.emplace_back();
+      gpuMesh.dequantization = mesh.dequantization;
+      gpuMesh.sphere = glm::vec4((mesh.min + mesh.max) * 0.5f, glm::length(mesh.max - mesh.min) * 0.5f);
+      gpuMesh.firstLod = (uint32_t) scene.lods.size();
+      gpuMesh.lodCount = mesh.lodCount;
+      for (uint32_t lod = 0; lod < mesh.lodCount; ++lod) {
+        scene.lods.push_back({mesh.lods[lod].iCount, mesh.lods[lod].firstIndex, mesh.lods[lod].error, 0});
+      }
+      gpuMeshDraws.push_back({&mesh, (uint32_t) scene.draws.size(), (uint32_t) mesh.instances.size()});
+      for (auto &instance : mesh.instances) {
+        scene.draws.push_back({gpuSceneNodeIndices.at(instance.id), (uint32_t) scene.meshes.size() - 1,
+                               instance.indices.getTexture(), 0});
+      }
+    }
+  }
+
+  scene.markAllDirty();
+}
+
+/**
+ * Called once per frame when rendering is GPU-driven. Only the nodes named by markTransformChanged since the last
+ * frame are read and uploaded, unless instances have come or gone or the scene tree has changed, in which case the
+ * tables are rebuilt. Entities that aren't in the GPU scene, like cameras, are skipped.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::updateGpuScene() {
+  if (gpuSceneDirty) {
+    rebuildGpuScene();
+    return;
+  }
+  for (typename EcsInterface::EcsId id : changedTransforms) {
+    auto index = gpuSceneNodeIndices.find(id);
+    if (index == gpuSceneNodeIndices.end()) { continue; }
+    readGpuSceneNode(id, gpuScene->nodes[index->second]);
+    gpuScene->markNodeDirty(index->second);
+  }
+  changedTransforms.clear();
+}
+
+/**
+ * The pipeline to draw meshes into the G-buffer with, which is the wireframe variant while the wireframe is shown
+ */
+template<typename EcsInterface>
+VkPipeline VulkanContext<EcsInterface>::getMeshPipeline(StandardPipeline index) {
+  auto &pipeline = pipelineRepo->at(index);
+  if (settings::graphics::vulkan::wireframe && pipeline.wireframeHandle) {
+    return pipeline.wireframeHandle;
+  }
+  return pipeline.handle;
+}
+
+/**
+ * Draw the meshes of the GPU scene with the draw commands that its culling pass wrote, from within SUBPASS_GBUFFER. The
+ * draws of each mesh are contiguous, and the culled ones have no instances.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::recordIndirectDraws(VkCommandBuffer commandBuffer, const glm::mat4 &vp,
+                                                      bool secondPhase) {
+  VkDescriptorSet descSets[] = {gpuScene->getInstanceDescriptorSet(), pipelineRepo->textureTable.set};
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, getMeshPipeline(MESH_INDIRECT));
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineRepo->at(MESH_INDIRECT).layout,
+                          0, 2, descSets, 0, nullptr);
+  vkCmdPushConstants(commandBuffer, pipelineRepo->at(MESH_INDIRECT).layout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                     sizeof(vp), &vp);
+
+  const VkDeviceSize stride = sizeof(VkDrawIndexedIndirectCommand);
+  VkDeviceSize phaseOffset = secondPhase ? gpuScene->getSecondPhaseCommandOffset() : 0;
+  for (auto &meshDraws : gpuMeshDraws) {
+    VkBuffer vertexBuffers[] = {meshDraws.mesh->buffer};
+    VkDeviceSize vertexOffsets[] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, vertexOffsets);
+    vkCmdBindIndexBuffer(commandBuffer, meshDraws.mesh->buffer, meshDraws.mesh->iOffset, meshDraws.mesh->indexType);
+    if (common.gpu.features.multiDrawIndirect) {
+      vkCmdDrawIndexedIndirect(commandBuffer, gpuScene->getDrawCommandBuffer(),
+                               phaseOffset + meshDraws.firstDraw * stride, meshDraws.drawCount, (uint32_t) stride);
+    } else {
+      for (uint32_t i = 0; i < meshDraws.drawCount; ++i) {
+        vkCmdDrawIndexedIndirect(commandBuffer, gpuScene->getDrawCommandBuffer(),
+                                 phaseOffset + (meshDraws.firstDraw + i) * stride, 1, (uint32_t) stride);
+      }
+    }
+  }
+}
+
 template<typename EcsInterface>
 void VulkanContext<EcsInterface>::render(
     UboPageMgr *dataStore, const glm::mat4 &wvMat, const MeshRepository <EcsInterface> &meshAssets,
@@ -752,12 +977,35 @@ void VulkanContext<EcsInterface>::render(
 
   glm::mat4 proj = glm::perspective(glm::radians(60.f), common.windowWidth / (float) common.windowHeight, 0.1f,
                                     10000.f);
+  // For choosing LODs: how many pixels tall something one unit tall appears at a distance of one unit
+  float lodScale = common.windowHeight * 0.5f * proj[1][1];
+  glm::vec3 cameraPos = glm::vec3(glm::inverse(wvMat)[3]);
   // reverse the y
   proj[1][1] *= -1;
 
+  // Rendering is GPU-driven if it's enabled and supported, otherwise instance data is written to the UBOs every frame
+  bool gpuDriven = settings::graphics::vulkan::gpuDriven && common.gpu.features.drawIndirectFirstInstance;
+  if (gpuDriven && ! gpuScene) {
+    gpuScene = std::make_unique<GpuScene>(common, *pipelineRepo);
+    gpuScene->setDepthBuffer(common.windowDependents.depthBuffer.handle, common.windowDependents.depthBuffer.view,
+                             common.swapChain.extent);
+    gpuSceneDirty = true;
+  } else if ( ! gpuDriven && gpuScene) {
+    vkDeviceWaitIdle(common.device);
+    gpuScene->destroy();
+    gpuScene.reset();
+  }
+
+  // With occlusion culling, the frame is drawn in two render passes with the second culling pass between them
+  bool occlusionCulling = false;
+  if (gpuScene) {
+    updateGpuScene();
+    occlusionCulling = settings::graphics::vulkan::occlusionCulling && ! gpuScene->draws.empty();
+  } else {
 #if !COPY_ON_MAIN_COMMANDBUFFER
-  dataStore->updateBuffers(wvMat, proj, nullptr, common, ecs, meshAssets);
+    dataStore->updateBuffers(wvMat, proj, nullptr, common, ecs, meshAssets);
 #endif
+  }
 
   VkResult res;
   uint32_t imageIndex;
@@ -773,6 +1021,30 @@ void VulkanContext<EcsInterface>::render(
 
   vkWaitForFences(common.device, 1, &common.frameFences[imageIndex], VK_FALSE, 5000000000);
   vkResetFences(common.device, 1, &common.frameFences[imageIndex]);
+  common.framesCompleted = std::max(common.framesCompleted, common.frameSerials[imageIndex]);
+  debugLines->release(imageIndex);
+  debugLines->setCameraPosition(cameraPos);
+
+  // The last frame that used this image is done, so what its culling passes measured can be read
+  if (gpuScene) {
+    const uint32_t *texturePixels = gpuScene->getTextureDetail(imageIndex);
+    for (uint32_t i = 0; texturePixels && i < MeshInstanceIndices::maxTextures; ++i) {
+      if (texturePixels[i]) {
+        textureRepo->requestDetail(i, (float) texturePixels[i]);
+      }
+    }
+    if (const CullStats *cullStats = gpuScene->getCullStats(imageIndex)) {
+      gpuCullStats = *cullStats;
+    }
+  }
+
+  // The compose pass only shades each pixel with the point lights that can reach its tile
+  framePointLights.clear();
+  for (auto &pair : pointLights) {
+    glm::vec3 position = glm::vec3(ecs->getAbsTransform(pair.first)[3]);
+    framePointLights.push_back({glm::vec4(position, pair.second.radius), glm::vec4(pair.second.color, 1.f)});
+  }
+  lightGrid->update(imageIndex, framePointLights, wvMat, proj);
 
   VkCommandBufferBeginInfo beginInfo = {};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -792,9 +1064,28 @@ void VulkanContext<EcsInterface>::render(
   vkCmdWriteTimestamp(common.windowDependents.commandBuffers[imageIndex], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
                       common.queryPool, 0);
 
+  if (gpuScene) { // Resolve transforms, cull, and write the draw commands before the render pass begins
+    // The frustum planes come straight from the rows of the view-projection matrix (depth is zero to one)
+    glm::mat4 vpRows = glm::transpose(proj * wvMat);
+    CullParams cullParams = {};
+    cullParams.frustumPlanes[0] = vpRows[3] + vpRows[0];
+    cullParams.frustumPlanes[1] = vpRows[3] - vpRows[0];
+    cullParams.frustumPlanes[2] = vpRows[3] + vpRows[1];
+    cullParams.frustumPlanes[3] = vpRows[3] - vpRows[1];
+    cullParams.frustumPlanes[4] = vpRows[2];
+    cullParams.frustumPlanes[5] = vpRows[3] - vpRows[2];
+    for (auto &plane : cullParams.frustumPlanes) {
+      plane /= glm::length(glm::vec3(plane));
+    }
+    cullParams.camera = glm::vec4(cameraPos, lodScale);
+    cullParams.lodPixelError = settings::graphics::vulkan::lodPixelError;
+    cullParams.viewProj = proj * wvMat;
+    gpuScene->record(common.windowDependents.commandBuffers[imageIndex], imageIndex, cullParams, occlusionCulling);
+  }
+
   VkRenderPassBeginInfo renderPassInfo = {};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  renderPassInfo.renderPass = pipelineRepo->mainRenderPass;
+  renderPassInfo.renderPass = occlusionCulling ? pipelineRepo->earlyRenderPass : pipelineRepo->mainRenderPass;
   renderPassInfo.framebuffer = common.windowDependents.frameBuffers[imageIndex];
   renderPassInfo.renderArea.offset = {0, 0};
   renderPassInfo.renderArea.extent = common.swapChain.extent;
@@ -813,84 +1104,77 @@ void VulkanContext<EcsInterface>::render(
 
 
 
-  int currentlyBound = -1;
-  vkCmdBindPipeline(common.windowDependents.commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    pipelineRepo->at(MESH).handle);
-
-  for (auto pair : meshAssets) {
-    for (auto mesh : pair.second) {
-      for (auto instance : mesh.instances) {
-        glm::uint32 uboPage = instance.indices.getPage();
-
-        if (currentlyBound != uboPage) {
-          vkCmdBindDescriptorSets(common.windowDependents.commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                  pipelineRepo->at(MESH).layout, 0, 1,
-                                  &pipelineRepo->at(MESH).descSets[uboPage], 0, nullptr);
-          currentlyBound = uboPage;
+  if (gpuScene) {
+    recordIndirectDraws(common.windowDependents.commandBuffers[imageIndex], proj * wvMat, false);
+  } else {
+    int currentlyBound = -1;
+    vkCmdBindPipeline(common.windowDependents.commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
+                      getMeshPipeline(MESH));
+    vkCmdBindDescriptorSets(common.windowDependents.commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            pipelineRepo->at(MESH).layout, 1, 1, &pipelineRepo->textureTable.set, 0, nullptr);
+
+    for (auto pair : meshAssets) {
+      for (auto mesh : pair.second) {
+        for (auto instance : mesh.instances) {
+          glm::uint32 uboPage = instance.indices.getPage();
+
+          if (currentlyBound != uboPage) {
+            vkCmdBindDescriptorSets(common.windowDependents.commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    pipelineRepo->at(MESH).layout, 0, 1,
+                                    &pipelineRepo->at(MESH).descSets[uboPage], 0, nullptr);
+            currentlyBound = uboPage;
+          }
+
+          vkCmdPushConstants(
+              common.windowDependents.commandBuffers[imageIndex],
+              pipelineRepo->at(MESH).layout,
+              VK_SHADER_STAGE_VERTEX_BIT | /*VK_SHADER_STAGE_GEOMETRY_BIT |*/ VK_SHADER_STAGE_FRAGMENT_BIT,
+              0,
+              sizeof(MeshInstanceIndices::rawType),
+              (void *) &instance.indices.raw);
+
+          VkBuffer vertexBuffers[] = {mesh.buffer};
+          VkDeviceSize vertexOffsets[] = {0};
+          vkCmdBindVertexBuffers(common.windowDependents.commandBuffers[imageIndex], 0, 1, vertexBuffers,
+                                 vertexOffsets);
+          vkCmdBindIndexBuffer(common.windowDependents.commandBuffers[imageIndex], mesh.buffer, mesh.iOffset,
+                               mesh.indexType);
+          float pixelsPerUnit = getPixelsPerObjectUnit(mesh, ecs->getAbsTransform(instance.id), cameraPos, lodScale);
+          textureRepo->requestDetail(instance.indices.getTexture(), pixelsPerUnit * glm::length(mesh.max - mesh.min));
+          const MeshLod &lod = mesh.lods[selectLod(mesh, pixelsPerUnit)];
+          vkCmdDrawIndexed(common.windowDependents.commandBuffers[imageIndex], lod.iCount, 1, lod.firstIndex, 0, 0);
         }
-
-        vkCmdPushConstants(
-            common.windowDependents.commandBuffers[imageIndex],
-            pipelineRepo->at(MESH).layout,
-            VK_SHADER_STAGE_VERTEX_BIT | /*VK_SHADER_STAGE_GEOMETRY_BIT |*/ VK_SHADER_STAGE_FRAGMENT_BIT,
-            0,
-            sizeof(MeshInstanceIndices::rawType),
-            (void *) &instance.indices.raw);
-
-        VkBuffer vertexBuffers[] = {mesh.buffer};
-        VkDeviceSize vertexOffsets[] = {0};
-        vkCmdBindVertexBuffers(common.windowDependents.commandBuffers[imageIndex], 0, 1, vertexBuffers, vertexOffsets);
-        vkCmdBindIndexBuffer(common.windowDependents.commandBuffers[imageIndex], mesh.buffer, mesh.iOffset,
-                             VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(common.windowDependents.commandBuffers[imageIndex], static_cast<uint32_t>(mesh.iCount), 1, 0, 0,
-                         0);
       }
     }
   }
 
-
-
   vkCmdNextSubpass(common.windowDependents.commandBuffers[imageIndex], VK_SUBPASS_CONTENTS_INLINE);
-  currentlyBound = -1;
-  vkCmdBindPipeline(common.windowDependents.commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    pipelineRepo->at(TRI_DEBUG).handle);
-
-  for (auto pair : meshAssets) {
-    for (auto mesh : pair.second) {
-      for (auto instance : mesh.instances) {
-        glm::uint32 uboPage = instance.indices.getPage();
-
-        if (currentlyBound != uboPage) {
-          vkCmdBindDescriptorSets(common.windowDependents.commandBuffers[imageIndex], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                  pipelineRepo->at(TRI_DEBUG).layout, 0, 1,
-                                  &pipelineRepo->at(TRI_DEBUG).descSets[uboPage], 0, nullptr);
-          currentlyBound = uboPage;
-        }
-
-        vkCmdPushConstants(
-            common.windowDependents.commandBuffers[imageIndex],
-            pipelineRepo->at(TRI_DEBUG).layout,
-            VK_SHADER_STAGE_VERTEX_BIT,
-            0,
-            sizeof(MeshInstanceIndices::rawType),
-            (void *) &instance.indices.raw);
-
-        VkBuffer vertexBuffers[] = {mesh.buffer};
-        VkDeviceSize vertexOffsets[] = {0};
-        vkCmdBindVertexBuffers(common.windowDependents.commandBuffers[imageIndex], 0, 1, vertexBuffers, vertexOffsets);
-        vkCmdBindIndexBuffer(common.windowDependents.commandBuffers[imageIndex], mesh.buffer, mesh.iOffset,
-                             VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(common.windowDependents.commandBuffers[imageIndex], static_cast<uint32_t>(mesh.iCount), 1, 0, 0,
-                         0);
-      }
-    }
+  // With occlusion culling, the G-buffer isn't finished until the second render pass, which lights it instead
+  if ( ! occlusionCulling) {
+    lightGrid->recordCompose(common.windowDependents.commandBuffers[imageIndex], imageIndex);
   }
 
+  vkCmdNextSubpass(common.windowDependents.commandBuffers[imageIndex], VK_SUBPASS_CONTENTS_INLINE);
+  // Nothing but debug lines is drawn over the lit frame, and only in the last render pass
+  if ( ! occlusionCulling) {
+    debugLines->record(common.windowDependents.commandBuffers[imageIndex], imageIndex, proj * wvMat);
+  }
 
+  vkCmdEndRenderPass(common.windowDependents.commandBuffers[imageIndex]);
 
+  if (occlusionCulling) { // Cull against what the first render pass drew, then draw whatever it missed
+    gpuScene->recordOcclusionCulling(common.windowDependents.commandBuffers[imageIndex], imageIndex);
+    renderPassInfo.renderPass = pipelineRepo->lateRenderPass;
+    vkCmdBeginRenderPass(common.windowDependents.commandBuffers[imageIndex], &renderPassInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+    recordIndirectDraws(common.windowDependents.commandBuffers[imageIndex], proj * wvMat, true);
+    vkCmdNextSubpass(common.windowDependents.commandBuffers[imageIndex], VK_SUBPASS_CONTENTS_INLINE);
+    lightGrid->recordCompose(common.windowDependents.commandBuffers[imageIndex], imageIndex);
+    vkCmdNextSubpass(common.windowDependents.commandBuffers[imageIndex], VK_SUBPASS_CONTENTS_INLINE);
+    debugLines->record(common.windowDependents.commandBuffers[imageIndex], imageIndex, proj * wvMat);
+    vkCmdEndRenderPass(common.windowDependents.commandBuffers[imageIndex]);
+  }
 
-
-  vkCmdEndRenderPass(common.windowDependents.commandBuffers[imageIndex]);
   vkCmdWriteTimestamp(common.windowDependents.commandBuffers[imageIndex], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
                       common.queryPool, 1);
 
@@ -913,6 +1197,7 @@ void VulkanContext<EcsInterface>::render(
   submitInfo.pCommandBuffers = &common.windowDependents.commandBuffers[imageIndex];
   submitInfo.commandBufferCount = 1;
 
+  common.frameSerials[imageIndex] = ++common.framesSubmitted;
   res = vkQueueSubmit(common.deviceQueues.graphicsQueue, 1, &submitInfo, common.frameFences[imageIndex]);
   AT3_ASSERT(res == VK_SUCCESS, "Error submitting queue");
 
@@ -932,29 +1217,39 @@ void VulkanContext<EcsInterface>::render(
 #if PRINT_VK_FRAMETIMES
   //log performance data:
 
-  uint32_t end = 0;
-  uint32_t begin = 0;
+  uint64_t end = 0;
+  uint64_t begin = 0;
 
   static int count = 0;
   static float totalTime = 0.0f;
+  static bool wireframeTimed = settings::graphics::vulkan::wireframe;
 
-  if (count++ > 1024)
+  // Frames from before and after the wireframe view is toggled are never averaged together, so the two can be compared
+  if (wireframeTimed != settings::graphics::vulkan::wireframe) {
+    wireframeTimed = settings::graphics::vulkan::wireframe;
+    count = 0;
+    totalTime = 0;
+  }
+  if (count == 1024)
   {
-    printf("VK Render Time (avg of past 1024 frames): %f ms\n", totalTime / 1024.0f);
+    printf("VK Render Time (avg of past 1024 frames, wireframe %s): %f ms\n", wireframeTimed ? "on" : "off",
+           totalTime / 1024.0f);
     count = 0;
     totalTime = 0;
   }
-  float timestampFrequency = common.gpu.deviceProps.limits.timestampPeriod;
+  float timestampPeriod = common.gpu.deviceProps.limits.timestampPeriod; // nanoseconds per tick
 
   // A "firstFrame" bool is easier than setting up more synchronization objects.
-  if (common.renderData.firstFrame[imageIndex]) {
-    common.renderData.firstFrame[imageIndex] = false;
+  if (common.windowDependents.firstFrame[imageIndex]) {
+    common.windowDependents.firstFrame[imageIndex] = false;
   } else {
-    vkGetQueryPoolResults(common.device, common.queryPool, 1, 1, sizeof(uint32_t), &end, 0, VK_QUERY_RESULT_WAIT_BIT);
-    vkGetQueryPoolResults(common.device, common.queryPool, 0, 1, sizeof(uint32_t), &begin, 0, VK_QUERY_RESULT_WAIT_BIT);
+    vkGetQueryPoolResults(common.device, common.queryPool, 1, 1, sizeof(uint64_t), &end, 0,
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    vkGetQueryPoolResults(common.device, common.queryPool, 0, 1, sizeof(uint64_t), &begin, 0,
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    totalTime += (float) (end - begin) * timestampPeriod / 1e6f;
+    ++count;
   }
-  uint32_t diff = end - begin;
-  totalTime += (diff) / (float)1e6;
 #endif
 
   if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR) {
@@ -3,18 +3,38 @@
 template<typename EcsInterface>
 MeshResource<EcsInterface> VulkanContext<EcsInterface>::loadMeshFromData(
     const std::vector<float> &vertices, const std::vector<uint32_t> &indices) {
+  size_t numVertices = vertices.size() / (pipelineRepo->getVertexAttributes().floatVertexSize / sizeof(float));
+  return loadMeshFromData(vertices.data(), numVertices, indices.data(), indices.size());
+}
+
+/**
+ * Vertices are given in the interleaved float layout and are packed into the GPU layout while they are copied into
+ * staging memory. Meshes with few enough vertices get 16-bit indices.
+ */
+template<typename EcsInterface>
+MeshResource<EcsInterface> VulkanContext<EcsInterface>::loadMeshFromData(
+    const float *vertices, size_t numVertices, const uint32_t *indices, size_t numIndices) {
 
-  size_t numVertices = vertices.size() / (pipelineRepo->getVertexAttributes().vertexSize / sizeof(float));
-  size_t vBufferSize = pipelineRepo->getVertexAttributes().vertexSize * numVertices;
-  size_t iBufferSize = sizeof(uint32_t) * indices.size();
+  const VertexAttributes &layout = pipelineRepo->getVertexAttributes();
+  bool shortIndices = numVertices <= std::numeric_limits<uint16_t>::max() + 1u;
+
+  size_t vBufferSize = layout.vertexSize * numVertices;
+  size_t iBufferSize = (shortIndices ? sizeof(uint16_t) : sizeof(uint32_t)) * numIndices;
 
   MeshResource<EcsInterface> m;
   m.vCount = static_cast<uint32_t>(numVertices);
-  m.iCount = static_cast<uint32_t>(indices.size());
+  m.iCount = static_cast<uint32_t>(numIndices);
+  m.lods[0] = {0, m.iCount, 0.f};
+  m.indexType = shortIndices ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+  m.bufferSize = vBufferSize + iBufferSize;
+
+  VertexQuantization quantization = computeVertexQuantization(layout, vertices, numVertices);
+  m.dequantization = getDequantizationTransform(quantization);
 
   createBuffer(m.buffer, m.bufferMemory, vBufferSize + iBufferSize,
-               VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
-               VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+               VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | // SRC for defragmentation
+               VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationCategory::MESH);
 
   //transfer data to the above buffers
   VkBuffer stagingBuffer;
@@ -23,16 +43,23 @@ MeshResource<EcsInterface> VulkanContext<EcsInterface>::loadMeshFromData(
   // TODO: put all mesh data in the same buffer
   createBuffer(stagingBuffer, stagingMemory, vBufferSize + iBufferSize,
                VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, AllocationCategory::STAGING);
 
   void *data;
 
   vkMapMemory(common.device, stagingMemory.handle, stagingMemory.offset, vBufferSize, 0, &data);
-  memcpy(data, vertices.data(), vBufferSize);
+  packVertices(layout, vertices, numVertices, quantization, (uint8_t *) data);
   vkUnmapMemory(common.device, stagingMemory.handle);
 
   vkMapMemory(common.device, stagingMemory.handle, stagingMemory.offset + vBufferSize, iBufferSize, 0, &data);
-  memcpy(data, indices.data(), iBufferSize);
+  if (shortIndices) {
+    auto *shortData = (uint16_t *) data;
+    for (size_t i = 0; i < numIndices; ++i) {
+      shortData[i] = static_cast<uint16_t>(indices[i]);
+    }
+  } else {
+    memcpy(data, indices, iBufferSize);
+  }
   vkUnmapMemory(common.device, stagingMemory.handle);
 
   //copy to device local here
@@ -43,18 +70,89 @@ MeshResource<EcsInterface> VulkanContext<EcsInterface>::loadMeshFromData(
   m.vOffset = 0;
   m.iOffset = static_cast<uint32_t>(vBufferSize);
 
+  { // Keep track of how much the compressed formats are saving
+    size_t uncompressedSize = layout.floatVertexSize * numVertices + sizeof(uint32_t) * numIndices;
+    uncompressedMeshBytes += uncompressedSize;
+    compressedMeshBytes += vBufferSize + iBufferSize;
+    if (settings::graphics::vulkan::verboseMeshLoading) {
+      printf("Mesh buffers: %zu KiB (%zu KiB uncompressed), %u byte vertex fetch, %u-bit indices. Total: %zu/%zu KiB\n",
+             (vBufferSize + iBufferSize) / 1024, uncompressedSize / 1024, layout.vertexSize, shortIndices ? 16 : 32,
+             compressedMeshBytes / 1024, uncompressedMeshBytes / 1024);
+    }
+  }
+
   return m;
 
 }
 
+template<typename EcsInterface>
+MeshResources <EcsInterface> VulkanContext<EcsInterface>::loadMeshFromCooked(
+    const float *vertices, const uint32_t *indices, const CookedSubMesh *subMeshes, uint32_t subMeshCount,
+    uint64_t cookedKey, bool storeTriangles) {
+
+  MeshResources<EcsInterface> outMeshes(subMeshCount);
+  uint32_t floatsPerVert = pipelineRepo->getVertexAttributes().floatVertexSize / sizeof(float);
+  int64_t positionOffset = getFloatAttributeOffset(pipelineRepo->getVertexAttributes(), EMeshVertexAttribute::POSITION);
+  AT3_ASSERT( ! storeTriangles || positionOffset >= 0, "Can't store the triangles of a mesh without positions\n");
+
+  for (uint32_t i = 0; i < subMeshCount; ++i) {
+    const CookedSubMesh &sub = subMeshes[i];
+    const float *subVerts = vertices + (size_t)sub.vOffset * floatsPerVert;
+    const uint32_t *subIndices = indices + sub.iOffset;
+    outMeshes[i] = loadMeshFromData(subVerts, sub.vCount, subIndices, sub.iCount);
+    outMeshes[i].min = sub.min;
+    outMeshes[i].max = sub.max;
+    outMeshes[i].iCount = sub.lodICount[0];
+    outMeshes[i].lodCount = sub.lodCount;
+    uint32_t firstIndex = 0;
+    for (uint32_t lod = 0; lod < sub.lodCount; ++lod) {
+      outMeshes[i].lods[lod] = {firstIndex, sub.lodICount[lod], sub.lodError[lod]};
+      firstIndex += sub.lodICount[lod];
+    }
+    if (storeTriangles) { // Physics only ever gets the positions of the full-detail triangles
+      auto triangles = std::make_shared<StoredTriangles>();
+      triangles->positions.resize((size_t)sub.vCount * 3);
+      for (uint32_t v = 0; v < sub.vCount; ++v) {
+        memcpy(&triangles->positions[(size_t)v * 3], subVerts + (size_t)v * floatsPerVert + positionOffset,
+               sizeof(float) * 3);
+      }
+      triangles->indices.assign(subIndices, subIndices + sub.lodICount[0]);
+      triangles->key = fnv1a64(&i, sizeof(i), cookedKey);
+      outMeshes[i].storedTriangles = std::move(triangles);
+    }
+  }
+
+  return outMeshes;
+}
+
 template<typename EcsInterface>
 MeshResources <EcsInterface> VulkanContext<EcsInterface>::loadMeshFromFile(
     const char *filepath, bool combineSubMeshes, bool storeTriangles /*= false*/) {
 
-  std::vector<MeshResource<EcsInterface>> outMeshes;
-
   const VertexAttributes &globalVertLayout = pipelineRepo->getVertexAttributes();
 
+  // If this mesh has been imported before with the same source file, layout, and settings, skip Assimp entirely.
+  std::string cookedPath = getCookedMeshPath(filepath);
+  SourceFileStamp sourceStamp = getSourceFileStamp(filepath);
+  uint32_t layoutHash = hashVertexLayout(globalVertLayout);
+  MeshResources<EcsInterface> outMeshes;
+  bool cookedIsValid, cookedNeedsStamp = false;
+  { // Unmapped before it's restamped
+    CookedMeshFile cooked;
+    cookedIsValid = cooked.open(cookedPath, filepath, sourceStamp, layoutHash, MESH_FLAGS, combineSubMeshes,
+                                globalVertLayout.floatVertexSize);
+    if (cookedIsValid) {
+      outMeshes = loadMeshFromCooked(cooked.getVertices(), cooked.getIndices(), cooked.getSubMeshes(),
+                                     cooked.getSubMeshCount(), cooked.getKey(), storeTriangles);
+      cookedNeedsStamp = cooked.isStampOutdated();
+    }
+  }
+  if (cookedIsValid) {
+    if (cookedNeedsStamp) { restampCookedMeshFile(cookedPath, sourceStamp); }
+    return outMeshes;
+  }
+  uint64_t sourceHash = hashFileContents(filepath);
+
   Assimp::Importer aiImporter;
   const struct aiScene *scene = NULL;
 
@@ -68,19 +166,22 @@ MeshResources <EcsInterface> VulkanContext<EcsInterface>::loadMeshFromFile(
   const aiColor4D ZeroColor(0.0, 0.0, 0.0, 0.0);
 
   if (scene) {
-    uint32_t floatsPerVert = globalVertLayout.vertexSize / sizeof(float);
-    std::vector<float> vertexBuffer;
-    std::vector<uint32_t> indexBuffer;
+    CookedMeshData cookedData;
+    std::vector<float> &vertexBuffer = cookedData.vertices;
+    std::vector<uint32_t> &indexBuffer = cookedData.indices;
     uint32_t numVerts = 0;
 
-    outMeshes.resize(combineSubMeshes ? 1 : scene->mNumMeshes);
-
     for (uint32_t i = 0; i < scene->mNumMeshes; i++) {
-      if (!combineSubMeshes) {
-        vertexBuffer.clear();
-        indexBuffer.clear();
+      if (!combineSubMeshes || i == 0) {
+        CookedSubMesh sub {};
+        sub.vOffset = static_cast<uint32_t>(vertexBuffer.size() * sizeof(float) / globalVertLayout.floatVertexSize);
+        sub.iOffset = static_cast<uint32_t>(indexBuffer.size());
+        sub.min = glm::vec3(std::numeric_limits<float>::max());
+        sub.max = glm::vec3(std::numeric_limits<float>::lowest());
+        cookedData.subMeshes.push_back(sub);
         numVerts = 0;
       }
+      CookedSubMesh &sub = cookedData.subMeshes.back();
 
       const aiMesh *mesh = scene->mMeshes[i];
 
@@ -94,6 +195,9 @@ MeshResources <EcsInterface> VulkanContext<EcsInterface>::loadMeshFromFile(
         const aiVector3D *biTan = mesh->HasTangentsAndBitangents() ? &(mesh->mBitangents[vIdx]) : &ZeroVector;
         const aiColor4D *col = mesh->HasVertexColors(0) ? &(mesh->mColors[0][vIdx]) : &ZeroColor;
 
+        sub.min = glm::min(sub.min, glm::vec3(pos->x, pos->y, pos->z));
+        sub.max = glm::max(sub.max, glm::vec3(pos->x, pos->y, pos->z));
+
         for (uint32_t lIdx = 0; lIdx < globalVertLayout.attrCount; ++lIdx) {
           EMeshVertexAttribute comp = globalVertLayout.attributes[lIdx];
 
@@ -150,23 +254,63 @@ MeshResources <EcsInterface> VulkanContext<EcsInterface>::loadMeshFromFile(
       }
 
       numVerts += mesh->mNumVertices;
+      sub.vCount += mesh->mNumVertices;
+      sub.iCount += mesh->mNumFaces * 3;
+    }
 
-      if (!combineSubMeshes) {
-        outMeshes[i] = loadMeshFromData(vertexBuffer, indexBuffer);
-        if (storeTriangles) {
-          outMeshes[i].storedVertices = std::make_shared<std::vector<float>>(vertexBuffer);
-          outMeshes[i].storedIndices = std::make_shared<std::vector<uint32_t>>(indexBuffer);
+    { // Optimize each sub-mesh and generate its LODs before it is cooked, so that this only happens once per mesh
+      uint32_t floatsPerVert = globalVertLayout.floatVertexSize / sizeof(float);
+      CookedMeshData optimized;
+      for (CookedSubMesh sub : cookedData.subMeshes) {
+        std::vector<float> subVerts(vertexBuffer.begin() + (size_t) sub.vOffset * floatsPerVert,
+                                    vertexBuffer.begin() + (size_t) (sub.vOffset + sub.vCount) * floatsPerVert);
+        std::vector<uint32_t> subIndices(indexBuffer.begin() + sub.iOffset,
+                                         indexBuffer.begin() + sub.iOffset + sub.iCount);
+        MeshOptimizationStats stats = optimizeMesh(globalVertLayout, subVerts, subIndices);
+        if (settings::graphics::vulkan::verboseMeshLoading) {
+          printf("Optimized mesh: %u -> %u vertices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+                 stats.verticesBefore, stats.verticesAfter, stats.before.acmr, stats.after.acmr,
+                 stats.before.atvr, stats.after.atvr);
         }
-      }
-    }
 
-    if (combineSubMeshes) {
-      outMeshes[0] = loadMeshFromData(vertexBuffer, indexBuffer);
-      if (storeTriangles) {
-        outMeshes[0].storedVertices = std::make_shared<std::vector<float>>(vertexBuffer);
-        outMeshes[0].storedIndices = std::make_shared<std::vector<uint32_t>>(indexBuffer);
+        // Build the LOD chain, each level simplified from the one before it, and all sharing the same vertices
+        sub.lodCount = 1;
+        sub.lodICount[0] = static_cast<uint32_t>(subIndices.size());
+        sub.lodError[0] = 0.f;
+        std::vector<uint32_t> lodIndices = subIndices;
+        for (uint32_t lod = 1; lod < MAX_MESH_LODS; ++lod) {
+          float error;
+          std::vector<uint32_t> simplified = simplifyMesh(globalVertLayout, subVerts, lodIndices,
+                                                          lodIndices.size() / 6 * 3, error);
+          if (simplified.empty() || simplified.size() * 10 > lodIndices.size() * 9) { break; } // not worth a level
+          sub.lodICount[lod] = static_cast<uint32_t>(simplified.size());
+          sub.lodError[lod] = sub.lodError[lod - 1] + error;
+          sub.lodCount = lod + 1;
+          subIndices.insert(subIndices.end(), simplified.begin(), simplified.end());
+          lodIndices.swap(simplified);
+          if (settings::graphics::vulkan::verboseMeshLoading) {
+            printf("LOD %u: %u triangles, error %f\n", lod, sub.lodICount[lod] / 3, sub.lodError[lod]);
+          }
+        }
+
+        sub.vOffset = static_cast<uint32_t>(optimized.vertices.size() / floatsPerVert);
+        sub.vCount = stats.verticesAfter;
+        sub.iOffset = static_cast<uint32_t>(optimized.indices.size());
+        sub.iCount = static_cast<uint32_t>(subIndices.size());
+        optimized.vertices.insert(optimized.vertices.end(), subVerts.begin(), subVerts.end());
+        optimized.indices.insert(optimized.indices.end(), subIndices.begin(), subIndices.end());
+        optimized.subMeshes.push_back(sub);
       }
+      cookedData = std::move(optimized);
     }
+
+    writeCookedMeshFile(cookedPath, cookedData, sourceHash, sourceStamp, layoutHash, MESH_FLAGS, combineSubMeshes,
+                        globalVertLayout.floatVertexSize);
+
+    outMeshes = loadMeshFromCooked(vertexBuffer.data(), indexBuffer.data(), cookedData.subMeshes.data(),
+                                   static_cast<uint32_t>(cookedData.subMeshes.size()),
+                                   hashCookedMeshKey(sourceHash, layoutHash, MESH_FLAGS, combineSubMeshes),
+                                   storeTriangles);
   }
 
   aiDetachAllLogStreams();
@@ -179,6 +323,246 @@ MeshResources <EcsInterface> VulkanContext<EcsInterface>::loadMeshFromFile(
 
 
 
+template<typename EcsInterface>
+bool VulkanContext<EcsInterface>::ensureMeshResident(const std::string &meshName) {
+  if (meshRepo.count(meshName)) { return true; }
+  if ( ! meshSources.count(meshName)) { return false; }
+  MeshSource &source = meshSources.at(meshName);
+  printf("\n%s:\nLoading Mesh: %s\n", meshName.c_str(), source.path.c_str());
+  if (source.storeTriangles) {
+    printf("Storing triangles of %s for use as a static terrain.\n", meshName.c_str());
+  }
+  MeshResources<EcsInterface> &resources =
+      meshRepo.emplace(meshName, loadMeshFromFile(source.path.c_str(), true, source.storeTriangles)).first->second;
+  for (auto &mesh : resources) {
+    meshResidentSize += mesh.bufferMemory.size;
+  }
+  source.lastUsed = ++meshUseCounter;
+  residencyChanged = true;
+  return true;
+}
+
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::evictMesh(const std::string &meshName) {
+  printf("Evicting Mesh: %s\n", meshName.c_str());
+  for (auto &mesh : meshRepo.at(meshName)) {
+    AT3_ASSERT(mesh.instances.empty(), "Evicting a mesh that still has instances");
+    meshResidentSize -= mesh.bufferMemory.size;
+    retireBuffer(mesh.buffer, mesh.bufferMemory);
+  }
+  meshRepo.erase(meshName);
+}
+
+/**
+ * A buffer that the frames in flight may still be reading is only destroyed once their fences have signalled.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::retireBuffer(VkBuffer buffer, const Allocation &memory) {
+  retiredBuffers.push_back({buffer, memory, common.framesSubmitted});
+}
+
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::destroyRetiredBuffers() {
+  auto finished = std::partition(retiredBuffers.begin(), retiredBuffers.end(), [this](const RetiredBuffer &retired) {
+    return retired.frame > common.framesCompleted;
+  });
+  for (auto it = finished; it != retiredBuffers.end(); ++it) {
+    vkDestroyBuffer(common.device, it->buffer, nullptr);
+    freeDeviceMemory(it->memory);
+  }
+  retiredBuffers.erase(finished, retiredBuffers.end());
+
+  // The UBO pages trimmed by compactUboPages, and their descriptor sets
+  dataStore->destroyRetiredPages();
+  auto finishedSets = std::partition(retiredDescriptorSets.begin(), retiredDescriptorSets.end(),
+                                     [this](const RetiredDescriptorSet &retired) {
+    return retired.frame > common.framesCompleted;
+  });
+  for (auto it = finishedSets; it != retiredDescriptorSets.end(); ++it) {
+    vkFreeDescriptorSets(common.device, common.descriptorPool, 1, &it->set);
+  }
+  retiredDescriptorSets.erase(finishedSets, retiredDescriptorSets.end());
+}
+
+/**
+ * Blocks until every frame submitted so far has finished, by waiting on the fences of those still in flight. Unlike
+ * vkDeviceWaitIdle, this doesn't wait for any other work on the device.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::waitForFramesInFlight() {
+  std::vector<VkFence> fences;
+  for (uint32_t i = 0; i < common.frameFences.size(); ++i) {
+    if (common.frameSerials[i] > common.framesCompleted) {
+      fences.push_back(common.frameFences[i]);
+    }
+  }
+  if ( ! fences.empty()) {
+    vkWaitForFences(common.device, (uint32_t) fences.size(), fences.data(), VK_TRUE, 5000000000);
+  }
+  common.framesCompleted = common.framesSubmitted;
+}
+
+template<typename EcsInterface>
+VkDeviceSize VulkanContext<EcsInterface>::evictUnusedMeshes(VkDeviceSize bytesToFree) {
+  std::vector<std::pair<uint64_t, std::string>> candidates; // least recently used first, once sorted
+  for (auto &pair : meshSources) {
+    if ( ! pair.second.refCount && meshRepo.count(pair.first)) {
+      candidates.emplace_back(pair.second.lastUsed, pair.first);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+  VkDeviceSize freed = 0;
+  for (auto &candidate : candidates) {
+    if (freed >= bytesToFree) { break; }
+    for (auto &mesh : meshRepo.at(candidate.second)) {
+      freed += mesh.bufferMemory.size;
+    }
+    evictMesh(candidate.second);
+  }
+  return freed;
+}
+
+/**
+ * Called once per frame before rendering. This is the only place where assets are evicted and where the texture
+ * descriptors are rewritten. It only does anything more than free what was retired in a frame in which something was
+ * loaded, released or streamed. Evicted and replaced images and buffers are only destroyed once the fences of the
+ * frames that may have used them have signalled. A texture descriptor can't be rewritten while a frame in flight may
+ * sample it, though, so replacing or evicting a texture waits for the frames in flight. Merely loading a texture does
+ * not if the texture table is bindless, since no frame in flight can be sampling the newly written entry. Otherwise
+ * any change to the table waits for them.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::updateResidency() {
+  textureRepo->destroyRetired();
+  destroyRetiredBuffers();
+
+  // Stream in the texture detail that the last frame asked for. This marks the descriptors dirty if it did anything.
+  textureRepo->updateStreaming((VkDeviceSize) settings::graphics::vulkan::textureBudgetMiB * 1024 * 1024);
+
+  if ( ! residencyChanged && ! textureRepo->descriptorsAreDirty()) { return; }
+  residencyChanged = false;
+
+  VkDeviceSize budget = (VkDeviceSize) settings::graphics::vulkan::assetBudgetMiB * 1024 * 1024;
+  VkDeviceSize residentSize = meshResidentSize + textureRepo->getResidentSize();
+  bool overBudget = budget && residentSize > budget;
+  if ( ! overBudget && ! textureRepo->descriptorsAreDirty()) { return; }
+
+  if (overBudget) {
+    VkDeviceSize excess = residentSize - budget;
+    VkDeviceSize freed = evictUnusedMeshes(excess);
+    if (freed < excess) {
+      freed += textureRepo->evictUnused(excess - freed);
+    }
+    if (freed < excess) {
+      fprintf(stderr, "Vulkan: %llu MiB of assets are in use, over the budget of %u MiB\n",
+              (unsigned long long) ((residentSize - freed) / (1024 * 1024)), settings::graphics::vulkan::assetBudgetMiB);
+    }
+  }
+
+  if (textureRepo->descriptorsAreDirty()) {
+    if (textureRepo->descriptorsWereReplaced() || ! pipelineRepo->textureTable.bindless) {
+      waitForFramesInFlight();
+    }
+    rewriteTextureDescriptors();
+    textureRepo->clearDescriptorsDirty();
+  }
+}
+
+/**
+ * Called once per frame before rendering. While the allocator is emptying blocks of device memory, this moves up to
+ * maxDefragmentationBytesPerFrame of mesh buffers out of them, each into a new buffer, with one transfer for all of
+ * them. The old buffers are retired, to be freed (which releases the block once it's empty) when the frames that may
+ * still draw from them have finished. Meshes are the only thing in pooled device memory that can be moved this way, so
+ * the allocator is told to stop on any pool whose block has none of them left.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::defragmentDeviceMemory() {
+  if ( ! pool::defragmentationPending()) { return; }
+
+  // Pools with meshes left to move out of the block, or old buffers in it that are still to be freed
+  std::vector<bool> pending(pool::state.memPools.size(), false);
+  for (auto &retired : retiredBuffers) {
+    if (pool::isEvacuating(retired.memory)) {
+      pending[retired.memory.pool] = true;
+    }
+  }
+  CommandBuffer scratch = {};
+  VkDeviceSize bytesMoved = 0;
+  for (auto &pair : meshRepo) {
+    for (auto &mesh : pair.second) {
+      if ( ! pool::isEvacuating(mesh.bufferMemory)) { continue; }
+      pending[mesh.bufferMemory.pool] = true;
+      if (bytesMoved >= maxDefragmentationBytesPerFrame) { continue; }
+      if ( ! scratch.buffer) {
+        scratch = beginScratchCommandBuffer(CmdPoolType::Transfer);
+      }
+      VkDeviceSize bufferSize = mesh.bufferSize;
+      VkBuffer newBuffer;
+      Allocation newMemory;
+      createBuffer(newBuffer, newMemory, bufferSize,
+                   VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationCategory::MESH);
+      copyBuffer(mesh.buffer, newBuffer, bufferSize, 0, 0, scratch);
+      retireBuffer(mesh.buffer, mesh.bufferMemory);
+      meshResidentSize += newMemory.size - mesh.bufferMemory.size;
+      mesh.buffer = newBuffer;
+      mesh.bufferMemory = newMemory;
+      bytesMoved += bufferSize;
+    }
+  }
+  if (scratch.buffer) { // The copies are done once this returns, before any frame draws from the new buffers
+    submitScratchCommandBuffer(scratch);
+  }
+
+  for (uint32_t i = 0; i < pending.size(); ++i) {
+    if ( ! pending[i] && pool::state.memPools[i].evacuating != pool::noBlock) {
+      pool::stopDefragmentation(i);
+    }
+  }
+}
+
+/**
+ * Called once per frame before rendering. Once enough mesh instances have been de-registered that their UBO slots
+ * would fit in fewer pages, this moves the instances in the last pages into free slots in the first ones and frees the
+ * pages (and their descriptor sets) that are left empty. Instance data is rewritten every frame, so only the indices
+ * need to move. The trimmed pages and their descriptor sets are retired, to be destroyed once the frames in flight
+ * are done with them.
+ */
+template<typename EcsInterface>
+void VulkanContext<EcsInterface>::compactUboPages() {
+  if ( ! dataStore->shouldCompact()) { return; }
+
+  uint32_t targetPages = dataStore->getCompactedPageCount();
+  uint32_t moved = 0;
+  for (auto &pair : meshRepo) {
+    for (auto &mesh : pair.second) {
+      for (auto &instance : mesh.instances) {
+        if (instance.indices.getPage() < targetPages) { continue; }
+        uint32_t texture = instance.indices.getTexture();
+        dataStore->release(instance.indices);
+        // Slots come from the lowest page with room, and the live slots fit in targetPages, so this never adds a page
+        UboPageMgr::AcquireStatus didAcquire = dataStore->acquire(instance.indices);
+        AT3_ASSERT(didAcquire == UboPageMgr::AcquireStatus::SUCCESS, "Error moving ubo index");
+        instance.indices.setTexture(texture);
+        ++moved;
+      }
+    }
+  }
+
+  uint32_t oldPages = dataStore->getNumPages();
+  uint32_t newPages = dataStore->trimEmptyPages();
+  updateDescriptorSets(dataStore.get());
+  if (settings::graphics::vulkan::verboseMeshLoading) {
+    printf("Compacted %u mesh instances from %u UBO pages into %u\n", moved, oldPages, newPages);
+  }
+}
+
+
+
+
+
+
 //template<typename EcsInterface>
 //void
 //VulkanContext<EcsInterface>::quad(
@@ -0,0 +1,245 @@
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include "vkcLightGrid.hpp"
+#include "vkcUboPageMgr.hpp"
+
+namespace at3::vkc {
+
+  LightGrid::LightGrid(Common &ctxt, PipelineRepository &pipelineRepo) : ctxt(&ctxt), pipelineRepo(&pipelineRepo) {
+    // One set per frame
+    VkDescriptorPoolSize poolSizes[2] = {};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    poolSizes[0].descriptorCount = maxFrames * LIGHT_GRID_LIGHTS;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = maxFrames * (LIGHT_GRID_BINDING_COUNT - LIGHT_GRID_LIGHTS);
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 2;
+    poolInfo.pPoolSizes = poolSizes;
+    poolInfo.maxSets = maxFrames;
+    VkResult res = vkCreateDescriptorPool(ctxt.device, &poolInfo, nullptr, &descPool);
+    AT3_ASSERT(res == VK_SUCCESS, "Error creating light grid descriptor pool");
+  }
+
+  void LightGrid::createFrame() {
+    AT3_ASSERT(frames.size() < maxFrames, "Too many frames in flight for the light grid");
+    Frame &frame = frames.emplace_back();
+
+    // Start with room for a light, and a light in every tile
+    reserveBuffer(frame.lights, sizeof(PointLight));
+    reserveBuffer(frame.tiles, 3 * tileCountX * tileCountY * sizeof(uint32_t));
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &pipelineRepo->at(DEFERRED_COMPOSE).descSetLayouts[0];
+    VkResult res = vkAllocateDescriptorSets(ctxt->device, &allocInfo, &frame.descSet);
+    AT3_ASSERT(res == VK_SUCCESS, "Error allocating light grid descriptor set");
+
+    writeAttachmentDescriptors(frame);
+    writeBufferDescriptors(frame);
+  }
+
+  /*
+   * Make sure that a host-visible buffer has room for size bytes, growing it if it doesn't. Returns true if the buffer
+   * was replaced, in which case the descriptors that point at it need to be rewritten. Its contents are lost.
+   */
+  bool LightGrid::reserveBuffer(Buffer &buffer, VkDeviceSize size) {
+    if (buffer.size >= size) { return false; }
+    VkDeviceSize newSize = std::max(size, 2 * buffer.size);
+    destroyBuffer(buffer);
+    createBuffer(buffer.buffer, buffer.memory, newSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, *ctxt,
+                 AllocationCategory::STAGING);
+    buffer.size = newSize;
+    vkMapMemory(ctxt->device, buffer.memory.handle, buffer.memory.offset, newSize, 0, &buffer.map);
+    return true;
+  }
+
+  void LightGrid::destroyBuffer(Buffer &buffer) {
+    if ( ! buffer.size) { return; }
+    vkUnmapMemory(ctxt->device, buffer.memory.handle);
+    vkDestroyBuffer(ctxt->device, buffer.buffer, nullptr);
+    ctxt->allocator.free(buffer.memory);
+    buffer = Buffer();
+  }
+
+  /*
+   * Point a frame's set at the current G-buffer. The frame must not be in use by the GPU.
+   */
+  void LightGrid::writeAttachmentDescriptors(Frame &frame) {
+    VkDescriptorImageInfo imageInfos[LIGHT_GRID_LIGHTS];
+    VkWriteDescriptorSet writes[LIGHT_GRID_LIGHTS];
+    for (uint32_t i = 0; i < LIGHT_GRID_LIGHTS; ++i) {
+      imageInfos[i].sampler = VK_NULL_HANDLE;
+      imageInfos[i].imageView = gBufferViews[i];
+      imageInfos[i].imageLayout = i == LIGHT_GRID_DEPTH ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL
+                                                        : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+      writes[i] = {};
+      writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[i].dstSet = frame.descSet;
+      writes[i].dstBinding = i;
+      writes[i].descriptorCount = 1;
+      writes[i].descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+      writes[i].pImageInfo = &imageInfos[i];
+    }
+    vkUpdateDescriptorSets(ctxt->device, LIGHT_GRID_LIGHTS, writes, 0, nullptr);
+  }
+
+  /*
+   * Point a frame's set at its current buffers. The frame must not be in use by the GPU.
+   */
+  void LightGrid::writeBufferDescriptors(Frame &frame) {
+    VkDescriptorBufferInfo bufferInfos[2] = {{frame.lights.buffer, 0, VK_WHOLE_SIZE},
+                                             {frame.tiles.buffer, 0, VK_WHOLE_SIZE}};
+    VkWriteDescriptorSet writes[2];
+    for (uint32_t i = 0; i < 2; ++i) {
+      writes[i] = {};
+      writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[i].dstSet = frame.descSet;
+      writes[i].dstBinding = LIGHT_GRID_LIGHTS + i;
+      writes[i].descriptorCount = 1;
+      writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(ctxt->device, 2, writes, 0, nullptr);
+  }
+
+  void LightGrid::setGBuffer(VkImageView albedo, VkImageView normal, VkImageView depth, VkExtent2D newExtent) {
+    gBufferViews[LIGHT_GRID_ALBEDO] = albedo;
+    gBufferViews[LIGHT_GRID_NORMAL] = normal;
+    gBufferViews[LIGHT_GRID_DEPTH] = depth;
+    extent = newExtent;
+    tileCountX = (extent.width + tileSize - 1) / tileSize;
+    tileCountY = (extent.height + tileSize - 1) / tileSize;
+    for (auto &frame : frames) {
+      writeAttachmentDescriptors(frame);
+    }
+  }
+
+  /*
+   * The box around a light's sphere in view space projects to somewhere within the projections of its corners, which
+   * are all at either its nearest or farthest depth. If the sphere reaches the camera, it could be anywhere on screen.
+   * Returns false if the light can't reach any tile.
+   */
+  bool LightGrid::findTiles(const PointLight &light, const glm::mat4 &view, const glm::mat4 &proj,
+                            TileRect &outRect) {
+    glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(light.positionRadius), 1.f));
+    float radius = light.positionRadius.w;
+    float depth = -center.z; // The camera looks down -z
+    if (depth + radius <= 0.f) { return false; } // Entirely behind the camera
+
+    glm::vec2 ndcMin(-1.f), ndcMax(1.f);
+    if (depth - radius > 0.f) {
+      ndcMin = glm::vec2(FLT_MAX);
+      ndcMax = glm::vec2(-FLT_MAX);
+      for (float cornerDepth : {depth - radius, depth + radius}) {
+        for (float x : {center.x - radius, center.x + radius}) {
+          for (float y : {center.y - radius, center.y + radius}) {
+            glm::vec2 ndc(proj[0][0] * x / cornerDepth, proj[1][1] * y / cornerDepth);
+            ndcMin = glm::min(ndcMin, ndc);
+            ndcMax = glm::max(ndcMax, ndc);
+          }
+        }
+      }
+      if (ndcMax.x < -1.f || ndcMax.y < -1.f || ndcMin.x > 1.f || ndcMin.y > 1.f) { return false; }
+      ndcMin = glm::max(ndcMin, glm::vec2(-1.f));
+      ndcMax = glm::min(ndcMax, glm::vec2(1.f));
+    }
+
+    glm::vec2 screenSize((float) extent.width, (float) extent.height);
+    glm::vec2 pixelMin = (ndcMin * 0.5f + 0.5f) * screenSize;
+    glm::vec2 pixelMax = (ndcMax * 0.5f + 0.5f) * screenSize;
+    outRect.minX = std::min((uint32_t) pixelMin.x / tileSize, tileCountX - 1);
+    outRect.minY = std::min((uint32_t) pixelMin.y / tileSize, tileCountY - 1);
+    outRect.maxX = std::min((uint32_t) pixelMax.x / tileSize, tileCountX - 1);
+    outRect.maxY = std::min((uint32_t) pixelMax.y / tileSize, tileCountY - 1);
+    return true;
+  }
+
+  void LightGrid::update(uint32_t frameIndex, const std::vector<PointLight> &lights, const glm::mat4 &view,
+                         const glm::mat4 &proj) {
+    AT3_ASSERT(tileCountX && tileCountY, "The light grid has no G-buffer to light");
+    while (frames.size() <= frameIndex) {
+      createFrame();
+    }
+    Frame &frame = frames[frameIndex];
+
+    // Count the lights in each tile, next to where each tile's offset will go
+    uint32_t tileCount = tileCountX * tileCountY;
+    tileData.assign(2 * tileCount, 0);
+    rects.clear();
+    for (uint32_t i = 0; i < lights.size(); ++i) {
+      TileRect rect = {};
+      if ( ! findTiles(lights[i], view, proj, rect)) { continue; }
+      rect.light = i;
+      rects.push_back(rect);
+      for (uint32_t y = rect.minY; y <= rect.maxY; ++y) {
+        for (uint32_t x = rect.minX; x <= rect.maxX; ++x) {
+          ++tileData[2 * (y * tileCountX + x) + 1];
+        }
+      }
+    }
+
+    // Give each tile its range of the index list, then fill them in, counting up again
+    uint32_t indexCount = 2 * tileCount;
+    for (uint32_t tile = 0; tile < tileCount; ++tile) {
+      tileData[2 * tile] = indexCount;
+      indexCount += tileData[2 * tile + 1];
+      tileData[2 * tile + 1] = 0;
+    }
+    tileData.resize(indexCount);
+    for (auto &rect : rects) {
+      for (uint32_t y = rect.minY; y <= rect.maxY; ++y) {
+        for (uint32_t x = rect.minX; x <= rect.maxX; ++x) {
+          uint32_t tile = y * tileCountX + x;
+          tileData[tileData[2 * tile] + tileData[2 * tile + 1]++] = rect.light;
+        }
+      }
+    }
+
+    bool replaced = reserveBuffer(frame.lights, std::max<size_t>(lights.size(), 1) * sizeof(PointLight));
+    replaced = reserveBuffer(frame.tiles, tileData.size() * sizeof(uint32_t)) || replaced;
+    if (replaced) {
+      writeBufferDescriptors(frame);
+    }
+    if ( ! lights.empty()) {
+      memcpy(frame.lights.map, lights.data(), lights.size() * sizeof(PointLight));
+    }
+    memcpy(frame.tiles.map, tileData.data(), tileData.size() * sizeof(uint32_t));
+
+    frame.params.invViewProj = glm::inverse(proj * view);
+    frame.params.screenSize = glm::vec2((float) extent.width, (float) extent.height);
+    frame.params.tileCount = glm::uvec2(tileCountX, tileCountY);
+  }
+
+  void LightGrid::recordCompose(VkCommandBuffer commandBuffer, uint32_t frameIndex) {
+    Frame &frame = frames.at(frameIndex);
+    auto &pipeline = pipelineRepo->at(DEFERRED_COMPOSE);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.handle);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, 0, 1, &frame.descSet, 0,
+                            nullptr);
+    vkCmdPushConstants(commandBuffer, pipeline.layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(ComposeParams),
+                       &frame.params);
+    vkCmdDraw(commandBuffer, 3, 1, 0, 0); // One triangle that covers the screen
+  }
+
+  /*
+   * Only called when the GPU is idle.
+   */
+  void LightGrid::destroy() {
+    for (auto &frame : frames) {
+      destroyBuffer(frame.lights);
+      destroyBuffer(frame.tiles);
+    }
+    frames.clear();
+    vkDestroyDescriptorPool(ctxt->device, descPool, nullptr); // Frees the sets too
+    descPool = VK_NULL_HANDLE;
+  }
+
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vkcPipelines.hpp"
+#include "math.hpp"
+
+namespace at3::vkc {
+
+  /*
+   * The point lights that the deferred compose pass shades with, culled against a grid of screen tiles on the CPU.
+   * Each frame, update finds which tiles each light's sphere of influence could reach, and writes the lights and each
+   * tile's list of them to that frame's buffers, so the compose shader only loops over the lights of a pixel's own tile.
+   * The cost of lighting then grows with the pixels that each light covers, rather than with every light at every
+   * pixel.
+   *
+   * The compose pass reads the G-buffer through the same descriptor set. It follows the views given to setGBuffer,
+   * which must be called before the first frame and whenever the G-buffer changes.
+   */
+  class LightGrid {
+
+    public:
+
+      static constexpr uint32_t tileSize = 16; // Pixels on each side, TILE_SIZE in the deferredCompose shader
+      static constexpr uint32_t maxFrames = 8;
+
+      LightGrid(Common &ctxt, PipelineRepository &pipelineRepo);
+      /*
+       * Read the G-buffer and depth through these views from now on. The GPU must be idle.
+       */
+      void setGBuffer(VkImageView albedo, VkImageView normal, VkImageView depth, VkExtent2D extent);
+      /*
+       * Cull the lights (in world space) against the tiles of a frame seen through view and proj. The frame index picks
+       * which buffers to write, and must not be in use by the GPU.
+       */
+      void update(uint32_t frame, const std::vector<PointLight> &lights, const glm::mat4 &view, const glm::mat4 &proj);
+      /*
+       * Record the compose pass of a frame that has been updated, from within SUBPASS_COMPOSE.
+       */
+      void recordCompose(VkCommandBuffer commandBuffer, uint32_t frame);
+      void destroy();
+
+    private:
+
+      struct Buffer {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        Allocation memory = {};
+        VkDeviceSize size = 0;
+        void *map = nullptr;
+      };
+
+      struct Frame {
+        Buffer lights;
+        Buffer tiles;
+        ComposeParams params = {};
+        VkDescriptorSet descSet = VK_NULL_HANDLE;
+      };
+
+      // The tiles that a light could reach, inclusive
+      struct TileRect {
+        uint32_t light;
+        uint32_t minX, minY, maxX, maxY;
+      };
+
+      Common *ctxt;
+      PipelineRepository *pipelineRepo;
+      VkDescriptorPool descPool = VK_NULL_HANDLE;
+      std::vector<Frame> frames;
+      VkImageView gBufferViews[LIGHT_GRID_LIGHTS] = {}; // Indexed by binding
+      VkExtent2D extent = {};
+      uint32_t tileCountX = 0, tileCountY = 0;
+      std::vector<TileRect> rects;      // Only kept to avoid reallocating every frame
+      std::vector<uint32_t> tileData;   // As the shader sees it, built here before being copied over
+
+      void createFrame();
+      bool reserveBuffer(Buffer &buffer, VkDeviceSize size);
+      void destroyBuffer(Buffer &buffer);
+      void writeAttachmentDescriptors(Frame &frame);
+      void writeBufferDescriptors(Frame &frame);
+      bool findTiles(const PointLight &light, const glm::mat4 &view, const glm::mat4 &proj, TileRect &outRect);
+  };
+
+}
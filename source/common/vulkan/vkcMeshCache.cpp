@@ -0,0 +1,277 @@
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+
+#include "vkcMeshCache.hpp"
+#include "fileSystemHelpers.hpp"
+#include "hash.hpp"
+
+namespace at3::vkc {
+
+  static const uint32_t cookedMeshMagic = 0x48534D41; // "AMSH"
+  static const uint32_t cookedMeshVersion = 4;
+  static const char *cookedMeshDir = "./assets/cooked";
+  static const char *cookedMeshExt = ".at3mesh";
+
+  static size_t getSubMeshTableOffset() {
+    return sizeof(CookedMeshHeader);
+  }
+  static size_t getVertexDataOffset(const CookedMeshHeader &header) {
+    return getSubMeshTableOffset() + sizeof(CookedSubMesh) * header.subMeshCount;
+  }
+  static size_t getIndexDataOffset(const CookedMeshHeader &header) {
+    return getVertexDataOffset(header) + (size_t)header.vertexSize * header.vertexCount;
+  }
+  static size_t getTotalSize(const CookedMeshHeader &header) {
+    return getIndexDataOffset(header) + sizeof(uint32_t) * header.indexCount;
+  }
+
+  bool SourceFileStamp::operator==(const SourceFileStamp &other) const {
+    return size == other.size && modTime == other.modTime;
+  }
+
+  CookedMeshFile::~CookedMeshFile() {
+    unmap();
+  }
+
+  void CookedMeshFile::unmap() {
+#   ifdef _WIN32
+    if (mapping) { UnmapViewOfFile(mapping); }
+    if (mapHandle) { CloseHandle(mapHandle); }
+    if (fileHandle) { CloseHandle(fileHandle); }
+    mapHandle = nullptr;
+    fileHandle = nullptr;
+#   else
+    if (mapping) { munmap(mapping, mappingSize); }
+#   endif
+    mapping = nullptr;
+    mappingSize = 0;
+    header = nullptr;
+    stampOutdated = false;
+  }
+
+  /*
+   * Everything that is read from the file later must lie inside it, however it was truncated or corrupted.
+   */
+  bool CookedMeshFile::isWellFormed() const {
+    if (getTotalSize(*header) != mappingSize) { return false; }
+    const CookedSubMesh *subMeshes = getSubMeshes();
+    for (uint32_t i = 0; i < header->subMeshCount; ++i) {
+      const CookedSubMesh &sub = subMeshes[i];
+      if ((uint64_t) sub.vOffset + sub.vCount > header->vertexCount) { return false; }
+      if ((uint64_t) sub.iOffset + sub.iCount > header->indexCount) { return false; }
+      if (sub.lodCount < 1 || sub.lodCount > MAX_MESH_LODS) { return false; }
+      uint64_t lodIndices = 0;
+      for (uint32_t lod = 0; lod < sub.lodCount; ++lod) {
+        lodIndices += sub.lodICount[lod];
+      }
+      if (lodIndices > sub.iCount) { return false; }
+    }
+    return true;
+  }
+
+  bool CookedMeshFile::open(const std::string &path, const std::string &sourcePath,
+                            const SourceFileStamp &sourceStamp, uint32_t layoutHash, uint32_t importFlags,
+                            bool combined, uint32_t vertexSize) {
+    unmap();
+
+#   ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) { return false; }
+    fileHandle = file;
+    LARGE_INTEGER fileSize;
+    if ( ! GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(CookedMeshHeader)) {
+      unmap();
+      return false;
+    }
+    mapHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if ( ! mapHandle) {
+      unmap();
+      return false;
+    }
+    mappingSize = (size_t)fileSize.QuadPart;
+    mapping = MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+    if ( ! mapping) {
+      unmap();
+      return false;
+    }
+#   else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { return false; }
+    struct stat fileStat {};
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(CookedMeshHeader)) {
+      close(fd);
+      return false;
+    }
+    mappingSize = (size_t)fileStat.st_size;
+    void *map = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid after the descriptor is closed
+    if (map == MAP_FAILED) {
+      mappingSize = 0;
+      return false;
+    }
+    mapping = map;
+#   endif
+
+    header = (const CookedMeshHeader *) mapping;
+    bool valid = header->magic == cookedMeshMagic
+                 && header->version == cookedMeshVersion
+                 && header->layoutHash == layoutHash
+                 && header->importFlags == importFlags
+                 && (bool)header->combined == combined
+                 && header->vertexSize == vertexSize;
+    if (valid && ! isWellFormed()) {
+      fprintf(stderr, "Cooked mesh %s is corrupt, and will be cooked again\n", path.c_str());
+      valid = false;
+    }
+    if (valid && ! (SourceFileStamp {header->sourceSize, header->sourceModTime} == sourceStamp)) {
+      valid = header->sourceHash == hashFileContents(sourcePath);
+      stampOutdated = valid;
+    }
+    if ( ! valid) {
+      unmap();
+    }
+    return valid;
+  }
+
+  bool CookedMeshFile::isStampOutdated() const {
+    return stampOutdated;
+  }
+
+  uint64_t CookedMeshFile::getKey() const {
+    return hashCookedMeshKey(header->sourceHash, header->layoutHash, header->importFlags, header->combined);
+  }
+
+  uint32_t CookedMeshFile::getSubMeshCount() const {
+    return header ? header->subMeshCount : 0;
+  }
+
+  const CookedSubMesh *CookedMeshFile::getSubMeshes() const {
+    return (const CookedSubMesh *) ((const char *) mapping + getSubMeshTableOffset());
+  }
+
+  const float *CookedMeshFile::getVertices() const {
+    return (const float *) ((const char *) mapping + getVertexDataOffset(*header));
+  }
+
+  const uint32_t *CookedMeshFile::getIndices() const {
+    return (const uint32_t *) ((const char *) mapping + getIndexDataOffset(*header));
+  }
+
+  bool writeCookedMeshFile(const std::string &path, const CookedMeshData &data, uint64_t sourceHash,
+                           const SourceFileStamp &sourceStamp, uint32_t layoutHash, uint32_t importFlags,
+                           bool combined, uint32_t vertexSize) {
+    CookedMeshHeader header {};
+    header.magic = cookedMeshMagic;
+    header.version = cookedMeshVersion;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceStamp.size;
+    header.sourceModTime = sourceStamp.modTime;
+    header.layoutHash = layoutHash;
+    header.importFlags = importFlags;
+    header.combined = combined ? 1u : 0u;
+    header.vertexSize = vertexSize;
+    header.vertexCount = (uint32_t)(data.vertices.size() * sizeof(float) / vertexSize);
+    header.indexCount = (uint32_t)data.indices.size();
+    header.subMeshCount = (uint32_t)data.subMeshes.size();
+
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+
+    // Write to a temporary file first so that a crash mid-write never leaves a truncated file that looks valid.
+    std::string tempPath = path + ".tmp";
+    {
+      std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+      if ( ! out) {
+        fprintf(stderr, "Could not write cooked mesh: %s\n", path.c_str());
+        return false;
+      }
+      out.write((const char *) &header, sizeof(header));
+      out.write((const char *) data.subMeshes.data(), sizeof(CookedSubMesh) * data.subMeshes.size());
+      out.write((const char *) data.vertices.data(), sizeof(float) * data.vertices.size());
+      out.write((const char *) data.indices.data(), sizeof(uint32_t) * data.indices.size());
+      if ( ! out) {
+        fprintf(stderr, "Error while writing cooked mesh: %s\n", path.c_str());
+        return false;
+      }
+    }
+    fs::remove(path, ec);
+    fs::rename(tempPath, path, ec);
+    if (ec) {
+      fprintf(stderr, "Could not move cooked mesh into place: %s\n", path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  bool restampCookedMeshFile(const std::string &path, const SourceFileStamp &sourceStamp) {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    CookedMeshHeader header {};
+    file.read((char *) &header, sizeof(header));
+    if ( ! file || header.magic != cookedMeshMagic || header.version != cookedMeshVersion) { return false; }
+    header.sourceSize = sourceStamp.size;
+    header.sourceModTime = sourceStamp.modTime;
+    file.seekp(0);
+    file.write((const char *) &header, sizeof(header));
+    return (bool) file;
+  }
+
+  SourceFileStamp getSourceFileStamp(const std::string &path) {
+    SourceFileStamp stamp;
+    std::error_code ec;
+    uintmax_t size = fs::file_size(path, ec);
+    if (ec) { return stamp; }
+    auto modTime = fs::last_write_time(path, ec);
+    if (ec) { return stamp; }
+    stamp.size = (uint64_t) size;
+    stamp.modTime = (int64_t) modTime.time_since_epoch().count();
+    return stamp;
+  }
+
+  uint64_t hashFileContents(const std::string &path) {
+    std::ifstream in(path, std::ios::binary);
+    if ( ! in) { return 0; }
+    uint64_t hash = fnvOffsetBasis64;
+    char buf[1 << 16];
+    while (in) {
+      in.read(buf, sizeof(buf));
+      hash = fnv1a64(buf, (size_t) in.gcount(), hash);
+    }
+    return hash;
+  }
+
+  uint32_t hashVertexLayout(const VertexAttributes &layout) {
+    uint32_t hash = fnvOffsetBasis32;
+    auto mix = [&](uint32_t value) {
+      hash = fnv1a32(&value, sizeof(value), hash);
+    };
+    // Cooked vertices are always stored as interleaved floats, so the GPU-side formats don't matter here.
+    mix(layout.floatVertexSize);
+    mix(layout.attrCount);
+    for (uint32_t i = 0; i < layout.attrCount; ++i) {
+      mix((uint32_t) layout.attributes[i]);
+    }
+    return hash;
+  }
+
+  uint64_t hashCookedMeshKey(uint64_t sourceHash, uint32_t layoutHash, uint32_t importFlags, bool combined) {
+    uint32_t settings[] = {cookedMeshVersion, layoutHash, importFlags, (uint32_t) combined};
+    return fnv1a64(settings, sizeof(settings), fnv1a64(&sourceHash, sizeof(sourceHash)));
+  }
+
+  std::string getCookedMeshPath(const std::string &sourcePath) {
+    return (fs::path(cookedMeshDir) / getCacheFileStem(sourcePath)).string() + cookedMeshExt;
+  }
+
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vkcTypes.hpp"
+
+namespace at3::vkc {
+
+  /**
+   * A cooked mesh is the result of importing a mesh file through Assimp and interleaving its vertices according to the
+   * current global vertex layout. It is written to disk the first time a mesh is imported, and on later runs it is
+   * memory-mapped and its vertex and index data are copied straight into staging memory without any parsing.
+   *
+   * File layout (all offsets are in bytes from the start of the file, and all sections are 4-byte aligned):
+   *    |CookedMeshHeader|CookedSubMesh * subMeshCount|float * vertexFloatCount|uint32_t * indexCount|
+   *
+   * Vertex and index ranges in the sub-mesh table are given in elements (vertices and indices, not bytes), and the
+   * indices of each sub-mesh are relative to the first vertex of that sub-mesh. A sub-mesh's index range holds all of
+   * its LODs back to back, starting with the full-detail one.
+   */
+  struct CookedMeshHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;    // hash of the contents of the source file the mesh was imported from
+    uint64_t sourceSize;    // the size and modification time of the source file when it was last hashed, so that it
+    int64_t sourceModTime;  // is only hashed again when one of them has changed
+    uint32_t layoutHash;    // hash of the vertex layout the vertices were interleaved with
+    uint32_t importFlags;   // the Assimp post-processing flags used during import
+    uint32_t combined;      // nonzero if all sub-meshes were combined into one at import
+    uint32_t vertexSize;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t subMeshCount;
+    uint32_t padding;
+  };
+
+  struct CookedSubMesh {
+    uint32_t vOffset;
+    uint32_t vCount;
+    uint32_t iOffset;
+    uint32_t iCount;
+    glm::vec3 min;
+    glm::vec3 max;
+    uint32_t lodCount;
+    uint32_t lodICount[MAX_MESH_LODS];
+    float lodError[MAX_MESH_LODS];
+  };
+
+  /**
+   * The size and modification time of a source file, which are much quicker to check than its contents.
+   */
+  struct SourceFileStamp {
+    uint64_t size = 0;
+    int64_t modTime = 0;
+    bool operator==(const SourceFileStamp &other) const;
+  };
+
+  /**
+   * The same data that is stored in a cooked mesh file, but owned in memory. This is what an Assimp import produces.
+   */
+  struct CookedMeshData {
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<CookedSubMesh> subMeshes;
+  };
+
+  /**
+   * A read-only view of a cooked mesh file that has been memory-mapped. The mapping lives as long as the object does.
+   */
+  class CookedMeshFile {
+
+      void *mapping = nullptr;
+      size_t mappingSize = 0;
+#     ifdef _WIN32
+      void *fileHandle = nullptr;
+      void *mapHandle = nullptr;
+#     endif
+
+      const CookedMeshHeader *header = nullptr;
+      bool stampOutdated = false;
+
+      void unmap();
+      bool isWellFormed() const;
+
+    public:
+
+      CookedMeshFile() = default;
+      CookedMeshFile(const CookedMeshFile &) = delete;
+      CookedMeshFile &operator=(const CookedMeshFile &) = delete;
+      ~CookedMeshFile();
+
+      /**
+       * Map a cooked mesh file and check that it is still valid for the given source and layout. The source file is
+       * only hashed if its size or modification time differ from the ones the mesh was cooked with.
+       * @return true if the file exists, is well formed, and matches every given key. false means it must be re-cooked.
+       */
+      bool open(const std::string &path, const std::string &sourcePath, const SourceFileStamp &sourceStamp,
+                uint32_t layoutHash, uint32_t importFlags, bool combined, uint32_t vertexSize);
+      /**
+       * True if the file was valid, but only once its source had been hashed again, because the source was touched
+       * without being changed. Restamping it (see restampCookedMeshFile) saves hashing it on every run after this one.
+       */
+      bool isStampOutdated() const;
+      /**
+       * See hashCookedMeshKey.
+       */
+      uint64_t getKey() const;
+
+      uint32_t getSubMeshCount() const;
+      const CookedSubMesh *getSubMeshes() const;
+      const float *getVertices() const;
+      const uint32_t *getIndices() const;
+  };
+
+  /**
+   * Write a cooked mesh file, creating its parent directory if necessary.
+   * Failing to write is not fatal (the mesh will just be imported again next time), so this only reports it.
+   * @return true if the whole file was written
+   */
+  bool writeCookedMeshFile(const std::string &path, const CookedMeshData &data, uint64_t sourceHash,
+                           const SourceFileStamp &sourceStamp, uint32_t layoutHash, uint32_t importFlags,
+                           bool combined, uint32_t vertexSize);
+
+  /**
+   * Replace the source file stamp of a cooked mesh file that isn't mapped, leaving the rest of it as it is.
+   */
+  bool restampCookedMeshFile(const std::string &path, const SourceFileStamp &sourceStamp);
+
+  /**
+   * The size and modification time of a file, or zeros if it can't be read.
+   */
+  SourceFileStamp getSourceFileStamp(const std::string &path);
+
+  /**
+   * 64-bit FNV-1a hash of the entire contents of a file. Returns 0 if the file can't be read.
+   */
+  uint64_t hashFileContents(const std::string &path);
+
+  /**
+   * Hash of a vertex layout, used to invalidate cooked meshes when the global vertex layout changes.
+   */
+  uint32_t hashVertexLayout(const VertexAttributes &layout);
+
+  /**
+   * Identifies what a cooked mesh holds without reading it: the hash of its source file, the cooked format version, and
+   * the layout and settings it was imported with. Anything derived from a cooked mesh can be cached under this.
+   */
+  uint64_t hashCookedMeshKey(uint64_t sourceHash, uint32_t layoutHash, uint32_t importFlags, bool combined);
+
+  /**
+   * Where the cooked version of a given mesh file is (or will be) stored.
+   */
+  std::string getCookedMeshPath(const std::string &sourcePath);
+
+}
@@ -0,0 +1,514 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include "hash.hpp"
+#include "vkcMeshOptimizer.hpp"
+#include "vkcVertexFormat.hpp"
+
+namespace at3::vkc {
+
+  // Roughly the size of the post-transform cache on the hardware we care about, used only for measurement
+  static const uint32_t simulatedCacheSize = 16;
+
+  // Tuning values for the vertex cache optimization, as given by Tom Forsyth
+  static const uint32_t forsythCacheSize = 32;
+  static const float cacheDecayPower = 1.5f;
+  static const float lastTriScore = 0.75f;
+  static const float valenceBoostScale = 2.0f;
+  static const float valenceBoostPower = 0.5f;
+
+  VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount) {
+    VertexCacheStats stats;
+    if ( ! indexCount || ! vertexCount) { return stats; }
+    // A vertex is in the FIFO if fewer than simulatedCacheSize misses have happened since it was last inserted.
+    std::vector<uint32_t> insertedAt(vertexCount, 0);
+    uint32_t time = simulatedCacheSize + 1;
+    uint32_t misses = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+      uint32_t v = indices[i];
+      if (time - insertedAt[v] > simulatedCacheSize) {
+        insertedAt[v] = time++;
+        ++misses;
+      }
+    }
+    stats.acmr = (float) misses / (float) (indexCount / 3);
+    stats.atvr = (float) misses / (float) vertexCount;
+    return stats;
+  }
+
+  /**
+   * Merge vertices whose attributes are bitwise identical, which Assimp only does when asked to pre-transform meshes.
+   * @return the new vertex count
+   */
+  static size_t weldVertices(std::vector<float> &vertices, std::vector<uint32_t> &indices, uint32_t floatsPerVert) {
+    size_t vertexCount = vertices.size() / floatsPerVert;
+    const float *data = vertices.data();
+    size_t vertBytes = sizeof(float) * floatsPerVert;
+
+    auto hash = [&](uint32_t v) {
+      return (size_t) fnv1a64(data + (size_t) v * floatsPerVert, vertBytes);
+    };
+    auto equal = [&](uint32_t a, uint32_t b) {
+      return ! memcmp(data + (size_t) a * floatsPerVert, data + (size_t) b * floatsPerVert, vertBytes);
+    };
+    std::unordered_map<uint32_t, uint32_t, decltype(hash), decltype(equal)> unique(vertexCount, hash, equal);
+
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<float> welded;
+    welded.reserve(vertices.size());
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+      auto result = unique.emplace(v, (uint32_t) (welded.size() / floatsPerVert));
+      if (result.second) {
+        welded.insert(welded.end(), data + (size_t) v * floatsPerVert, data + (size_t) (v + 1) * floatsPerVert);
+      }
+      remap[v] = result.first->second;
+    }
+    for (auto &index : indices) {
+      index = remap[index];
+    }
+    vertices.swap(welded);
+    return vertices.size() / floatsPerVert;
+  }
+
+  static float getVertexScore(int32_t cachePos, uint32_t remainingTris) {
+    if ( ! remainingTris) { return -1.f; }
+    float score = 0.f;
+    if (cachePos >= 0) {
+      if (cachePos < 3) {
+        score = lastTriScore; // The last triangle's vertices get a fixed score so that strips aren't over-favored
+      } else {
+        float scaler = 1.f - (float) (cachePos - 3) / (float) (forsythCacheSize - 3);
+        score = powf(scaler, cacheDecayPower);
+      }
+    }
+    // Vertices with few triangles left get a boost, so that lone triangles aren't left behind to be drawn last
+    score += valenceBoostScale * powf((float) remainingTris, -valenceBoostPower);
+    return score;
+  }
+
+  /**
+   * Tom Forsyth's "Linear-Speed Vertex Cache Optimisation". Greedily emits the triangle with the best score, where
+   * vertices score higher the more recently they were used and the fewer unemitted triangles they have left.
+   */
+  static void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount) {
+    size_t triCount = indices.size() / 3;
+    if ( ! triCount) { return; }
+
+    // Build the vertex -> triangle adjacency
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (auto index : indices) {
+      ++remaining[index];
+    }
+    std::vector<uint32_t> adjOffsets(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; ++v) {
+      adjOffsets[v + 1] = adjOffsets[v] + remaining[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    {
+      std::vector<uint32_t> cursor(adjOffsets.begin(), adjOffsets.end() - 1);
+      for (size_t i = 0; i < indices.size(); ++i) {
+        adjacency[cursor[indices[i]]++] = (uint32_t) (i / 3);
+      }
+    }
+
+    std::vector<int32_t> cachePos(vertexCount, -1);
+    std::vector<float> vertScore(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+      vertScore[v] = getVertexScore(-1, remaining[v]);
+    }
+    std::vector<float> triScore(triCount);
+    for (size_t t = 0; t < triCount; ++t) {
+      triScore[t] = vertScore[indices[t * 3]] + vertScore[indices[t * 3 + 1]] + vertScore[indices[t * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(triCount, false);
+    std::vector<uint32_t> optimized;
+    optimized.reserve(indices.size());
+    std::vector<uint32_t> cache, nextCache;
+    cache.reserve(forsythCacheSize + 3);
+    nextCache.reserve(forsythCacheSize + 3);
+
+    size_t nextUnemitted = 0;
+    int64_t bestTri = std::max_element(triScore.begin(), triScore.end()) - triScore.begin();
+    for (size_t n = 0; n < triCount; ++n) {
+      if (bestTri < 0) { // Nothing in the cache has triangles left, so start somewhere new
+        while (emitted[nextUnemitted]) { ++nextUnemitted; }
+        bestTri = (int64_t) nextUnemitted;
+      }
+      emitted[bestTri] = true;
+      const uint32_t *tri = &indices[bestTri * 3];
+
+      nextCache.clear();
+      for (uint32_t k = 0; k < 3; ++k) {
+        uint32_t v = tri[k];
+        optimized.push_back(v);
+        nextCache.push_back(v);
+        uint32_t *adj = &adjacency[adjOffsets[v]];
+        for (uint32_t j = 0; j < remaining[v]; ++j) {
+          if (adj[j] == (uint32_t) bestTri) {
+            adj[j] = adj[remaining[v] - 1];
+            break;
+          }
+        }
+        --remaining[v];
+      }
+      for (auto v : cache) {
+        if (v != tri[0] && v != tri[1] && v != tri[2]) { nextCache.push_back(v); }
+      }
+      for (size_t i = forsythCacheSize; i < nextCache.size(); ++i) { // These fell out of the cache
+        cachePos[nextCache[i]] = -1;
+        vertScore[nextCache[i]] = getVertexScore(-1, remaining[nextCache[i]]);
+      }
+      nextCache.resize(std::min<size_t>(nextCache.size(), forsythCacheSize));
+      cache.swap(nextCache);
+
+      for (size_t i = 0; i < cache.size(); ++i) {
+        cachePos[cache[i]] = (int32_t) i;
+        vertScore[cache[i]] = getVertexScore((int32_t) i, remaining[cache[i]]);
+      }
+
+      // Only triangles that touch the cache can have changed, so the next one is chosen from among those
+      bestTri = -1;
+      float bestScore = -1.f;
+      for (auto v : cache) {
+        for (uint32_t j = 0; j < remaining[v]; ++j) {
+          uint32_t t = adjacency[adjOffsets[v] + j];
+          triScore[t] = vertScore[indices[t * 3]] + vertScore[indices[t * 3 + 1]] + vertScore[indices[t * 3 + 2]];
+          if (triScore[t] > bestScore) {
+            bestScore = triScore[t];
+            bestTri = t;
+          }
+        }
+      }
+    }
+    indices.swap(optimized);
+  }
+
+  /**
+   * A simplified version of the cluster sorting from Sander et al., "Fast Triangle Reordering for Vertex Locality and
+   * Reduced Overdraw". The cache-optimized triangles are split into clusters wherever the vertex cache would have been
+   * flushed anyway, and clusters that face away from the center of the mesh are drawn first, since they are the ones
+   * most likely to occlude the others. Vertex normals are used to decide which way a cluster faces so that this does
+   * not depend on the winding order.
+   */
+  static void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<float> &vertices,
+                               uint32_t floatsPerVert, uint32_t positionOffset, uint32_t normalOffset) {
+    size_t triCount = indices.size() / 3;
+    size_t vertexCount = vertices.size() / floatsPerVert;
+
+    std::vector<size_t> clusterStarts;
+    {
+      std::vector<uint32_t> insertedAt(vertexCount, 0);
+      uint32_t time = simulatedCacheSize + 1;
+      for (size_t t = 0; t < triCount; ++t) {
+        uint32_t misses = 0;
+        for (uint32_t k = 0; k < 3; ++k) {
+          uint32_t v = indices[t * 3 + k];
+          if (time - insertedAt[v] > simulatedCacheSize) {
+            insertedAt[v] = time++;
+            ++misses;
+          }
+        }
+        if (misses == 3 || t == 0) { clusterStarts.push_back(t); }
+      }
+    }
+    if (clusterStarts.size() < 2) { return; }
+    clusterStarts.push_back(triCount);
+
+    auto position = [&](uint32_t v) {
+      const float *p = &vertices[(size_t) v * floatsPerVert + positionOffset];
+      return glm::vec3(p[0], p[1], p[2]);
+    };
+    auto normal = [&](uint32_t v) {
+      const float *n = &vertices[(size_t) v * floatsPerVert + normalOffset];
+      return glm::vec3(n[0], n[1], n[2]);
+    };
+
+    glm::vec3 meshCentroid(0.f);
+    for (auto index : indices) {
+      meshCentroid += position(index);
+    }
+    meshCentroid /= (float) indices.size();
+
+    size_t clusterCount = clusterStarts.size() - 1;
+    std::vector<std::pair<float, size_t>> sortKeys(clusterCount);
+    for (size_t c = 0; c < clusterCount; ++c) {
+      glm::vec3 centroid(0.f), facing(0.f);
+      for (size_t i = clusterStarts[c] * 3; i < clusterStarts[c + 1] * 3; ++i) {
+        centroid += position(indices[i]);
+        facing += normal(indices[i]);
+      }
+      centroid /= (float) ((clusterStarts[c + 1] - clusterStarts[c]) * 3);
+      float facingLength = glm::length(facing);
+      float key = facingLength > 0.f ? glm::dot(centroid - meshCentroid, facing / facingLength) : 0.f;
+      sortKeys[c] = {-key, c}; // Most outward-facing first
+    }
+    std::stable_sort(sortKeys.begin(), sortKeys.end(),
+                     [](const std::pair<float, size_t> &a, const std::pair<float, size_t> &b) {
+                       return a.first < b.first;
+                     });
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(indices.size());
+    for (auto &key : sortKeys) {
+      sorted.insert(sorted.end(), indices.begin() + clusterStarts[key.second] * 3,
+                    indices.begin() + clusterStarts[key.second + 1] * 3);
+    }
+    indices.swap(sorted);
+  }
+
+  /**
+   * Renumber vertices in the order the index buffer first uses them, so that vertex fetch walks memory linearly.
+   * Vertices that no triangle uses are dropped.
+   */
+  static void optimizeVertexFetch(std::vector<float> &vertices, std::vector<uint32_t> &indices,
+                                  uint32_t floatsPerVert) {
+    size_t vertexCount = vertices.size() / floatsPerVert;
+    std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+    std::vector<float> reordered;
+    reordered.reserve(vertices.size());
+    for (auto &index : indices) {
+      if (remap[index] == UINT32_MAX) {
+        remap[index] = (uint32_t) (reordered.size() / floatsPerVert);
+        reordered.insert(reordered.end(), vertices.begin() + (size_t) index * floatsPerVert,
+                         vertices.begin() + (size_t) (index + 1) * floatsPerVert);
+      }
+      index = remap[index];
+    }
+    vertices.swap(reordered);
+  }
+
+  static void getPositionAndNormalOffsets(const VertexAttributes &layout, int64_t &positionOffset,
+                                         int64_t &normalOffset) {
+    positionOffset = -1;
+    normalOffset = -1;
+    uint32_t floatOffset = 0;
+    for (uint32_t i = 0; i < layout.attrCount; ++i) {
+      if (layout.attributes[i] == EMeshVertexAttribute::POSITION) { positionOffset = floatOffset; }
+      if (layout.attributes[i] == EMeshVertexAttribute::NORMAL) { normalOffset = floatOffset; }
+      floatOffset += getFloatAttributeSize(layout.attributes[i]);
+    }
+  }
+
+  MeshOptimizationStats optimizeMesh(const VertexAttributes &layout, std::vector<float> &vertices,
+                                     std::vector<uint32_t> &indices) {
+    MeshOptimizationStats stats;
+    uint32_t floatsPerVert = layout.floatVertexSize / sizeof(float);
+    size_t vertexCount = vertices.size() / floatsPerVert;
+    stats.verticesBefore = (uint32_t) vertexCount;
+    stats.before = analyzeVertexCache(indices.data(), indices.size(), vertexCount);
+
+    int64_t positionOffset, normalOffset;
+    getPositionAndNormalOffsets(layout, positionOffset, normalOffset);
+
+    vertexCount = weldVertices(vertices, indices, floatsPerVert);
+    optimizeVertexCache(indices, vertexCount);
+    if (positionOffset >= 0 && normalOffset >= 0) {
+      optimizeOverdraw(indices, vertices, floatsPerVert, (uint32_t) positionOffset, (uint32_t) normalOffset);
+    }
+    optimizeVertexFetch(vertices, indices, floatsPerVert);
+
+    stats.verticesAfter = (uint32_t) (vertices.size() / floatsPerVert);
+    stats.after = analyzeVertexCache(indices.data(), indices.size(), stats.verticesAfter);
+    return stats;
+  }
+
+  /**
+   * A symmetric 4x4 error quadric, stored as its upper triangle.
+   */
+  struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a03 = 0, a11 = 0, a12 = 0, a13 = 0, a22 = 0, a23 = 0, a33 = 0;
+
+    void addPlane(const glm::dvec3 &n, double d) {
+      a00 += n.x * n.x; a01 += n.x * n.y; a02 += n.x * n.z; a03 += n.x * d;
+      a11 += n.y * n.y; a12 += n.y * n.z; a13 += n.y * d;
+      a22 += n.z * n.z; a23 += n.z * d;
+      a33 += d * d;
+    }
+    void add(const Quadric &o) {
+      a00 += o.a00; a01 += o.a01; a02 += o.a02; a03 += o.a03;
+      a11 += o.a11; a12 += o.a12; a13 += o.a13;
+      a22 += o.a22; a23 += o.a23;
+      a33 += o.a33;
+    }
+    // The sum of squared distances from p to every plane in the quadric
+    double evaluate(const glm::dvec3 &p) const {
+      return a00 * p.x * p.x + 2 * a01 * p.x * p.y + 2 * a02 * p.x * p.z + 2 * a03 * p.x
+             + a11 * p.y * p.y + 2 * a12 * p.y * p.z + 2 * a13 * p.y
+             + a22 * p.z * p.z + 2 * a23 * p.z
+             + a33;
+    }
+  };
+
+  std::vector<uint32_t> simplifyMesh(const VertexAttributes &layout, const std::vector<float> &vertices,
+                                     const std::vector<uint32_t> &indices, size_t targetIndexCount, float &outError) {
+    outError = 0.f;
+    int64_t positionOffset, normalOffset;
+    getPositionAndNormalOffsets(layout, positionOffset, normalOffset);
+    if (positionOffset < 0) { return indices; }
+
+    uint32_t floatsPerVert = layout.floatVertexSize / sizeof(float);
+    size_t vertexCount = vertices.size() / floatsPerVert;
+    auto position = [&](uint32_t v) {
+      const float *p = &vertices[(size_t) v * floatsPerVert + positionOffset];
+      return glm::dvec3(p[0], p[1], p[2]);
+    };
+
+    std::vector<bool> locked(vertexCount, false);
+    { // Lock vertices on attribute seams (where several vertices share a position) and on borders of the surface
+      auto hash = [&](uint32_t v) {
+        return (size_t) fnv1a64(&vertices[(size_t) v * floatsPerVert + positionOffset], sizeof(float) * 3);
+      };
+      auto equal = [&](uint32_t a, uint32_t b) {
+        return ! memcmp(&vertices[(size_t) a * floatsPerVert + positionOffset],
+                        &vertices[(size_t) b * floatsPerVert + positionOffset], sizeof(float) * 3);
+      };
+      std::unordered_map<uint32_t, uint32_t, decltype(hash), decltype(equal)> positions(vertexCount, hash, equal);
+      std::vector<uint32_t> group(vertexCount);
+      std::vector<uint32_t> groupSize(vertexCount, 0);
+      for (uint32_t v = 0; v < vertexCount; ++v) {
+        group[v] = positions.emplace(v, v).first->second;
+        ++groupSize[group[v]];
+      }
+      std::unordered_map<uint64_t, uint32_t> edgeUses;
+      auto edgeKey = [&](uint32_t a, uint32_t b) {
+        uint64_t ga = group[a], gb = group[b];
+        return ga < gb ? (ga << 32u) | gb : (gb << 32u) | ga;
+      };
+      for (size_t i = 0; i < indices.size(); i += 3) {
+        for (uint32_t k = 0; k < 3; ++k) {
+          ++edgeUses[edgeKey(indices[i + k], indices[i + (k + 1) % 3])];
+        }
+      }
+      for (size_t i = 0; i < indices.size(); i += 3) {
+        for (uint32_t k = 0; k < 3; ++k) {
+          uint32_t a = indices[i + k], b = indices[i + (k + 1) % 3];
+          if (edgeUses[edgeKey(a, b)] != 2) {
+            locked[a] = true;
+            locked[b] = true;
+          }
+        }
+      }
+      for (uint32_t v = 0; v < vertexCount; ++v) {
+        if (groupSize[group[v]] > 1) { locked[v] = true; }
+      }
+    }
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      glm::dvec3 p0 = position(indices[i]), p1 = position(indices[i + 1]), p2 = position(indices[i + 2]);
+      glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+      double length = glm::length(n);
+      if (length <= 0.0) { continue; }
+      n /= length;
+      for (uint32_t k = 0; k < 3; ++k) {
+        quadrics[indices[i + k]].addPlane(n, -glm::dot(n, p0));
+      }
+    }
+
+    struct Collapse {
+      double cost;
+      uint32_t from, to;
+      bool operator<(const Collapse &o) const { return cost < o.cost; }
+    };
+
+    std::vector<uint32_t> result(indices);
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> adjOffsets(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    double maxCost = 0.0;
+
+    // Each pass collapses the cheapest edges that don't interfere with each other, until the target is reached
+    while (result.size() > targetIndexCount) {
+      std::fill(adjOffsets.begin(), adjOffsets.end(), 0);
+      for (auto index : result) { ++adjOffsets[index + 1]; }
+      for (size_t v = 0; v < vertexCount; ++v) { adjOffsets[v + 1] += adjOffsets[v]; }
+      adjacency.resize(result.size());
+      {
+        std::vector<uint32_t> cursor(adjOffsets.begin(), adjOffsets.end() - 1);
+        for (size_t i = 0; i < result.size(); ++i) {
+          adjacency[cursor[result[i]]++] = (uint32_t) (i / 3);
+        }
+      }
+
+      collapses.clear();
+      for (size_t i = 0; i < result.size(); i += 3) {
+        for (uint32_t k = 0; k < 3; ++k) {
+          uint32_t a = result[i + k], b = result[i + (k + 1) % 3];
+          if ( ! locked[a]) {
+            collapses.push_back({quadrics[a].evaluate(position(b)) + quadrics[b].evaluate(position(b)), a, b});
+          }
+          if ( ! locked[b]) {
+            collapses.push_back({quadrics[a].evaluate(position(a)) + quadrics[b].evaluate(position(a)), b, a});
+          }
+        }
+      }
+      if (collapses.empty()) { break; }
+      std::sort(collapses.begin(), collapses.end());
+
+      for (uint32_t v = 0; v < vertexCount; ++v) { remap[v] = v; }
+      std::fill(touched.begin(), touched.end(), false);
+      size_t trisToRemove = (result.size() - targetIndexCount) / 3;
+      size_t trisRemoved = 0;
+
+      for (auto &collapse : collapses) {
+        if (trisRemoved >= trisToRemove) { break; }
+        uint32_t from = collapse.from, to = collapse.to;
+        if (touched[from] || touched[to]) { continue; }
+
+        // Reject collapses that would move anything else that is changing this pass, or that would flip a triangle
+        bool valid = true;
+        uint32_t trisCollapsing = 0;
+        glm::dvec3 toPos = position(to);
+        for (uint32_t j = adjOffsets[from]; j < adjOffsets[from + 1] && valid; ++j) {
+          const uint32_t *tri = &result[adjacency[j] * 3];
+          if (touched[tri[0]] || touched[tri[1]] || touched[tri[2]]) { valid = false; }
+          if (tri[0] == to || tri[1] == to || tri[2] == to) {
+            ++trisCollapsing;
+            continue;
+          }
+          glm::dvec3 p[3] = {position(tri[0]), position(tri[1]), position(tri[2])};
+          glm::dvec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+          for (uint32_t k = 0; k < 3; ++k) {
+            if (tri[k] == from) { p[k] = toPos; }
+          }
+          glm::dvec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+          if (glm::dot(before, after) <= 0.0) { valid = false; }
+        }
+        if ( ! valid) { continue; }
+
+        remap[from] = to;
+        quadrics[to].add(quadrics[from]);
+        maxCost = std::max(maxCost, collapse.cost);
+        trisRemoved += trisCollapsing;
+        for (uint32_t j = adjOffsets[from]; j < adjOffsets[from + 1]; ++j) {
+          const uint32_t *tri = &result[adjacency[j] * 3];
+          touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = true;
+        }
+      }
+      if ( ! trisRemoved) { break; }
+
+      std::vector<uint32_t> next;
+      next.reserve(result.size());
+      for (size_t i = 0; i < result.size(); i += 3) {
+        uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+        if (a != b && b != c && a != c) {
+          next.push_back(a);
+          next.push_back(b);
+          next.push_back(c);
+        }
+      }
+      result.swap(next);
+    }
+
+    optimizeVertexCache(result, vertexCount);
+    outError = (float) sqrt(maxCost);
+    return result;
+  }
+
+}
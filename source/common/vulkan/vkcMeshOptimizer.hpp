@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "vkcTypes.hpp"
+
+namespace at3::vkc {
+
+  /**
+   * Average cache miss ratio (transformed vertices per triangle) and average transform to vertex ratio (transformed
+   * vertices per unique vertex), as measured by simulating a small FIFO post-transform cache. Lower is better for both,
+   * with ACMR approaching 0.5 and ATVR approaching 1.0 for well-ordered meshes.
+   */
+  struct VertexCacheStats {
+    float acmr = 0.f;
+    float atvr = 0.f;
+  };
+
+  struct MeshOptimizationStats {
+    VertexCacheStats before;
+    VertexCacheStats after;
+    uint32_t verticesBefore = 0;
+    uint32_t verticesAfter = 0;
+  };
+
+  /**
+   * Measure how well an index buffer uses the post-transform vertex cache.
+   */
+  VertexCacheStats analyzeVertexCache(const uint32_t *indices, size_t indexCount, size_t vertexCount);
+
+  /**
+   * Run the whole load-time optimization pipeline on one mesh in the interleaved float layout, in place:
+   *    1. Weld bitwise-identical vertices together.
+   *    2. Reorder triangles for the post-transform vertex cache (Forsyth's linear-speed algorithm).
+   *    3. Reorder clusters of those triangles so that outward-facing ones are drawn first, to reduce overdraw.
+   *    4. Reorder vertices into the order in which they are first referenced, to improve vertex fetch locality.
+   */
+  MeshOptimizationStats optimizeMesh(const VertexAttributes &layout, std::vector<float> &vertices,
+                                     std::vector<uint32_t> &indices);
+
+  /**
+   * Reduce the triangle count of a mesh by quadric edge collapse (Garland and Heckbert), collapsing each removed vertex
+   * onto one of its neighbors so that no new vertices are needed and the result can share the original vertex buffer.
+   * Vertices on borders and on attribute seams are never removed, so the result has no new cracks. The result is
+   * ordered for the vertex cache.
+   * @param targetIndexCount stop once there are at most this many indices (this may not be reachable)
+   * @param outError the largest distance by which the result is estimated to deviate from the input, in object space
+   * @return the new index buffer
+   */
+  std::vector<uint32_t> simplifyMesh(const VertexAttributes &layout, const std::vector<float> &vertices,
+                                     const std::vector<uint32_t> &indices, size_t targetIndexCount, float &outError);
+
+}
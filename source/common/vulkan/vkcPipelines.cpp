@@ -1,13 +1,24 @@
 
+#include <algorithm>
 #include "vkcPipelines.hpp"
 
 // Include the shader codes
 #include "meshDefault.vert.spv.c"
 #include "meshDefault.frag.spv.c"
 
-#include "triangleDebug.vert.spv.c"
-#include "triangleDebug.geom.spv.c"
-#include "triangleDebug.frag.spv.c"
+#include "meshWireframe.geom.spv.c"
+#include "meshWireframe.frag.spv.c"
+
+#include "deferredCompose.vert.spv.c"
+#include "deferredCompose.frag.spv.c"
+
+#include "debugLines.vert.spv.c"
+#include "debugLines.frag.spv.c"
+
+#include "meshIndirect.vert.spv.c"
+#include "resolveTransforms.comp.spv.c"
+#include "cullInstances.comp.spv.c"
+#include "depthPyramid.comp.spv.c"
 
 namespace at3::vkc {
 
@@ -41,10 +52,18 @@ namespace at3::vkc {
 
     pipelines.resize(PIPELINE_COUNT);
 
-    createRenderPass(ctxt);
-    createStandardMeshPipeline(ctxt, numTextures2D);
-    createTriangleDebugPipeline(ctxt, numTextures2D);
+    createRenderPass(ctxt, mainRenderPass, false, false);
+    createRenderPass(ctxt, earlyRenderPass, false, true);
+    createRenderPass(ctxt, lateRenderPass, true, false);
+    createTextureTable(ctxt, numTextures2D);
+    createDeferredGBufferPipeline(ctxt, textureTable.capacity);
+    createDeferredComposePipeline(ctxt);
     createStaticHeightmapTerrainPipeline(ctxt);
+    createResolveTransformsPipeline(ctxt);
+    createCullInstancesPipeline(ctxt);
+    createIndirectMeshPipeline(ctxt);
+    createDepthPyramidPipeline(ctxt);
+    createDebugLinesPipeline(ctxt);
   }
 
   void PipelineRepository::setVertexAttributes(std::vector<EMeshVertexAttribute> layout) {
@@ -58,24 +77,54 @@ namespace at3::vkc {
         sizeof(EMeshVertexAttribute) * vertexAttributes->attrCount);
     memcpy(vertexAttributes->attributes, layout.data(), sizeof(EMeshVertexAttribute) * vertexAttributes->attrCount);
 
+    // Meshes are always imported and cached as interleaved 32-bit floats (floatVertexSize), but may be packed into
+    // smaller formats when they are uploaded to the GPU (vertexSize). See packVertices.
     uint32_t curOffset = 0;
+    uint32_t curFloatOffset = 0;
     for (uint32_t i = 0; i < layout.size(); ++i) {
       switch (layout[i]) {
-        case EMeshVertexAttribute::POSITION:
+        case EMeshVertexAttribute::POSITION: {
+#         if COMPRESS_VERTICES && QUANTIZE_VERTEX_POSITIONS
+          vertexAttributes->attrDescriptions[i] = {i, 0, VK_FORMAT_R16G16B16A16_UNORM, curOffset};
+          curOffset += sizeof(uint16_t) * 4;
+#         else
+          vertexAttributes->attrDescriptions[i] = {i, 0, VK_FORMAT_R32G32B32_SFLOAT, curOffset};
+          curOffset += sizeof(glm::vec3);
+#         endif
+          curFloatOffset += sizeof(glm::vec3);
+        } break;
         case EMeshVertexAttribute::NORMAL:
         case EMeshVertexAttribute::TANGENT:
         case EMeshVertexAttribute::BITANGENT: {
+#         if COMPRESS_VERTICES
+          vertexAttributes->attrDescriptions[i] = {i, 0, VK_FORMAT_R8G8B8A8_SNORM, curOffset};
+          curOffset += sizeof(uint8_t) * 4;
+#         else
           vertexAttributes->attrDescriptions[i] = {i, 0, VK_FORMAT_R32G32B32_SFLOAT, curOffset};
           curOffset += sizeof(glm::vec3);
+#         endif
+          curFloatOffset += sizeof(glm::vec3);
         } break;
         case EMeshVertexAttribute::UV0:
         case EMeshVertexAttribute::UV1: {
+#         if COMPRESS_VERTICES
+          vertexAttributes->attrDescriptions[i] = {i, 0, VK_FORMAT_R16G16_SFLOAT, curOffset};
+          curOffset += sizeof(uint16_t) * 2;
+#         else
           vertexAttributes->attrDescriptions[i] = {i, 0, VK_FORMAT_R32G32_SFLOAT, curOffset};
           curOffset += sizeof(glm::vec2);
+#         endif
+          curFloatOffset += sizeof(glm::vec2);
         } break;
         case EMeshVertexAttribute::COLOR: {
+#         if COMPRESS_VERTICES
+          vertexAttributes->attrDescriptions[i] = {i, 0, VK_FORMAT_R8G8B8A8_UNORM, curOffset};
+          curOffset += sizeof(uint8_t) * 4;
+#         else
           vertexAttributes->attrDescriptions[i] = {i, 0, VK_FORMAT_R32G32B32A32_SFLOAT, curOffset};
           curOffset += sizeof(glm::vec4);
+#         endif
+          curFloatOffset += sizeof(glm::vec4);
         } break;
         default:
           AT3_ASSERT(0, "Invalid vertex attribute specified");
@@ -83,6 +132,7 @@ namespace at3::vkc {
       }
     }
     vertexAttributes->vertexSize = curOffset;
+    vertexAttributes->floatVertexSize = curFloatOffset;
   }
 
 
@@ -90,86 +140,138 @@ namespace at3::vkc {
 
 
 
-  void PipelineRepository::createRenderPass(Common &ctxt) {
+  /*
+   * All of the render passes made here are compatible with each other, and differ only in what happens to the
+   * attachments at either end. With loadPrevious, the attachments carry on from the render pass before, instead of
+   * starting over. With keepForLater, they are left for another render pass (and the depth buffer for anything else
+   * that wants to read it), instead of being presented.
+   *
+   * The attachments are the swapchain image, the depth buffer, and the G-buffer's albedo and normals, in that order.
+   * The G-buffer and depth are written in SUBPASS_GBUFFER and read back as input attachments in SUBPASS_COMPOSE, which
+   * lets tiled GPUs keep them on chip between the two.
+   */
+  void PipelineRepository::createRenderPass(Common &ctxt, VkRenderPass &outPass, bool loadPrevious, bool keepForLater) {
 
     std::vector<VkAttachmentDescription> attachments;
-    std::vector<VkAttachmentReference> colorRefs;
-    VkAttachmentReference depthRef = {};
     {
       VkAttachmentDescription &colorAttachment = attachments.emplace_back();
       colorAttachment.format = ctxt.swapChain.imageFormat;
       colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-      colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+      colorAttachment.loadOp = loadPrevious ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
       colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
       colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
       colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-      colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-      colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-      uint32_t attachIdx = 0;
-      for (; attachIdx < attachments.size(); ++attachIdx) {
-        VkAttachmentReference &ref = colorRefs.emplace_back();
-        ref.attachment = attachIdx;
-        ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-      }
+      colorAttachment.initialLayout = loadPrevious ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                                   : VK_IMAGE_LAYOUT_UNDEFINED;
+      colorAttachment.finalLayout = keepForLater ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                                 : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
       VkAttachmentDescription &depthAttachment = attachments.emplace_back();
       depthAttachment.format = VK_FORMAT_D32_SFLOAT;
       depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-      depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-      depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+      depthAttachment.loadOp = loadPrevious ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+      depthAttachment.storeOp = keepForLater ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
       depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
       depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-      depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+      depthAttachment.initialLayout = loadPrevious ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+                                                   : VK_IMAGE_LAYOUT_UNDEFINED;
       depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-      depthRef.attachment = attachIdx;
-      depthRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+      // Every pixel that was drawn to is written in the first subpass, so the G-buffer needn't be cleared
+      for (VkFormat format : {gBufferAlbedoFormat, gBufferNormalFormat}) {
+        VkAttachmentDescription &gBufferAttachment = attachments.emplace_back();
+        gBufferAttachment.format = format;
+        gBufferAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        gBufferAttachment.loadOp = loadPrevious ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        gBufferAttachment.storeOp = keepForLater ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        gBufferAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+        gBufferAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+        gBufferAttachment.initialLayout = loadPrevious ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+                                                       : VK_IMAGE_LAYOUT_UNDEFINED;
+        gBufferAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+      }
     }
 
-    std::vector<VkSubpassDescription> subpasses;
+    VkAttachmentReference colorRef = {0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    VkAttachmentReference depthRef = {1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+    VkAttachmentReference gBufferRefs[] = {
+        {2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+        {3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL}};
+    // In the order of the input_attachment_index values of the deferredCompose shader
+    VkAttachmentReference inputRefs[] = {
+        {2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+        {3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+        {1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL}};
+    uint32_t gBufferAttachments[] = {2, 3};
+
+    std::vector<VkSubpassDescription> subpasses(SUBPASS_COUNT);
     {
-      VkSubpassDescription &meshSubpass = subpasses.emplace_back();
-      meshSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-      meshSubpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
-      meshSubpass.pColorAttachments = colorRefs.data();
-      meshSubpass.pDepthStencilAttachment = &depthRef;
-
-      VkSubpassDescription &normSubpass = subpasses.emplace_back();
-      normSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-      normSubpass.colorAttachmentCount = static_cast<uint32_t>(colorRefs.size());
-      normSubpass.pColorAttachments = colorRefs.data();
-      normSubpass.pDepthStencilAttachment = &depthRef;
+      VkSubpassDescription &gBufferSubpass = subpasses[SUBPASS_GBUFFER];
+      gBufferSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+      gBufferSubpass.colorAttachmentCount = 2;
+      gBufferSubpass.pColorAttachments = gBufferRefs;
+      gBufferSubpass.pDepthStencilAttachment = &depthRef;
+
+      VkSubpassDescription &composeSubpass = subpasses[SUBPASS_COMPOSE];
+      composeSubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+      composeSubpass.inputAttachmentCount = 3;
+      composeSubpass.pInputAttachments = inputRefs;
+      composeSubpass.colorAttachmentCount = 1;
+      composeSubpass.pColorAttachments = &colorRef;
+
+      // The G-buffer isn't used here, but may still be needed by the render pass after this one
+      VkSubpassDescription &overlaySubpass = subpasses[SUBPASS_OVERLAY];
+      overlaySubpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+      overlaySubpass.colorAttachmentCount = 1;
+      overlaySubpass.pColorAttachments = &colorRef;
+      overlaySubpass.pDepthStencilAttachment = &depthRef;
+      overlaySubpass.preserveAttachmentCount = 2;
+      overlaySubpass.pPreserveAttachments = gBufferAttachments;
     }
 
     std::vector<VkSubpassDependency> dependencies;
     {
       VkSubpassDependency &depsExternTo0 = dependencies.emplace_back();
       depsExternTo0.srcSubpass = VK_SUBPASS_EXTERNAL;
-      depsExternTo0.dstSubpass = 0;
+      depsExternTo0.dstSubpass = SUBPASS_GBUFFER;
       depsExternTo0.srcStageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
       depsExternTo0.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
       depsExternTo0.srcAccessMask = 0;
       depsExternTo0.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
       depsExternTo0.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+      // The compose pass reads the G-buffer and depth that the meshes wrote, at the same pixel
       VkSubpassDependency &deps0to1 = dependencies.emplace_back();
-      deps0to1.srcSubpass = 0;
-      deps0to1.dstSubpass = 1;
-      deps0to1.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-      deps0to1.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-      deps0to1.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-      deps0to1.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+      deps0to1.srcSubpass = SUBPASS_GBUFFER;
+      deps0to1.dstSubpass = SUBPASS_COMPOSE;
+      deps0to1.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                              | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+      deps0to1.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+      deps0to1.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+      deps0to1.dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
       deps0to1.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
-      VkSubpassDependency &deps1toExtern = dependencies.emplace_back();
-      deps1toExtern.srcSubpass = 0;
-      deps1toExtern.dstSubpass = VK_SUBPASS_EXTERNAL;
-      deps1toExtern.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-      deps1toExtern.dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-      deps1toExtern.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-      deps1toExtern.dstAccessMask = 0;
-      deps1toExtern.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+      // The overlays draw over what the compose pass wrote, and test against the depth that it read
+      VkSubpassDependency &deps1to2 = dependencies.emplace_back();
+      deps1to2.srcSubpass = SUBPASS_COMPOSE;
+      deps1to2.dstSubpass = SUBPASS_OVERLAY;
+      deps1to2.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+      deps1to2.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
+                              | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+      deps1to2.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+      deps1to2.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+                               | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+                               | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+      deps1to2.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+      VkSubpassDependency &deps2toExtern = dependencies.emplace_back();
+      deps2toExtern.srcSubpass = SUBPASS_OVERLAY;
+      deps2toExtern.dstSubpass = VK_SUBPASS_EXTERNAL;
+      deps2toExtern.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+      deps2toExtern.dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+      deps2toExtern.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+      deps2toExtern.dstAccessMask = 0;
+      deps2toExtern.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
     }
 
     VkRenderPassCreateInfo renderPassInfo = {};
@@ -183,12 +285,76 @@ namespace at3::vkc {
       renderPassInfo.pDependencies = dependencies.data();
     }
 
-    VkResult res = vkCreateRenderPass(ctxt.device, &renderPassInfo, nullptr, &mainRenderPass);
+    VkResult res = vkCreateRenderPass(ctxt.device, &renderPassInfo, nullptr, &outPass);
     AT3_ASSERT(res == VK_SUCCESS, "Error creating render pass");
   }
 
 
 
+  void PipelineRepository::createTextureTable(Common &ctxt, uint32_t numTextures2D) {
+    textureTable.bindless = ctxt.gpu.maxBindlessTextures >= numTextures2D;
+    textureTable.capacity = textureTable.bindless ?
+        std::min(ctxt.gpu.maxBindlessTextures, MeshInstanceIndices::maxTextures) : numTextures2D;
+    AT3_ASSERT(numTextures2D <= MeshInstanceIndices::maxTextures, "Too many textures (%u)\n", numTextures2D);
+
+    VkResult res;
+
+    { // Create a pool just for the table, since a bindless table must come from an update-after-bind pool
+      VkDescriptorPoolSize poolSize = {};
+      poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      poolSize.descriptorCount = textureTable.capacity;
+
+      VkDescriptorPoolCreateInfo poolInfo = {};
+      poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+      poolInfo.flags = textureTable.bindless ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT : 0;
+      poolInfo.poolSizeCount = 1;
+      poolInfo.pPoolSizes = &poolSize;
+      poolInfo.maxSets = 1;
+      res = vkCreateDescriptorPool(ctxt.device, &poolInfo, nullptr, &textureTable.pool);
+      AT3_ASSERT(res == VK_SUCCESS, "Error creating texture table descriptor pool");
+    }
+
+    { // Create the layout
+      VkDescriptorSetLayoutBinding textureArrayBinding{};
+      textureArrayBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      textureArrayBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+      textureArrayBinding.binding = 0;
+      textureArrayBinding.descriptorCount = textureTable.capacity;
+
+      VkDescriptorBindingFlagsEXT bindingFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+                                                 | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+                                                 | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+      VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+      bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+      bindingFlagsInfo.bindingCount = 1;
+      bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+      VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+      layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+      layoutInfo.bindingCount = 1;
+      layoutInfo.pBindings = &textureArrayBinding;
+      if (textureTable.bindless) {
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+      }
+      res = vkCreateDescriptorSetLayout(ctxt.device, &layoutInfo, nullptr, &textureTable.layout);
+      AT3_ASSERT(res == VK_SUCCESS, "Error creating texture table desc set layout");
+    }
+
+    { // Allocate the one set
+      VkDescriptorSetAllocateInfo allocInfo = {};
+      allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+      allocInfo.descriptorPool = textureTable.pool;
+      allocInfo.descriptorSetCount = 1;
+      allocInfo.pSetLayouts = &textureTable.layout;
+      res = vkAllocateDescriptorSets(ctxt.device, &allocInfo, &textureTable.set);
+      AT3_ASSERT(res == VK_SUCCESS, "Error allocating texture table descriptor set");
+    }
+
+    printf("Texture table: %u textures, room for %u (%s)\n", numTextures2D, textureTable.capacity,
+           textureTable.bindless ? "bindless" : "fixed");
+  }
+
   void PipelineRepository::createPipelineLayout(PipelineCreateInfo &info) {
 
     // Get a reference to the pipeline to be filled
@@ -206,11 +372,13 @@ namespace at3::vkc {
             info.ctxt->device, &layoutInfo, nullptr, &pipeline.descSetLayouts.back());
         AT3_ASSERT(res == VK_SUCCESS, "Error creating desc set layout");
       }
+      std::vector<VkDescriptorSetLayout> allSetLayouts = pipeline.descSetLayouts;
+      allSetLayouts.insert(allSetLayouts.end(), info.sharedDescSetLayouts.begin(), info.sharedDescSetLayouts.end());
 
       // Include the descriptor set layouts in the pipeline layout creation info.
       pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-      pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(pipeline.descSetLayouts.size());
-      pipelineLayoutInfo.pSetLayouts = pipeline.descSetLayouts.data();
+      pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(allSetLayouts.size());
+      pipelineLayoutInfo.pSetLayouts = allSetLayouts.data();
 
       // Include the push constants in the pipeline layout creation info.
       pipelineLayoutInfo.pPushConstantRanges = info.pcRanges.data();
@@ -277,26 +445,34 @@ namespace at3::vkc {
       shaderStages.push_back(fragStageInfo);
     } // shaderStages is now populated and final.
 
+    bool customVertices = info.customVertexSize != 0;
     VkVertexInputBindingDescription bindingDescription {};
     {
       bindingDescription.binding = 0;
-      bindingDescription.stride = vertexAttributes->vertexSize;
+      bindingDescription.stride = customVertices ? info.customVertexSize : vertexAttributes->vertexSize;
       bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
     }
 
     VkPipelineVertexInputStateCreateInfo vertexInputInfo {};
     {
       vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-      vertexInputInfo.vertexBindingDescriptionCount = 1;
-      vertexInputInfo.vertexAttributeDescriptionCount = vertexAttributes->attrCount;
-      vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-      vertexInputInfo.pVertexAttributeDescriptions = &vertexAttributes->attrDescriptions[0];
+      if (info.vertexInput) { // Otherwise the vertex shader makes up its own vertices
+        vertexInputInfo.vertexBindingDescriptionCount = 1;
+        vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
+        if (customVertices) {
+          vertexInputInfo.vertexAttributeDescriptionCount = (uint32_t) info.customVertexAttributes.size();
+          vertexInputInfo.pVertexAttributeDescriptions = info.customVertexAttributes.data();
+        } else {
+          vertexInputInfo.vertexAttributeDescriptionCount = vertexAttributes->attrCount;
+          vertexInputInfo.pVertexAttributeDescriptions = &vertexAttributes->attrDescriptions[0];
+        }
+      }
     }
 
     VkPipelineInputAssemblyStateCreateInfo inputAssembly {};
     {
       inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-      inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+      inputAssembly.topology = info.topology;
       inputAssembly.primitiveRestartEnable = VK_FALSE;
     }
 
@@ -334,7 +510,7 @@ namespace at3::vkc {
       rasterizer.rasterizerDiscardEnable = VK_FALSE; //this disables output to the fb
       rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
       rasterizer.lineWidth = 1.0f;
-      rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+      rasterizer.cullMode = info.cullMode;
       rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
       rasterizer.depthBiasEnable = VK_FALSE;
       rasterizer.depthBiasConstantFactor = 0.0f; // Optional
@@ -353,8 +529,9 @@ namespace at3::vkc {
       multisampling.alphaToOneEnable = VK_FALSE; // Optional
     }
 
-    VkPipelineColorBlendAttachmentState colorBlendAttachment {};
-    {
+    // One for each color attachment of the subpass, all the same
+    std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments(info.colorAttachmentCount);
+    for (auto &colorBlendAttachment : colorBlendAttachments) {
       colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
                                             VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
       colorBlendAttachment.blendEnable = VK_FALSE;
@@ -365,8 +542,8 @@ namespace at3::vkc {
       colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
       colorBlending.logicOpEnable = VK_FALSE; //can be used for bitwise blending
       colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-      colorBlending.attachmentCount = 1;
-      colorBlending.pAttachments = &colorBlendAttachment;
+      colorBlending.attachmentCount = static_cast<uint32_t>(colorBlendAttachments.size());
+      colorBlending.pAttachments = colorBlendAttachments.data();
       colorBlending.blendConstants[0] = 0.0f; // Optional
       colorBlending.blendConstants[1] = 0.0f; // Optional
       colorBlending.blendConstants[2] = 0.0f; // Optional
@@ -376,8 +553,8 @@ namespace at3::vkc {
     VkPipelineDepthStencilStateCreateInfo depthStencil = {};
     {
       depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-      depthStencil.depthTestEnable = VK_TRUE;
-      depthStencil.depthWriteEnable = VK_TRUE;
+      depthStencil.depthTestEnable = info.depthTest ? VK_TRUE : VK_FALSE;
+      depthStencil.depthWriteEnable = info.depthTest ? VK_TRUE : VK_FALSE;
       depthStencil.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
     }
 
@@ -406,7 +583,8 @@ namespace at3::vkc {
 
     // Create the pipeline on the gpu.
     res = vkCreateGraphicsPipelines(
-        info.ctxt->device, VK_NULL_HANDLE, 1,&pipelineInfo, nullptr, &pipeline.handle);
+        info.ctxt->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr,
+        info.wireframe ? &pipeline.wireframeHandle : &pipeline.handle);
     AT3_ASSERT(res == VK_SUCCESS, "Error creating graphics pipeline");
 
     // Cleanup the shader modules now that they've been copied to the gpu.
@@ -416,7 +594,49 @@ namespace at3::vkc {
 
   }
 
-  void PipelineRepository::createStandardMeshPipeline(Common &ctxt, uint32_t texArrayLen) {
+  void PipelineRepository::createComputePipeline(PipelineCreateInfo &info) {
+
+    // Get a reference to the pipeline to be filled
+    Pipeline &pipeline = pipelines.at(info.index);
+
+    VkPipelineShaderStageCreateInfo compStageInfo{};
+    compStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    compStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    compStageInfo.pName = "main";
+    createShaderModule(compStageInfo.module, info.compCode.data, info.compCode.length, *info.ctxt);
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage = compStageInfo;
+    pipelineInfo.layout = pipeline.layout;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkResult res = vkCreateComputePipelines(
+        info.ctxt->device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline.handle);
+    AT3_ASSERT(res == VK_SUCCESS, "Error creating compute pipeline");
+
+    vkDestroyShaderModule(info.ctxt->device, compStageInfo.module, nullptr);
+  }
+
+  /*
+   * Create the wireframe variant of a pipeline that draws meshes into the G-buffer, from the same create info, if the
+   * device can run the geometry shader that it needs. It shares the pipeline's layout, so the two are interchangeable
+   * and nothing needs to be bound differently for it. Unless it's bound, it costs nothing.
+   */
+  void PipelineRepository::createWireframeVariant(PipelineCreateInfo &info) {
+    if ( ! info.ctxt->gpu.features.geometryShader) { return; }
+    info.geomCode = {meshWireframe_geom_spv, meshWireframe_geom_spv_len};
+    info.fragCode = {meshWireframe_frag_spv, meshWireframe_frag_spv_len};
+    info.wireframe = true;
+    createPipeline(info);
+  }
+
+  /*
+   * The mesh pipeline, which writes the albedo and normals of whatever is in front to the G-buffer, to be lit later by
+   * the compose pipeline.
+   */
+  void PipelineRepository::createDeferredGBufferPipeline(Common &ctxt, uint32_t texArrayLen) {
 
     // This is populated and then passed to createPipeline.
     PipelineCreateInfo info {};
@@ -425,6 +645,8 @@ namespace at3::vkc {
       info.index = MESH;
       info.ctxt = &ctxt;
       info.renderPass = mainRenderPass;
+      info.subpass = SUBPASS_GBUFFER;
+      info.colorAttachmentCount = 2;
     }
 
     { // Shaders
@@ -441,13 +663,6 @@ namespace at3::vkc {
       uboBinding.binding = 0;
       uboBinding.descriptorCount = 1;
       layoutBindings.push_back(uboBinding);
-
-      VkDescriptorSetLayoutBinding textureArrayBinding{};
-      textureArrayBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-      textureArrayBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-      textureArrayBinding.binding = 1;
-      textureArrayBinding.descriptorCount = texArrayLen;
-      layoutBindings.push_back(textureArrayBinding);
     }
 
     // Layout creation info
@@ -457,6 +672,7 @@ namespace at3::vkc {
       layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
       layoutInfo.pBindings = layoutBindings.data();
       info.descSetLayoutInfos.push_back(layoutInfo);
+      info.sharedDescSetLayouts.push_back(textureTable.layout); // Set 1
     }
 
     // Push constants
@@ -498,47 +714,44 @@ namespace at3::vkc {
     // Another option would be to keep both a dynamic and non-dynamic version of each pipeline, so that the dynamic
     // one could be used while the static ones were being recreated.
     createPipeline(info);
+    createWireframeVariant(info);
   }
 
 
 
-  void PipelineRepository::createDeferredGBufferPipeline(Common &ctxt, uint32_t texArrayLen) {
-
-  }
-
-  void PipelineRepository::createDeferredComposePipeline(Common &ctxt, uint32_t texArrayLen) {
-
-  }
-
-
-
-  void PipelineRepository::createTriangleDebugPipeline(Common &ctxt, uint32_t texArrayLen) {
+  /*
+   * Lights the G-buffer with one fullscreen triangle, reading it as input attachments. Set 0 is written by LightGrid.
+   */
+  void PipelineRepository::createDeferredComposePipeline(Common &ctxt) {
 
     // This is populated and then passed to createPipeline.
     PipelineCreateInfo info {};
 
     { // pipeline type, context, and renderpass
-      info.index = TRI_DEBUG;
+      info.index = DEFERRED_COMPOSE;
       info.ctxt = &ctxt;
       info.renderPass = mainRenderPass;
-      info.subpass = 1;
+      info.subpass = SUBPASS_COMPOSE;
+      info.vertexInput = false;
+      info.depthTest = false;
+      info.cullMode = VK_CULL_MODE_NONE;
     }
 
     { // Shaders
-      info.vertCode = {triangleDebug_vert_spv, triangleDebug_vert_spv_len};
-      info.geomCode = {triangleDebug_geom_spv, triangleDebug_geom_spv_len};
-      info.fragCode = {triangleDebug_frag_spv, triangleDebug_frag_spv_len};
+      info.vertCode = {deferredCompose_vert_spv, deferredCompose_vert_spv_len};
+      info.fragCode = {deferredCompose_frag_spv, deferredCompose_frag_spv_len};
     }
 
-    // Descriptor set layout bindings
+    // Descriptor set layout bindings: the albedo, normal and depth attachments, then the lights and the light grid
     std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
-    {
-      VkDescriptorSetLayoutBinding uboBinding{};
-      uboBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      uboBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT /*| VK_SHADER_STAGE_GEOMETRY_BIT*/;
-      uboBinding.binding = 0;
-      uboBinding.descriptorCount = 1;
-      layoutBindings.push_back(uboBinding);
+    for (uint32_t i = 0; i < LIGHT_GRID_BINDING_COUNT; ++i) {
+      VkDescriptorSetLayoutBinding binding{};
+      binding.descriptorType = i < LIGHT_GRID_LIGHTS ? VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT
+                                                     : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+      binding.binding = i;
+      binding.descriptorCount = 1;
+      layoutBindings.push_back(binding);
     }
 
     // Layout creation info
@@ -554,8 +767,8 @@ namespace at3::vkc {
     VkPushConstantRange pcRange = {};
     {
       pcRange.offset = 0;
-      pcRange.size = sizeof(MeshInstanceIndices::rawType);
-      pcRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT /*| VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT*/;
+      pcRange.size = sizeof(ComposeParams);
+      pcRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
       info.pcRanges.push_back(pcRange);
     }
 
@@ -565,548 +778,246 @@ namespace at3::vkc {
       pipelines.at(info.index).layoutsExist = true;
     }
 
-    // The pipeline itself will need to be recreated even for a re-initialization, since it's not dynamic.
-    // An alternative would be to make the viewport and scissors dynamic, but that could hurt performance.
-    // Benchmarking would need to be done to make sure, but for now I'm leaving them non-dynamic.
-    // Another option would be to keep both a dynamic and non-dynamic version of each pipeline, so that the dynamic
-    // one could be used while the static ones were being recreated.
     createPipeline(info);
   }
 
+  void PipelineRepository::createStaticHeightmapTerrainPipeline(Common &ctxt) {
 
+  }
 
+  void PipelineRepository::describeGpuSceneSetLayout(PipelineCreateInfo &info,
+                                                     std::vector<VkDescriptorSetLayoutBinding> &bindings) {
+    // Both compute pipelines use the same layout, so that one descriptor set can be bound to either of them
+    for (uint32_t i = 0; i < GPU_SCENE_BINDING_COUNT; ++i) {
+      VkDescriptorSetLayoutBinding binding{};
+      binding.descriptorType = i == GPU_SCENE_DEPTH_PYRAMID ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+                                                            : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      binding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+      binding.binding = i;
+      binding.descriptorCount = 1;
+      bindings.push_back(binding);
+    }
 
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+    layoutInfo.pBindings = bindings.data();
+    info.descSetLayoutInfos.push_back(layoutInfo);
+  }
 
+  void PipelineRepository::createResolveTransformsPipeline(Common &ctxt) {
 
+    PipelineCreateInfo info {};
+    info.index = RESOLVE_TRANSFORMS;
+    info.ctxt = &ctxt;
+    info.compCode = {resolveTransforms_comp_spv, resolveTransforms_comp_spv_len};
 
+    std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+    describeGpuSceneSetLayout(info, layoutBindings);
 
-
-//  void PipelineRepository::setupDescriptorSetLayout(PipelineCreateInfo &info)
-  /*{
-    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
-    {
-      VkDescriptorSetLayoutBinding setLayoutBinding{};
-      setLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-      setLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-      setLayoutBinding.binding = 0;
-      setLayoutBinding.descriptorCount = 1;
-      setLayoutBindings.push_back(setLayoutBinding);
-    }
-
-    VkDescriptorSetLayoutCreateInfo descriptorLayout {};
+    // Push constants
+    VkPushConstantRange pcRange = {};
     {
-      descriptorLayout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-      descriptorLayout.pBindings = setLayoutBindings.data();
-      descriptorLayout.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
+      pcRange.offset = 0;
+      pcRange.size = sizeof(ResolveParams);
+      pcRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+      info.pcRanges.push_back(pcRange);
     }
 
+    // Compute pipelines don't depend on the window size, so they are never re-initialized
+    createPipelineLayout(info);
+    pipelines.at(info.index).layoutsExist = true;
+    createComputePipeline(info);
+  }
 
+  void PipelineRepository::createCullInstancesPipeline(Common &ctxt) {
 
-    VkResult res = vkCreateDescriptorSetLayout(info.ctxt->device, &descriptorLayout, nullptr, &descriptorSetLayouts.scene);
-
-    VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo =
-        vks::initializers::pipelineLayoutCreateInfo(
-            &descriptorSetLayouts.scene,
-            1);
-
-    // Offscreen (scene) rendering pipeline layout
-    VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &pipelineLayouts.offscreen));
-  }*/
-
-//  void PipelineRepository::setupDescriptorSet()
-  /*{
-    std::vector<VkWriteDescriptorSet> writeDescriptorSets;
-
-    VkDescriptorSetAllocateInfo allocInfo =
-        vks::initializers::descriptorSetAllocateInfo(
-            descriptorPool,
-            &descriptorSetLayouts.scene,
-            1);
-
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.scene));
-    writeDescriptorSets =
-        {
-            // Binding 0: Vertex shader uniform buffer
-            vks::initializers::writeDescriptorSet(
-                descriptorSets.scene,
-                VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                0,
-                &uniformBuffers.GBuffer.descriptor)
-        };
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
-  }*/
-
-//  void PipelineRepository::preparePipelines(Common &ctxt, uint32_t texArrayLen)
-  /*{
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
-        vks::initializers::pipelineInputAssemblyStateCreateInfo(
-            VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-            0,
-            VK_FALSE);
-
-    VkPipelineRasterizationStateCreateInfo rasterizationState =
-        vks::initializers::pipelineRasterizationStateCreateInfo(
-            VK_POLYGON_MODE_FILL,
-            VK_CULL_MODE_BACK_BIT,
-            VK_FRONT_FACE_CLOCKWISE,
-            0);
-
-    VkPipelineColorBlendAttachmentState blendAttachmentState =
-        vks::initializers::pipelineColorBlendAttachmentState(
-            0xf,
-            VK_FALSE);
-
-    VkPipelineColorBlendStateCreateInfo colorBlendState =
-        vks::initializers::pipelineColorBlendStateCreateInfo(
-            1,
-            &blendAttachmentState);
-
-    VkPipelineDepthStencilStateCreateInfo depthStencilState =
-        vks::initializers::pipelineDepthStencilStateCreateInfo(
-            VK_TRUE,
-            VK_TRUE,
-            VK_COMPARE_OP_LESS_OR_EQUAL);
-
-    VkPipelineViewportStateCreateInfo viewportState =
-        vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
-
-    VkPipelineMultisampleStateCreateInfo multisampleState =
-        vks::initializers::pipelineMultisampleStateCreateInfo(
-            VK_SAMPLE_COUNT_1_BIT,
-            0);
-
-    std::vector<VkDynamicState> dynamicStateEnables = {
-        VK_DYNAMIC_STATE_VIEWPORT,
-        VK_DYNAMIC_STATE_SCISSOR
-    };
-    VkPipelineDynamicStateCreateInfo dynamicState =
-        vks::initializers::pipelineDynamicStateCreateInfo(
-            dynamicStateEnables.data(),
-            static_cast<uint32_t>(dynamicStateEnables.size()),
-            0);
-
-    // Final fullscreen pass pipeline
-    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
-
-    VkGraphicsPipelineCreateInfo pipelineCreateInfo =
-        vks::initializers::pipelineCreateInfo(
-            pipelineLayouts.offscreen,
-            renderPass,
-            0);
-
-    pipelineCreateInfo.pVertexInputState = &vertices.inputState;
-    pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
-    pipelineCreateInfo.pRasterizationState = &rasterizationState;
-    pipelineCreateInfo.pColorBlendState = &colorBlendState;
-    pipelineCreateInfo.pMultisampleState = &multisampleState;
-    pipelineCreateInfo.pViewportState = &viewportState;
-    pipelineCreateInfo.pDepthStencilState = &depthStencilState;
-    pipelineCreateInfo.pDynamicState = &dynamicState;
-    pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
-    pipelineCreateInfo.pStages = shaderStages.data();
-    pipelineCreateInfo.subpass = 0;
-
-    std::array<VkPipelineColorBlendAttachmentState, 4> blendAttachmentStates = {
-        vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
-        vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
-        vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE),
-        vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE)
-    };
-
-    colorBlendState.attachmentCount = static_cast<uint32_t>(blendAttachmentStates.size());
-    colorBlendState.pAttachments = blendAttachmentStates.data();
-
-    // Offscreen scene rendering pipeline
-    shaderStages[0] = loadShader(getAssetPath() + "shaders/subpasses/gbuffer.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-    shaderStages[1] = loadShader(getAssetPath() + "shaders/subpasses/gbuffer.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.offscreen));
-  }*/
-
-//  void PipelineRepository::setupRenderPass(Common &ctxt)
-  /*{
-//    createGBufferAttachments(); // Create attachments in vkc?
-
-    std::array<VkAttachmentDescription, 5> attachments{};
-    // Color attachment
-//    attachments[0].format = swapChain.colorFormat;
-    attachments[0].format = ctxt.swapChain.imageFormat;
-    attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-    // Deferred attachments
-    // Position
-//    attachments[1].format = this->attachments.position.format;
-    attachments[1].format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[1].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    // Normals
-//    attachments[2].format = this->attachments.normal.format;
-    attachments[2].format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    attachments[2].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[2].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[2].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[2].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    // Albedo
-//    attachments[3].format = this->attachments.albedo.format;
-    attachments[3].format = VK_FORMAT_R8G8B8A8_UNORM;
-    attachments[3].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachments[3].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[3].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[3].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[3].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[3].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[3].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    // Depth attachment
-//    attachments[4].format = depthFormat;
-    attachments[4].format = VK_FORMAT_D32_SFLOAT;
-    attachments[4].samples = VK_SAMPLE_COUNT_1_BIT;
-    attachments[4].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachments[4].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[4].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachments[4].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachments[4].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachments[4].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    // Three subpasses
-    std::array<VkSubpassDescription,3> subpassDescriptions{};
-
-    // First subpass: Fill G-Buffer components
-    // ----------------------------------------------------------------------------------------
-
-    VkAttachmentReference colorReferences[4];
-    colorReferences[0] = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-    colorReferences[1] = { 1, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-    colorReferences[2] = { 2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-    colorReferences[3] = { 3, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-    VkAttachmentReference depthReference = { 4, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
-
-    subpassDescriptions[0].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpassDescriptions[0].colorAttachmentCount = 4;
-    subpassDescriptions[0].pColorAttachments = colorReferences;
-    subpassDescriptions[0].pDepthStencilAttachment = &depthReference;
-
-    // Second subpass: Final composition (using G-Buffer components)
-    // ----------------------------------------------------------------------------------------
-
-    VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-    VkAttachmentReference inputReferences[3];
-    inputReferences[0] = { 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-    inputReferences[1] = { 2, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-    inputReferences[2] = { 3, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-
-    uint32_t preserveAttachmentIndex = 1;
-
-    subpassDescriptions[1].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpassDescriptions[1].colorAttachmentCount = 1;
-    subpassDescriptions[1].pColorAttachments = &colorReference;
-    subpassDescriptions[1].pDepthStencilAttachment = &depthReference;
-    // Use the color attachments filled in the first pass as input attachments
-    subpassDescriptions[1].inputAttachmentCount = 3;
-    subpassDescriptions[1].pInputAttachments = inputReferences;
-
-    // Third subpass: Forward transparency
-    // ----------------------------------------------------------------------------------------
-    colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
-
-    inputReferences[0] = { 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
-
-    subpassDescriptions[2].pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpassDescriptions[2].colorAttachmentCount = 1;
-    subpassDescriptions[2].pColorAttachments = &colorReference;
-    subpassDescriptions[2].pDepthStencilAttachment = &depthReference;
-    // Use the color/depth attachments filled in the first pass as input attachments
-    subpassDescriptions[2].inputAttachmentCount = 1;
-    subpassDescriptions[2].pInputAttachments = inputReferences;
-
-    // Subpass dependencies for layout transitions
-    std::array<VkSubpassDependency, 4> dependencies;
-
-    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependencies[0].dstSubpass = 0;
-    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    // This dependency transitions the input attachment from color attachment to shader read
-    dependencies[1].srcSubpass = 0;
-    dependencies[1].dstSubpass = 1;
-    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    dependencies[2].srcSubpass = 1;
-    dependencies[2].dstSubpass = 2;
-    dependencies[2].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependencies[2].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    dependencies[2].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependencies[2].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    dependencies[2].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    dependencies[3].srcSubpass = 0;
-    dependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
-    dependencies[3].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependencies[3].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    dependencies[3].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    dependencies[3].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    dependencies[3].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-
-    VkRenderPassCreateInfo renderPassInfo = {};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-    renderPassInfo.pAttachments = attachments.data();
-    renderPassInfo.subpassCount = static_cast<uint32_t>(subpassDescriptions.size());
-    renderPassInfo.pSubpasses = subpassDescriptions.data();
-    renderPassInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
-    renderPassInfo.pDependencies = dependencies.data();
-
-    VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass));
-
-    // Create custom overlay render pass
-    attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-    attachments[0].initialLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    VK_CHECK_RESULT(vkCreateRenderPass(device, &renderPassInfo, nullptr, &uiRenderPass));
-  }*/
-
-//  void PipelineRepository::prepareCompositionPass(Common &ctxt)
-  /*{
-    // Descriptor set layout
-    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings =
-        {
-            // Binding 0: Position input attachment
-            vks::initializers::descriptorSetLayoutBinding(
-                VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-                VK_SHADER_STAGE_FRAGMENT_BIT,
-                0),
-            // Binding 1: Normal input attachment
-            vks::initializers::descriptorSetLayoutBinding(
-                VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-                VK_SHADER_STAGE_FRAGMENT_BIT,
-                1),
-            // Binding 2: Albedo input attachment
-            vks::initializers::descriptorSetLayoutBinding(
-                VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-                VK_SHADER_STAGE_FRAGMENT_BIT,
-                2),
-            // Binding 3: Light positions
-            vks::initializers::descriptorSetLayoutBinding(
-                VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                VK_SHADER_STAGE_FRAGMENT_BIT,
-                3),
-        };
-
-    VkDescriptorSetLayoutCreateInfo descriptorLayout =
-        vks::initializers::descriptorSetLayoutCreateInfo(
-            setLayoutBindings.data(),
-            static_cast<uint32_t>(setLayoutBindings.size()));
-
-    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayouts.composition));
-
-    // Pipeline layout
-    VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo =
-        vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.composition, 1);
-
-    VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &pipelineLayouts.composition));
-
-    // Descriptor sets
-    VkDescriptorSetAllocateInfo allocInfo =
-        vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.composition, 1);
-
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.composition));
-
-    // Image descriptors for the offscreen color attachments
-    VkDescriptorImageInfo texDescriptorPosition =
-        vks::initializers::descriptorImageInfo(
-            VK_NULL_HANDLE,
-            attachments.position.view,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    VkDescriptorImageInfo texDescriptorNormal =
-        vks::initializers::descriptorImageInfo(
-            VK_NULL_HANDLE,
-            attachments.normal.view,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    VkDescriptorImageInfo texDescriptorAlbedo =
-        vks::initializers::descriptorImageInfo(
-            VK_NULL_HANDLE,
-            attachments.albedo.view,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-    std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
-        // Binding 0: Position texture target
-        vks::initializers::writeDescriptorSet(
-            descriptorSets.composition,
-            VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-            0,
-            &texDescriptorPosition),
-        // Binding 1: Normals texture target
-        vks::initializers::writeDescriptorSet(
-            descriptorSets.composition,
-            VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-            1,
-            &texDescriptorNormal),
-        // Binding 2: Albedo texture target
-        vks::initializers::writeDescriptorSet(
-            descriptorSets.composition,
-            VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,
-            2,
-            &texDescriptorAlbedo),
-        // Binding 4: Fragment shader lights
-        vks::initializers::writeDescriptorSet(
-            descriptorSets.composition,
-            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            3,
-            &uniformBuffers.lights.descriptor),
-    };
-
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
-
-    // Pipeline
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState =
-        vks::initializers::pipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, 0, VK_FALSE);
-
-    VkPipelineRasterizationStateCreateInfo rasterizationState =
-        vks::initializers::pipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE, 0);
-
-    VkPipelineColorBlendAttachmentState blendAttachmentState =
-        vks::initializers::pipelineColorBlendAttachmentState(0xf, VK_FALSE);
-
-    VkPipelineColorBlendStateCreateInfo colorBlendState =
-        vks::initializers::pipelineColorBlendStateCreateInfo(1,	&blendAttachmentState);
-
-    VkPipelineDepthStencilStateCreateInfo depthStencilState =
-        vks::initializers::pipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
-
-    VkPipelineViewportStateCreateInfo viewportState =
-        vks::initializers::pipelineViewportStateCreateInfo(1, 1, 0);
-
-    VkPipelineMultisampleStateCreateInfo multisampleState =
-        vks::initializers::pipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT, 0);
-
-    std::vector<VkDynamicState> dynamicStateEnables = {	VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-    VkPipelineDynamicStateCreateInfo dynamicState =
-        vks::initializers::pipelineDynamicStateCreateInfo(dynamicStateEnables.data(), static_cast<uint32_t>(dynamicStateEnables.size()), 0);
-
-    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
-
-    shaderStages[0] = loadShader(getAssetPath() + "shaders/subpasses/composition.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-    shaderStages[1] = loadShader(getAssetPath() + "shaders/subpasses/composition.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
-
-    // Use specialization constants to pass number of lights to the shader
-    VkSpecializationMapEntry specializationEntry{};
-    specializationEntry.constantID = 0;
-    specializationEntry.offset = 0;
-    specializationEntry.size = sizeof(uint32_t);
-
-    uint32_t specializationData = NUM_LIGHTS;
+    PipelineCreateInfo info {};
+    info.index = CULL_INSTANCES;
+    info.ctxt = &ctxt;
+    info.compCode = {cullInstances_comp_spv, cullInstances_comp_spv_len};
 
-    VkSpecializationInfo specializationInfo;
-    specializationInfo.mapEntryCount = 1;
-    specializationInfo.pMapEntries = &specializationEntry;
-    specializationInfo.dataSize = sizeof(specializationData);
-    specializationInfo.pData = &specializationData;
+    std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+    describeGpuSceneSetLayout(info, layoutBindings);
 
-    shaderStages[1].pSpecializationInfo = &specializationInfo;
+    // Push constants
+    VkPushConstantRange pcRange = {};
+    {
+      pcRange.offset = 0;
+      pcRange.size = sizeof(CullPhase);
+      pcRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+      info.pcRanges.push_back(pcRange);
+    }
 
-    VkGraphicsPipelineCreateInfo pipelineCreateInfo =
-        vks::initializers::pipelineCreateInfo(pipelineLayouts.composition, renderPass, 0);
+    createPipelineLayout(info);
+    pipelines.at(info.index).layoutsExist = true;
+    createComputePipeline(info);
+  }
 
-    VkPipelineVertexInputStateCreateInfo emptyInputState{};
-    emptyInputState.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-    pipelineCreateInfo.pVertexInputState = &emptyInputState;
-    pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
-    pipelineCreateInfo.pRasterizationState = &rasterizationState;
-    pipelineCreateInfo.pColorBlendState = &colorBlendState;
-    pipelineCreateInfo.pMultisampleState = &multisampleState;
-    pipelineCreateInfo.pViewportState = &viewportState;
-    pipelineCreateInfo.pDepthStencilState = &depthStencilState;
-    pipelineCreateInfo.pDynamicState = &dynamicState;
-    pipelineCreateInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
-    pipelineCreateInfo.pStages = shaderStages.data();
-    // Index of the subpass that this pipeline will be used in
-    pipelineCreateInfo.subpass = 1;
+  void PipelineRepository::createIndirectMeshPipeline(Common &ctxt) {
 
-    depthStencilState.depthWriteEnable = VK_FALSE;
+    // This is populated and then passed to createPipeline.
+    PipelineCreateInfo info {};
 
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.composition));
+    { // pipeline type, context, and renderpass
+      info.index = MESH_INDIRECT;
+      info.ctxt = &ctxt;
+      info.renderPass = mainRenderPass;
+      info.subpass = SUBPASS_GBUFFER;
+      info.colorAttachmentCount = 2;
+    }
 
-    // Transparent (forward) pipeline
+    { // Shaders
+      info.vertCode = {meshIndirect_vert_spv, meshIndirect_vert_spv_len};
+      info.fragCode = {meshDefault_frag_spv, meshDefault_frag_spv_len};
+    }
 
-    // Descriptor set layout
-    setLayoutBindings = {
-        vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
-        vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, VK_SHADER_STAGE_FRAGMENT_BIT, 1),
-        vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2),
-    };
+    // Descriptor set layout bindings
+    std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+    {
+      VkDescriptorSetLayoutBinding instanceBinding{};
+      instanceBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      instanceBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+      instanceBinding.binding = 0;
+      instanceBinding.descriptorCount = 1;
+      layoutBindings.push_back(instanceBinding);
+    }
 
-    descriptorLayout = vks::initializers::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), static_cast<uint32_t>(setLayoutBindings.size()));
-    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device, &descriptorLayout, nullptr, &descriptorSetLayouts.transparent));
+    // Layout creation info
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+    {
+      layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+      layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+      layoutInfo.pBindings = layoutBindings.data();
+      info.descSetLayoutInfos.push_back(layoutInfo);
+      info.sharedDescSetLayouts.push_back(textureTable.layout); // Set 1
+    }
 
-    // Pipeline layout
-    pPipelineLayoutCreateInfo = vks::initializers::pipelineLayoutCreateInfo(&descriptorSetLayouts.transparent, 1);
-    VK_CHECK_RESULT(vkCreatePipelineLayout(device, &pPipelineLayoutCreateInfo, nullptr, &pipelineLayouts.transparent));
+    // Push constants: the view-projection matrix, since instances only carry their model matrices
+    VkPushConstantRange pcRange = {};
+    {
+      pcRange.offset = 0;
+      pcRange.size = sizeof(glm::mat4);
+      pcRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+      info.pcRanges.push_back(pcRange);
+    }
 
-    // Descriptor sets
-    allocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayouts.transparent, 1);
-    VK_CHECK_RESULT(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSets.transparent));
+    // Specialization constants
+    struct SpecializationData {
+      uint32_t textureArrayLength = 1;
+    } specializationData;
+    VkSpecializationMapEntry textureArrayLengthEntry{};
+    {
+      specializationData.textureArrayLength = textureTable.capacity;
+      textureArrayLengthEntry.constantID = 0;
+      textureArrayLengthEntry.size = sizeof(specializationData.textureArrayLength);
+      textureArrayLengthEntry.offset = static_cast<uint32_t>(offsetof(SpecializationData, textureArrayLength));
+      info.specializationInfo.dataSize = sizeof(specializationData);
+      info.specializationInfo.mapEntryCount = 1;
+      info.specializationInfo.pMapEntries = &textureArrayLengthEntry;
+      info.specializationInfo.pData = &specializationData;
+    }
 
-    writeDescriptorSets = {
-        vks::initializers::writeDescriptorSet(descriptorSets.transparent, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &uniformBuffers.GBuffer.descriptor),
-        vks::initializers::writeDescriptorSet(descriptorSets.transparent, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 1, &texDescriptorPosition),
-        vks::initializers::writeDescriptorSet(descriptorSets.transparent, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &textures.glass.descriptor),
-    };
-    vkUpdateDescriptorSets(device, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, NULL);
+    // If this is a re-initialization, the layouts will already exist and do not need to be recreated.
+    if (!pipelines.at(info.index).layoutsExist) {
+      createPipelineLayout(info);
+      pipelines.at(info.index).layoutsExist = true;
+    }
 
-    // Enable blending
-    blendAttachmentState.blendEnable = VK_TRUE;
-    blendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    blendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    blendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
-    blendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    blendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    blendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
-    blendAttachmentState.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    createPipeline(info);
+    createWireframeVariant(info);
+  }
 
-    pipelineCreateInfo.pVertexInputState = &vertices.inputState;
-    pipelineCreateInfo.layout = pipelineLayouts.transparent;
-    pipelineCreateInfo.subpass = 2;
+  void PipelineRepository::createDepthPyramidPipeline(Common &ctxt) {
 
-    shaderStages[0] = loadShader(getAssetPath() + "shaders/subpasses/transparent.vert.spv", VK_SHADER_STAGE_VERTEX_BIT);
-    shaderStages[1] = loadShader(getAssetPath() + "shaders/subpasses/transparent.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT);
+    PipelineCreateInfo info {};
+    info.index = BUILD_DEPTH_PYRAMID;
+    info.ctxt = &ctxt;
+    info.compCode = {depthPyramid_comp_spv, depthPyramid_comp_spv_len};
 
-    VK_CHECK_RESULT(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipelines.transparent));
-  }*/
+    // Descriptor set layout bindings: the level to read from, and the level to write
+    std::vector<VkDescriptorSetLayoutBinding> layoutBindings;
+    {
+      VkDescriptorSetLayoutBinding srcBinding{};
+      srcBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      srcBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+      srcBinding.binding = 0;
+      srcBinding.descriptorCount = 1;
+      layoutBindings.push_back(srcBinding);
+
+      VkDescriptorSetLayoutBinding dstBinding{};
+      dstBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+      dstBinding.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+      dstBinding.binding = 1;
+      dstBinding.descriptorCount = 1;
+      layoutBindings.push_back(dstBinding);
+
+      VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+      layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+      layoutInfo.bindingCount = static_cast<uint32_t>(layoutBindings.size());
+      layoutInfo.pBindings = layoutBindings.data();
+      info.descSetLayoutInfos.push_back(layoutInfo);
+    }
 
+    // Push constants
+    VkPushConstantRange pcRange = {};
+    {
+      pcRange.offset = 0;
+      pcRange.size = sizeof(DepthPyramidParams);
+      pcRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+      info.pcRanges.push_back(pcRange);
+    }
 
+    createPipelineLayout(info);
+    pipelines.at(info.index).layoutsExist = true;
+    createComputePipeline(info);
+  }
 
+  /*
+   * Lines in world space, each vertex with its own color, drawn over everything else. See DebugLines.
+   */
+  void PipelineRepository::createDebugLinesPipeline(Common &ctxt) {
 
+    // This is populated and then passed to createPipeline.
+    PipelineCreateInfo info {};
 
+    { // pipeline type, context, and renderpass
+      info.index = DEBUG_LINES;
+      info.ctxt = &ctxt;
+      info.renderPass = mainRenderPass;
+      info.subpass = SUBPASS_OVERLAY;
+      info.topology = VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+      info.cullMode = VK_CULL_MODE_NONE;
+    }
 
+    { // Shaders
+      info.vertCode = {debugLines_vert_spv, debugLines_vert_spv_len};
+      info.fragCode = {debugLines_frag_spv, debugLines_frag_spv_len};
+    }
 
+    // Vertices: a position, and a color packed into four bytes (DebugLines::Vertex)
+    {
+      info.customVertexSize = sizeof(glm::vec3) + sizeof(uint32_t);
+      info.customVertexAttributes.push_back({0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0});
+      info.customVertexAttributes.push_back({1, 0, VK_FORMAT_R8G8B8A8_UNORM, sizeof(glm::vec3)});
+    }
 
+    // Push constants: the view-projection matrix, since the lines are in world space
+    VkPushConstantRange pcRange = {};
+    {
+      pcRange.offset = 0;
+      pcRange.size = sizeof(glm::mat4);
+      pcRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+      info.pcRanges.push_back(pcRange);
+    }
 
-  void PipelineRepository::createStaticHeightmapTerrainPipeline(Common &ctxt) {
+    // If this is a re-initialization, the layouts will already exist and do not need to be recreated.
+    if (!pipelines.at(info.index).layoutsExist) {
+      createPipelineLayout(info);
+      pipelines.at(info.index).layoutsExist = true;
+    }
 
+    createPipeline(info);
   }
 
   void PipelineRepository::destroy(Common &ctxt) {
@@ -1115,23 +1026,30 @@ namespace at3::vkc {
         vkFreeDescriptorSets(ctxt.device, ctxt.descriptorPool, (uint32_t)pipeline.descSetLayouts.size(), &set);
       }
       vkDestroyPipeline(ctxt.device, pipeline.handle, nullptr);
+      vkDestroyPipeline(ctxt.device, pipeline.wireframeHandle, nullptr);
       vkDestroyPipelineLayout(ctxt.device, pipeline.layout, nullptr);
       for (auto layout : pipeline.descSetLayouts) {
         vkDestroyDescriptorSetLayout(ctxt.device, layout, nullptr);
       }
       pipeline.descSetLayouts.clear();
-      vkDestroyRenderPass(ctxt.device, mainRenderPass, nullptr);
     }
+    vkDestroyRenderPass(ctxt.device, mainRenderPass, nullptr);
+    vkDestroyRenderPass(ctxt.device, earlyRenderPass, nullptr);
+    vkDestroyRenderPass(ctxt.device, lateRenderPass, nullptr);
+    vkDestroyDescriptorPool(ctxt.device, textureTable.pool, nullptr); // Frees the set too
+    vkDestroyDescriptorSetLayout(ctxt.device, textureTable.layout, nullptr);
   }
 
   PipelineRepository::Pipeline &PipelineRepository::at(uint32_t index) {
     return pipelines.at(index);
   }
 
-  void PipelineRepository::reinit(Common &ctxt, uint32_t numTextures2D) {
-    createStandardMeshPipeline(ctxt, numTextures2D);
-    createTriangleDebugPipeline(ctxt, numTextures2D);
+  void PipelineRepository::reinit(Common &ctxt) {
+    createDeferredGBufferPipeline(ctxt, textureTable.capacity);
+    createDeferredComposePipeline(ctxt);
     createStaticHeightmapTerrainPipeline(ctxt);
+    createIndirectMeshPipeline(ctxt);
+    createDebugLinesPipeline(ctxt);
   }
   const VertexAttributes &PipelineRepository::getVertexAttributes() {
     return *vertexAttributes;
@@ -10,6 +10,56 @@ namespace at3::vkc {
     glm::mat4 m = glm::mat4(1.f);
   };
 
+  // Push constants of the resolveTransforms compute shader: one level of the scene hierarchy
+  struct ResolveParams {
+    uint32_t first;
+    uint32_t count;
+  };
+
+  // The view that the cullInstances compute shader culls against, kept in a buffer since it outgrew push constants
+  struct CullParams {
+    glm::mat4 viewProj;
+    glm::vec4 frustumPlanes[6]; // world space, pointing inward
+    glm::vec4 camera;           // xyz: world position, w: pixels tall that one unit appears at a distance of one unit
+    uint32_t drawCount;
+    float lodPixelError;
+    glm::vec2 depthSize;        // of the depth buffer that the depth pyramid was built from
+  };
+
+  // Push constants of the cullInstances compute shader
+  enum CullPhase : uint32_t {
+    CULL_SINGLE_PHASE = 0, // No occlusion culling: draw everything in the frustum
+    CULL_FIRST_PHASE,      // Draw what was visible last frame, before the depth pyramid is built
+    CULL_SECOND_PHASE      // Test the rest against the depth pyramid and draw what has become visible
+  };
+
+  // How many draws the culling passes of a frame threw away or kept, counted by the cullInstances compute shader
+  struct CullStats {
+    uint32_t frustumCulled;
+    uint32_t occlusionCulled;
+    uint32_t drawnFirstPhase; // Everything drawn, if there was only one phase
+    uint32_t drawnSecondPhase;
+  };
+
+  // Push constants of the depthPyramid compute shader: the sizes of the level it reads and the level it writes
+  struct DepthPyramidParams {
+    glm::uvec2 srcSize;
+    glm::uvec2 dstSize;
+  };
+
+  // A point light as the deferredCompose shader sees it
+  struct PointLight {
+    glm::vec4 positionRadius; // xyz: world position, w: the distance at which it has faded out entirely
+    glm::vec4 color;
+  };
+
+  // Push constants of the deferredCompose shader
+  struct ComposeParams {
+    glm::mat4 invViewProj;
+    glm::vec2 screenSize;
+    glm::uvec2 tileCount;     // of the light grid
+  };
+
   struct GlobalShaderData {
     AT3_ALIGNED_(16) glm::float32 time;
     AT3_ALIGNED_(16) glm::float32 lightIntensity;
@@ -41,19 +91,80 @@ namespace at3::vkc {
 
   enum StandardPipeline {
     MESH = 0,
-    TRI_DEBUG,
     SKYBOX,
     HEIGHT_TERRAIN,
+    RESOLVE_TRANSFORMS,
+    CULL_INSTANCES,
+    MESH_INDIRECT,
+    BUILD_DEPTH_PYRAMID,
+    DEFERRED_COMPOSE,
+    DEBUG_LINES,
     PIPELINE_COUNT,
     INVALID_PIPELINE
   };
 
+  /*
+   * The storage buffers that GPU-driven rendering keeps its scene in, all in set 0 of both of its compute pipelines
+   * (see GpuScene and the resolveTransforms and cullInstances shaders). The ones before GPU_SCENE_TEXTURE_DETAIL are
+   * shared by every frame, and the buffers from there on belong to one frame each. The last binding is the depth
+   * pyramid, a combined image sampler.
+   */
+  enum GpuSceneBinding {
+    GPU_SCENE_NODES = 0,
+    GPU_SCENE_ABS_TRANSFORMS,
+    GPU_SCENE_MESHES,
+    GPU_SCENE_LODS,
+    GPU_SCENE_DRAWS,
+    GPU_SCENE_DRAW_COMMANDS,
+    GPU_SCENE_INSTANCES,
+    GPU_SCENE_VISIBILITY,
+    GPU_SCENE_TEXTURE_DETAIL,
+    GPU_SCENE_VIEW,
+    GPU_SCENE_CULL_STATS,
+    GPU_SCENE_DEPTH_PYRAMID,
+    GPU_SCENE_BINDING_COUNT
+  };
+
+  /*
+   * The descriptor set of the compose pipeline (see LightGrid and the deferredCompose shader): the G-buffer and depth as
+   * input attachments, then the storage buffers that the light grid fills in each frame.
+   */
+  enum LightGridBinding {
+    LIGHT_GRID_ALBEDO = 0,
+    LIGHT_GRID_NORMAL,
+    LIGHT_GRID_DEPTH,
+    LIGHT_GRID_LIGHTS,
+    LIGHT_GRID_TILES,
+    LIGHT_GRID_BINDING_COUNT
+  };
+
+  /*
+   * The subpasses of every render pass that draws a frame. Meshes write the G-buffer and depth in the first, the second
+   * lights the G-buffer into the swapchain image, and the third draws debug lines on top.
+   */
+  enum MainSubpass {
+    SUBPASS_GBUFFER = 0,
+    SUBPASS_COMPOSE,
+    SUBPASS_OVERLAY,
+    SUBPASS_COUNT
+  };
+
   struct PipelineCreateInfo {
     StandardPipeline index = INVALID_PIPELINE;
     Common *ctxt = nullptr;
     VkRenderPass renderPass = VK_NULL_HANDLE;
     uint32_t subpass = 0;
+    uint32_t colorAttachmentCount = 1; // Of the subpass
+    bool vertexInput = true; // Whether the pipeline reads vertex buffers, laid out per getVertexAttributes
+    // If given, the vertex buffer is laid out like this instead
+    std::vector<VkVertexInputAttributeDescription> customVertexAttributes;
+    uint32_t customVertexSize = 0;
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    bool wireframe = false; // Create the pipeline's wireframeHandle instead of its handle
+    bool depthTest = true;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
     std::vector<VkDescriptorSetLayoutCreateInfo> descSetLayoutInfos;
+    std::vector<VkDescriptorSetLayout> sharedDescSetLayouts; // Not owned by the pipeline, come after its own sets
     std::vector<VkPushConstantRange> pcRanges;
     VkSpecializationInfo specializationInfo;
     ShaderSourceInfo
@@ -61,7 +172,24 @@ namespace at3::vkc {
         tescCode,
         teseCode,
         geomCode,
-        fragCode;
+        fragCode,
+        compCode; // If present, the pipeline is a compute pipeline and the other stages are ignored
+  };
+
+  /*
+   * One descriptor set holding every 2D texture, bound as set 1 by the pipelines that sample textures and shared by all
+   * of them. If the device supports it, the table is bindless: it has room for every texture index that a mesh instance
+   * can refer to, its unused entries may be left unwritten, and entries that no frame in flight is sampling may be
+   * rewritten while those frames are still pending. Otherwise it has exactly one entry per texture, all of which must be
+   * written, and it may only be rewritten while the GPU is idle. Either way its size never changes, so textures can be
+   * loaded and evicted without rebuilding any pipelines.
+   */
+  struct TextureTable {
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    uint32_t capacity = 0;
+    bool bindless = false;
   };
 
   class PipelineRepository {
@@ -71,6 +199,9 @@ namespace at3::vkc {
         std::vector<VkDescriptorSetLayout> descSetLayouts;
         VkPipelineLayout layout;
         VkPipeline handle;
+        // The same, with the edges of each triangle drawn over it. Only for the pipelines that draw meshes into the
+        // G-buffer, and only if the device supports geometry shaders.
+        VkPipeline wireframeHandle = VK_NULL_HANDLE;
         bool layoutsExist = false;
       };
       std::vector<Pipeline> pipelines;
@@ -78,39 +209,46 @@ namespace at3::vkc {
 
       void setVertexAttributes(std::vector<EMeshVertexAttribute> layout);
 
-      void createRenderPass(Common &ctxt);
+      void createRenderPass(Common &ctxt, VkRenderPass &outPass, bool loadPrevious, bool keepForLater);
 
+      void createTextureTable(Common &ctxt, uint32_t numTextures2D);
       void createPipelineLayout(PipelineCreateInfo &info);
       void createPipeline(PipelineCreateInfo &info);
-
-      void createStandardMeshPipeline(Common &ctxt, uint32_t texArrayLen);
+      void createComputePipeline(PipelineCreateInfo &info);
+      void createWireframeVariant(PipelineCreateInfo &info);
 
       void createDeferredGBufferPipeline(Common &ctxt, uint32_t texArrayLen);
-      void createDeferredComposePipeline(Common &ctxt, uint32_t texArrayLen);
+      void createDeferredComposePipeline(Common &ctxt);
 
-      void createTriangleDebugPipeline(Common &ctxt, uint32_t texArrayLen);
       void createStaticHeightmapTerrainPipeline(Common &ctxt);
 
-      void destroy(Common &ctxt);
-
-
-
-      void setupDescriptorSetLayout(PipelineCreateInfo &info);
-      void setupDescriptorSet();
-      void preparePipelines(Common &ctxt, uint32_t texArrayLen);
-      void setupRenderPass(Common &ctxt);
-      void prepareCompositionPass(Common &ctxt);
-
+      void describeGpuSceneSetLayout(PipelineCreateInfo &info, std::vector<VkDescriptorSetLayoutBinding> &bindings);
+      void createResolveTransformsPipeline(Common &ctxt);
+      void createCullInstancesPipeline(Common &ctxt);
+      void createIndirectMeshPipeline(Common &ctxt);
+      void createDepthPyramidPipeline(Common &ctxt);
+      void createDebugLinesPipeline(Common &ctxt);
 
+      void destroy(Common &ctxt);
 
     public:
 
+      // The G-buffer attachments, which only live through the render passes that draw a frame
+      static constexpr VkFormat gBufferAlbedoFormat = VK_FORMAT_R8G8B8A8_UNORM;
+      static constexpr VkFormat gBufferNormalFormat = VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+
       VkRenderPass mainRenderPass;
+      // Compatible with mainRenderPass, for drawing a frame in two parts with occlusion culling between them. The first
+      // leaves the depth buffer and G-buffer behind, the depth buffer for the depth pyramid, and the second carries on
+      // from where the first left off.
+      VkRenderPass earlyRenderPass;
+      VkRenderPass lateRenderPass;
+      TextureTable textureTable;
 
       PipelineRepository(Common &ctxt, uint32_t numTextures2D);
       const VertexAttributes &getVertexAttributes();
       Pipeline &at(uint32_t index);
-      void reinit(Common &ctxt, uint32_t numTextures2D);
+      void reinit(Common &ctxt);
   };
 
 }
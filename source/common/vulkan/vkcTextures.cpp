@@ -15,11 +15,18 @@
 //#pragma once
 
 //#include "vkc.h"
+#include <algorithm>
+#include <cmath>
 #include <vulkan/vulkan.h>
+#include "settings.hpp"
 #include "vkcTextures.hpp"
 
 namespace at3::vkc {
 
+  static const uint32_t mipTailSize = 64; // textures are first loaded with only the mip levels this size and smaller
+  static const uint32_t maxMipUpgradesPerFrame = 2;
+  static const uint32_t maxMipTrimsPerFrame = 4;
+
   /**
 		* Get the index of a memory type that has all the requested property bits set
 		*
@@ -266,34 +273,124 @@ namespace at3::vkc {
     vkFreeCommandBuffers(device, pool, 1, &commandBuffer);
   }
 
+  void TextureStagingBuffer::reserve(TextureOperationInfo &info, VkDeviceSize minSize) {
+    if (size >= minSize) { return; }
+    // Grow geometrically so that a run of ever larger textures doesn't re-create it every time
+    VkDeviceSize newSize = std::max(minSize, VkDeviceSize(4 * 1024 * 1024));
+    newSize = std::max(newSize, size * 2);
+    destroy(info); // Which forgets the old size
+
+    VkBufferCreateInfo bufferCreateInfo{};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.size = newSize;
+    // This buffer is used as a transfer source for the buffer copy
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkResult result = vkCreateBuffer(info.logicalDevice, &bufferCreateInfo, nullptr, &buffer);
+    AT3_ASSERT(result == VK_SUCCESS, "Failed to create texture staging buffer!\n");
+
+    VkMemoryRequirements memReqs;
+    vkGetBufferMemoryRequirements(info.logicalDevice, buffer, &memReqs);
+
+    AllocationCreateInfo createInfo;
+    createInfo.size = memReqs.size;
+    createInfo.alignment = memReqs.alignment;
+    createInfo.usage = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    createInfo.memoryTypeIndex = chooseMemoryType(memReqs.memoryTypeBits, info.physicalMemProps, createInfo.usage);
+    createInfo.category = AllocationCategory::STAGING;
+    info.context->allocator.alloc(memory, createInfo);
+    vkBindBufferMemory(info.logicalDevice, buffer, memory.handle, memory.offset);
+
+    vkMapMemory(info.logicalDevice, memory.handle, memory.offset, memReqs.size, 0, (void **) &mapped);
+    size = newSize;
+  }
+
+  void TextureStagingBuffer::destroy(TextureOperationInfo &info) {
+    if ( ! size) { return; }
+    vkUnmapMemory(info.logicalDevice, memory.handle);
+    vkDestroyBuffer(info.logicalDevice, buffer, nullptr);
+    info.context->allocator.free(memory);
+    buffer = VK_NULL_HANDLE;
+    mapped = nullptr;
+    size = 0;
+  }
+
+  /*
+   * Get device memory for an image from the engine's allocator and bind it
+   */
+  static void allocateImageMemory(TextureOperationInfo &info, Texture &texture, VkMemoryPropertyFlags properties,
+                                  bool optimalTiling) {
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(info.logicalDevice, texture.image, &memReqs);
+
+    AllocationCreateInfo createInfo;
+    createInfo.size = memReqs.size;
+    createInfo.alignment = memReqs.alignment;
+    createInfo.optimalTiling = optimalTiling;
+    createInfo.usage = properties;
+    createInfo.memoryTypeIndex = chooseMemoryType(memReqs.memoryTypeBits, info.physicalMemProps, properties);
+    createInfo.category = AllocationCategory::TEXTURE;
+    info.context->allocator.alloc(texture.memory, createInfo);
+    texture.memorySize = memReqs.size;
+    vkBindImageMemory(info.logicalDevice, texture.image, texture.memory.handle, texture.memory.offset);
+  }
+
   void Texture::destroy(TextureOperationInfo &info) {
     vkDestroyImageView(info.logicalDevice, view, nullptr);
     vkDestroyImage(info.logicalDevice, image, nullptr);
     if (sampler) {
       vkDestroySampler(info.logicalDevice, sampler, nullptr);
     }
-    vkFreeMemory(info.logicalDevice, deviceMemory, nullptr);
+    info.context->allocator.free(memory);
+  }
+
+  gli::texture2d loadTextureFile(const std::string &filename) {
+    AT3_ASSERT(fileExists(filename), "Could not load texture from file: %s\n", filename.c_str());
+    gli::texture2d tex2D(gli::load(filename.c_str()));
+    AT3_ASSERT(!tex2D.empty(), "Texture loaded, but empty: %s\n", filename.c_str());
+    return tex2D;
   }
 
   Texture2D::Texture2D(
       const std::string &filename,
       VkFormat format,
       TextureOperationInfo &info,
+      uint32_t firstMip,
+      uint32_t maxDimension,
       VkImageUsageFlags imageUsageFlags,
-      VkImageLayout imageLayout) {
-
-    AT3_ASSERT(fileExists(filename), "Could not load texture from file: %s\n", filename.c_str());
+      VkImageLayout imageLayout)
+      : Texture2D(loadTextureFile(filename), filename, format, info, firstMip, maxDimension, imageUsageFlags,
+                  imageLayout) { }
 
-    gli::texture2d tex2D(gli::load(filename.c_str()));
-
-    AT3_ASSERT(!tex2D.empty(), "Texture loaded, but empty: %s\n", filename.c_str());
+  Texture2D::Texture2D(
+      const gli::texture2d &tex2D,
+      const std::string &filename,
+      VkFormat format,
+      TextureOperationInfo &info,
+      uint32_t firstMip,
+      uint32_t maxDimension,
+      VkImageUsageFlags imageUsageFlags,
+      VkImageLayout imageLayout) {
 
-    texture.width = static_cast<uint32_t>(tex2D[0].extent().x);
-    texture.height = static_cast<uint32_t>(tex2D[0].extent().y);
-    texture.mipLevels = static_cast<uint32_t>(tex2D.levels());
+    texture.fullWidth = static_cast<uint32_t>(tex2D[0].extent().x);
+    texture.fullHeight = static_cast<uint32_t>(tex2D[0].extent().y);
+    texture.fullMipLevels = static_cast<uint32_t>(tex2D.levels());
 
-    printf("Loading Texture: %s (%u x %u with %u mip levels).\n", filename.c_str(),
-           texture.width, texture.height, texture.mipLevels);
+    // Skip the mip levels that weren't asked for
+    uint32_t baseMip = std::min(firstMip, texture.fullMipLevels - 1);
+    while (maxDimension && baseMip + 1 < texture.fullMipLevels
+           && (uint32_t) std::max(tex2D[baseMip].extent().x, tex2D[baseMip].extent().y) > maxDimension) {
+      ++baseMip;
+    }
+    texture.baseMip = baseMip;
+    texture.width = static_cast<uint32_t>(tex2D[baseMip].extent().x);
+    texture.height = static_cast<uint32_t>(tex2D[baseMip].extent().y);
+    texture.mipLevels = texture.fullMipLevels - baseMip;
+
+    if (settings::graphics::vulkan::verboseMeshLoading) {
+      printf("Loading Texture: %s (%u x %u with %u mip levels, from mip level %u).\n", filename.c_str(),
+             texture.width, texture.height, texture.mipLevels, baseMip);
+    }
 
     // Get device properites for the requested texture format
     VkFormatProperties formatProperties;
@@ -306,47 +403,25 @@ namespace at3::vkc {
     // limited amount of formats and features (mip maps, cubemaps, arrays, etc.)
     auto useStaging = (VkBool32) !info.forceLinear;
 
-    VkMemoryAllocateInfo memAllocInfo{};
-    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-
-    VkMemoryRequirements memReqs;
-
     // Use a separate command buffer for texture loading TODO: Correct to use this pool?
     VkCommandBuffer copyCmd = beginNewCommandBuffer(info.logicalDevice, info.transferCommandPool);
 
     if (useStaging) {
-      // Create a host-visible staging buffer that contains the raw image data
-      VkBuffer stagingBuffer;
-      VkDeviceMemory stagingMemory;
-
-      VkBufferCreateInfo bufferCreateInfo{};
-      bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-
-      bufferCreateInfo.size = tex2D.size();
-      // This buffer is used as a transfer source for the buffer copy
-      bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-      bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-      vkCreateBuffer(info.logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer);
-
-      // Get memory requirements for the staging buffer (alignment, memory type bits)
-      vkGetBufferMemoryRequirements(info.logicalDevice, stagingBuffer, &memReqs);
-
-      memAllocInfo.allocationSize = memReqs.size;
+      // Copy the raw image data into the shared staging buffer, which is host-visible and always mapped
+      AT3_ASSERT(info.staging, "No staging buffer to load texture with: %s\n", filename.c_str());
+      TextureStagingBuffer &staging = *info.staging;
 
-      // Get memory type index for a host visible buffer
-      memAllocInfo.memoryTypeIndex = chooseMemoryType(memReqs.memoryTypeBits, info.physicalMemProps,
-                                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-      vkAllocateMemory(info.logicalDevice, &memAllocInfo, nullptr, &stagingMemory);
-      vkBindBufferMemory(info.logicalDevice, stagingBuffer, stagingMemory, 0);
+      size_t stagingSize = 0;
+      for (uint32_t i = baseMip; i < texture.fullMipLevels; i++) {
+        stagingSize += tex2D[i].size();
+      }
+      staging.reserve(info, stagingSize);
 
-      // Copy texture data into staging buffer
-      uint8_t *data;
-      vkMapMemory(info.logicalDevice, stagingMemory, 0, memReqs.size, 0, (void **) &data);
-      memcpy(data, tex2D.data(), tex2D.size());
-      vkUnmapMemory(info.logicalDevice, stagingMemory);
+      size_t copyOffset = 0;
+      for (uint32_t i = baseMip; i < texture.fullMipLevels; i++) {
+        memcpy(staging.mapped + copyOffset, tex2D[i].data(), tex2D[i].size());
+        copyOffset += tex2D[i].size();
+      }
 
       // Setup buffer copy regions for each mip level
       std::vector<VkBufferImageCopy> bufferCopyRegions;
@@ -358,14 +433,14 @@ namespace at3::vkc {
         bufferCopyRegion.imageSubresource.mipLevel = i;
         bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
         bufferCopyRegion.imageSubresource.layerCount = 1;
-        bufferCopyRegion.imageExtent.width = static_cast<uint32_t>(tex2D[i].extent().x);
-        bufferCopyRegion.imageExtent.height = static_cast<uint32_t>(tex2D[i].extent().y);
+        bufferCopyRegion.imageExtent.width = static_cast<uint32_t>(tex2D[baseMip + i].extent().x);
+        bufferCopyRegion.imageExtent.height = static_cast<uint32_t>(tex2D[baseMip + i].extent().y);
         bufferCopyRegion.imageExtent.depth = 1;
         bufferCopyRegion.bufferOffset = offset;
 
         bufferCopyRegions.push_back(bufferCopyRegion);
 
-        offset += static_cast<uint32_t>(tex2D[i].size());
+        offset += static_cast<uint32_t>(tex2D[baseMip + i].size());
       }
 
       // Create optimal tiled target image
@@ -387,15 +462,7 @@ namespace at3::vkc {
         imageCreateInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
       }
       vkCreateImage(info.logicalDevice, &imageCreateInfo, nullptr, &texture.image);
-
-      vkGetImageMemoryRequirements(info.logicalDevice, texture.image, &memReqs);
-
-      memAllocInfo.allocationSize = memReqs.size;
-
-      memAllocInfo.memoryTypeIndex = chooseMemoryType(memReqs.memoryTypeBits, info.physicalMemProps,
-                                                      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-      vkAllocateMemory(info.logicalDevice, &memAllocInfo, nullptr, &texture.deviceMemory);
-      vkBindImageMemory(info.logicalDevice, texture.image, texture.deviceMemory, 0);
+      allocateImageMemory(info, texture, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, true);
 
       VkImageSubresourceRange subresourceRange = {};
       subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -415,7 +482,7 @@ namespace at3::vkc {
       // Copy mip levels from staging buffer
       vkCmdCopyBufferToImage(
           copyCmd,
-          stagingBuffer,
+          staging.buffer,
           texture.image,
           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
           static_cast<uint32_t>(bufferCopyRegions.size()),
@@ -432,10 +499,6 @@ namespace at3::vkc {
           subresourceRange);
 
       flushCommandBuffer(info.logicalDevice, info.transferCommandPool, copyCmd, info.transferQueue);
-
-      // Clean up staging resources
-      vkFreeMemory(info.logicalDevice, stagingMemory, nullptr);
-      vkDestroyBuffer(info.logicalDevice, stagingBuffer, nullptr);
     } else {
       // Prefer using optimal tiling, as linear tiling
       // may support only a small set of features
@@ -445,9 +508,6 @@ namespace at3::vkc {
       AT3_ASSERT(formatProperties.linearTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT,
                  "Linear tiling not supported!\n");
 
-      VkImage mappableImage;
-      VkDeviceMemory mappableMemory;
-
       VkImageCreateInfo imageCreateInfo{};
       imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 
@@ -463,50 +523,35 @@ namespace at3::vkc {
       imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
       // Load mip map level 0 to linear tiling image
-      vkCreateImage(info.logicalDevice, &imageCreateInfo, nullptr, &mappableImage);
-
-      // Get memory requirements for this image
-      // like size and alignment
-      vkGetImageMemoryRequirements(info.logicalDevice, mappableImage, &memReqs);
-      // Set memory allocation size to required memory size
-      memAllocInfo.allocationSize = memReqs.size;
-
-      // Get memory type that can be mapped to host memory
-      memAllocInfo.memoryTypeIndex = chooseMemoryType(memReqs.memoryTypeBits, info.physicalMemProps,
-                                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                                                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-      // Allocate host memory
-      vkAllocateMemory(info.logicalDevice, &memAllocInfo, nullptr, &mappableMemory);
+      // Linear tiled images don't need to be staged
+      // and can be directly used as textures
+      vkCreateImage(info.logicalDevice, &imageCreateInfo, nullptr, &texture.image);
 
-      // Bind allocated image for use
-      vkBindImageMemory(info.logicalDevice, mappableImage, mappableMemory, 0);
+      // Get memory that can be mapped to host memory
+      allocateImageMemory(info, texture,
+                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, false);
 
       // Get sub resource layout
       // Mip map count, array layer, etc.
       VkImageSubresource subRes = {};
       subRes.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
       subRes.mipLevel = 0;
+      uint32_t sourceMip = baseMip;
 
       VkSubresourceLayout subResLayout;
       void *data;
 
       // Get sub resources layout
       // Includes row pitch, size offsets, etc.
-      vkGetImageSubresourceLayout(info.logicalDevice, mappableImage, &subRes, &subResLayout);
+      vkGetImageSubresourceLayout(info.logicalDevice, texture.image, &subRes, &subResLayout);
 
       // Map image memory
-      vkMapMemory(info.logicalDevice, mappableMemory, 0, memReqs.size, 0, &data);
+      vkMapMemory(info.logicalDevice, texture.memory.handle, texture.memory.offset, texture.memorySize, 0, &data);
 
       // Copy image data into memory
-      memcpy(data, tex2D[subRes.mipLevel].data(), tex2D[subRes.mipLevel].size());
+      memcpy(data, tex2D[sourceMip].data(), tex2D[sourceMip].size());
 
-      vkUnmapMemory(info.logicalDevice, mappableMemory);
-
-      // Linear tiled images don't need to be staged
-      // and can be directly used as textures
-      texture.image = mappableImage;
-      texture.deviceMemory = mappableMemory;
+      vkUnmapMemory(info.logicalDevice, texture.memory.handle);
 
       // Setup image memory barrier
       setImageLayout(copyCmd, texture.image, VK_IMAGE_ASPECT_COLOR_BIT, VK_IMAGE_LAYOUT_UNDEFINED, imageLayout);
@@ -556,24 +601,90 @@ namespace at3::vkc {
     AT3_ASSERT(result == VK_SUCCESS, "Failed to create image view for %s!\n", filename.c_str());
   }
 
-  void TextureRepository::registerNewTexture2D(
-      Texture2D* texture2D, TextureOperationInfo &info, const std::string &key) {
-    textureArrayIndexMap.emplace(key, nextId++);
-    VkDescriptorImageInfo imageInfo {};
-    imageInfo.sampler = texture2D->texture.sampler;
-    imageInfo.imageView = texture2D->texture.view;
-    imageInfo.imageLayout = texture2D->texture.imageLayout;
-    descriptorImageInfos.push_back(imageInfo);
+  void TextureRepository::setDescriptorImageInfo(uint32_t index, const Texture &texture) {
+    VkDescriptorImageInfo &imageInfo = descriptorImageInfos.at(index);
+    imageInfo.sampler = texture.sampler;
+    imageInfo.imageView = texture.view;
+    imageInfo.imageLayout = texture.imageLayout;
+    if ( ! slots.at(index).descriptorDirty) {
+      slots[index].descriptorDirty = true;
+      dirtyDescriptors.push_back(index);
+    }
+  }
+  void TextureRepository::retire(std::unique_ptr<Texture2D> texture) {
+    retired.push_back({std::move(texture), opInfo.context->framesSubmitted}); // The frames in flight may be using it
   }
-  TextureRepository::TextureRepository(const std::string &textureDirectory, TextureOperationInfo &info) {
+  /*
+   * Texture memory comes from pooled blocks, so once the pools have grown to fit the working set, loading textures
+   * should not need any new device memory allocations. Whenever one does, it is logged, so that it can be seen if the
+   * count keeps climbing.
+   */
+  std::unique_ptr<Texture2D> TextureRepository::loadTexture(uint32_t index, uint32_t firstMip, uint32_t maxDimension) {
+    TextureSlot &slot = slots.at(index);
+    opInfo.magFilterNearest = slot.magFilterNearest;
+    uint32_t allocsBefore = opInfo.context->allocator.numAllocs();
+    auto texture = std::make_unique<Texture2D>(slot.source, slot.path, VK_FORMAT_R8G8B8A8_UNORM, opInfo, firstMip,
+                                               maxDimension);
+    uint32_t allocsAfter = opInfo.context->allocator.numAllocs();
+    if (allocsAfter > allocsBefore) {
+      printf("Loading %s took %u new device memory allocation(s), making %u\n", slot.path.c_str(),
+             allocsAfter - allocsBefore, allocsAfter);
+    }
+    return texture;
+  }
+  void TextureRepository::makeResident(uint32_t index) {
+    TextureSlot &slot = slots.at(index);
+    if (slot.texture) { return; }
+    slot.source = loadTextureFile(slot.path);
+    // The placeholder is always fully resident, but everything else starts out with just its mip tail
+    slot.texture = loadTexture(index, 0, index ? mipTailSize : 0);
+    slot.tailMip = slot.texture->texture.baseMip;
+    residentSize += slot.texture->texture.memorySize;
+    setDescriptorImageInfo(index, slot.texture->texture);
+  }
+  void TextureRepository::setResidentMip(uint32_t index, uint32_t mip) {
+    TextureSlot &slot = slots.at(index);
+    auto replacement = loadTexture(index, mip, 0);
+    residentSize -= slot.texture->texture.memorySize;
+    residentSize += replacement->texture.memorySize;
+    retire(std::move(slot.texture));
+    slot.texture = std::move(replacement);
+    setDescriptorImageInfo(index, slot.texture->texture);
+    replacedDescriptors = true;
+  }
+  void TextureRepository::evict(uint32_t index) {
+    TextureSlot &slot = slots.at(index);
+    if ( ! slot.texture) { return; }
+    if (settings::graphics::vulkan::verboseMeshLoading) {
+      printf("Evicting Texture: %s\n", slot.path.c_str());
+    }
+    residentSize -= slot.texture->texture.memorySize;
+    retire(std::move(slot.texture));
+    slot.source = gli::texture2d();
+    setDescriptorImageInfo(index, slots[0].texture->texture);
+    replacedDescriptors = true;
+  }
+  TextureRepository::TextureRepository(const std::string &textureDirectory, TextureOperationInfo &info)
+      : opInfo(info) {
+    AT3_ASSERT(opInfo.context, "Textures need a context to allocate memory from\n");
+    opInfo.staging = &staging;
     for (auto &path : fs::recursive_directory_iterator(textureDirectory)) {
       if (getFileExtOnly(path) == ".ktx") {
-        printf("TEX: %s : %u\n", getFileNameOnly(path).c_str(), static_cast<unsigned>(getFileNameOnly(path).size()));
-        info.magFilterNearest = getFileNameOnly(path).size() < 3; // FIXME: This is going to irk somebody at some point.
-        textures.emplace_back(getFileNameRelative(path), VK_FORMAT_R8G8B8A8_UNORM, info);
-        registerNewTexture2D(&textures.back(), info, getFileNameOnly(path));
+        TextureSlot &slot = slots.emplace_back();
+        slot.path = getFileNameRelative(path);
+        slot.magFilterNearest = getFileNameOnly(path).size() < 3; // FIXME: This is going to irk somebody at some point.
+        textureArrayIndexMap.emplace(getFileNameOnly(path), (uint32_t) slots.size() - 1);
       }
     }
+    AT3_ASSERT(!slots.empty(), "No textures found in %s\n", textureDirectory.c_str());
+    descriptorImageInfos.resize(slots.size());
+
+    // The first texture doubles as the placeholder for all the others, so it is loaded now and never evicted.
+    makeResident(0);
+    slots[0].refCount = 1;
+    for (uint32_t i = 1; i < slots.size(); ++i) {
+      setDescriptorImageInfo(i, slots[0].texture->texture);
+    }
   }
   bool TextureRepository::textureExists(const std::string &key) {
     return textureArrayIndexMap.count(key) > 0;
@@ -581,6 +692,175 @@ namespace at3::vkc {
   uint32_t TextureRepository::getTextureArrayIndex(const std::string &key) {
     return textureArrayIndexMap.at(key);
   }
+  uint32_t TextureRepository::acquire(const std::string &key) {
+    uint32_t index = textureArrayIndexMap.at(key);
+    makeResident(index);
+    ++slots[index].refCount;
+    slots[index].lastUsed = ++useCounter;
+    return index;
+  }
+  void TextureRepository::release(uint32_t index) {
+    AT3_ASSERT(slots.at(index).refCount, "Texture released more times than it was acquired\n");
+    --slots[index].refCount;
+  }
+  VkDeviceSize TextureRepository::evictUnused(VkDeviceSize bytesToFree) {
+    std::vector<uint32_t> candidates;
+    for (uint32_t i = 0; i < slots.size(); ++i) {
+      if (slots[i].texture && ! slots[i].refCount) {
+        candidates.push_back(i);
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+      return slots[a].lastUsed < slots[b].lastUsed;
+    });
+    VkDeviceSize freed = 0;
+    for (uint32_t index : candidates) {
+      if (freed >= bytesToFree) { break; }
+      freed += slots[index].texture->texture.memorySize;
+      evict(index);
+    }
+    return freed;
+  }
+  void TextureRepository::requestDetail(uint32_t index, float pixelsOnScreen) {
+    TextureSlot &slot = slots.at(index);
+    if ( ! slot.texture) { return; }
+    // Assume the texture is stretched across the whole object once, so it needs about one texel per pixel it covers
+    const Texture &tex = slot.texture->texture;
+    auto texels = (float) std::max(tex.fullWidth, tex.fullHeight);
+    uint32_t mip = pixelsOnScreen >= texels ? 0 : (uint32_t) std::log2(texels / std::max(pixelsOnScreen, 1.f));
+    if (slot.lastRequested != frameCounter) { // First request this frame
+      slot.requestedMip = slot.tailMip;
+      slot.lastRequested = frameCounter;
+    }
+    slot.requestedMip = std::min(slot.requestedMip, mip);
+  }
+  bool TextureRepository::updateStreaming(VkDeviceSize budget) {
+    uint64_t frame = frameCounter++;
+    bool changed = false;
+
+    // Drop detail from the textures that were least recently asked for it until the given amount has been freed.
+    // Textures that were drawn last frame only lose the detail they didn't need, and none lose their mip tails.
+    // Each trim re-creates a texture, so like upgrades, only so many happen per frame, and the rest wait for the next.
+    uint32_t trimmed = 0;
+    auto trim = [&](VkDeviceSize bytesToFree) {
+      std::vector<uint32_t> candidates;
+      for (uint32_t i = 1; i < slots.size(); ++i) {
+        if ( ! slots[i].texture) { continue; }
+        uint32_t target = slots[i].lastRequested == frame ? slots[i].requestedMip : slots[i].tailMip;
+        if (target > slots[i].texture->texture.baseMip) { candidates.push_back(i); }
+      }
+      std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+        return slots[a].lastRequested < slots[b].lastRequested;
+      });
+      VkDeviceSize freed = 0;
+      for (uint32_t index : candidates) {
+        if (freed >= bytesToFree || trimmed >= maxMipTrimsPerFrame) { break; }
+        VkDeviceSize sizeBefore = slots[index].texture->texture.memorySize;
+        setResidentMip(index, slots[index].lastRequested == frame ? slots[index].requestedMip : slots[index].tailMip);
+        freed += sizeBefore - slots[index].texture->texture.memorySize;
+        ++trimmed;
+        changed = true;
+      }
+      return freed;
+    };
+
+    if (budget && residentSize > budget) {
+      trim(residentSize - budget);
+    }
+
+    std::vector<uint32_t> upgrades;
+    for (uint32_t i = 1; i < slots.size(); ++i) {
+      if (slots[i].texture && slots[i].lastRequested == frame
+          && slots[i].requestedMip < slots[i].texture->texture.baseMip) {
+        upgrades.push_back(i);
+      }
+    }
+    std::sort(upgrades.begin(), upgrades.end(), [this](uint32_t a, uint32_t b) { // Neediest first
+      return slots[a].texture->texture.baseMip - slots[a].requestedMip
+             > slots[b].texture->texture.baseMip - slots[b].requestedMip;
+    });
+    uint32_t upgraded = 0;
+    for (uint32_t index : upgrades) {
+      if (upgraded >= maxMipUpgradesPerFrame) { break; }
+      TextureSlot &slot = slots[index];
+      // Each additional mip level is about four times the size of the whole chain below it
+      uint32_t levelsAdded = slot.texture->texture.baseMip - slot.requestedMip;
+      VkDeviceSize growth = slot.texture->texture.memorySize * ((VkDeviceSize(1) << (2 * levelsAdded)) - 1);
+      if (budget && residentSize + growth > budget) {
+        VkDeviceSize excess = residentSize + growth - budget;
+        if (trim(excess) < excess) { continue; }
+      }
+      setResidentMip(index, slot.requestedMip);
+      ++upgraded;
+      changed = true;
+    }
+
+    return changed;
+  }
+  void TextureRepository::destroyRetired() {
+    auto finished = std::partition(retired.begin(), retired.end(), [this](const RetiredTexture &texture) {
+      return texture.frame > opInfo.context->framesCompleted;
+    });
+    for (auto it = finished; it != retired.end(); ++it) {
+      it->texture->texture.destroy(opInfo);
+    }
+    retired.erase(finished, retired.end());
+  }
+  void TextureRepository::destroy() {
+    for (auto &texture : retired) {
+      texture.texture->texture.destroy(opInfo);
+    }
+    retired.clear();
+    for (auto &slot : slots) {
+      if (slot.texture) {
+        slot.texture->texture.destroy(opInfo);
+        slot.texture.reset();
+      }
+      slot.source = gli::texture2d();
+    }
+    residentSize = 0;
+    staging.destroy(opInfo);
+  }
+  std::vector<TextureResidencyStats> TextureRepository::getResidencyStats() {
+    std::vector<TextureResidencyStats> stats;
+    for (auto &slot : slots) {
+      TextureResidencyStats &stat = stats.emplace_back();
+      stat.path = slot.path;
+      stat.refCount = slot.refCount;
+      if (slot.texture) {
+        const Texture &tex = slot.texture->texture;
+        stat.fullWidth = tex.fullWidth;
+        stat.fullHeight = tex.fullHeight;
+        stat.fullMipLevels = tex.fullMipLevels;
+        stat.residentMip = tex.baseMip;
+        stat.residentBytes = tex.memorySize;
+      } else {
+        stat.fullWidth = stat.fullHeight = stat.fullMipLevels = stat.residentMip = 0;
+        stat.residentBytes = 0;
+      }
+      stat.requestedMip = slot.lastRequested + 1 >= frameCounter ? slot.requestedMip : stat.fullMipLevels;
+    }
+    return stats;
+  }
+  VkDeviceSize TextureRepository::getResidentSize() {
+    return residentSize;
+  }
+  bool TextureRepository::descriptorsAreDirty() {
+    return ! dirtyDescriptors.empty();
+  }
+  bool TextureRepository::descriptorsWereReplaced() {
+    return replacedDescriptors;
+  }
+  const std::vector<uint32_t> &TextureRepository::getDirtyDescriptorIndices() {
+    return dirtyDescriptors;
+  }
+  void TextureRepository::clearDescriptorsDirty() {
+    for (uint32_t index : dirtyDescriptors) {
+      slots[index].descriptorDirty = false;
+    }
+    dirtyDescriptors.clear();
+    replacedDescriptors = false;
+  }
   VkDescriptorImageInfo* TextureRepository::getDescriptorImageInfoArrayPtr() {
     return descriptorImageInfos.data();
   }
@@ -32,6 +32,7 @@
 #include <gli/gli.hpp>
 
 #include "fileSystemHelpers.hpp"
+#include "vkcTypes.hpp"
 
 namespace at3::vkc {
 
@@ -70,7 +71,11 @@ namespace at3::vkc {
 
   void flushCommandBuffer(VkDevice device, VkCommandPool pool, VkCommandBuffer commandBuffer, VkQueue queue);
 
+  struct TextureStagingBuffer;
+
   struct TextureOperationInfo {
+    Common *context = nullptr; // texture and staging memory comes from its allocator
+    TextureStagingBuffer *staging = nullptr;
     VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
     VkDevice logicalDevice = VK_NULL_HANDLE;
     VkCommandPool transferCommandPool = VK_NULL_HANDLE;
@@ -82,38 +87,150 @@ namespace at3::vkc {
     bool magFilterNearest = false;
   };
 
+  /*
+   * A host-visible buffer that stays mapped and is reused for every texture upload, growing to fit the largest one.
+   * Uploads wait until they are finished, so only one ever uses it at a time.
+   */
+  struct TextureStagingBuffer {
+      VkBuffer buffer = VK_NULL_HANDLE;
+      Allocation memory = {};
+      VkDeviceSize size = 0;
+      uint8_t *mapped = nullptr;
+      void reserve(TextureOperationInfo &info, VkDeviceSize minSize);
+      void destroy(TextureOperationInfo &info);
+  };
+
   struct Texture {
       VkImage image;
       VkImageLayout imageLayout;
-      VkDeviceMemory deviceMemory;
+      Allocation memory;
       VkImageView view;
       uint32_t width, height;
       uint32_t mipLevels;
       uint32_t layerCount;
       VkSampler sampler;
+      VkDeviceSize memorySize;
+      uint32_t baseMip;           // which mip level of the source file is level 0 of the image
+      uint32_t fullWidth, fullHeight, fullMipLevels; // as given in the source file
       void destroy(TextureOperationInfo &info);
   };
 
+  /*
+   * Reads a KTX or DDS file, asserting that it holds a texture.
+   */
+  gli::texture2d loadTextureFile(const std::string &filename);
+
   struct Texture2D {
     Texture texture;
+    /*
+     * Only the mip levels from firstMip down are uploaded, and if maxDimension is nonzero, the first level uploaded is
+     * also no larger than maxDimension in either direction. The smallest mip level is always uploaded.
+     */
     Texture2D (
         const std::string &filename,
         VkFormat format,
         TextureOperationInfo &info,
+        uint32_t firstMip = 0,
+        uint32_t maxDimension = 0,
+        VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
+        VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    /*
+     * The same, from a file that has already been read (filename is only used in messages).
+     */
+    Texture2D (
+        const gli::texture2d &tex2D,
+        const std::string &filename,
+        VkFormat format,
+        TextureOperationInfo &info,
+        uint32_t firstMip = 0,
+        uint32_t maxDimension = 0,
         VkImageUsageFlags imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
         VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
   };
 
+  struct TextureResidencyStats {
+    std::string path;
+    uint32_t fullWidth, fullHeight, fullMipLevels;
+    uint32_t residentMip;   // the most detailed mip level in device memory, or fullMipLevels if none are
+    uint32_t requestedMip;  // the most detailed mip level asked for by the last frame drawn
+    VkDeviceSize residentBytes;
+    uint32_t refCount;
+  };
+
+  /*
+   * Every texture found in the texture directory gets a permanent slot in the texture array, but a texture is only
+   * loaded into device memory the first time it is acquired. Until then (or after it has been evicted) its slot
+   * describes the placeholder texture, which is the texture in slot 0 and is always resident.
+   * Textures are reference counted by acquire/release, and only unreferenced textures are ever evicted.
+   * Loading or evicting a texture marks its descriptor image info dirty. Whoever owns the descriptor sets that use them
+   * must rewrite the dirty entries of those sets (see getDirtyDescriptorIndices) and then call clearDescriptorsDirty.
+   * All of them start out dirty.
+   *
+   * Textures are also streamed by mip level. Loading a texture only uploads its mip tail (the levels no larger than
+   * mipTailSize). While drawing, requestDetail is called with how large each use of a texture appears on screen, and
+   * updateStreaming then re-creates the textures that need more detail with more of their mip levels, dropping detail
+   * from the least recently requested ones when over budget. Only a few textures are re-created either way per frame,
+   * and the rest wait for the following frames.
+   *
+   * Replaced and evicted textures are retired rather than destroyed, and destroyRetired only destroys those that every
+   * frame submitted before their retirement is done with (see Common::framesCompleted). The descriptors of replaced or
+   * evicted textures may still be sampled by the frames in flight, though, so descriptorsWereReplaced tells whoever
+   * rewrites them that those frames must finish first.
+   */
   class TextureRepository {
-      std::vector<Texture2D> textures;
+      struct TextureSlot {
+        std::string path;
+        bool magFilterNearest = false;
+        std::unique_ptr<Texture2D> texture;
+        gli::texture2d source; // the file as read, kept while resident so that changing mip levels doesn't re-read it
+        uint32_t refCount = 0;
+        uint64_t lastUsed = 0;
+        uint32_t tailMip = 0;
+        uint32_t requestedMip = 0;
+        uint64_t lastRequested = 0;
+        bool descriptorDirty = false;
+      };
+      std::vector<TextureSlot> slots;
+      struct RetiredTexture {
+        std::unique_ptr<Texture2D> texture;
+        uint64_t frame; // the last submission that may have used it
+      };
+      std::vector<RetiredTexture> retired;
       std::vector<VkDescriptorImageInfo> descriptorImageInfos;
       std::unordered_map<std::string, uint32_t> textureArrayIndexMap;
-      uint32_t nextId = 0;
-      void registerNewTexture2D(Texture2D* texture2D, TextureOperationInfo &info, const std::string &key);
+      TextureOperationInfo opInfo;
+      TextureStagingBuffer staging;
+      VkDeviceSize residentSize = 0;
+      uint64_t useCounter = 0;
+      uint64_t frameCounter = 1;
+      std::vector<uint32_t> dirtyDescriptors;
+      bool replacedDescriptors = false;
+      void retire(std::unique_ptr<Texture2D> texture);
+      std::unique_ptr<Texture2D> loadTexture(uint32_t index, uint32_t firstMip, uint32_t maxDimension);
+      void makeResident(uint32_t index);
+      void evict(uint32_t index);
+      void setResidentMip(uint32_t index, uint32_t mip);
+      void setDescriptorImageInfo(uint32_t index, const Texture &texture);
     public:
       TextureRepository(const std::string &textureDirectory, TextureOperationInfo &info);
       bool textureExists(const std::string &key);
       uint32_t getTextureArrayIndex(const std::string &key);
+      uint32_t acquire(const std::string &key);
+      void release(uint32_t index);
+      VkDeviceSize evictUnused(VkDeviceSize bytesToFree);
+      void requestDetail(uint32_t index, float pixelsOnScreen);
+      bool updateStreaming(VkDeviceSize budget);
+      void destroyRetired();
+      /*
+       * Destroy every texture, retired or not, and the staging buffer. The GPU must not be using any of them.
+       */
+      void destroy();
+      std::vector<TextureResidencyStats> getResidencyStats();
+      VkDeviceSize getResidentSize();
+      bool descriptorsAreDirty();
+      bool descriptorsWereReplaced();
+      const std::vector<uint32_t> &getDirtyDescriptorIndices();
+      void clearDescriptorsDirty();
       VkDescriptorImageInfo* getDescriptorImageInfoArrayPtr();
       uint32_t getDescriptorImageInfoArrayCount();
   };
@@ -9,7 +9,6 @@
 
 #include "math.hpp"
 #include "fileSystemHelpers.hpp"
-#include "vkcTextures.hpp"
 
 namespace at3::vkc {
 
@@ -21,12 +20,29 @@ namespace at3::vkc {
       Present
   };
 
+  /*
+   * What an allocation is for, so that memory usage can be broken down by it.
+   */
+  enum class AllocationCategory : uint32_t {
+      OTHER = 0,
+      MESH,
+      TEXTURE,
+      INSTANCE_DATA,
+      RENDER_TARGET,
+      STAGING,
+      COUNT
+  };
+
+  const char *getAllocationCategoryName(AllocationCategory category);
+
   struct Allocation {
       VkDeviceMemory handle;
       uint32_t type;
+      uint32_t pool; // which of the allocator's pools it came from, if the allocator has pools
       uint32_t id;
       VkDeviceSize size;
       VkDeviceSize offset;
+      AllocationCategory category;
       Common *context;
   };
 
@@ -34,6 +50,39 @@ namespace at3::vkc {
       VkMemoryPropertyFlags usage;
       uint32_t memoryTypeIndex;
       VkDeviceSize size;
+      VkDeviceSize alignment = 1;  // from VkMemoryRequirements
+      bool optimalTiling = false;  // for images with VK_IMAGE_TILING_OPTIMAL, which can't share pages with buffers
+      AllocationCategory category = AllocationCategory::OTHER;
+  };
+
+  struct MemoryTypeStats {
+      VkDeviceSize liveBytes = 0;        // allocated to something
+      VkDeviceSize reservedBytes = 0;    // allocated from the device, whether or not in use
+      VkDeviceSize highWaterBytes = 0;   // the most that has been live at once
+      VkDeviceSize largestFreeBytes = 0; // the largest single free span in any block
+      uint32_t blockCount = 0;           // device memory allocations, including dedicated ones
+      uint32_t allocationCount = 0;
+      VkDeviceSize categoryBytes[(size_t) AllocationCategory::COUNT] = {};
+      /*
+       * 1 - (largest free span / all free space): 0 if all of the free space could be used by a single allocation, and
+       * approaching 1 as it gets scattered into smaller spans
+       */
+      float getFragmentation() const;
+  };
+
+  struct MemoryHeapStats {
+      VkDeviceSize size = 0;
+      VkDeviceSize liveBytes = 0;
+      VkDeviceSize reservedBytes = 0;
+      // From VK_EXT_memory_budget, if available: how much of the heap this process can use, and is using
+      bool hasBudget = false;
+      VkDeviceSize budgetBytes = 0;
+      VkDeviceSize usageBytes = 0;
+  };
+
+  struct DeviceMemoryStats {
+      std::vector<MemoryTypeStats> types; // indexed by memory type
+      std::vector<MemoryHeapStats> heaps; // indexed by memory heap
   };
 
   struct AllocatorInterface {
@@ -42,6 +91,7 @@ namespace at3::vkc {
       void (*free)(Allocation &);
       size_t (*allocatedSize)(uint32_t);
       uint32_t (*numAllocs)();
+      void (*getStats)(std::vector<MemoryTypeStats> &); // one per memory type
   };
 
   struct DeviceQueues {
@@ -78,6 +128,10 @@ namespace at3::vkc {
       VkPhysicalDeviceProperties deviceProps;
       VkPhysicalDeviceMemoryProperties memProps;
       VkPhysicalDeviceFeatures features;
+      bool hasMemoryBudget; // VK_EXT_memory_budget is enabled
+      // The most textures a bindless (update-after-bind, partially bound) texture table may hold, or 0 if the device
+      // does not support descriptor indexing well enough for one
+      uint32_t maxBindlessTextures;
       SwapChainSupportInfo swapChainSupport;
       uint32_t queueFamilyCount;
       uint32_t presentQueueFamilyIdx;
@@ -98,6 +152,8 @@ namespace at3::vkc {
       std::vector<VkCommandBuffer> commandBuffers;
       std::vector<bool> firstFrame;
       RenderBuffer depthBuffer;
+      RenderBuffer gBufferAlbedo;
+      RenderBuffer gBufferNormal;
   };
 
   struct Common {
@@ -106,6 +162,7 @@ namespace at3::vkc {
       int windowHeight;
 
       VkInstance instance;
+      bool hasPhysicalDeviceProperties2; // VK_KHR_get_physical_device_properties2 is enabled on the instance
       Surface surface;
       PhysicalDevice gpu;
       VkDevice device;
@@ -119,6 +176,9 @@ namespace at3::vkc {
       VkSemaphore imageAvailableSemaphore;
       VkSemaphore renderFinishedSemaphore;
       std::vector<VkFence> frameFences;
+      std::vector<uint64_t> frameSerials; // by swapchain image, which submission its fence was last submitted with
+      uint64_t framesSubmitted = 0;
+      uint64_t framesCompleted = 0;       // every submission up to and including this one has finished
 
       WindowSizeDependents windowDependents;
       std::vector<VkWriteDescriptorSet> setWriters; // Only kept to avoid reallocating every frame (what compiler?)
@@ -148,7 +208,8 @@ namespace at3::vkc {
     VkVertexInputAttributeDescription *attrDescriptions;
     EMeshVertexAttribute *attributes;
     uint32_t attrCount;
-    uint32_t vertexSize;
+    uint32_t vertexSize;      // size of one vertex as it is stored on the GPU
+    uint32_t floatVertexSize; // size of one vertex interleaved as 32-bit floats, as it is imported and cached
   };
 
   /**
@@ -161,6 +222,7 @@ namespace at3::vkc {
    */
   struct MeshInstanceIndices {
     typedef uint32_t rawType;
+    static constexpr uint32_t maxTextures = 1u << 12u;
     rawType raw;
     MeshInstanceIndices() : raw(std::numeric_limits<rawType>::max()) {
       // set to max so that things will probably crash if an index is used without first setting it to a valid value.
@@ -191,10 +253,30 @@ namespace at3::vkc {
     MeshInstanceIndices indices;
   };
 
+  /**
+   * A range of a mesh's index data that draws the mesh at a reduced level of detail, using the same vertices.
+   */
+  struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t iCount;
+    float error; // how far (in object space) this LOD may deviate from the full-detail mesh
+  };
+
+  /**
+   * Only the positions and indices of a mesh's full-detail triangles, kept on the CPU for physics, which uses them
+   * where they are instead of copying them.
+   */
+  struct StoredTriangles {
+    std::vector<float> positions; // x, y and z of each vertex
+    std::vector<uint32_t> indices;
+    uint64_t key; // the key of the cooked mesh they were read from (see hashCookedMeshKey), and the sub-mesh's index
+  };
+
   template<typename EcsInterface>
   struct MeshResource {
     VkBuffer buffer;
     Allocation bufferMemory;
+    VkDeviceSize bufferSize; // of the vertices and the indices of every LOD, which may be less than the allocation
 
     uint32_t vOffset;
     uint32_t iOffset;
@@ -202,13 +284,28 @@ namespace at3::vkc {
     uint32_t vCount;
     uint32_t iCount;
 
+    VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+
+    MeshLod lods[MAX_MESH_LODS];
+    uint32_t lodCount = 1;
+
     glm::vec3 min;
     glm::vec3 max;
+    glm::mat4 dequantization = glm::mat4(1.f); // applied before the model matrix, identity unless quantized
 
     std::vector<MeshInstance<EcsInterface>> instances;
 
-    std::shared_ptr<std::vector<float>> storedVertices;
-    std::shared_ptr<std::vector<uint32_t>> storedIndices;
+    std::shared_ptr<const StoredTriangles> storedTriangles; // Outlives the mesh if physics still uses it
+  };
+
+  /**
+   * Where to find a mesh that has not necessarily been loaded yet, and how many instances currently reference it.
+   */
+  struct MeshSource {
+    std::string path;
+    bool storeTriangles = false;
+    uint32_t refCount = 0;
+    uint64_t lastUsed = 0;
   };
 
   // TODO: Get this disentangled from VulkanContext like TextureRepository, do it when upgrading to gltf
@@ -1,8 +1,114 @@
 
+#if defined(_MSC_VER)
+# include <intrin.h>
+#endif
 #include "vkcUboPageMgr.hpp"
 
 namespace at3::vkc {
 
+  static uint32_t lowestSetBit(uint64_t bits) {
+#   if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (uint32_t) index;
+#   else
+    return (uint32_t) __builtin_ctzll(bits);
+#   endif
+  }
+
+  void UboSlotMap::setHasSpace(uint32_t page, bool hasSpace) {
+    uint64_t bit = uint64_t(1) << (page % 64);
+    if (hasSpace) {
+      pagesWithSpace[page / 64] |= bit;
+    } else {
+      pagesWithSpace[page / 64] &= ~bit;
+    }
+  }
+
+  bool UboSlotMap::acquire(uint32_t maxPages, uint32_t &outPage, uint32_t &outSlot, bool &outNewPage) {
+    uint32_t pageIndex = UINT32_MAX;
+    for (uint32_t word = 0; word < pagesWithSpace.size(); ++word) {
+      if (pagesWithSpace[word]) {
+        pageIndex = word * 64 + lowestSetBit(pagesWithSpace[word]);
+        break;
+      }
+    }
+
+    outNewPage = pageIndex == UINT32_MAX;
+    if (outNewPage) {
+      if (pages.size() >= maxPages) {
+        return false;
+      }
+      pageIndex = (uint32_t) pages.size();
+      Page &page = pages.emplace_back();
+      for (uint64_t &word : page.freeBits) {
+        word = ~uint64_t(0);
+      }
+      page.freeCount = slotsPerPage;
+      if (pagesWithSpace.size() * 64 < pages.size()) {
+        pagesWithSpace.push_back(0);
+      }
+      setHasSpace(pageIndex, true);
+    }
+
+    Page &page = pages[pageIndex];
+    uint32_t slot = 0;
+    for (uint32_t word = 0; word < wordsPerPage; ++word) {
+      if (page.freeBits[word]) {
+        slot = word * 64 + lowestSetBit(page.freeBits[word]);
+        break;
+      }
+    }
+    page.freeBits[slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    if ( ! --page.freeCount) {
+      setHasSpace(pageIndex, false);
+    }
+    ++liveSlots;
+
+    outPage = pageIndex;
+    outSlot = slot;
+    return true;
+  }
+
+  void UboSlotMap::release(uint32_t pageIndex, uint32_t slot) {
+    AT3_ASSERT(pageIndex < pages.size(), "Array index out of bounds");
+    Page &page = pages[pageIndex];
+    uint64_t bit = uint64_t(1) << (slot % 64);
+    AT3_ASSERT( ! (page.freeBits[slot / 64] & bit), "UBO slot released more than once");
+    page.freeBits[slot / 64] |= bit;
+    if ( ! page.freeCount++) {
+      setHasSpace(pageIndex, true);
+    }
+    --liveSlots;
+  }
+
+  uint32_t UboSlotMap::getNumPages() const {
+    return (uint32_t) pages.size();
+  }
+
+  uint32_t UboSlotMap::getNumLiveSlots() const {
+    return liveSlots;
+  }
+
+  uint32_t UboSlotMap::getCompactedPageCount() const {
+    return (liveSlots + slotsPerPage - 1) / slotsPerPage;
+  }
+
+  bool UboSlotMap::shouldCompact() const {
+    return pages.size() && liveSlots + slotsPerPage / 2 <= (pages.size() - 1) * slotsPerPage;
+  }
+
+  bool UboSlotMap::lastPageIsEmpty() const {
+    return ! pages.empty() && pages.back().freeCount == slotsPerPage;
+  }
+
+  void UboSlotMap::removeLastPage() {
+    AT3_ASSERT(lastPageIsEmpty(), "Removing a UBO page that still has live slots");
+    setHasSpace((uint32_t) pages.size() - 1, false);
+    pages.pop_back();
+    pagesWithSpace.resize((pages.size() + 63) / 64);
+  }
+
   uint32_t getMemoryType(const VkPhysicalDevice &device, uint32_t memoryTypeBitsRequirement,
                          VkMemoryPropertyFlags requiredProperties) {
     VkPhysicalDeviceMemoryProperties memProperties;
@@ -32,7 +138,7 @@ namespace at3::vkc {
   }
 
   void createBuffer(VkBuffer &outBuffer, Allocation &bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage,
-                    VkMemoryPropertyFlags properties, Common &ctxt) {
+                    VkMemoryPropertyFlags properties, Common &ctxt, AllocationCategory category) {
     VkBufferCreateInfo bufferInfo = {};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
@@ -60,8 +166,10 @@ namespace at3::vkc {
 
     AllocationCreateInfo allocInfo = {};
     allocInfo.size = memRequirements.size;
+    allocInfo.alignment = memRequirements.alignment;
     allocInfo.memoryTypeIndex = getMemoryType(ctxt.gpu.device, memRequirements.memoryTypeBits, properties);
     allocInfo.usage = properties;
+    allocInfo.category = category;
 
     ctxt.allocator.alloc(bufferMemory, allocInfo);
     vkBindBufferMemory(ctxt.device, outBuffer, bufferMemory.handle, bufferMemory.offset);
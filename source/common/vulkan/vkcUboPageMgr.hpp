@@ -1,8 +1,9 @@
 
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
-#include <deque>
+#include <vector>
 #include "vkcPipelines.hpp"
 #include "math.hpp"
 
@@ -12,20 +13,78 @@ namespace at3::vkc {
                          VkMemoryPropertyFlags requiredProperties);
 
   void createBuffer(VkBuffer &outBuffer, Allocation &bufferMemory, VkDeviceSize size, VkBufferUsageFlags usage,
-                    VkMemoryPropertyFlags properties, Common &ctxt);
+                    VkMemoryPropertyFlags properties, Common &ctxt,
+                    AllocationCategory category = AllocationCategory::OTHER);
+
+  /*
+   * Keeps track of which UBO slots are free, in pages of slotsPerPage slots. Free slots are tracked by a bitmap in
+   * each page, and pages with any free slots by a bitmap of pages, so acquire and release take constant time. A slot
+   * is always acquired from the lowest-numbered page that has room, which keeps the live slots packed toward the first
+   * pages. This knows nothing about the buffers behind the pages, so it can be exercised on its own.
+   */
+  class UboSlotMap {
+    public:
+      static constexpr uint32_t slotsPerPage = 512; // The 9 slot bits in MeshInstanceIndices
+
+      /*
+       * Take the lowest free slot in the lowest page that has one, adding a page at the end if none does (and setting
+       * outNewPage). Returns false if every slot of maxPages pages is taken.
+       */
+      bool acquire(uint32_t maxPages, uint32_t &outPage, uint32_t &outSlot, bool &outNewPage);
+      void release(uint32_t page, uint32_t slot);
+      uint32_t getNumPages() const;
+      uint32_t getNumLiveSlots() const;
+      /*
+       * How many pages the live slots would fit in if they were packed together.
+       */
+      uint32_t getCompactedPageCount() const;
+      /*
+       * Whether compacting would free at least one page, with half a page to spare so that spawning and despawning
+       * around a page boundary doesn't compact every frame.
+       */
+      bool shouldCompact() const;
+      bool lastPageIsEmpty() const;
+      void removeLastPage();
+
+    private:
+      static constexpr uint32_t wordsPerPage = slotsPerPage / 64;
+
+      struct Page {
+        uint64_t freeBits[wordsPerPage]; // A set bit means that slot is free
+        uint32_t freeCount;
+      };
+
+      std::vector<Page> pages;
+      std::vector<uint64_t> pagesWithSpace; // A set bit means that page has at least one free slot
+      uint32_t liveSlots = 0;
 
+      void setHasSpace(uint32_t page, bool hasSpace);
+  };
+
+  /*
+   * Hands out UBO slots for mesh instances, in pages of slotsPerPage slots that each get their own buffer, with the
+   * slots themselves kept track of by a UboSlotMap. Pages are only ever removed from the end (since page numbers are
+   * baked into instance indices and descriptor sets are kept per page), so when enough slots have been released,
+   * shouldCompact returns true and the owner should move the instances in the last pages into free slots in the first
+   * ones (see getCompactedPageCount) and then call trimEmptyPages. The frames in flight may still be using the trimmed
+   * pages, so they are retired, and destroyRetiredPages destroys them once those frames are done (see
+   * Common::framesCompleted).
+   */
   class UboPageMgr {
 
-      uint32_t slotsPerPage;
+    public:
+      static constexpr uint32_t slotsPerPage = UboSlotMap::slotsPerPage;
+
+    private:
       uint32_t size;
 
       Common *ctxt;
 
+      UboSlotMap slots;
+
       struct Page {
         VkBuffer buf;
         Allocation alloc;
-        std::deque<uint32_t> freeIndices;
-        uint32_t index;
 
 #       if DEVICE_LOCAL
 #         if PERSISTENT_STAGING_BUFFER
@@ -45,7 +104,13 @@ namespace at3::vkc {
 
       std::vector<Page> pages;
 
-      Page &createNewPage() {
+      struct RetiredPage {
+        Page page;
+        uint64_t frame; // the last submission that may have used it
+      };
+      std::vector<RetiredPage> retired;
+
+      void createNewPage() {
         Page page;
         Common &_ctxt = *ctxt;
 
@@ -60,7 +125,7 @@ namespace at3::vkc {
             VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
             VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
 #           endif
-            _ctxt);
+            _ctxt, AllocationCategory::INSTANCE_DATA);
 
 #       if PERSISTENT_STAGING_BUFFER
         createBuffer(
@@ -73,7 +138,7 @@ namespace at3::vkc {
 #           else
             VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
 #           endif
-          _ctxt );
+          _ctxt, AllocationCategory::STAGING);
 #       endif
 
 #       if DEVICE_LOCAL
@@ -86,14 +151,28 @@ namespace at3::vkc {
         vkMapMemory(_ctxt.device, page.alloc.handle, page.alloc.offset, page.alloc.size, 0, &page.map);
 #       endif
 
-        for (uint32_t i = 0; i < slotsPerPage; ++i) {
-          page.freeIndices.push_back(i);
-        }
+        pages.push_back(page);
+      }
 
-        page.index = (uint32_t) pages.size();
+      void destroyPage(Page &page) {
+        Common &_ctxt = *ctxt;
+#       if DEVICE_LOCAL
+#         if PERSISTENT_STAGING_BUFFER
+        vkUnmapMemory(_ctxt.device, page.stagingAlloc.handle);
+#         else
+        free(page.map);
+#         endif
+#       else
+        vkUnmapMemory(_ctxt.device, page.alloc.handle);
+#       endif
 
-        pages.push_back(page);
-        return pages[page.index];
+#       if PERSISTENT_STAGING_BUFFER
+        vkDestroyBuffer(_ctxt.device, page.stagingBuf, nullptr);
+        _ctxt.allocator.free(page.stagingAlloc);
+#       endif
+
+        vkDestroyBuffer(_ctxt.device, page.buf, nullptr);
+        _ctxt.allocator.free(page.alloc);
       }
 
     public:
@@ -104,7 +183,6 @@ namespace at3::vkc {
 
       UboPageMgr(Common &_ctxt) {
         ctxt = &_ctxt;
-        slotsPerPage = 512;
         size = (sizeof(VShaderInput) * slotsPerPage);
       }
 
@@ -121,33 +199,60 @@ namespace at3::vkc {
 
 
       AcquireStatus acquire(MeshInstanceIndices &outIdx) {
-        Page *p = nullptr;
-
-        for (auto &page : pages) {
-          if (page.freeIndices.size() > 0) {
-            p = &page;
-            break;
-          }
+        uint32_t page, slot;
+        bool newPage;
+        if ( ! slots.acquire(0x800u, page, slot, newPage)) { // The 11 page bits in MeshInstanceIndices
+          return FAILURE;
         }
-
-        bool newPage = false;
-        if (!p) {
-          p = &createNewPage();
-          newPage = true;
+        if (newPage) {
+          createNewPage();
         }
+        outIdx.set(page, slot);
+        return newPage ? NEWPAGE : SUCCESS;
+      }
 
-        uint32_t slot = p->freeIndices.front();
-        p->freeIndices.pop_front();
+      void release(const MeshInstanceIndices &idx) {
+        slots.release(idx.getPage(), idx.getSlot());
+      }
 
-        outIdx.set(p->index, slot);
+      uint32_t getNumPages() {
+        return (uint32_t) pages.size();
+      }
 
-        return newPage ? NEWPAGE : SUCCESS;
+      uint32_t getNumLiveSlots() {
+        return slots.getNumLiveSlots();
       }
 
-      uint32_t getNumPages() {
+      uint32_t getCompactedPageCount() {
+        return slots.getCompactedPageCount();
+      }
+
+      bool shouldCompact() {
+        return slots.shouldCompact();
+      }
+
+      /*
+       * Retire the pages at the end that have no live slots. Returns the new number of pages.
+       */
+      uint32_t trimEmptyPages() {
+        while ( ! pages.empty() && slots.lastPageIsEmpty()) {
+          slots.removeLastPage();
+          retired.push_back({pages.back(), ctxt->framesSubmitted});
+          pages.pop_back();
+        }
         return (uint32_t) pages.size();
       }
 
+      void destroyRetiredPages() {
+        auto finished = std::partition(retired.begin(), retired.end(), [this](const RetiredPage &page) {
+          return page.frame > ctxt->framesCompleted;
+        });
+        for (auto it = finished; it != retired.end(); ++it) {
+          destroyPage(it->page);
+        }
+        retired.erase(finished, retired.end());
+      }
+
       template<typename EcsInterface>
       void updateBuffers(const glm::mat4 &viewMatrix, const glm::mat4 &projMatrix, VkCommandBuffer *commandBuffer,
                          Common &ctxt, EcsInterface *ecs, const MeshRepository<EcsInterface> &meshRepo) {
@@ -177,7 +282,7 @@ namespace at3::vkc {
               glm::uint32 uboPage = instance.indices.getPage();
               objPtrs[uboPage][uboSlot].vp = projMatrix * viewMatrix;
 //              objPtrs[uboPage][uboSlot].custom = glm::transpose(glm::inverse(modelViewMatrix));
-              objPtrs[uboPage][uboSlot].m = ecs->getAbsTransform(instance.id);
+              objPtrs[uboPage][uboSlot].m = ecs->getAbsTransform(instance.id) * mesh.dequantization;
             }
           }
         }
@@ -0,0 +1,106 @@
+
+#include <cstring>
+#include <limits>
+#include <glm/gtc/packing.hpp>
+
+#include "vkcVertexFormat.hpp"
+
+namespace at3::vkc {
+
+  uint32_t getFloatAttributeSize(EMeshVertexAttribute attribute) {
+    switch (attribute) {
+      case EMeshVertexAttribute::POSITION:
+      case EMeshVertexAttribute::NORMAL:
+      case EMeshVertexAttribute::TANGENT:
+      case EMeshVertexAttribute::BITANGENT: return 3;
+      case EMeshVertexAttribute::UV0:
+      case EMeshVertexAttribute::UV1: return 2;
+      case EMeshVertexAttribute::COLOR: return 4;
+      default: {
+        AT3_ASSERT(false, "Invalid vertex attribute specified");
+        return 0;
+      }
+    }
+  }
+
+  int64_t getFloatAttributeOffset(const VertexAttributes &layout, EMeshVertexAttribute attribute) {
+    uint32_t floatOffset = 0;
+    for (uint32_t i = 0; i < layout.attrCount; ++i) {
+      if (layout.attributes[i] == attribute) { return floatOffset; }
+      floatOffset += getFloatAttributeSize(layout.attributes[i]);
+    }
+    return -1;
+  }
+
+  VertexQuantization computeVertexQuantization(const VertexAttributes &layout, const float *vertices, size_t count) {
+    VertexQuantization quantization;
+    uint32_t floatOffset = 0;
+    for (uint32_t i = 0; i < layout.attrCount; ++i) {
+      if (layout.attributes[i] == EMeshVertexAttribute::POSITION) {
+        if (layout.attrDescriptions[i].format != VK_FORMAT_R16G16B16A16_UNORM || ! count) {
+          return quantization;
+        }
+        uint32_t floatsPerVert = layout.floatVertexSize / sizeof(float);
+        glm::vec3 min(std::numeric_limits<float>::max());
+        glm::vec3 max(std::numeric_limits<float>::lowest());
+        for (size_t v = 0; v < count; ++v) {
+          const float *pos = vertices + v * floatsPerVert + floatOffset;
+          min = glm::min(min, glm::vec3(pos[0], pos[1], pos[2]));
+          max = glm::max(max, glm::vec3(pos[0], pos[1], pos[2]));
+        }
+        glm::vec3 extent = max - min;
+        quantization.offset = min;
+        quantization.scale = glm::max(glm::max(extent.x, extent.y), glm::max(extent.z, std::numeric_limits<float>::min()));
+        return quantization;
+      }
+      floatOffset += getFloatAttributeSize(layout.attributes[i]);
+    }
+    return quantization;
+  }
+
+  glm::mat4 getDequantizationTransform(const VertexQuantization &quantization) {
+    return glm::translate(quantization.offset) * glm::scale(glm::vec3(quantization.scale));
+  }
+
+  void packVertices(const VertexAttributes &layout, const float *src, size_t count,
+                    const VertexQuantization &quantization, uint8_t *dst) {
+    uint32_t floatsPerVert = layout.floatVertexSize / sizeof(float);
+    for (size_t v = 0; v < count; ++v) {
+      const float *inVert = src + v * floatsPerVert;
+      uint8_t *outVert = dst + v * layout.vertexSize;
+      for (uint32_t i = 0; i < layout.attrCount; ++i) {
+        uint32_t floatCount = getFloatAttributeSize(layout.attributes[i]);
+        uint8_t *out = outVert + layout.attrDescriptions[i].offset;
+        switch (layout.attrDescriptions[i].format) {
+          case VK_FORMAT_R32G32_SFLOAT:
+          case VK_FORMAT_R32G32B32_SFLOAT:
+          case VK_FORMAT_R32G32B32A32_SFLOAT: {
+            memcpy(out, inVert, sizeof(float) * floatCount);
+          } break;
+          case VK_FORMAT_R16G16_SFLOAT: {
+            uint16_t packed[2] = { glm::packHalf1x16(inVert[0]), glm::packHalf1x16(inVert[1]) };
+            memcpy(out, packed, sizeof(packed));
+          } break;
+          case VK_FORMAT_R8G8B8A8_SNORM: {
+            uint32_t packed = glm::packSnorm4x8(glm::vec4(inVert[0], inVert[1], inVert[2], 0.f));
+            memcpy(out, &packed, sizeof(packed));
+          } break;
+          case VK_FORMAT_R8G8B8A8_UNORM: {
+            uint32_t packed = glm::packUnorm4x8(glm::vec4(inVert[0], inVert[1], inVert[2], inVert[3]));
+            memcpy(out, &packed, sizeof(packed));
+          } break;
+          case VK_FORMAT_R16G16B16A16_UNORM: {
+            glm::vec3 pos = (glm::vec3(inVert[0], inVert[1], inVert[2]) - quantization.offset) / quantization.scale;
+            uint64_t packed = glm::packUnorm4x16(glm::vec4(pos, 1.f));
+            memcpy(out, &packed, sizeof(packed));
+          } break;
+          default: {
+            AT3_ASSERT(false, "Unsupported vertex attribute format");
+          } break;
+        }
+        inVert += floatCount;
+      }
+    }
+  }
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "vkcTypes.hpp"
+
+namespace at3::vkc {
+
+  /**
+   * Describes how quantized positions map back to object space: position = offset + storedPosition * scale.
+   * A single scale is used for all three axes so that the dequantization can be folded into the model matrix without
+   * distorting normals (they only get uniformly scaled, and the fragment shader normalizes them anyway).
+   */
+  struct VertexQuantization {
+    glm::vec3 offset = glm::vec3(0.f);
+    float scale = 1.f;
+  };
+
+  /**
+   * The number of floats an attribute takes up in the interleaved float layout that meshes are imported and cached in.
+   */
+  uint32_t getFloatAttributeSize(EMeshVertexAttribute attribute);
+
+  /**
+   * Where an attribute starts within a vertex in the interleaved float layout, in floats, or -1 if it isn't in it.
+   */
+  int64_t getFloatAttributeOffset(const VertexAttributes &layout, EMeshVertexAttribute attribute);
+
+  /**
+   * Find the quantization range for a set of vertices in the interleaved float layout.
+   * If positions are not quantized by the given layout, this returns the identity quantization.
+   */
+  VertexQuantization computeVertexQuantization(const VertexAttributes &layout, const float *vertices, size_t count);
+
+  /**
+   * The transform that takes quantized positions back into object space, to be applied before the model matrix.
+   */
+  glm::mat4 getDequantizationTransform(const VertexQuantization &quantization);
+
+  /**
+   * Convert vertices from the interleaved float layout into the (possibly compressed) GPU layout described by the
+   * formats in layout.attrDescriptions. dst must have room for count * layout.vertexSize bytes.
+   */
+  void packVertices(const VertexAttributes &layout, const float *src, size_t count,
+                    const VertexQuantization &quantization, uint8_t *dst);
+
+}
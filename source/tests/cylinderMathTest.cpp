@@ -0,0 +1,71 @@
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "cylinderMath.hpp"
+
+/*
+ * Checks that the batch gravity functions agree with the ones that take a single mass, for counts that are and aren't
+ * multiples of any SIMD width the compiler might pick. Returns nonzero if anything is wrong.
+ */
+
+using namespace at3;
+
+static int failures = 0;
+
+static bool isNear(float a, float b) {
+  return std::fabs(a - b) <= 1e-4f + 1e-4f * std::fabs(b);
+}
+
+static void testCount(size_t count, std::mt19937 &random) {
+  std::uniform_real_distribution<float> radius(1.f, 1000.f), angle(0.f, 6.2831853f), speed(-100.f, 100.f);
+  std::vector<float> posX(count), posY(count), velX(count), velY(count), posZ(count), velZ(count);
+  for (size_t i = 0; i < count; ++i) {
+    float r = radius(random), a = angle(random);
+    posX[i] = r * std::cos(a);
+    posY[i] = r * std::sin(a);
+    posZ[i] = speed(random);
+    velX[i] = speed(random);
+    velY[i] = speed(random);
+    velZ[i] = speed(random);
+  }
+  if (count) { // A mass on the axis doesn't move with the cylinder at all
+    posX[0] = posY[0] = 0.f;
+  }
+
+  std::vector<float> outX(count), outY(count), outZ(count);
+  getCylGravBatch(count, posX.data(), posY.data(), velX.data(), velY.data(), outX.data(), outY.data(), outZ.data());
+  std::vector<float> naiveX(count), naiveY(count), naiveZ(count);
+  getNaiveCylGravBatch(count, posX.data(), posY.data(), naiveX.data(), naiveY.data(), naiveZ.data());
+
+  for (size_t i = 0; i < count; ++i) {
+    glm::vec3 pos(posX[i], posY[i], posZ[i]);
+    glm::vec3 grav = getCylGrav(pos, glm::vec3(velX[i], velY[i], velZ[i]));
+    if ( ! isNear(outX[i], grav.x) || ! isNear(outY[i], grav.y) || ! isNear(outZ[i], grav.z)) {
+      fprintf(stderr, "FAIL: getCylGravBatch of %zu, mass %zu: (%f, %f, %f) instead of (%f, %f, %f)\n", count, i,
+              outX[i], outY[i], outZ[i], grav.x, grav.y, grav.z);
+      ++failures;
+    }
+    glm::vec3 naive = getNaiveCylGrav(pos);
+    if ( ! isNear(naiveX[i], naive.x) || ! isNear(naiveY[i], naive.y) || ! isNear(naiveZ[i], naive.z)) {
+      fprintf(stderr, "FAIL: getNaiveCylGravBatch of %zu, mass %zu: (%f, %f, %f) instead of (%f, %f, %f)\n", count, i,
+              naiveX[i], naiveY[i], naiveZ[i], naive.x, naive.y, naive.z);
+      ++failures;
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  std::mt19937 random(1234);
+  for (size_t count : {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 1000, 1023}) {
+    testCount(count, random);
+  }
+  if (failures) {
+    fprintf(stderr, "%d masses disagreed\n", failures);
+    return 1;
+  }
+  printf("All cylinder gravity checks passed\n");
+  return 0;
+}
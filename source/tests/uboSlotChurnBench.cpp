@@ -0,0 +1,96 @@
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "vkcUboPageMgr.hpp"
+
+/*
+ * Churns the UBO slot bitmaps the way spawning and despawning mesh instances would, and prints how many pages are in
+ * use, how fragmented they are, and how long acquire and release take as it goes. Whenever the pages should be
+ * compacted, the instances in the last pages are moved the same way VulkanContext::compactUboPages moves them.
+ *
+ * Usage: at3_bench_ubo_slot_churn [instances] [rounds]
+ * The number of live instances wanders between half of and all of [instances] (100000 by default) over [rounds] (50).
+ */
+
+using namespace at3::vkc;
+
+struct Instance {
+  uint32_t page, slot;
+};
+
+int main(int argc, char **argv) {
+  uint32_t maxInstances = argc > 1 ? (uint32_t) strtoul(argv[1], nullptr, 10) : 100000;
+  uint32_t rounds = argc > 2 ? (uint32_t) strtoul(argv[2], nullptr, 10) : 50;
+  uint32_t maxPages = 0x800; // The 11 page bits in MeshInstanceIndices
+  if (maxInstances > maxPages * UboSlotMap::slotsPerPage) {
+    fprintf(stderr, "At most %u instances fit in the UBO pages\n", maxPages * UboSlotMap::slotsPerPage);
+    return 1;
+  }
+
+  UboSlotMap slots;
+  std::vector<Instance> instances;
+  std::mt19937 random(1234);
+
+  auto acquire = [&]() {
+    Instance instance;
+    bool newPage;
+    slots.acquire(maxPages, instance.page, instance.slot, newPage);
+    instances.push_back(instance);
+  };
+  auto releaseAt = [&](size_t index) {
+    slots.release(instances[index].page, instances[index].slot);
+    instances[index] = instances.back();
+    instances.pop_back();
+  };
+
+  printf("%6s %9s %6s %9s %14s %11s %11s %9s\n", "round", "instances", "pages", "min pages", "fragmentation",
+         "ns/acquire", "ns/release", "moved");
+  for (uint32_t round = 0; round <= rounds; ++round) {
+    // Despawn a random share of the instances, and spawn up to a random new total
+    uint32_t target = maxInstances / 2 + (uint32_t) (random() % (maxInstances / 2 + 1));
+    size_t releases = round ? instances.size() * (random() % 50) / 100 : 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < releases; ++i) {
+      releaseAt(random() % instances.size());
+    }
+    auto released = std::chrono::steady_clock::now();
+    size_t acquires = instances.size() < target ? target - instances.size() : 0;
+    for (size_t i = 0; i < acquires; ++i) {
+      acquire();
+    }
+    auto acquired = std::chrono::steady_clock::now();
+
+    // Measured before compacting, which is when the gaps left by despawning are there
+    uint32_t pages = slots.getNumPages();
+    float fragmentation = pages ? 1.f - (float) slots.getNumLiveSlots() / (float) (pages * UboSlotMap::slotsPerPage)
+                                : 0.f;
+
+    uint32_t moved = 0;
+    if (slots.shouldCompact()) {
+      uint32_t targetPages = slots.getCompactedPageCount();
+      for (Instance &instance : instances) {
+        if (instance.page < targetPages) { continue; }
+        slots.release(instance.page, instance.slot);
+        bool newPage;
+        slots.acquire(maxPages, instance.page, instance.slot, newPage);
+        ++moved;
+      }
+      while (slots.lastPageIsEmpty()) {
+        slots.removeLastPage();
+      }
+    }
+
+    auto nanoseconds = [](auto duration, size_t count) {
+      return count ? (double) std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count() / count : 0.0;
+    };
+    printf("%6u %9zu %6u %9u %13.1f%% %11.1f %11.1f %9u\n", round, instances.size(), pages,
+           slots.getCompactedPageCount(), fragmentation * 100.f, nanoseconds(acquired - released, acquires),
+           nanoseconds(released - start, releases), moved);
+  }
+  return 0;
+}
@@ -0,0 +1,275 @@
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "vkcAlloc.hpp"
+
+/*
+ * Exercises the pooled device memory allocator without a GPU, by giving it stand-ins for vkAllocateMemory and
+ * vkFreeMemory. TlsfHeap::validate only asserts in debug builds, so everything it checks that can be seen from the
+ * outside is also checked here. Returns nonzero if anything is wrong.
+ */
+
+using namespace at3::vkc;
+
+static int failures = 0;
+
+#define CHECK(expr) do {                                               \
+    if ( ! (expr)) {                                                   \
+      fprintf(stderr, "FAIL: %s:%d: %s\n", __FILE__, __LINE__, #expr); \
+      ++failures;                                                      \
+    }                                                                  \
+  } while (0)
+
+// Device memory handed out by the fake vkAllocateMemory, by handle
+static std::unordered_map<uint64_t, VkDeviceSize> deviceMemory;
+static uint64_t nextHandle = 1;
+
+static VKAPI_ATTR VkResult VKAPI_CALL fakeAllocateMemory(VkDevice device, const VkMemoryAllocateInfo *allocInfo,
+                                                         const VkAllocationCallbacks *allocator,
+                                                         VkDeviceMemory *outMemory) {
+  deviceMemory[nextHandle] = allocInfo->allocationSize;
+  *outMemory = (VkDeviceMemory) nextHandle++;
+  return VK_SUCCESS;
+}
+
+static VKAPI_ATTR void VKAPI_CALL fakeFreeMemory(VkDevice device, VkDeviceMemory memory,
+                                                 const VkAllocationCallbacks *allocator) {
+  CHECK(deviceMemory.erase((uint64_t) memory) == 1);
+}
+
+static void setupPool(uint32_t memoryTypeCount, VkDeviceSize blockSize) {
+  deviceMemory.clear();
+  pool::setup(VK_NULL_HANDLE, memoryTypeCount, fakeAllocateMemory, fakeFreeMemory);
+  pool::state.memoryBlockMinSize = blockSize;
+}
+
+static Allocation poolAlloc(VkDeviceSize size, VkDeviceSize alignment, bool optimalTiling,
+                            VkMemoryPropertyFlags usage = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+  AllocationCreateInfo createInfo;
+  createInfo.usage = usage;
+  createInfo.memoryTypeIndex = 0;
+  createInfo.size = size;
+  createInfo.alignment = alignment;
+  createInfo.optimalTiling = optimalTiling;
+  Allocation allocation {};
+  pool::alloc(allocation, createInfo);
+  return allocation;
+}
+
+static void testHeapAllocFree() {
+  pool::TlsfHeap heap(1024);
+  VkDeviceSize a, b;
+  CHECK(heap.alloc(100, 1, a));
+  CHECK(heap.alloc(200, 1, b));
+  CHECK(a + 100 <= b || b + 200 <= a);
+  CHECK(heap.getUsedSize() == 300);
+  CHECK( ! heap.isEmpty());
+
+  VkDeviceSize tooBig;
+  CHECK( ! heap.alloc(1024, 1, tooBig));
+
+  heap.free(a);
+  heap.free(b);
+  heap.validate();
+  CHECK(heap.isEmpty());
+  CHECK(heap.getUsedSize() == 0);
+  CHECK(heap.getLargestFreeSize() == 1024);
+
+  VkDeviceSize whole;
+  CHECK(heap.alloc(1024, 1, whole));
+  CHECK(whole == 0);
+  CHECK(heap.getLargestFreeSize() == 0);
+}
+
+static void testHeapCoalescing() {
+  pool::TlsfHeap heap(1000);
+  VkDeviceSize a, b, c, d;
+  CHECK(heap.alloc(100, 1, a));
+  CHECK(heap.alloc(100, 1, b));
+  CHECK(heap.alloc(100, 1, c));
+  CHECK(heap.alloc(700, 1, d)); // Fills the heap
+  CHECK(heap.getLargestFreeSize() == 0);
+
+  // Free the first and third spans. Neither has a free neighbor to merge with.
+  std::vector<VkDeviceSize> byOffset = {a, b, c, d};
+  std::sort(byOffset.begin(), byOffset.end());
+  heap.free(byOffset[0]);
+  heap.free(byOffset[2]);
+  heap.validate();
+  CHECK(heap.getLargestFreeSize() == std::max(byOffset[1] - byOffset[0], byOffset[3] - byOffset[2]));
+
+  // Freeing the span between two free ones has to merge it with both
+  VkDeviceSize before = byOffset[1] - byOffset[0], middle = byOffset[2] - byOffset[1];
+  VkDeviceSize after = byOffset[3] - byOffset[2];
+  heap.free(byOffset[1]);
+  heap.validate();
+  CHECK(heap.getLargestFreeSize() == before + middle + after);
+
+  heap.free(byOffset[3]);
+  heap.validate();
+  CHECK(heap.isEmpty());
+  CHECK(heap.getLargestFreeSize() == 1000);
+}
+
+static void testHeapAlignment() {
+  pool::TlsfHeap heap(4096);
+  VkDeviceSize odd, aligned, small;
+  CHECK(heap.alloc(3, 1, odd));
+  CHECK(heap.alloc(64, 256, aligned));
+  CHECK(aligned % 256 == 0);
+  CHECK(aligned >= odd + 3 || aligned + 64 <= odd);
+  // The padding skipped to align the last one is still free, and only what was asked for counts as used
+  CHECK(heap.getUsedSize() == 3 + 64);
+  CHECK(heap.alloc(200, 1, small));
+  CHECK(heap.getUsedSize() == 3 + 64 + 200);
+  heap.validate();
+
+  heap.free(aligned);
+  heap.free(odd);
+  heap.free(small);
+  heap.validate();
+  CHECK(heap.isEmpty());
+  CHECK(heap.getLargestFreeSize() == 4096); // The padding merged back with everything else
+}
+
+static void testPoolSplit() {
+  setupPool(1, 1024 * 1024);
+
+  // Buffers and optimal-tiling images of the same memory type never share a block
+  Allocation buffer = poolAlloc(4096, 256, false);
+  Allocation image = poolAlloc(4096, 256, true);
+  CHECK(buffer.pool != image.pool);
+  CHECK(buffer.handle != image.handle);
+  CHECK(deviceMemory.size() == 2);
+
+  // But more of the same kind do
+  Allocation buffer2 = poolAlloc(4096, 256, false);
+  Allocation image2 = poolAlloc(4096, 256, true);
+  CHECK(buffer2.handle == buffer.handle);
+  CHECK(image2.handle == image.handle);
+  CHECK(deviceMemory.size() == 2);
+  CHECK(pool::numAllocs() == 2);
+
+  // Memory that will be mapped gets its own
+  Allocation mapped = poolAlloc(4096, 256, false,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  CHECK(mapped.handle != buffer.handle && mapped.handle != image.handle);
+  CHECK(deviceMemory.size() == 3);
+  pool::free(mapped);
+  CHECK(deviceMemory.size() == 2);
+
+  // Anything too big for a block gets a block its own size
+  Allocation huge = poolAlloc(4 * 1024 * 1024, 256, false);
+  CHECK(huge.handle != buffer.handle);
+  CHECK(deviceMemory.at((uint64_t) huge.handle) == 4 * 1024 * 1024);
+  pool::free(huge);
+  CHECK(deviceMemory.size() == 2);
+
+  std::vector<MemoryTypeStats> stats;
+  pool::getStats(stats);
+  CHECK(stats[0].liveBytes == 4 * 4096);
+  CHECK(stats[0].allocationCount == 4);
+  CHECK(stats[0].blockCount == 2);
+
+  // Each pool keeps its last block even once it is empty
+  pool::free(buffer);
+  pool::free(image);
+  pool::free(buffer2);
+  pool::free(image2);
+  CHECK(deviceMemory.size() == 2);
+  pool::getStats(stats);
+  CHECK(stats[0].liveBytes == 0);
+  CHECK(stats[0].allocationCount == 0);
+}
+
+static void validatePools(const std::vector<std::pair<Allocation, VkDeviceSize>> &live) {
+  for (auto &memPool : pool::state.memPools) {
+    for (auto &block : memPool.blocks) {
+      if (block.heap) {
+        block.heap->validate();
+      }
+    }
+  }
+
+  // No two live allocations overlap, and each is aligned and within its block
+  std::vector<const std::pair<Allocation, VkDeviceSize> *> sorted;
+  for (auto &entry : live) {
+    const Allocation &allocation = entry.first;
+    CHECK(allocation.offset % entry.second == 0);
+    CHECK(deviceMemory.count((uint64_t) allocation.handle));
+    if (deviceMemory.count((uint64_t) allocation.handle)) {
+      CHECK(allocation.offset + allocation.size <= deviceMemory.at((uint64_t) allocation.handle));
+    }
+    sorted.push_back(&entry);
+  }
+  std::sort(sorted.begin(), sorted.end(), [](auto *a, auto *b) {
+    if (a->first.handle != b->first.handle) { return (uint64_t) a->first.handle < (uint64_t) b->first.handle; }
+    return a->first.offset < b->first.offset;
+  });
+  for (size_t i = 1; i < sorted.size(); ++i) {
+    if (sorted[i]->first.handle == sorted[i - 1]->first.handle) {
+      CHECK(sorted[i - 1]->first.offset + sorted[i - 1]->first.size <= sorted[i]->first.offset);
+    }
+  }
+
+  VkDeviceSize liveBytes = 0;
+  for (auto &entry : live) {
+    liveBytes += entry.first.size;
+  }
+  std::vector<MemoryTypeStats> stats;
+  pool::getStats(stats);
+  CHECK(stats[0].liveBytes == liveBytes);
+  CHECK(stats[0].allocationCount == live.size());
+  CHECK(stats[0].blockCount == deviceMemory.size());
+}
+
+static void testChurn() {
+  // Small blocks, so that there are plenty of them to come and go
+  setupPool(1, 256 * 1024);
+  std::mt19937 random(1234);
+  std::vector<std::pair<Allocation, VkDeviceSize>> live; // and the alignment each was made with
+
+  for (uint32_t i = 0; i < 20000; ++i) {
+    // Mostly allocate for the first half, and mostly free for the second
+    bool allocate = live.empty() || random() % 100 < (i < 10000 ? 60u : 35u);
+    if (allocate) {
+      VkDeviceSize size = 1 + random() % (64 * 1024);
+      VkDeviceSize alignment = VkDeviceSize(1) << (random() % 13);
+      live.emplace_back(poolAlloc(size, alignment, random() % 2 == 0), alignment);
+    } else {
+      size_t index = random() % live.size();
+      pool::free(live[index].first);
+      live[index] = live.back();
+      live.pop_back();
+    }
+    if (i % 500 == 0) {
+      validatePools(live);
+    }
+  }
+  validatePools(live);
+
+  for (auto &entry : live) {
+    pool::free(entry.first);
+  }
+  live.clear();
+  validatePools(live);
+  CHECK(deviceMemory.size() <= 2); // At most the last block of each pool is left
+}
+
+int main(int argc, char **argv) {
+  testHeapAllocFree();
+  testHeapCoalescing();
+  testHeapAlignment();
+  testPoolSplit();
+  testChurn();
+  if (failures) {
+    fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  printf("All allocator checks passed\n");
+  return 0;
+}
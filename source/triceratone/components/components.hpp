@@ -109,7 +109,9 @@ namespace {
   };
   struct Physics : public Component<Physics> {
     enum UseCase {
-      INVALID = 0, PLANE, SPHERE, BOX, DYNAMIC_CONVEX_MESH, STATIC_MESH, WHEEL, CHARA, MAX_USE_CASE
+      INVALID = 0, PLANE, SPHERE, BOX, DYNAMIC_CONVEX_MESH, STATIC_MESH, WHEEL, CHARA,
+      PROJECTILE, // A sphere that starts out parked, to be reused from a pool (see ProjectilePool)
+      MAX_USE_CASE
     };
     int useCase;
 
@@ -117,11 +119,15 @@ namespace {
     sharedVoidPtr initData;
     void* customData = nullptr;
     btRigidBody* rigidBody;
+    btTransform previousTransform; // Before the last physics step, for drawing the body in between steps
 
     Physics(float mass, sharedVoidPtr initData, UseCase useCase);
     ~Physics();
     void setTransform(glm::mat4 &newTrans);
     void beStill();
+    void park();
+    void unpark();
+    bool isParked();
 
     // TODO: if writing to the component, it will have to be re-created in Bullet for changes to happen.
     void serialize(bool rw, SLNet::BitStream & stream);
@@ -273,11 +279,35 @@ namespace {
     btTransform transform = rigidBody->getCenterOfMassTransform();
     transform.setFromOpenGLMatrix((btScalar *)&newTrans);
     rigidBody->setCenterOfMassTransform(transform);
+    previousTransform = transform; // Jump straight there
   }
   void Physics::beStill() {
     rigidBody->setLinearVelocity( {0.f, 0.f, 0.f} );
     rigidBody->setAngularVelocity( {0.f, 0.f, 0.f} );
   }
+  // Stop simulating it, and stop it from touching anything, wherever it is, until it's unparked
+  void Physics::park() {
+    beStill();
+    rigidBody->setCollisionFlags(rigidBody->getCollisionFlags() | btCollisionObject::CF_NO_CONTACT_RESPONSE);
+    if (rigidBody->getBroadphaseHandle()) { // Nothing is paired with it in the broadphase either
+      rigidBody->getBroadphaseHandle()->m_collisionFilterGroup = 0;
+      rigidBody->getBroadphaseHandle()->m_collisionFilterMask = 0;
+    }
+    rigidBody->forceActivationState(DISABLE_SIMULATION);
+  }
+  // Simulate it again, as the dynamic body it was before it was parked, from wherever it has been put
+  void Physics::unpark() {
+    rigidBody->setCollisionFlags(rigidBody->getCollisionFlags() & ~btCollisionObject::CF_NO_CONTACT_RESPONSE);
+    if (rigidBody->getBroadphaseHandle()) {
+      rigidBody->getBroadphaseHandle()->m_collisionFilterGroup = btBroadphaseProxy::DefaultFilter;
+      rigidBody->getBroadphaseHandle()->m_collisionFilterMask = btBroadphaseProxy::AllFilter;
+    }
+    rigidBody->forceActivationState(ACTIVE_TAG);
+    rigidBody->setDeactivationTime(0.f);
+  }
+  bool Physics::isParked() {
+    return rigidBody->getActivationState() == DISABLE_SIMULATION;
+  }
   // TODO: if writing to the component, it will have to be re-created in Bullet for changes to happen.
   void Physics::serialize(bool rw, SLNet::BitStream & stream) {
     serialize(rw, stream, mass, initData, useCase);
@@ -287,7 +317,8 @@ namespace {
     stream.Serialize(rw, mass);
     stream.SerializeBitsFromIntegerRange(rw, useCase, INVALID + 1, MAX_USE_CASE - 1);
     switch(useCase) {
-      case Physics::SPHERE: {
+      case Physics::SPHERE:
+      case Physics::PROJECTILE: {
         if ( ! rw) { initData = std::make_shared<float>(); }
         float & radius = *((float*)initData.get());
         stream.Serialize(rw, radius);
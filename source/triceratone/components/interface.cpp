@@ -226,6 +226,17 @@ namespace at3 {
     return transformFunction->transformed;
   }
 
+  EntityComponentSystemInterface::EcsId EntityComponentSystemInterface::getSceneParent(const entityId &id) {
+    compMask compsPresent = state->getComponents(id);
+    assert(compsPresent);
+    if ( ! (compsPresent & SCENENODE)) { return 0; }
+    SceneNode *sceneNode;
+    ezecs::CompOpReturn status = state->get_SceneNode(id, &sceneNode);
+    EZECS_CHECK_PRINT(EZECS_ERR(status));
+    assert(status == ezecs::SUCCESS);
+    return sceneNode->parentId;
+  }
+
   void EntityComponentSystemInterface::addCamera(const ezecs::entityId &id, const float fovy,
                                                       const float nearPlane, const float farPlane) {
     ezecs::CompOpReturn status = this->state->add_Camera(id, fovy, nearPlane, farPlane);
@@ -131,6 +131,12 @@ namespace at3 {
       bool hasCustomModelTransform(const EcsId &id);
       glm::mat4 getCustomModelTransform(const EcsId &id);
 
+      /*
+       * The parent of an entity in the scene tree, or 0 if it has none. This is the same relationship that the scene
+       * tree follows when it caches absolute transforms, for renderers that would rather resolve them themselves.
+       */
+      EcsId getSceneParent(const EcsId &id);
+
       /*
        * These methods assume you keep some sort of state representing your cameras, which will include keeping
        * data like the field of view and the near ans far planes.
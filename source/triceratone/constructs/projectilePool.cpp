@@ -0,0 +1,70 @@
+
+#include "projectilePool.hpp"
+#include "settings.hpp"
+
+using namespace ezecs;
+
+namespace at3 {
+
+  static const glm::vec3 parkingSpot(0.f, 0.f, -100000.f); // Far past the end of the cylinder, and the far plane
+
+  ProjectilePool::ProjectilePool(State &state) : state(&state) { }
+
+  void ProjectilePool::fill(EntityComponentSystemInterface &ecs) {
+    glm::mat4 parked = glm::translate(glm::mat4(1.f), parkingSpot);
+    std::shared_ptr<void> radius = std::make_shared<float>(1.f);
+    for (uint32_t i = 0; i < settings::physics::projectilePoolSize; ++i) {
+      ecs.openEntityRequest();
+      ecs.requestPlacement(parked);
+      ecs.requestMesh("sphere", "");
+      ecs.requestPhysics(5.f, radius, Physics::PROJECTILE);
+      ecs.requestSceneNode(0);
+      entityId id = ecs.closeEntityRequest();
+      if (id) { ids.push_back(id); } // Its body is parked as soon as it's made
+    }
+    spawnTimes.resize(ids.size());
+  }
+
+  void ProjectilePool::park(entityId id) {
+    Physics *physics;
+    state->get_Physics(id, &physics);
+    glm::mat4 parked = glm::translate(glm::mat4(1.f), parkingSpot);
+    physics->setTransform(parked);
+    physics->park();
+    rtu::topics::publish<entityId>("projectile_parked", id);
+  }
+
+  Physics *ProjectilePool::spawn(const glm::mat4 &transform, const btVector3 &velocity) {
+    if (ids.empty()) { return nullptr; }
+
+    auto size = (uint32_t) ids.size();
+    uint32_t index;
+    if (outCount == size) { // The oldest is taken back and becomes the newest
+      index = outBegin;
+      outBegin = (outBegin + 1) % size;
+    } else {
+      index = (outBegin + outCount++) % size;
+    }
+    spawnTimes[index] = time;
+
+    Physics *physics;
+    state->get_Physics(ids[index], &physics);
+    glm::mat4 start = transform;
+    physics->setTransform(start);
+    physics->beStill();
+    physics->unpark();
+    physics->rigidBody->setLinearVelocity(velocity);
+    rtu::topics::publish<entityId>("projectile_unparked", ids[index]);
+    return physics;
+  }
+
+  void ProjectilePool::tick(float dt) {
+    time += dt;
+    // The balls that are out are in the order they were spawned, so the ones to put back are all at the front
+    while (outCount && time - spawnTimes[outBegin] >= settings::physics::projectileLifetime) {
+      park(ids[outBegin]);
+      outBegin = (outBegin + 1) % (uint32_t) ids.size();
+      --outCount;
+    }
+  }
+}
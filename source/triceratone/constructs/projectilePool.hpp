@@ -0,0 +1,46 @@
+
+#pragma once
+
+#include <vector>
+#include "interface.hpp"
+#include "ezecs.hpp"
+
+namespace at3 {
+
+  /*
+   * Balls to shoot and drop, made once and then handed out again and again, so that spawning one creates no entity,
+   * body, motion state or mesh instance. The pool is filled when the level starts. A ball goes back into the pool once
+   * it has been out for settings::physics::projectileLifetime seconds, or sooner if every ball is out and it is the
+   * oldest. A ball in the pool is parked far out of sight (see Physics::park).
+   * Only a server or a game without networking fills the pool and spawns balls. Clients get the balls as entities like
+   * any other, and they are parked as they arrive. Whenever a ball is parked or unparked, the "projectile_parked" or
+   * "projectile_unparked" topic is published with its id, so that the physics system can move its placement and list
+   * it as awake or not, and so that the network system can tell clients. A client parks and unparks its balls as the
+   * server syncs them (see NetworkSystem::serializePhysicsSync), and publishes the same topics when it does.
+   */
+  class ProjectilePool {
+    private:
+
+      ezecs::State *state;
+
+      std::vector<ezecs::entityId> ids;
+      std::vector<float> spawnTimes; // Of the ball with the same index in ids
+      uint32_t outBegin = 0, outCount = 0; // The balls that are out, oldest first, wrapping around the end of ids
+      float time = 0.f;
+
+      void park(ezecs::entityId id);
+
+    public:
+
+      explicit ProjectilePool(ezecs::State &state);
+      // Make every ball, parked, once the level has started
+      void fill(EntityComponentSystemInterface &ecs);
+      /*
+       * Put a ball where the transform says, moving at the given velocity.
+       * @return the ball's physics component, or nullptr if the pool is empty
+       */
+      Physics *spawn(const glm::mat4 &transform, const btVector3 &velocity);
+      // Put back the balls that have been out for too long
+      void tick(float dt);
+  };
+}
@@ -154,6 +154,9 @@ class Triceratone : public Game<EntityComponentSystemInterface, Triceratone> {
         pyramidMat *= glm::mat4(getCylStandingRot(pyramidPos, (float) M_PI * -0.5f, 0));
         players.back().pyramid = std::make_unique<Pyramid>(state, ecs, pyramidMat);
       }
+
+      // the balls the pyramids shoot and drop
+      controlSystem.fillProjectilePool();
       makeFreeCamActiveControl();
 
       // the event subscriptions
@@ -3,6 +3,7 @@
 #include <SDL.h>  // just for Pi
 #include <cstdio> // just for printf
 #include <algorithm>  // just for clamp/min/max
+#include <cfloat>  // just for FLT_MIN
 
 #include "math.hpp"
 
@@ -62,6 +63,42 @@ namespace at3 {
     return fakeGrav;
   }
 
+  /*
+   * The batch versions below are the scalar ones worked out by hand, branch-free so that they vectorize. The tangential
+   * velocity of the cylinder at a point is angVel * (-y, x), so the factor is 2 * dot / cylSpeed^2 - 1, clamped.
+   */
+  void getCylGravApplicationFactorBatch(size_t count, const float *posX, const float *posY,
+                                        const float *velX, const float *velY, float *outFactor) {
+    for (size_t i = 0; i < count; ++i) {
+      float cylVelX = -posY[i] * angVel;
+      float cylVelY = posX[i] * angVel;
+      float cylSpeedSq = cylVelX * cylVelX + cylVelY * cylVelY;
+      float dot = (velX[i] + cylVelX) * cylVelX + (velY[i] + cylVelY) * cylVelY;
+      float gravAdjustment = 2.f * dot / std::max(cylSpeedSq, FLT_MIN) - 1.f;
+      outFactor[i] = cylSpeedSq > 0.f ? std::min(std::max(gravAdjustment, -1.f), 1.f) : 0.f; // c'ya NaN
+    }
+  }
+
+  void getCylGravBatch(size_t count, const float *posX, const float *posY, const float *velX, const float *velY,
+                       float *outX, float *outY, float *outZ) {
+    getCylGravApplicationFactorBatch(count, posX, posY, velX, velY, outZ); // outZ holds the factors for now
+    float angVelSq = angVel * angVel;
+    for (size_t i = 0; i < count; ++i) {
+      outX[i] = posX[i] * angVelSq * outZ[i];
+      outY[i] = posY[i] * angVelSq * outZ[i];
+      outZ[i] = engIsOn ? -engAcc : 0.f;
+    }
+  }
+
+  void getNaiveCylGravBatch(size_t count, const float *posX, const float *posY, float *outX, float *outY, float *outZ) {
+    float angVelSq = angVel * angVel;
+    for (size_t i = 0; i < count; ++i) {
+      outX[i] = posX[i] * angVelSq;
+      outY[i] = posY[i] * angVelSq;
+      outZ[i] = engIsOn ? -engAcc : 0.f;
+    }
+  }
+
   glm::vec3 getNaiveCylGrav(const glm::vec3 &pos) {
     // magnitude is angular velocity (rad/sec) times radius squared
     glm::vec3 fakeGrav = glm::vec3(pos.x, pos.y, 0.f) * powf(angVel, 2);
@@ -1,6 +1,7 @@
 
 #pragma once
 
+#include <cstddef>
 #include "math.hpp"
 
 namespace at3 {
@@ -24,6 +25,24 @@ namespace at3 {
    */
   glm::vec3 getCylGrav(const glm::vec3 & pos, const glm::vec3 & nativeVel);
 
+  /**
+   * The same as getCylGravApplicationFactor, for many masses at once. Each component has an array of its own, so that
+   * the compiler can vectorize the loop. Only x and y matter here, since the cylinder's axis is z.
+   * @param count How many masses there are
+   * @param posX, posY The centers of the masses in standard R3
+   * @param velX, velY The linear velocities of the masses in standard R3
+   * @param outFactor Where to write a value between -1 and 1 for each mass
+   */
+  void getCylGravApplicationFactorBatch(size_t count, const float *posX, const float *posY,
+                                        const float *velX, const float *velY, float *outFactor);
+
+  /**
+   * The same as getCylGrav, for many masses at once, laid out like getCylGravApplicationFactorBatch.
+   * @param outX, outY, outZ Where to write the gravity vector of each mass
+   */
+  void getCylGravBatch(size_t count, const float *posX, const float *posY, const float *velX, const float *velY,
+                       float *outX, float *outY, float *outZ);
+
   /**
    * Get the faked cylinder gravity to apply to a mass.
    * This neglects any velocity component of the mass in the cylinder-tangential direction, and thus is wrong.
@@ -33,6 +52,11 @@ namespace at3 {
    */
   glm::vec3 getNaiveCylGrav(const glm::vec3 &pos);
 
+  /**
+   * The same as getNaiveCylGrav, for many masses at once, laid out like getCylGravApplicationFactorBatch.
+   */
+  void getNaiveCylGravBatch(size_t count, const float *posX, const float *posY, float *outX, float *outY, float *outZ);
+
   /**
    * Get only the directional part of the naive gravity vector returned by getNaiveCylGrav.
    * @param pos The center of the mass in standard R3
@@ -0,0 +1,105 @@
+
+#include <cstdio>
+#include <fstream>
+#include "bvhCache.hpp"
+#include "fileSystemHelpers.hpp"
+#include "hash.hpp"
+
+namespace at3 {
+
+  static const uint32_t bvhCacheMagic = 0x48564241; // "ABVH"
+  static const uint32_t bvhCacheVersion = 2;
+  static const char *bvhCacheDir = "./assets/cooked";
+  static const char *bvhCacheExt = ".at3bvh";
+
+  static_assert(sizeof(BvhCacheHeader) % 16 == 0, "The hierarchy after the header must stay 16-byte aligned");
+
+  CachedBvh::~CachedBvh() {
+    release();
+  }
+
+  void CachedBvh::release() {
+    if (bvh) { bvh->~btOptimizedBvh(); } // It was constructed in place, and its arrays point into the buffer
+    if (buffer) { btAlignedFree(buffer); }
+    bvh = nullptr;
+    buffer = nullptr;
+  }
+
+  bool CachedBvh::load(const std::string &path, uint64_t meshHash) {
+    release();
+
+    std::ifstream in(path, std::ios::binary);
+    if ( ! in) { return false; }
+    BvhCacheHeader header {};
+    in.read((char *) &header, sizeof(header));
+    bool valid = in
+                 && header.magic == bvhCacheMagic
+                 && header.version == bvhCacheVersion
+                 && header.meshHash == meshHash
+                 && header.scalarSize == sizeof(btScalar)
+                 && header.bvhSize;
+    if ( ! valid) { return false; }
+
+    buffer = btAlignedAlloc(header.bvhSize, 16);
+    in.read((char *) buffer, header.bvhSize);
+    if ( ! in || in.gcount() != (std::streamsize) header.bvhSize) {
+      release();
+      return false;
+    }
+    bvh = btOptimizedBvh::deSerializeInPlace(buffer, header.bvhSize, false);
+    if ( ! bvh) {
+      release();
+      return false;
+    }
+    return true;
+  }
+
+  btOptimizedBvh *CachedBvh::getBvh() const {
+    return bvh;
+  }
+
+  bool writeBvhCacheFile(const std::string &path, const btOptimizedBvh &bvh, uint64_t meshHash) {
+    BvhCacheHeader header {};
+    header.magic = bvhCacheMagic;
+    header.version = bvhCacheVersion;
+    header.meshHash = meshHash;
+    header.bvhSize = bvh.calculateSerializeBufferSize();
+    header.scalarSize = sizeof(btScalar);
+
+    void *buffer = btAlignedAlloc(header.bvhSize, 16);
+    bool serialized = bvh.serializeInPlace(buffer, header.bvhSize, false);
+
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+
+    // Write to a temporary file first so that a crash mid-write never leaves a truncated file that looks valid.
+    std::string tempPath = path + ".tmp";
+    bool written = false;
+    if (serialized) {
+      std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+      out.write((const char *) &header, sizeof(header));
+      out.write((const char *) buffer, header.bvhSize);
+      written = (bool) out;
+    }
+    btAlignedFree(buffer);
+    if ( ! written) {
+      fprintf(stderr, "Could not write cached collision hierarchy: %s\n", path.c_str());
+      return false;
+    }
+    fs::remove(path, ec);
+    fs::rename(tempPath, path, ec);
+    if (ec) {
+      fprintf(stderr, "Could not move cached collision hierarchy into place: %s\n", path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  uint64_t hashBvhCacheKey(uint64_t trianglesKey, const btVector3 &scaling) {
+    return fnv1a64(scaling.m_floats, sizeof(btScalar) * 3, trianglesKey);
+  }
+
+  std::string getBvhCachePath(const std::string &meshName) {
+    return (fs::path(bvhCacheDir) / getCacheFileStem(meshName)).string() + bvhCacheExt;
+  }
+}
@@ -0,0 +1,71 @@
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <btBulletDynamicsCommon.h>
+
+namespace at3 {
+
+  /**
+   * Bullet takes far longer to build the bounding volume hierarchy of a big static triangle mesh, like the terrain,
+   * than to read one back. So the first time a mesh is given a body, its hierarchy is written to disk, and on later
+   * runs it is read back and used in place, without building anything. A cached hierarchy is keyed by the cooked mesh
+   * that the triangles were read from (see vkc::StoredTriangles::key) and the scaling of the shape, so finding it
+   * doesn't take reading the whole mesh.
+   *
+   * File layout: |BvhCacheHeader|the hierarchy, as btOptimizedBvh::serializeInPlace writes it|
+   * The header is 32 bytes, so the hierarchy after it is as aligned as it is in memory.
+   */
+  struct BvhCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t meshHash;    // see hashBvhCacheKey
+    uint32_t bvhSize;
+    uint32_t scalarSize;  // sizeof(btScalar), since a cache built with doubles is no good with floats
+    uint32_t padding[2];
+  };
+
+  /**
+   * A hierarchy read back from a cache file. It lives in memory owned by this object, so it must outlive any shape
+   * that uses it.
+   */
+  class CachedBvh {
+
+      void *buffer = nullptr;
+      btOptimizedBvh *bvh = nullptr;
+
+      void release();
+
+    public:
+
+      CachedBvh() = default;
+      CachedBvh(const CachedBvh &) = delete;
+      CachedBvh &operator=(const CachedBvh &) = delete;
+      ~CachedBvh();
+
+      /**
+       * Read a cached hierarchy and check that it was built for the given mesh.
+       * @return true if the file exists, is well formed, and matches the mesh. false means it must be built again.
+       */
+      bool load(const std::string &path, uint64_t meshHash);
+      btOptimizedBvh *getBvh() const;
+  };
+
+  /**
+   * Write a hierarchy to a cache file, creating its parent directory if necessary.
+   * Failing to write is not fatal (the hierarchy will just be built again next time), so this only reports it.
+   * @return true if the whole file was written
+   */
+  bool writeBvhCacheFile(const std::string &path, const btOptimizedBvh &bvh, uint64_t meshHash);
+
+  /**
+   * The key of the hierarchy of the given triangles (by their StoredTriangles::key), scaled by the given scaling.
+   */
+  uint64_t hashBvhCacheKey(uint64_t trianglesKey, const btVector3 &scaling);
+
+  /**
+   * Where the cached hierarchy of the named mesh is (or will be) stored.
+   */
+  std::string getBvhCachePath(const std::string &meshName);
+}
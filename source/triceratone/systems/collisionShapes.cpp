@@ -0,0 +1,77 @@
+
+#include <cstring>
+#include "collisionShapes.hpp"
+#include "hash.hpp"
+
+namespace at3 {
+
+  CollisionShapeCache::~CollisionShapeCache() {
+    for (auto &pair : entries) {
+      delete pair.second.shape;
+    }
+  }
+
+  bool CollisionShapeCache::Key::operator==(const Key &other) const {
+    return type == other.type && params == other.params;
+  }
+
+  size_t CollisionShapeCache::KeyHash::operator()(const Key &key) const {
+    uint64_t hash = fnv1a64(&key.type, sizeof(key.type));
+    return (size_t) fnv1a64(key.params.data(), key.params.size() * sizeof(uint32_t), hash);
+  }
+
+  CollisionShapeCache::Key CollisionShapeCache::makeKey(int type, const float *params, size_t count) {
+    Key key {type, std::vector<uint32_t>(count)};
+    memcpy(key.params.data(), params, count * sizeof(float));
+    return key;
+  }
+
+  btCollisionShape *CollisionShapeCache::find(const Key &key) {
+    auto found = entries.find(key);
+    if (found == entries.end()) { return nullptr; }
+    ++found->second.refCount;
+    return found->second.shape;
+  }
+
+  btCollisionShape *CollisionShapeCache::insert(Key &&key, btCollisionShape *shape) {
+    auto inserted = entries.emplace(std::move(key), Entry {shape, 1}).first;
+    keys.emplace(shape, &inserted->first);
+    return shape;
+  }
+
+  btCollisionShape *CollisionShapeCache::getSphere(float radius) {
+    Key key = makeKey(SPHERE_SHAPE_PROXYTYPE, &radius, 1);
+    if (btCollisionShape *shape = find(key)) { return shape; }
+    return insert(std::move(key), new btSphereShape(radius));
+  }
+
+  btCollisionShape *CollisionShapeCache::getBox(const btVector3 &halfExtents) {
+    float params[] = {(float) halfExtents.x(), (float) halfExtents.y(), (float) halfExtents.z()};
+    Key key = makeKey(BOX_SHAPE_PROXYTYPE, params, 3);
+    if (btCollisionShape *shape = find(key)) { return shape; }
+    return insert(std::move(key), new btBoxShape(halfExtents));
+  }
+
+  btCollisionShape *CollisionShapeCache::getConvexHull(const std::vector<float> &points) {
+    Key key = makeKey(CONVEX_HULL_SHAPE_PROXYTYPE, points.data(), points.size());
+    if (btCollisionShape *shape = find(key)) { return shape; }
+    return insert(std::move(key),
+                  new btConvexHullShape(points.data(), (int) points.size() / 3, 3 * sizeof(float)));
+  }
+
+  bool CollisionShapeCache::release(btCollisionShape *shape) {
+    auto found = keys.find(shape);
+    if (found == keys.end()) { return false; }
+    auto entry = entries.find(*found->second);
+    if ( ! --entry->second.refCount) {
+      entries.erase(entry);
+      keys.erase(found);
+      delete shape;
+    }
+    return true;
+  }
+
+  size_t CollisionShapeCache::getShapeCount() const {
+    return entries.size();
+  }
+}
@@ -0,0 +1,56 @@
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <btBulletDynamicsCommon.h>
+
+namespace at3 {
+
+  /*
+   * Collision shapes shared by every body that has the same kind of shape with the same dimensions, so that a thousand
+   * identical balls cost one shape instead of a thousand, and the hull of a vehicle is only built once. Every shape
+   * handed out must be given back with release once its body is gone, and is deleted along with its last user.
+   * Since the shapes are shared, they must not be changed (by setLocalScaling, for example).
+   */
+  class CollisionShapeCache {
+
+    public:
+
+      ~CollisionShapeCache();
+      btCollisionShape *getSphere(float radius);
+      btCollisionShape *getBox(const btVector3 &halfExtents);
+      // Points are x, y, z, one after the other
+      btCollisionShape *getConvexHull(const std::vector<float> &points);
+      /*
+       * Give back a shape from this cache. Returns false, and does nothing, for a shape that didn't come from it.
+       */
+      bool release(btCollisionShape *shape);
+      size_t getShapeCount() const;
+
+    private:
+
+      // The type of shape and the bits of every float that it was made from, compared exactly
+      struct Key {
+        int type;
+        std::vector<uint32_t> params;
+        bool operator==(const Key &other) const;
+      };
+      struct KeyHash {
+        size_t operator()(const Key &key) const;
+      };
+      struct Entry {
+        btCollisionShape *shape;
+        uint32_t refCount;
+      };
+
+      std::unordered_map<Key, Entry, KeyHash> entries;
+      std::unordered_map<btCollisionShape*, const Key*> keys; // Into entries, whose elements never move
+
+      static Key makeKey(int type, const float *params, size_t count);
+      btCollisionShape *find(const Key &key);
+      btCollisionShape *insert(Key &&key, btCollisionShape *shape);
+  };
+}
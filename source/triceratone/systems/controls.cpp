@@ -15,11 +15,13 @@ namespace at3 {
   ControlSystem::ControlSystem(State *state)
       : System(state),
         setEcsInterfaceSub("set_ecs_interface", RTU_MTHD_DLGT(&ControlSystem::setEcsInterface, this)),
+        setVulkanContextSub("set_vulkan_context", RTU_MTHD_DLGT(&ControlSystem::setVulkanContext, this)),
         switchToMouseCtrlSub("switch_to_mouse_controls", RTU_MTHD_DLGT(&ControlSystem::switchToMouseCtrl, this)),
         switchToWalkCtrlSub("switch_to_walking_controls", RTU_MTHD_DLGT(&ControlSystem::switchToWalkCtrl, this)),
         switchToPyramidCtrlSub("switch_to_pyramid_controls", RTU_MTHD_DLGT(&ControlSystem::switchToPyramidCtrl, this)),
         switchToTrackCtrlSub("switch_to_track_controls", RTU_MTHD_DLGT(&ControlSystem::switchToTrackCtrl, this)),
-        switchToFreeCtrlSub("switch_to_free_controls", RTU_MTHD_DLGT(&ControlSystem::switchToFreeCtrl, this))
+        switchToFreeCtrlSub("switch_to_free_controls", RTU_MTHD_DLGT(&ControlSystem::switchToFreeCtrl, this)),
+        projectiles(*state)
   {
     name = "Control System";
   }
@@ -36,6 +38,8 @@ namespace at3 {
 
     // TODO: put a clean/dirty bool in control components in order to only update the dirty ones?
 
+    projectiles.tick(dt);
+
     for (auto id : (registries[0].ids)) { // Mouse controls
       MouseControls *mouseControls;
       state->get_MouseControls(id, &mouseControls);
@@ -51,6 +55,7 @@ namespace at3 {
       rot[3][1] = placement->mat[3][1];
       rot[3][2] = placement->mat[3][2];
       placement->mat = rot;
+      vulkan->markTransformChanged(id);
     }
     for (auto id : (registries[1].ids)) { // Pyramid
       PyramidControls* pyramidControls;
@@ -107,21 +112,12 @@ namespace at3 {
           btVector3 sourceVel = sourcePhysics->rigidBody->getLinearVelocity();
           Physics *ballPhysics = nullptr;
 
-          entityId ballId = 0;
           uint32_t count = pyramidControls->shoot ? 1 : 4;  // 0 for shoot will crash
           for (uint32_t i = 0; i < count; ++i) {
-            ecs->openEntityRequest();
-            ecs->requestPlacement(sourceMat);
-            ecs->requestMesh("sphere", "");
-            std::shared_ptr<void> radius = std::make_shared<float>(1.f);
-            ecs->requestPhysics(5.f, radius, Physics::SPHERE);
-            ecs->requestSceneNode(0);
-            ballId = ecs->closeEntityRequest();
-            state->get_Physics(ballId, &ballPhysics);
-            ballPhysics->rigidBody->setLinearVelocity(sourceVel);
+            ballPhysics = projectiles.spawn(sourceMat, sourceVel);
           }
           if (pyramidControls->shoot) {
-            if (ballId) { // This just won't work on an unfulfilled request (which is another reason to get rid of them)
+            if (ballPhysics) {
               glm::mat3 tiltRot = glm::rotate(.35f, glm::vec3(1.0f, 0.0f, 0.0f));
               glm::mat3 rot = getCylStandingRot(source->getTranslation(true), mouseControls->pitch, mouseControls->yaw);
               glm::vec3 shootDir = rot * tiltRot * glm::vec3(0, 0, -1);
@@ -191,6 +187,7 @@ namespace at3 {
         placement->mat[3][0] += movement.x;
         placement->mat[3][1] += movement.y;
         placement->mat[3][2] += movement.z;
+        vulkan->markTransformChanged(id);
 
         // zero inputs, but not for networked inputs (this is an attempt to smooth out networked movement)
         if (id == currentCtrlKeys->getId()) {
@@ -206,6 +203,14 @@ namespace at3 {
   void ControlSystem::setEcsInterface(void *ecs) {
     this->ecs = *(std::shared_ptr<EntityComponentSystemInterface>*) ecs;
   }
+  void ControlSystem::fillProjectilePool() {
+    if (settings::network::role != settings::network::CLIENT) { // Clients get the server's balls
+      projectiles.fill(*ecs);
+    }
+  }
+  void ControlSystem::setVulkanContext(void *vkc) {
+    vulkan = *(std::shared_ptr<vkc::VulkanContext<EntityComponentSystemInterface>>*) vkc;
+  }
 
   /*
    * This section deals with the current active control interface and defines actions for key
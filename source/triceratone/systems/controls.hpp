@@ -6,7 +6,9 @@
 #include "ezecs.hpp"
 #include "topics.hpp"
 #include "eventResponseMap.hpp"
+#include "vkc.hpp"
 #include "interface.hpp"
+#include "projectilePool.hpp"
 
 using namespace ezecs;
 
@@ -16,6 +18,8 @@ namespace at3 {
 
       std::shared_ptr<EntityComponentSystemInterface> ecs;
       rtu::topics::Subscription setEcsInterfaceSub;
+      std::shared_ptr<vkc::VulkanContext<EntityComponentSystemInterface>> vulkan;
+      rtu::topics::Subscription setVulkanContextSub;
 
       rtu::topics::Subscription switchToMouseCtrlSub;
       std::unique_ptr<EntityAssociatedERM> currentCtrlMouse;
@@ -26,7 +30,10 @@ namespace at3 {
       rtu::topics::Subscription switchToFreeCtrlSub;
       std::unique_ptr<EntityAssociatedERM> currentCtrlKeys;
 
+      ProjectilePool projectiles; // What pyramids shoot and drop
+
       void setEcsInterface(void *ecs);
+      void setVulkanContext(void *vkc);
       void switchToMouseCtrl(void *id);
       void switchToWalkCtrl(void* id);
       void switchToPyramidCtrl(void *id);
@@ -45,6 +52,7 @@ namespace at3 {
       ~ControlSystem() override;
       bool onInit();
       void onTick(float dt);
+      void fillProjectilePool(); // Once the level has started, so that the first shot doesn't have to wait for it
   };
 
   /*
@@ -14,7 +14,9 @@ namespace at3 {
         switchToWalkCtrlSub("switch_to_walking_controls", RTU_MTHD_DLGT(&NetworkSystem::switchToWalkCtrl, this)),
         switchToPyramidCtrlSub("switch_to_pyramid_controls", RTU_MTHD_DLGT(&NetworkSystem::switchToPyramidCtrl, this)),
         switchToTrackCtrlSub("switch_to_track_controls", RTU_MTHD_DLGT(&NetworkSystem::switchToTrackCtrl, this)),
-        switchToFreeCtrlSub("switch_to_free_controls", RTU_MTHD_DLGT(&NetworkSystem::switchToFreeCtrl, this))
+        switchToFreeCtrlSub("switch_to_free_controls", RTU_MTHD_DLGT(&NetworkSystem::switchToFreeCtrl, this)),
+        setAwakePhysicsIdsSub("set_awake_physics_ids", RTU_MTHD_DLGT(&NetworkSystem::setAwakePhysicsIds, this)),
+        projectileParkedSub("projectile_parked", RTU_MTHD_DLGT(&NetworkSystem::onProjectileParked, this))
   {
     name = "Net Sync System";
   }
@@ -170,56 +172,100 @@ namespace at3 {
 
   }
 
+  /*
+   * Only bodies that are awake are sent, each with its id, so however many are asleep costs nothing. A body that isn't
+   * here yet is read past and left alone. Balls that were just put back in their pool are sent too, parked, in the next
+   * few syncs in case one is lost, so that clients park them as well. A parked ball that is sent moving again has been
+   * handed out again, and is unparked.
+   */
   void NetworkSystem::serializePhysicsSync(bool rw, SLNet::BitStream &stream) {
-    for (auto id : registries[0].ids) {
-      Physics *physics;
-      state->get_Physics(id, &physics);
+    uint32_t count;
+    if (rw) {
+      physicsSyncIds.clear();
+      if (awakePhysicsIds) {
+        for (auto id : *awakePhysicsIds) {
+          Physics *physics;
+          state->get_Physics(id, &physics);
+          if (physics->rigidBody->isActive()) { physicsSyncIds.push_back(id); }
+        }
+      }
+      for (size_t i = parkedToSync.size(); i-- > 0; ) {
+        Physics *physics;
+        bool parked = SUCCESS == state->get_Physics(parkedToSync[i].first, &physics) && physics->isParked();
+        if (parked) { physicsSyncIds.push_back(parkedToSync[i].first); }
+        if ( ! parked || ! --parkedToSync[i].second) { // Handed out again already, or sent enough times
+          parkedToSync[i] = parkedToSync.back();
+          parkedToSync.pop_back();
+        }
+      }
+      count = (uint32_t) physicsSyncIds.size();
+    } // else it's written to by the stream
+    stream.Serialize(rw, count);
 
-      bool include;
+    for (uint32_t i = 0; i < count; ++i) {
+      entityId id;
       if (rw) {
-        include = physics->useCase != Physics::WHEEL &&
-                  physics->useCase != Physics::STATIC_MESH &&
-                  physics->rigidBody->isActive();
+        id = physicsSyncIds[i];
       } // else it's written to by the stream
-      stream.SerializeCompressed(rw, include);
-
-      if (include) {
+      stream.Serialize(rw, id);
+      Physics *physics = nullptr;
+      bool known = SUCCESS == state->get_Physics(id, &physics);
 
-        bool needsRotation;
-        if (rw) {
-          needsRotation = physics->useCase != Physics::CHARA && physics->useCase != Physics::SPHERE;
-        } // else it's written to by the stream
-        stream.SerializeCompressed(rw, needsRotation);
+      bool needsRotation;
+      if (rw) {
+        needsRotation = physics->useCase != Physics::CHARA && physics->useCase != Physics::SPHERE &&
+                        physics->useCase != Physics::PROJECTILE;
+      } // else it's written to by the stream
+      stream.SerializeCompressed(rw, needsRotation);
+      bool parked;
+      if (rw) {
+        parked = physics->isParked();
+      } // else it's written to by the stream
+      stream.SerializeCompressed(rw, parked);
 
-        glm::vec3 pos, lin, ang;  // glm conversion because bullet uses four floats for its vec3's for *SOME* reason.
-        btQuaternion rot;
-        btTransform transform;
-        if (rw) {
+      glm::vec3 pos, lin, ang;  // glm conversion because bullet uses four floats for its vec3's for *SOME* reason.
+      btQuaternion rot;
+      btTransform transform;
+      if (rw) {
+        if (parked) { // Its motion state isn't moved while it's parked
+          transform = physics->rigidBody->getWorldTransform();
+        } else {
           physics->rigidBody->getMotionState()->getWorldTransform(transform);
-          pos = bulletToGlm(transform.getOrigin());
-          lin = bulletToGlm(physics->rigidBody->getLinearVelocity());
-          if (needsRotation) {
-            rot = transform.getRotation();
-            ang = bulletToGlm(physics->rigidBody->getAngularVelocity());
-          }
         }
-        stream.Serialize(rw, pos);
-        stream.Serialize(rw, lin);
+        pos = bulletToGlm(transform.getOrigin());
+        lin = bulletToGlm(physics->rigidBody->getLinearVelocity());
         if (needsRotation) {
-          stream.Serialize(rw, rot);
-          stream.Serialize(rw, ang);
+          rot = transform.getRotation();
+          ang = bulletToGlm(physics->rigidBody->getAngularVelocity());
         }
-        if ( ! rw) {
-          if (needsRotation) {
-            transform.setRotation(rot);
-            physics->rigidBody->setAngularVelocity(glmToBullet(ang));
+      }
+      stream.Serialize(rw, pos);
+      stream.Serialize(rw, lin);
+      if (needsRotation) {
+        stream.Serialize(rw, rot);
+        stream.Serialize(rw, ang);
+      }
+      if ( ! rw && known) {
+        if (needsRotation) {
+          transform.setRotation(rot);
+          physics->rigidBody->setAngularVelocity(glmToBullet(ang));
 
-          } else {
-            physics->rigidBody->getMotionState()->getWorldTransform(transform);
+        } else {
+          physics->rigidBody->getMotionState()->getWorldTransform(transform);
+        }
+        transform.setOrigin(glmToBullet(pos));
+        physics->rigidBody->setLinearVelocity(glmToBullet(lin));
+        physics->rigidBody->setCenterOfMassTransform(transform);
+        if (parked) {
+          if ( ! physics->isParked()) { // Its pool took it back where it was sent from
+            physics->park();
+            rtu::topics::publish<entityId>("projectile_parked", id);
           }
-          transform.setOrigin(glmToBullet(pos));
-          physics->rigidBody->setLinearVelocity(glmToBullet(lin));
-          physics->rigidBody->setCenterOfMassTransform(transform);
+        } else if (physics->isParked()) { // Its pool handed it out again where it was sent from
+          physics->unpark();
+          rtu::topics::publish<entityId>("projectile_unparked", id);
+        } else {
+          physics->rigidBody->activate(); // It's awake where it was sent from, so it moves here too
         }
       }
     }
@@ -297,6 +343,16 @@ namespace at3 {
     this->ecs = *(std::shared_ptr<EntityComponentSystemInterface>*) ecs;
   }
 
+  void NetworkSystem::setAwakePhysicsIds(void *ids) {
+    awakePhysicsIds = *(const std::vector<entityId>**) ids;
+  }
+
+  void NetworkSystem::onProjectileParked(void *id) {
+    if (network->getRole() == settings::network::SERVER) { // Nobody else sends physics syncs
+      parkedToSync.emplace_back(*(entityId *) id, 3u);
+    }
+  }
+
   void NetworkSystem::switchToMouseCtrl(void *id) {
     mouseControlId = *(entityId*)id;
   }
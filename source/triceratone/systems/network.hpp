@@ -19,6 +19,9 @@ namespace at3 {
       float timeAccumulator = 0;
 
       SLNet::BitStream outStream;
+      const std::vector<entityId> *awakePhysicsIds = nullptr; // Kept by the physics system
+      std::vector<entityId> physicsSyncIds;
+      std::vector<std::pair<entityId, uint32_t>> parkedToSync; // Balls parked lately, and how many more syncs to send
 
       rtu::topics::Subscription setNetInterfaceSub;
       rtu::topics::Subscription setEcsInterfaceSub;
@@ -27,6 +30,8 @@ namespace at3 {
       rtu::topics::Subscription switchToPyramidCtrlSub;
       rtu::topics::Subscription switchToTrackCtrlSub;
       rtu::topics::Subscription switchToFreeCtrlSub;
+      rtu::topics::Subscription setAwakePhysicsIdsSub;
+      rtu::topics::Subscription projectileParkedSub;
 
       void setNetInterface(void *netInterface);
       void setEcsInterface(void *ecs);
@@ -35,6 +40,8 @@ namespace at3 {
       void switchToPyramidCtrl(void *id);
       void switchToTrackCtrl(void *id);
       void switchToFreeCtrl(void *id);
+      void setAwakePhysicsIds(void *ids);
+      void onProjectileParked(void *id);
 
       bool writePhysicsSyncs(float dt);
       void writeControlSyncs();
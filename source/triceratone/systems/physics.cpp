@@ -4,10 +4,15 @@
 #include <BulletCollision/CollisionDispatch/btGhostObject.h>
 #include <BulletDynamics/Vehicle/btRaycastVehicle.h>
 #include <BulletCollision/CollisionShapes/btTriangleShape.h>
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
 //#include <BulletDynamics/Character/btKinematicCharacterController.h>
+#include <chrono>
 
 #include "math.hpp"
 #include "cylinderMath.hpp"
+#include "settings.hpp"
 
 #pragma clang diagnostic push
 #pragma ide diagnostic ignored "IncompatibleTypes"
@@ -45,9 +50,117 @@ namespace at3 {
     return false;
   }
 
+# if PRINT_PHYSICS_STEP_TIMES
+  static double stepSeconds = 0.0, raySeconds = 0.0;
+  static uint32_t stepsTimed = 0, raysTimed = 0;
+# endif
+
+  // What a static mesh body owns besides its shape, kept in its Physics component's customData
+  struct StaticMeshData {
+    std::shared_ptr<const vkc::StoredTriangles> triangles; // Shared with the renderer, and used where they are
+    btTriangleIndexVertexArray mesh;
+    CachedBvh bvh; // Unused if the shape built its own
+  };
+
+  VulkanDebugDrawer::VulkanDebugDrawer(vkc::DebugLines *lines) : lines(lines) { }
+
+  void VulkanDebugDrawer::drawLine(const btVector3 &from, const btVector3 &to, const btVector3 &color) {
+    uint32_t packed = 0xff000000u;
+    for (int i = 0; i < 3; ++i) {
+      packed |= (uint32_t) (btClamped(color[i], btScalar(0), btScalar(1)) * 255.f + 0.5f) << (i * 8);
+    }
+    lines->add(bulletToGlm(from), bulletToGlm(to), packed);
+  }
+
+  void VulkanDebugDrawer::drawContactPoint(const btVector3 &pointOnB, const btVector3 &normalOnB, btScalar distance,
+                                           int lifeTime, const btVector3 &color) {
+    drawLine(pointOnB, pointOnB + normalOnB * distance, color);
+  }
+
+  void VulkanDebugDrawer::reportErrorWarning(const char *warningString) {
+    fprintf(stderr, "Bullet: %s\n", warningString);
+  }
+
+  void VulkanDebugDrawer::draw3dText(const btVector3 &location, const char *textString) { }
+
+  void VulkanDebugDrawer::setDebugMode(int debugMode) {
+    this->debugMode = debugMode;
+  }
+
+  int VulkanDebugDrawer::getDebugMode() const {
+    return debugMode;
+  }
+
+  // Draws the edges of each triangle it's given, for drawing only part of a concave shape
+  class DebugTriangleCallback : public btTriangleCallback {
+      btIDebugDraw *drawer;
+      const btTransform &transform;
+      btVector3 color;
+    public:
+      DebugTriangleCallback(btIDebugDraw *drawer, const btTransform &transform, const btVector3 &color)
+          : drawer(drawer), transform(transform), color(color) { }
+      void processTriangle(btVector3 *triangle, int partId, int triangleIndex) override {
+        btVector3 a = transform * triangle[0], b = transform * triangle[1], c = transform * triangle[2];
+        drawer->drawLine(a, b, color);
+        drawer->drawLine(b, c, color);
+        drawer->drawLine(c, a, color);
+      }
+  };
+
+  BulletTaskScheduler::BulletTaskScheduler(TaskScheduler *scheduler, int threadCount)
+      : btITaskScheduler("at3"), scheduler(scheduler), threadCount(1) {
+    setNumThreads(threadCount);
+  }
+
+  int BulletTaskScheduler::getMaxNumThreads() const {
+    return std::min((int) scheduler->getMaxThreadCount(), BT_MAX_THREAD_COUNT);
+  }
+
+  int BulletTaskScheduler::getNumThreads() const {
+    return threadCount;
+  }
+
+  void BulletTaskScheduler::setNumThreads(int numThreads) {
+    threadCount = std::max(1, std::min(numThreads, getMaxNumThreads()));
+  }
+
+  void BulletTaskScheduler::parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody &body) {
+    scheduler->parallelFor(iBegin, iEnd, grainSize, [&](int begin, int end) {
+      body.forLoop(begin, end);
+    }, (uint32_t) threadCount);
+  }
+
+  btScalar BulletTaskScheduler::parallelSum(int iBegin, int iEnd, int grainSize, const btIParallelSumBody &body) {
+    btScalar sum = 0;
+    std::mutex sumMutex;
+    scheduler->parallelFor(iBegin, iEnd, grainSize, [&](int begin, int end) {
+      btScalar partial = body.sumLoop(begin, end);
+      std::lock_guard<std::mutex> lock(sumMutex);
+      sum += partial;
+    }, (uint32_t) threadCount);
+    return sum;
+  }
+
+  AwakeMotionState::AwakeMotionState(const btTransform &transform, entityId id, std::vector<entityId> *awakeIds,
+                                     std::mutex *awakeMutex)
+      : btDefaultMotionState(transform), awakeIds(awakeIds), awakeMutex(awakeMutex), id(id) { }
+
+  void AwakeMotionState::setWorldTransform(const btTransform &transform) {
+    btDefaultMotionState::setWorldTransform(transform);
+    if (awakeIndex < 0) { list(); } // Only this body's thread touches its index during a step
+  }
+
+  void AwakeMotionState::list() {
+    std::lock_guard<std::mutex> lock(*awakeMutex);
+    awakeIndex = (int32_t) awakeIds->size();
+    awakeIds->push_back(id);
+  }
+
   PhysicsSystem::PhysicsSystem(State *state) : System(state),
       debugDrawToggleSub("key_down_f3", RTU_MTHD_DLGT(&PhysicsSystem::toggleDebugDraw, this)),
-      setVulkanContextSub("set_vulkan_context", RTU_MTHD_DLGT(&PhysicsSystem::setVulkanContext, this))
+      setVulkanContextSub("set_vulkan_context", RTU_MTHD_DLGT(&PhysicsSystem::setVulkanContext, this)),
+      projectileParkedSub("projectile_parked", RTU_MTHD_DLGT(&PhysicsSystem::onProjectileParked, this)),
+      projectileUnparkedSub("projectile_unparked", RTU_MTHD_DLGT(&PhysicsSystem::onProjectileUnparked, this))
   {
     name = "Physics System";
   }
@@ -57,6 +170,7 @@ namespace at3 {
 
   void PhysicsSystem::setVulkanContext(void *vkc) {
     vulkan = *(std::shared_ptr<vkc::VulkanContext<EntityComponentSystemInterface>>*) vkc;
+    setDebugDrawer();
   }
 
   bool PhysicsSystem::onInit() {
@@ -67,11 +181,27 @@ namespace at3 {
 
     broadphase = new btDbvtBroadphase();
     collisionConfiguration = new btDefaultCollisionConfiguration();
-    dispatcher = new btCollisionDispatcher(collisionConfiguration);
-    solver = new btSequentialImpulseConstraintSolver();
-    dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfiguration);
+    // The engine's threads are only started if physics is going to use them
+    TaskScheduler *engineTasks = settings::physics::threads == 1 ? nullptr : &TaskScheduler::shared();
+    uint32_t threads = settings::physics::threads ? settings::physics::threads : engineTasks->getMaxThreadCount();
+    if (threads > 1 && engineTasks->getMaxThreadCount() > 1) {
+      // Collision detection, and solving islands of bodies, are spread across the engine's threads. The task scheduler
+      // must be set before any of this is created.
+      taskScheduler = new BulletTaskScheduler(engineTasks, (int) threads);
+      btSetTaskScheduler(taskScheduler);
+      threads = (uint32_t) taskScheduler->getNumThreads();
+      dispatcher = new btCollisionDispatcherMt(collisionConfiguration);
+      solverPool = new btConstraintSolverPoolMt((int) threads);
+      solver = new btSequentialImpulseConstraintSolverMt();
+      dynamicsWorld = new btDiscreteDynamicsWorldMt(dispatcher, broadphase, solverPool, solver, collisionConfiguration);
+      printf("Physics is stepped on %u threads\n", threads);
+    } else {
+      dispatcher = new btCollisionDispatcher(collisionConfiguration);
+      solver = new btSequentialImpulseConstraintSolver();
+      dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfiguration);
+    }
     dynamicsWorld->setGravity(btVector3(0.f, 0.f, 0.f));
-    vehicleRaycaster = new btDefaultVehicleRaycaster(dynamicsWorld);
+    vehicleRaycaster = new BatchedVehicleRaycaster(dynamicsWorld, &rays);
 
     // prevent backface collisions with anything that uses the custom collision callback (like terrain)
     gContactAddedCallback = myCustomMaterialCombinerCallback;
@@ -79,18 +209,135 @@ namespace at3 {
     // set up ghost object collision detection
     dynamicsWorld->getPairCache()->setInternalGhostPairCallback(new btGhostPairCallback());
 
+    setDebugDrawer();
+
+    // The network sends only the bodies that are awake
+    const std::vector<entityId> *awake = &awakeIds;
+    rtu::topics::publish<const std::vector<entityId>*>("set_awake_physics_ids", awake);
+
     // TODO: somehow do this at the same time for a server and a client upon connect?
 //    solver->reset();
 
     return true;
   }
 
+  /*
+   * The world is simulated in steps of PHYSICS_STEP, the same everywhere, so that the server and every client simulate
+   * alike whatever their frame rates. Each tick runs as many steps as the time since the last one makes up, carrying
+   * over whatever is left, but never more than PHYSICS_MAX_STEPS_PER_TICK: after a hitch, the simulation slows down for
+   * a moment instead of taking one huge step, or falling further behind with every tick. Everything is then drawn part
+   * of the way from where it was before the last step to where it is now, by how much time was left over.
+   */
   void PhysicsSystem::onTick(float dt) {
+    int steps = 0;
+    stepTimeLeft += dt;
+    while (stepTimeLeft >= PHYSICS_STEP && steps < PHYSICS_MAX_STEPS_PER_TICK) {
+      step();
+      stepTimeLeft -= PHYSICS_STEP;
+      ++steps;
+    }
+    stepTimeLeft = std::min(stepTimeLeft, PHYSICS_STEP); // Whatever couldn't be caught up on is dropped
+
+    if (steps) {
+      for (auto id : registries[2].ids) {
+        TrackControls *trackControls;
+        state->get_TrackControls(id, &trackControls);
+        for (int i = 0; i < trackControls->vehicle->getNumWheels(); ++i) {
+          trackControls->vehicle->updateWheelTransform(i, true);
+        }
+      }
+      if (debugDrawMode && debugDrawer) { drawDebugLines(); }
+    }
+
+    // Controls are given again every tick, and have been applied in every step that they were meant for
+    for (auto id : registries[2].ids) {
+      TrackControls *trackControls;
+      state->get_TrackControls(id, &trackControls);
+      trackControls->torque = glm::vec2(0, 0);
+      trackControls->brakes = glm::vec2(0, 0);
+    }
+    for (auto id : registries[3].ids) {
+      WalkControls *ctrls;
+      state->get_WalkControls(id, &ctrls);
+      ctrls->force = glm::vec3(0, 0, 0);
+      ctrls->isRunning = false;
+    }
+
+    updatePlacements(stepTimeLeft / PHYSICS_STEP);
+  }
+
+  void PhysicsSystem::step() {
+    gravity.bodies.clear();
+    gravity.posX.clear();
+    gravity.posY.clear();
+    gravity.velX.clear();
+    gravity.velY.clear();
+    for (auto id : awakeIds) {
+      Physics *physics;
+      state->get_Physics(id, &physics);
+      if ( ! physics->rigidBody->isActive()) { continue; } // Fell asleep, but not yet unlisted
+
+      // Where it was before this step, to draw it in between
+      physics->previousTransform = physics->rigidBody->getWorldTransform();
+
+      btVector3 pos = physics->rigidBody->getWorldTransform().getOrigin();
+      const btVector3 &vel = physics->rigidBody->getLinearVelocity();
+      gravity.bodies.push_back(physics->rigidBody);
+      gravity.posX.push_back(pos.x());
+      gravity.posY.push_back(pos.y());
+      gravity.velX.push_back(vel.x());
+      gravity.velY.push_back(vel.y());
+
+      // temporary hack to stop things from flying off to infinity if they escape the cylinder FIXME: hack
+      if (glm::length(glm::vec2(pos.x(), pos.y())) > 810.f || pos.z() < -2510.f) {
+        btTransform writeTransform = physics->rigidBody->getCenterOfMassTransform();
+        float xOffset = (rand() % 400) * .1f - 20.f;
+        float yOffset = (rand() % 400) * .1f - 20.f;
+        writeTransform.setOrigin(btVector3(xOffset, yOffset, 2200)); // appears near "top" end of cylinder
+        physics->rigidBody->setCenterOfMassTransform(writeTransform);
+        physics->rigidBody->setLinearVelocity(btVector3(0, 0, 0));
+        physics->previousTransform = writeTransform;
+      }
+    }
+
+    // The gravity of every active body, all at once
+    size_t count = gravity.bodies.size();
+    gravity.gravX.resize(count);
+    gravity.gravY.resize(count);
+    gravity.gravZ.resize(count);
+    getCylGravBatch(count, gravity.posX.data(), gravity.posY.data(), gravity.velX.data(), gravity.velY.data(),
+                    gravity.gravX.data(), gravity.gravY.data(), gravity.gravZ.data());
+    for (size_t i = 0; i < count; ++i) {
+      gravity.bodies[i]->setGravity(btVector3(gravity.gravX[i], gravity.gravY[i], gravity.gravZ[i]));
+    }
+
+    applyControls();
+
+    // Exactly one step, which bullet doesn't interpolate on its own (see onTick)
+#   if PRINT_PHYSICS_STEP_TIMES
+      auto stepStart = std::chrono::steady_clock::now();
+#   endif
+    dynamicsWorld->stepSimulation(PHYSICS_STEP, 0);
+#   if PRINT_PHYSICS_STEP_TIMES
+      stepSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - stepStart).count();
+      if (++stepsTimed == 300) {
+        printf("Physics step: %.3f ms on %d threads, %d bodies, %.3f us per ray over %u rays\n",
+               stepSeconds / stepsTimed * 1000.0, taskScheduler ? taskScheduler->getNumThreads() : 1,
+               dynamicsWorld->getNumCollisionObjects(), raysTimed ? raySeconds / raysTimed * 1000000.0 : 0.0,
+               raysTimed / stepsTimed);
+        stepSeconds = raySeconds = 0.0;
+        stepsTimed = raysTimed = 0;
+      }
+#   endif
+  }
+
+  /*
+   * Apply every control to its body. This happens before every step, since bullet clears forces after each one.
+   */
+  void PhysicsSystem::applyControls() {
 
     // PyramidControls
     for (auto id : registries[1].ids) {
-      Placement *placement;
-      state->get_Placement(id, &placement);
       PyramidControls *ctrls;
       state->get_PyramidControls(id, &ctrls);
       Physics *physics;
@@ -99,7 +346,7 @@ namespace at3 {
                                      btVector3(ctrls->up.x, ctrls->up.y, ctrls->up.z) * 0.05f);
 
       // simplified gravity affecting pyramid, not accounting for tangential motion.
-      glm::vec3 grav = getNaiveCylGrav(placement->getTranslation(true));
+      glm::vec3 grav = getNaiveCylGrav(bulletToGlm(physics->rigidBody->getWorldTransform().getOrigin()));
 
       // Custom constraint to keep the pyramid pointing in the correct "up" direction
       glm::vec3 up = -glm::normalize(grav);
@@ -110,57 +357,64 @@ namespace at3 {
       );
     }
 
+    // Every ray that walkers and vehicles need for this step, cast all together: one straight "down" from each walker,
+    // then one for each wheel of each vehicle, in the order the vehicles will cast them when they update below.
+    float rayLength = 2.f;//HUMAN_HEIGHT * 1.5f;
+    rays.clear();
+    for (auto id : registries[3].ids) {
+      Physics *physics;
+      state->get_Physics(id, &physics);
+      btVector3 rayStart = physics->rigidBody->getWorldTransform().getOrigin();
+      rays.add(rayStart, rayStart + glmToBullet(getNaiveCylGravDir(bulletToGlm(rayStart))) * rayLength);
+    }
+    uint32_t firstWheelRay = rays.getRayCount();
+    for (auto id : registries[2].ids) {
+      TrackControls *trackControls;
+      state->get_TrackControls(id, &trackControls);
+      for (int i = 0; i < trackControls->vehicle->getNumWheels(); ++i) {
+        trackControls->vehicle->updateWheelTransform(i, false);
+        const btWheelInfo &wheel = trackControls->vehicle->getWheelInfo(i);
+        btScalar travel = wheel.getSuspensionRestLength() + wheel.m_wheelsRadius;
+        rays.add(wheel.m_raycastInfo.m_hardPointWS,
+                 wheel.m_raycastInfo.m_hardPointWS + wheel.m_raycastInfo.m_wheelDirectionWS * travel);
+      }
+    }
+#   if PRINT_PHYSICS_STEP_TIMES
+      auto castStart = std::chrono::steady_clock::now();
+#   endif
+    if (taskScheduler) {
+      rays.cast(dynamicsWorld, &TaskScheduler::shared(), (uint32_t) taskScheduler->getNumThreads());
+    } else {
+      rays.cast(dynamicsWorld, nullptr, 1);
+    }
+#   if PRINT_PHYSICS_STEP_TIMES
+      raySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - castStart).count();
+      raysTimed += rays.getRayCount();
+#   endif
+
     // WalkControls
     // TODO: create a kinematic body (0 mass, recalc inertia) to which to anchor
     //       the body when it lands from a height (point to point constraint, AKA ball joint, maybe)?
+    uint32_t walkerRay = 0;
     for (auto id : registries[3].ids) {
-      Placement *placement;
-      state->get_Placement(id, &placement);
       WalkControls *ctrls;
       state->get_WalkControls(id, &ctrls);
       Physics *physics;
       state->get_Physics(id, &physics);
 
-      // Fire some rays straight "down"
+      const RayBatch::Hit &groundHit = rays.getHit(walkerRay);
+      btVector3 rayStart = rays.getFrom(walkerRay++);
+      float rayDistTravelled = (groundHit.point - rayStart).length();
+      bool rayHitGoodGround = groundHit.object != nullptr; // TODO: add steepness check?
 
-      float rayLength = 2.f;//HUMAN_HEIGHT * 1.5f;
-      float rayDistTravelledAvg = 0.f;
-      btVector3 rayHitPointAvg = {0.f, 0.f, 0.f};
-      btVector3 rayNormalAvg = {0.f, 0.f, 0.f};
-      btVector3 groundVelocity;
-      bool groundVelocityFound = false;
-      bool anyRayHitGoodGround = false;
-
-      glm::vec3 pos = placement->getTranslation(true);
-      btVector3 btPos = glmToBullet(pos);
+      glm::vec3 pos = bulletToGlm(rayStart);
       glm::vec3 btVel = bulletToGlm(physics->rigidBody->getLinearVelocity());
       glm::vec3 down = getNaiveCylGravDir(pos);
       btVector3 rayDirection = glmToBullet(down);
 
-      std::vector<btVector3> rayStartLocations = {
-          {btPos.x(), btPos.y(), btPos.z()},
-      };
-
-      for (auto rayStart : rayStartLocations) {
-        btVector3 rayEnd = rayStart + rayDirection * rayLength;
-        btCollisionWorld::ClosestRayResultCallback groundSpringRayCallback(rayStart, rayEnd);
-        dynamicsWorld->rayTest(rayStart, rayEnd, groundSpringRayCallback);
-        rayDistTravelledAvg += (groundSpringRayCallback.m_hitPointWorld - rayStart).length();
-        anyRayHitGoodGround |= (groundSpringRayCallback.hasHit()); // TODO: add steepness check?
-        rayHitPointAvg += groundSpringRayCallback.m_hitPointWorld;
-        rayNormalAvg += groundSpringRayCallback.m_hitNormalWorld;
-        if ( ! groundVelocityFound && groundSpringRayCallback.m_collisionObject) { // Use the results of the first ray
-          groundVelocity = groundSpringRayCallback.m_collisionObject->getInterpolationLinearVelocity();
-          groundVelocityFound = true;
-        }
-      }
-      rayDistTravelledAvg /= rayStartLocations.size();
-      rayHitPointAvg /= rayStartLocations.size();
-      rayNormalAvg /= rayStartLocations.size();
-
       // some variables to use below
       float maxSpringForce = rayLength * 0.5f;
-      float springForceLinear = maxSpringForce - rayDistTravelledAvg;
+      float springForceLinear = maxSpringForce - rayDistTravelled;
       bool isInJumpRange = springForceLinear > -rayLength * 0.2f;
 
       // store the linear spring force as offset from equilibrium
@@ -176,6 +430,7 @@ namespace at3 {
         physics->rigidBody->applyCentralImpulse(-rayDirection * CHARA_JUMP);
         ctrls->jumpInProgress = true;
       }
+      ctrls->jumpRequested = false;
 
       // damping variables to be applied to object
       float linDamp = 0.f;
@@ -183,7 +438,7 @@ namespace at3 {
       float zFactor = 1.f;
 
       float springForceOverMax = springForceLinear / maxSpringForce; // How far from equilibrium (0 to 1, 1 is far)
-      ctrls->isGrounded = anyRayHitGoodGround; // not grounded if high in the air or on steep slope
+      ctrls->isGrounded = rayHitGoodGround; // not grounded if high in the air or on steep slope
       ctrls->isGrounded &= fabs(springForceOverMax) < 1.f; // extra range checks
       ctrls->isGrounded &= fabs(springForceOverMax) > -1.f;
       ctrls->isGrounded &= (! ctrls->jumpInProgress); // not grounded if jumping
@@ -221,8 +476,8 @@ namespace at3 {
 //        // modify walking force to be perpendicular to the ground normal so as not to point into or out of the ground.
 //        // this avoids "jiggling" as you walk up or down a hill, especially on slow hardware.
 //        float origForceMag = glm::length(ctrls->force);
-//        ctrls->force.z = -1 * ( ctrls->force.x * rayNormalAvg.x() +
-//                                 ctrls->force.y * rayNormalAvg.y() ) ;
+//        ctrls->force.z = -1 * ( ctrls->force.x * groundHit.normal.x() +
+//                                 ctrls->force.y * groundHit.normal.y() ) ;
 //        // re-normalize the new walking force vector to match the magnitude of the old one
 //        if ( glm::length(ctrls->force) ) {
 //          ctrls->force = origForceMag * glm::normalize(ctrls->force);
@@ -244,22 +499,12 @@ namespace at3 {
 
       physics->rigidBody->setDamping(linDamp, angDamp); // Set damping
       physics->rigidBody->setLinearFactor(btVector3(1, 1, zFactor));
-
-      // zero controls
-      ctrls->force = glm::vec3(0, 0, 0);
-      ctrls->jumpRequested = false;
-      ctrls->isRunning = false;
     }
 
-    // Step the world here
-    dynamicsWorld->stepSimulation(dt); // time step (s), max sub-steps, sub-step length (s)
-    if (debugDrawMode) { dynamicsWorld->debugDrawWorld(); }
-
     // TrackControls
     for (auto id : registries[2].ids) {
       TrackControls *trackControls;
       state->get_TrackControls(id, &trackControls);
-      //Todo: put engine force application *before* the sim update, with wheel update after?
 
 //      for (size_t i = 0; i < trackControls->wheels.size(); ++i) {
 //        if (trackControls->wheels.at(i).leftOrRight < 0) {
@@ -292,71 +537,105 @@ namespace at3 {
       if (trackControls->flipRequested) {
         Physics *physics;
         state->get_Physics(id, &physics);
-        Placement *placement;
-        state->get_Placement(id, &placement);
         glm::vec3 cen = glm::vec3(0, 0, 1);
-        glm::vec3 dir = -getNaiveCylGrav(placement->getTranslation(true)) * 25.f;
+        glm::vec3 dir = -getNaiveCylGrav(bulletToGlm(physics->rigidBody->getWorldTransform().getOrigin())) * 25.f;
         physics->rigidBody->applyImpulse({dir.x, dir.y, dir.z}, {cen.x, cen.y, cen.z});
         trackControls->flipRequested = false;
       }
+    }
 
-      for (int i = 0; i < trackControls->vehicle->getNumWheels(); ++i) {
-        trackControls->vehicle->updateWheelTransform(i, true);
-      }
-      // zero control forces
-      trackControls->torque = glm::vec2(0, 0);
-      trackControls->brakes = glm::vec2(0, 0);
+    // Vehicles are updated here, instead of by bullet during the step, so that their rays are cast with the others
+    vehicleRaycaster->setNextRay(firstWheelRay);
+    for (auto id : registries[2].ids) {
+      TrackControls *trackControls;
+      state->get_TrackControls(id, &trackControls);
+      trackControls->vehicle->updateVehicle(PHYSICS_STEP);
     }
+  }
 
-    // All Physics
-    for (auto id : registries[0].ids) {
+  // Somewhere between two transforms, for drawing in between physics steps
+  static btTransform interpolate(const btTransform &from, const btTransform &to, btScalar alpha) {
+    return btTransform(from.getRotation().slerp(to.getRotation(), alpha), from.getOrigin().lerp(to.getOrigin(), alpha));
+  }
+
+  /*
+   * Move the placement of every awake body to where it is drawn, alpha of the way from where it was before the last
+   * step to where it is now. Wheels are drawn where they are on their chassis, wherever that is drawn. A body that has
+   * fallen asleep is drawn where it came to rest one last time and unlisted, and isn't moved again until it wakes up.
+   * Orphan wheels aren't drawn at all.
+   * TODO: instead of deleting all wheels in onForgetTrackControls, replace each wheel's physics component with a normal
+   * physics component at the same location
+   */
+  void PhysicsSystem::updatePlacements(float alpha) {
+    for (size_t i = awakeIds.size(); i-- > 0; ) { // Backwards, since unlisting moves the last one here
+      entityId id = awakeIds[i];
       Physics *physics;
       state->get_Physics(id, &physics);
+      const btTransform &now = physics->rigidBody->getWorldTransform();
+      bool asleep = ! physics->rigidBody->isActive();
+      if (asleep) { physics->previousTransform = now; }
+      btTransform drawn = interpolate(physics->previousTransform, now, alpha);
       Placement *placement;
       state->get_Placement(id, &placement);
-      btTransform transform;
-      switch (physics->useCase) {
-        case Physics::WHEEL: {
-          WheelInfo wi = *((WheelInfo*)physics->customData);
-          TrackControls *trackControls;
-          if (SUCCESS == state->get_TrackControls(wi.parentVehicle, &trackControls)) {
-            transform = trackControls->vehicle->getWheelTransformWS(((WheelInfo*)physics->customData)->bulletWheelId);
-          } else {
-            // TODO: handle an orphan wheel
-            // TODO: instead of deleting all wheels in onForgetTrackControls, do the following here:
-            // replace the wheel's physics component with a normal physics component at the same location
-          }
-        } break;
-        default: {
-          if ( ! physics->rigidBody->isActive()) { continue; }
-
-          physics->rigidBody->getMotionState()->getWorldTransform(transform);
-
-          btVector3 vel = physics->rigidBody->getLinearVelocity();
-          glm::vec3 grav = getCylGrav(placement->getTranslation(true), glm::vec3(vel.x(), vel.y(), vel.z()));
-
-          btVector3 btGrav = btVector3(grav.x, grav.y, grav.z);
-          physics->rigidBody->setGravity(btGrav);
-
-          // temporary hack to stop things from flying off to infinity if they escape the cylinder FIXME: hack
-          glm::vec3 pos = placement->getTranslation(true);
-          if (glm::length(glm::vec2(pos.x, pos.y)) > 810.f || pos.z < -2510.f) {
-            btTransform writeTransform = physics->rigidBody->getCenterOfMassTransform();
-            float xOffset = (rand() % 400) * .1f - 20.f;
-            float yOffset = (rand() % 400) * .1f - 20.f;
-            writeTransform.setOrigin(btVector3(xOffset, yOffset, 2200)); // appears near "top" end of cylinder
-            physics->rigidBody->setCenterOfMassTransform(writeTransform);
-            physics->rigidBody->setLinearVelocity(btVector3(0, 0, 0));
-          }
+      drawn.getOpenGLMatrix((btScalar *) &placement->mat);
+      vulkan->markTransformChanged(id);
 
-        } break;
+      TrackControls *trackControls;
+      if (SUCCESS == state->get_TrackControls(id, &trackControls)) {
+        btTransform nowToDrawn = drawn * now.inverse();
+        for (auto &wi : trackControls->wheels) {
+          state->get_Placement(wi.myId, &placement);
+          btTransform transform = nowToDrawn * trackControls->vehicle->getWheelTransformWS(wi.bulletWheelId);
+          transform.getOpenGLMatrix((btScalar *) &placement->mat);
+          vulkan->markTransformChanged(wi.myId);
+        }
       }
-      glm::mat4 newTransform(1.f);
-      transform.getOpenGLMatrix((btScalar *) &newTransform);
-      placement->mat = newTransform;
+
+      if (asleep) { unlistAwake(physics); }
     }
   }
 
+  void PhysicsSystem::unlistAwake(Physics *physics) {
+    auto *motionState = (AwakeMotionState *) physics->rigidBody->getMotionState();
+    if (motionState->awakeIndex < 0) { return; }
+    entityId last = awakeIds.back();
+    if (last != (entityId) physics->rigidBody->getUserIndex()) {
+      Physics *lastPhysics;
+      state->get_Physics(last, &lastPhysics);
+      ((AwakeMotionState *) lastPhysics->rigidBody->getMotionState())->awakeIndex = motionState->awakeIndex;
+      awakeIds[motionState->awakeIndex] = last;
+    }
+    awakeIds.pop_back();
+    motionState->awakeIndex = -1;
+  }
+
+  /*
+   * A pooled ball was parked, whether it was awake or had already fallen asleep, so updatePlacements may never see it
+   * again. It's drawn where it was put from now on, and isn't listed until it's handed out again.
+   */
+  void PhysicsSystem::onProjectileParked(void *id) {
+    entityId parkedId = *(entityId *) id;
+    Physics *physics;
+    state->get_Physics(parkedId, &physics);
+    physics->previousTransform = physics->rigidBody->getWorldTransform();
+    Placement *placement;
+    state->get_Placement(parkedId, &placement);
+    physics->previousTransform.getOpenGLMatrix((btScalar *) &placement->mat);
+    vulkan->markTransformChanged(parkedId);
+    unlistAwake(physics);
+  }
+
+  /*
+   * A pooled ball was handed out again, from wherever its body has been put. It's listed as awake right away, so that
+   * gravity pulls it in the next step, and drawn from where it starts rather than from its parking spot.
+   */
+  void PhysicsSystem::onProjectileUnparked(void *id) {
+    Physics *physics;
+    state->get_Physics(*(entityId *) id, &physics);
+    physics->previousTransform = physics->rigidBody->getWorldTransform();
+    physics->rigidBody->getMotionState()->setWorldTransform(physics->previousTransform); // Which lists it
+  }
+
   void PhysicsSystem::deInit() {
 	  // onForget will be called for each remaining id
     // TODO: does this need to be updated?
@@ -375,10 +654,20 @@ namespace at3 {
 
     delete vehicleRaycaster;
     delete dynamicsWorld;
+    dynamicsWorld = nullptr;
+    delete debugDrawer;
+    debugDrawer = nullptr;
     delete solver;
+    delete solverPool;
+    solverPool = nullptr;
     delete dispatcher;
     delete collisionConfiguration;
     delete broadphase;
+    if (taskScheduler) {
+      btSetTaskScheduler(nullptr);
+      delete taskScheduler;
+      taskScheduler = nullptr;
+    }
   }
 
   bool PhysicsSystem::onDiscover(const entityId &id) {
@@ -386,46 +675,75 @@ namespace at3 {
     state->get_Placement(id, &placement);
     Physics *physics;
     state->get_Physics(id, &physics);
-    // TODO: Re-use shapes instead of making a new one for each instance
+    // Dynamic shapes come from the cache, so all the bodies of the same shape and size share one
     btCollisionShape* shape = nullptr;
     switch (physics->useCase) {
-      case Physics::SPHERE: {
-        shape = new btSphereShape(*((float *) physics->initData.get()));
+      case Physics::SPHERE:
+      case Physics::PROJECTILE: {
+        shape = shapes.getSphere(*((float *) physics->initData.get()));
       } break;
       case Physics::PLANE: {
         AT3_ASSERT(false, "missing plane collision implementation");
       } break;
       case Physics::BOX: {
-        shape = new btBoxShape(*((btVector3*) physics->initData.get()));
+        shape = shapes.getBox(*((btVector3*) physics->initData.get()));
       } break;
       case Physics::DYNAMIC_CONVEX_MESH: {
-        auto *points = (std::vector<float> *) physics->initData.get();
-        shape = new btConvexHullShape(points->data(), (int) points->size() / 3, 3 * sizeof(float));
+        shape = shapes.getConvexHull(*(std::vector<float> *) physics->initData.get());
       } break;
       case Physics::CHARA: {
 //        shape = new btCapsuleShapeZ(HUMAN_WIDTH * 0.5f, HUMAN_HEIGHT * 0.33f);
-        shape = new btSphereShape(HUMAN_WIDTH * 0.5f);
+        shape = shapes.getSphere(HUMAN_WIDTH * 0.5f);
       } break;
       case Physics::STATIC_MESH: {
 
-        physics->customData = new btTriangleMesh();
-        auto *mesh = reinterpret_cast<btTriangleMesh*>(physics->customData);
-
         std::string terrainMeshName = *static_cast<std::string*>(physics->initData.get());
-        std::vector<float> *verts = vulkan->getMeshStoredVertices(terrainMeshName);
-        std::vector<uint32_t> *indices = vulkan->getMeshStoredIndices(terrainMeshName);
-        uint32_t vertexStride = vulkan->getMeshStoredVertexStride();
-
-        for (uint32_t i = 0; i < verts->size(); i += vertexStride / sizeof(float)) {
-          glm::vec4 pos = placement->mat * glm::vec4((*verts)[i], (*verts)[i + 1], (*verts)[i + 2], 1.f);
-          mesh->findOrAddVertex({pos.x, pos.y, pos.z}, false);
+        auto *meshData = new StaticMeshData();
+        physics->customData = meshData;
+        meshData->triangles = vulkan->getMeshStoredTriangles(terrainMeshName);
+        AT3_ASSERT(meshData->triangles, "No stored triangles for static mesh %s", terrainMeshName.c_str());
+
+        // The renderer's positions and indices, read in place
+        btIndexedMesh part;
+        part.m_numTriangles = (int) meshData->triangles->indices.size() / 3;
+        part.m_triangleIndexBase = (const unsigned char *) meshData->triangles->indices.data();
+        part.m_triangleIndexStride = sizeof(uint32_t) * 3;
+        part.m_numVertices = (int) meshData->triangles->positions.size() / 3;
+        part.m_vertexBase = (const unsigned char *) meshData->triangles->positions.data();
+        part.m_vertexStride = sizeof(float) * 3;
+        part.m_indexType = PHY_INTEGER;
+        part.m_vertexType = PHY_FLOAT;
+        meshData->mesh.addIndexedMesh(part, PHY_INTEGER);
+
+        // The placement becomes the body's transform, all but its scale, which the shape takes instead
+        glm::mat4 unscaled = placement->mat;
+        btVector3 scale(glm::length(glm::vec3(unscaled[0])), glm::length(glm::vec3(unscaled[1])),
+                        glm::length(glm::vec3(unscaled[2])));
+        for (int i = 0; i < 3; ++i) {
+          unscaled[i] /= scale[i];
         }
-        for (uint32_t i = 0; i < indices->size(); i += 3) {
-          mesh->addTriangleIndices((*indices)[i], (*indices)[i + 1], (*indices)[i + 2]);
+        btTransform transform;
+        transform.setFromOpenGLMatrix((btScalar *) &unscaled);
+
+        // Building the hierarchy of something like the terrain takes a while, so it's only done the first time
+        auto buildStart = std::chrono::steady_clock::now();
+        uint64_t meshHash = hashBvhCacheKey(meshData->triangles->key, scale);
+        std::string bvhPath = getBvhCachePath(terrainMeshName);
+        bool cached = meshData->bvh.load(bvhPath, meshHash);
+        auto *meshShape = new btBvhTriangleMeshShape(&meshData->mesh, true, false);
+        if (cached) {
+          meshShape->setOptimizedBvh(meshData->bvh.getBvh(), scale); // Which scales it without building another
+        } else {
+          meshShape->setLocalScaling(scale); // Which builds the hierarchy, unless the scale is already the same
+          if ( ! meshShape->getOptimizedBvh()) { meshShape->buildOptimizedBvh(); }
+          writeBvhCacheFile(bvhPath, *meshShape->getOptimizedBvh(), meshHash);
         }
-        shape = new btBvhTriangleMeshShape(mesh, true);
+        shape = meshShape;
+        printf("Collision hierarchy of %s %s in %.1f ms\n", terrainMeshName.c_str(), cached ? "loaded" : "built",
+               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count());
 
-        auto *motionState = new btDefaultMotionState();
+        auto *motionState = new btDefaultMotionState(transform);
+        physics->previousTransform = transform;
         btRigidBody::btRigidBodyConstructionInfo rbci(0, motionState, shape);
         physics->rigidBody = new btRigidBody(rbci);
         physics->rigidBody->setRestitution(0.5f);
@@ -458,11 +776,13 @@ namespace at3 {
     }
     btTransform transform;
     transform.setFromOpenGLMatrix((btScalar *) &placement->mat);
-    auto *motionState = new btDefaultMotionState(transform);
+    auto *motionState = new AwakeMotionState(transform, id, &awakeIds, &awakeMutex);
+    motionState->list(); // New bodies start out awake
     btVector3 inertia(0.f, 0.f, 0.f);
     shape->calculateLocalInertia(physics->mass, inertia);
     btRigidBody::btRigidBodyConstructionInfo ci(physics->mass, motionState, shape, inertia);
     physics->rigidBody = new btRigidBody(ci);
+    physics->previousTransform = transform;
     switch (physics->useCase) {
       case Physics::CHARA: {
         physics->rigidBody->setAngularFactor({0.f, 0.f, 0.f});
@@ -480,6 +800,7 @@ namespace at3 {
     }
     physics->rigidBody->setUserIndex((int)id);
     dynamicsWorld->addRigidBody(physics->rigidBody);
+    if (physics->useCase == Physics::PROJECTILE) { physics->park(); } // Until its pool hands it out
     return true;
   }
 
@@ -500,14 +821,20 @@ namespace at3 {
       } return true;
       case Physics::STATIC_MESH: {
         dynamicsWorld->removeRigidBody(physics->rigidBody);
-        delete (reinterpret_cast<btTriangleMeshShape*>(physics->rigidBody->getCollisionShape()))->getMeshInterface();
       } break;
       default: {
         dynamicsWorld->removeRigidBody(physics->rigidBody);
+        unlistAwake(physics);
       } break;
     }
     delete physics->rigidBody->getMotionState();
-    delete physics->rigidBody->getCollisionShape();
+    if ( ! shapes.release(physics->rigidBody->getCollisionShape())) { // Only static meshes have their own
+      delete physics->rigidBody->getCollisionShape();
+    }
+    if (physics->useCase == Physics::STATIC_MESH) { // Only once the shape that uses it is gone
+      delete (StaticMeshData *) physics->customData;
+      physics->customData = nullptr;
+    }
     delete physics->rigidBody;
     return true;
   }
@@ -518,8 +845,8 @@ namespace at3 {
     state->get_Physics(id, &physics);
     TrackControls *trackControls;
     state->get_TrackControls(id, &trackControls);
+    // Not added to the world, since applyControls updates it (see there)
     trackControls->vehicle = new btRaycastVehicle(trackControls->tuning, physics->rigidBody, vehicleRaycaster);
-    dynamicsWorld->addVehicle(trackControls->vehicle);
     trackControls->vehicle->setCoordinateSystem(0, 2, 1);
     return true;
   }
@@ -530,13 +857,63 @@ namespace at3 {
     for (auto wheel : trackControls->wheels) {
       state->rem_Physics(wheel.myId);
     }
-    dynamicsWorld->removeVehicle(trackControls->vehicle);
     delete trackControls->vehicle;
     return true;
   }
 
+  /*
+   * Debug drawing needs both the renderer and the world, which could show up in either order.
+   */
   void PhysicsSystem::setDebugDrawer() {
-//    dynamicsWorld->setDebugDrawer(thing);
+    if ( ! vulkan || ! dynamicsWorld) { return; }
+    delete debugDrawer;
+    debugDrawer = new VulkanDebugDrawer(&vulkan->getDebugLines());
+    dynamicsWorld->setDebugDrawer(debugDrawer);
+  }
+
+  /*
+   * Draw the world as bullet sees it over the next frame. Something like a terrain has far too many triangles to draw
+   * all of them, so unless graphics_vk_debug_line_radius_f is zero, only what lies within that distance of the camera
+   * is drawn, and of a concave shape only the triangles near the camera. Constraints and vehicles are only drawn when
+   * there is no limit.
+   */
+  void PhysicsSystem::drawDebugLines() {
+    vkc::DebugLines &lines = vulkan->getDebugLines();
+    lines.clear(); // Anything left from a tick that wasn't drawn
+
+    float radius = settings::graphics::vulkan::debugLineRadius;
+    if (radius <= 0.f) {
+      dynamicsWorld->debugDrawWorld();
+      for (auto id : registries[2].ids) { // Not in the world, so not drawn with it
+        TrackControls *trackControls;
+        state->get_TrackControls(id, &trackControls);
+        trackControls->vehicle->debugDraw(debugDrawer);
+      }
+      return;
+    }
+
+    btVector3 camera = glmToBullet(lines.getCameraPosition());
+    btVector3 reach(radius, radius, radius);
+    btIDebugDraw::DefaultColors colors = debugDrawer->getDefaultColors();
+    btCollisionObjectArray &objects = dynamicsWorld->getCollisionObjectArray();
+    for (int i = 0; i < objects.size(); ++i) {
+      btCollisionObject *object = objects[i];
+      btCollisionShape *shape = object->getCollisionShape();
+      const btTransform &transform = object->getWorldTransform();
+      btVector3 aabbMin, aabbMax;
+      shape->getAabb(transform, aabbMin, aabbMax);
+      if ( ! TestAabbAgainstAabb2(aabbMin, aabbMax, camera - reach, camera + reach)) { continue; }
+
+      btVector3 color = object->getActivationState() == ISLAND_SLEEPING ? colors.m_deactivatedObject
+                                                                         : colors.m_activeObject;
+      if (shape->isConcave()) { // Only the triangles near the camera, found in the shape's own space
+        btVector3 localCamera = transform.invXform(camera);
+        DebugTriangleCallback callback(debugDrawer, transform, color);
+        static_cast<btConcaveShape *>(shape)->processAllTriangles(&callback, localCamera - reach, localCamera + reach);
+      } else {
+        dynamicsWorld->debugDrawObject(transform, shape, color);
+      }
+    }
   }
 
   btCollisionWorld::ClosestRayResultCallback PhysicsSystem::rayTest(const btVector3 &start, const btVector3 &end) {
@@ -551,6 +928,9 @@ namespace at3 {
 
   void PhysicsSystem::toggleDebugDraw(void* nothing) {
     debugDrawMode = !debugDrawMode;
+    if ( ! debugDrawMode && vulkan) {
+      vulkan->getDebugLines().clear();
+    }
   }
 }
 
@@ -3,11 +3,17 @@
 
 #include <btBulletDynamicsCommon.h>
 #include <LinearMath/btIDebugDraw.h>
+#include <LinearMath/btThreads.h>
+#include <mutex>
 #include "ezecs.hpp"
 #include "sceneObject.hpp"
 #include "interface.hpp"
 #include "topics.hpp"
 #include "vkc.hpp"
+#include "collisionShapes.hpp"
+#include "taskScheduler.hpp"
+#include "rayBatch.hpp"
+#include "bvhCache.hpp"
 
 using namespace ezecs;
 
@@ -16,21 +22,92 @@ namespace at3 {
 
   typedef std::function<btCollisionWorld::ClosestRayResultCallback(btVector3 &, btVector3 &)> rayFuncType;
 
+  /*
+   * Hands bullet's debug drawing to the renderer's debug lines, which draws them over the next frame.
+   */
+  class VulkanDebugDrawer : public btIDebugDraw {
+      vkc::DebugLines *lines;
+      int debugMode = DBG_DrawWireframe;
+    public:
+      explicit VulkanDebugDrawer(vkc::DebugLines *lines);
+      void drawLine(const btVector3 &from, const btVector3 &to, const btVector3 &color) override;
+      void drawContactPoint(const btVector3 &pointOnB, const btVector3 &normalOnB, btScalar distance, int lifeTime,
+                            const btVector3 &color) override;
+      void reportErrorWarning(const char *warningString) override;
+      void draw3dText(const btVector3 &location, const char *textString) override;
+      void setDebugMode(int debugMode) override;
+      int getDebugMode() const override;
+  };
+
+  /*
+   * Runs bullet's parallel loops on the engine's shared task scheduler, on at most as many threads as it's set to.
+   */
+  class BulletTaskScheduler : public btITaskScheduler {
+      TaskScheduler *scheduler;
+      int threadCount;
+    public:
+      BulletTaskScheduler(TaskScheduler *scheduler, int threadCount);
+      int getMaxNumThreads() const override;
+      int getNumThreads() const override;
+      void setNumThreads(int numThreads) override;
+      void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody &body) override;
+      btScalar parallelSum(int iBegin, int iEnd, int grainSize, const btIParallelSumBody &body) override;
+  };
+
+  /*
+   * Lists its body as awake whenever bullet moves it. Bullet only moves the motion states of bodies that are awake, at
+   * the end of each step, so a body that wakes up is listed by the end of the step it woke up in. The physics system
+   * unlists it again once it has fallen asleep (see updatePlacements), so that nothing done every step or tick has to
+   * look at the sleeping ones.
+   */
+  class AwakeMotionState : public btDefaultMotionState {
+      std::vector<entityId> *awakeIds;
+      std::mutex *awakeMutex; // Bullet may move bodies on several threads at once
+      entityId id;
+    public:
+      int32_t awakeIndex = -1; // In awakeIds, or -1 if it isn't listed
+      AwakeMotionState(const btTransform &transform, entityId id, std::vector<entityId> *awakeIds,
+                       std::mutex *awakeMutex);
+      void setWorldTransform(const btTransform &transform) override;
+      void list();
+  };
+
   class PhysicsSystem : public System<PhysicsSystem> {
       /* Global physics data structures */
       btDispatcher *dispatcher;
       btBroadphaseInterface *broadphase;
       btConstraintSolver *solver;
+      btConstraintSolverPoolMt *solverPool = nullptr; // Only in a multithreaded world, with the task scheduler below
+      BulletTaskScheduler *taskScheduler = nullptr;
       btCollisionConfiguration *collisionConfiguration;
-      btDynamicsWorld *dynamicsWorld;
-      btVehicleRaycaster * vehicleRaycaster;
+      btDynamicsWorld *dynamicsWorld = nullptr;
+      BatchedVehicleRaycaster *vehicleRaycaster;
+      RayBatch rays; // Cast once a step for walkers and vehicles, kept to reuse its buffers
+      struct GravityBatch { // The active bodies of a step, with one array for each component, for getCylGravBatch
+        std::vector<btRigidBody*> bodies;
+        std::vector<float> posX, posY, velX, velY, gravX, gravY, gravZ;
+      } gravity;
+      std::vector<entityId> awakeIds; // Of bodies that aren't wheels or static, in no particular order
+      std::mutex awakeMutex;
       bool debugDrawMode = false;
+      VulkanDebugDrawer *debugDrawer = nullptr;
+      CollisionShapeCache shapes;
+      float stepTimeLeft = 0.f; // Not yet simulated, at most PHYSICS_STEP once a tick is done (equal if it fell behind)
 
       std::shared_ptr<vkc::VulkanContext<EntityComponentSystemInterface>> vulkan;
       rtu::topics::Subscription setVulkanContextSub;
       void setVulkanContext(void *vkc);
 
+      rtu::topics::Subscription projectileParkedSub, projectileUnparkedSub;
+      void onProjectileParked(void *id);
+      void onProjectileUnparked(void *id);
+
       rtu::topics::Subscription debugDrawToggleSub;
+      void drawDebugLines();
+      void step();
+      void applyControls();
+      void updatePlacements(float alpha);
+      void unlistAwake(Physics *physics);
 
     public:
       std::vector<compMask> requiredComponents = {
@@ -0,0 +1,93 @@
+
+#include "rayBatch.hpp"
+
+namespace at3 {
+
+  void RayBatch::clear() {
+    froms.clear();
+    tos.clear();
+    hits.clear();
+  }
+
+  uint32_t RayBatch::add(const btVector3 &from, const btVector3 &to) {
+    froms.push_back(from);
+    tos.push_back(to);
+    return (uint32_t) froms.size() - 1;
+  }
+
+  void RayBatch::cast(const btCollisionWorld *world, TaskScheduler *scheduler, uint32_t threads) {
+    hits.resize(froms.size());
+    // Bullet's ray tests only read the world, and its broadphase keeps a separate stack for each thread
+    auto castRange = [&](int begin, int end) {
+      for (int i = begin; i < end; ++i) {
+        btCollisionWorld::ClosestRayResultCallback callback(froms[i], tos[i]);
+        world->rayTest(froms[i], tos[i], callback);
+        Hit &hit = hits[i];
+        if (callback.hasHit()) {
+          hit.point = callback.m_hitPointWorld;
+          hit.normal = callback.m_hitNormalWorld;
+          hit.object = callback.m_collisionObject;
+          hit.fraction = callback.m_closestHitFraction;
+        } else {
+          hit.point = tos[i];
+          hit.normal.setZero();
+          hit.object = nullptr;
+          hit.fraction = 1;
+        }
+      }
+    };
+    if (scheduler) {
+      scheduler->parallelFor(0, (int) froms.size(), grainSize, castRange, threads);
+    } else {
+      castRange(0, (int) froms.size());
+    }
+  }
+
+  uint32_t RayBatch::getRayCount() const {
+    return (uint32_t) froms.size();
+  }
+
+  const btVector3 &RayBatch::getFrom(uint32_t ray) const {
+    return froms[ray];
+  }
+
+  const btVector3 &RayBatch::getTo(uint32_t ray) const {
+    return tos[ray];
+  }
+
+  const RayBatch::Hit &RayBatch::getHit(uint32_t ray) const {
+    return hits[ray];
+  }
+
+  BatchedVehicleRaycaster::BatchedVehicleRaycaster(const btCollisionWorld *world, const RayBatch *batch)
+      : world(world), batch(batch) { }
+
+  void BatchedVehicleRaycaster::setNextRay(uint32_t ray) {
+    nextRay = ray;
+  }
+
+  // The same as btDefaultVehicleRaycaster, which only counts hits on rigid bodies that respond to contact
+  void *BatchedVehicleRaycaster::castRay(const btVector3 &from, const btVector3 &to,
+                                         btVehicleRaycasterResult &result) {
+    RayBatch::Hit single;
+    const RayBatch::Hit *hit = &single;
+    if (nextRay < batch->getRayCount() && batch->getFrom(nextRay) == from && batch->getTo(nextRay) == to) {
+      hit = &batch->getHit(nextRay++);
+    } else {
+      btCollisionWorld::ClosestRayResultCallback callback(from, to);
+      world->rayTest(from, to, callback);
+      single.object = callback.hasHit() ? callback.m_collisionObject : nullptr;
+      single.point = callback.m_hitPointWorld;
+      single.normal = callback.m_hitNormalWorld;
+      single.fraction = callback.m_closestHitFraction;
+    }
+    if ( ! hit->object) { return nullptr; }
+
+    const btRigidBody *body = btRigidBody::upcast(hit->object);
+    if ( ! body || ! body->hasContactResponse()) { return nullptr; }
+    result.m_hitPointInWorld = hit->point;
+    result.m_hitNormalInWorld = hit->normal.normalized();
+    result.m_distFraction = hit->fraction;
+    return (void *) body;
+  }
+}
@@ -0,0 +1,64 @@
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <btBulletDynamicsCommon.h>
+#include <BulletDynamics/Vehicle/btVehicleRaycaster.h>
+#include "taskScheduler.hpp"
+
+namespace at3 {
+
+  /*
+   * Rays gathered from everything that needs one in a step, and then cast all at once, spread across the engine's
+   * threads. Each ray finds the closest thing it hits, like btCollisionWorld::ClosestRayResultCallback. The buffers are
+   * kept from one batch to the next, so once they have grown to fit, gathering and casting rays allocates nothing.
+   */
+  class RayBatch {
+
+    public:
+
+      struct Hit {
+        btVector3 point;  // Where the ray ends if it hit nothing
+        btVector3 normal; // Zero if the ray hit nothing
+        const btCollisionObject *object; // nullptr if the ray hit nothing
+        btScalar fraction; // Of the way from the start to the end
+      };
+
+      void clear();
+      // Returns the index of the ray, which its hit will have once cast
+      uint32_t add(const btVector3 &from, const btVector3 &to);
+      /*
+       * Cast every ray added since clear against the world, on at most this many of the scheduler's threads, or on the
+       * calling thread alone if there is no scheduler.
+       */
+      void cast(const btCollisionWorld *world, TaskScheduler *scheduler, uint32_t threads);
+      uint32_t getRayCount() const;
+      const btVector3 &getFrom(uint32_t ray) const;
+      const btVector3 &getTo(uint32_t ray) const;
+      const Hit &getHit(uint32_t ray) const;
+
+    private:
+
+      static constexpr int grainSize = 16;
+
+      std::vector<btVector3> froms, tos;
+      std::vector<Hit> hits;
+  };
+
+  /*
+   * Answers the suspension rays of vehicles from a batch, in the order they were added starting at setNextRay. A
+   * vehicle casts its rays one wheel at a time while it updates, so the batch must hold exactly the rays that the
+   * update will cast: from each wheel's hard point to the end of its travel, with the chassis where it is now. A ray
+   * that isn't the next one in the batch is cast on its own instead, so answers are never wrong, only slower.
+   */
+  class BatchedVehicleRaycaster : public btVehicleRaycaster {
+      const btCollisionWorld *world;
+      const RayBatch *batch;
+      uint32_t nextRay = 0;
+    public:
+      BatchedVehicleRaycaster(const btCollisionWorld *world, const RayBatch *batch);
+      void setNextRay(uint32_t ray);
+      void *castRay(const btVector3 &from, const btVector3 &to, btVehicleRaycasterResult &result) override;
+  };
+}
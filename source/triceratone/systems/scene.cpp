@@ -45,6 +45,7 @@ namespace at3 {
       ctxt.id = id;
       transformFunction->transformed = transformFuncs[transformFunction->transFuncId - 1] // indexed from 1 - shift to 0
           (placement->mat, placement->absMat, currentTime, &ctxt);
+      vulkan->markTransformChanged(id);
     }
     scene.updateAbsoluteTransformCaches();
   }
@@ -56,6 +57,7 @@ namespace at3 {
     } else {
       scene.addObject(id);
     }
+    vulkan->markSceneTreeChanged();
     return true;
   }
   bool SceneSystem::onForgetSceneNode(const entityId &id) {
@@ -63,6 +65,7 @@ namespace at3 {
     state->get_SceneNode(id, &sceneNode);
     // TODO: maybe get the node's children and reassign their parent field to this object's parent here instead of
     // inside SceneTree
+    vulkan->markSceneTreeChanged();
     return true;
   }
   bool SceneSystem::onDiscoverMesh(const entityId &id) {